@@ -0,0 +1,255 @@
+// Texture bind and draw count benchmark: one SetTexture + DrawPrimitiveUP per object
+// against objects batched per atlas page with UV remap applied on the CPU.
+// Pages are composed from textures with distinct texels and the layout is saved and loaded
+// again; fails if a remapped texel center samples another texel than the original texture,
+// or a gutter does not replicate the texture edge
+
+#include "deterministic_random.h"
+#include "null_device.h"
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct VertPosTex
+{
+    float x, y, z;
+    float u, v;
+};
+
+struct SceneObject
+{
+    unsigned texture;
+    float x, y;
+};
+
+void MakeQuad(const SceneObject& object, VertPosTex* strip)
+{
+    const float size = 0.05f;
+    VertPosTex quad[] =
+    {
+        { object.x,        object.y,        0, 0, 1 },
+        { object.x + size, object.y,        0, 1, 1 },
+        { object.x,        object.y + size, 0, 0, 0 },
+        { object.x + size, object.y + size, 0, 1, 0 }
+    };
+    std::copy(quad, quad + 4, strip);
+}
+
+struct FrameResult
+{
+    double milliseconds;
+    DeviceCounters counters;
+};
+
+/// @brief Point sample of the page, what the texture unit fetches at the top mip without filtering
+uint32_t SamplePage(const std::vector<uint32_t>& page, unsigned pageSize, float u, float v)
+{
+    int x = std::min(std::max(static_cast<int>(u * pageSize), 0), static_cast<int>(pageSize) - 1);
+    int y = std::min(std::max(static_cast<int>(v * pageSize), 0), static_cast<int>(pageSize) - 1);
+    return page[static_cast<size_t>(y) * pageSize + x];
+}
+
+/// @brief Compose the pages, reload the layout from a file and sample every texel through its remap
+bool CheckAtlasSampling(const AtlasLayout& packed, const std::vector<std::vector<uint32_t> >& textures)
+{
+    std::vector<std::vector<uint32_t> > pages(packed.pageCount, 
+        std::vector<uint32_t>(static_cast<size_t>(packed.pageSize) * packed.pageSize, 0));
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        ComposeAtlasRegion(packed, static_cast<unsigned>(i), textures[i].data(), pages[packed.regions[i].atlas].data());
+    }
+
+    const std::string layoutFile("atlas_benchmark_layout.txt");
+    AtlasLayout layout;
+    bool loaded = SaveAtlasLayout(packed, std::vector<std::string>(), layoutFile) && LoadAtlasLayout(layoutFile, layout, NULL);
+    std::remove(layoutFile.c_str());
+    if (!loaded || layout.regions.size() != textures.size())
+    {
+        printf("atlas layout did not survive saving and loading\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        const AtlasRegion& region = layout.regions[i];
+        const std::vector<uint32_t>& page = pages[region.atlas];
+        const std::vector<uint32_t>& texels = textures[i];
+        for (unsigned y = 0; y < region.height; ++y)
+        {
+            for (unsigned x = 0; x < region.width; ++x)
+            {
+                float uv[2] = { (x + 0.5f) / region.width, (y + 0.5f) / region.height };
+                ApplyUvRemap(layout.remaps[i], uv, 1, sizeof(uv));
+                if (SamplePage(page, layout.pageSize, uv[0], uv[1]) != texels[static_cast<size_t>(y) * region.width + x])
+                {
+                    printf("texture %u texel %u,%u samples another texel of the atlas page\n", static_cast<unsigned>(i), x, y);
+                    return false;
+                }
+            }
+        }
+
+        // Texels just outside of the region are copies of the nearest edge texels
+        bool gutters = true;
+        for (unsigned y = 0; y < region.height; ++y)
+        {
+            const uint32_t* pageRow = &page[static_cast<size_t>(region.y + y) * layout.pageSize];
+            gutters = gutters && pageRow[region.x - 1] == texels[static_cast<size_t>(y) * region.width];
+            gutters = gutters && pageRow[region.x + region.width] == texels[static_cast<size_t>(y) * region.width + region.width - 1];
+        }
+        for (unsigned x = 0; x < region.width; ++x)
+        {
+            gutters = gutters && page[static_cast<size_t>(region.y - 1) * layout.pageSize + region.x + x] == texels[x];
+            gutters = gutters && page[static_cast<size_t>(region.y + region.height) * layout.pageSize + region.x + x] ==
+                texels[static_cast<size_t>(region.height - 1) * region.width + x];
+        }
+        if (!gutters)
+        {
+            printf("texture %u gutter does not replicate its edges\n", static_cast<unsigned>(i));
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Frame>
+FrameResult Measure(NullDevice& device, unsigned frames, Frame frame)
+{
+    frame();
+    device.ResetCounters();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < frames; ++i)
+    {
+        frame();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    FrameResult result;
+    result.milliseconds = elapsed.count() / frames;
+    result.counters = device.Counters();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned objectCount = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 2000;
+    unsigned textureCount = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 300;
+    unsigned callOverheadNs = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 1000;
+    unsigned frames = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], NULL, 10)) : 50;
+    if (0 == objectCount || 0 == textureCount || 0 == frames)
+    {
+        printf("Usage: atlas_benchmark [objects = 2000] [textures = 300] [call overhead ns = 1000] [frames = 50]\n");
+        return 1;
+    }
+
+    // Small textures from 16x16 to 128x128
+    unsigned seed = 12345;
+    TextureAtlasPacker packer(2048, 4);
+    std::vector<std::vector<uint32_t> > textureTexels(textureCount);
+    for (unsigned i = 0; i < textureCount; ++i)
+    {
+        unsigned width = 16u << (NextRandom(seed) % 4);
+        unsigned height = 16u << (NextRandom(seed) % 4);
+        packer.Add(width, height);
+
+        // Texel value is unique in the whole atlas: texture index and texel index
+        textureTexels[i].resize(width * height);
+        for (unsigned t = 0; t < width * height; ++t)
+        {
+            textureTexels[i][t] = (i << 16) | t;
+        }
+    }
+    AtlasLayout layout = packer.Pack();
+    const bool succeeded = CheckAtlasSampling(layout, textureTexels);
+
+    // Texture and atlas page handles only have to be distinct for the null device
+    std::vector<int> textures(textureCount);
+    std::vector<int> pages(layout.pageCount);
+
+    std::vector<SceneObject> objects(objectCount);
+    for (unsigned i = 0; i < objectCount; ++i)
+    {
+        objects[i].texture = NextRandom(seed) % textureCount;
+        objects[i].x = (NextRandom(seed) % 2000) / 1000.0f - 1.0f;
+        objects[i].y = (NextRandom(seed) % 2000) / 1000.0f - 1.0f;
+    }
+
+    // Objects sharing an atlas page are consecutive, ordering is done once for the scene
+    std::vector<SceneObject> atlasObjects(objects);
+    std::stable_sort(atlasObjects.begin(), atlasObjects.end(), [&layout](const SceneObject& a, const SceneObject& b)
+    {
+        return layout.regions[a.texture].atlas < layout.regions[b.texture].atlas;
+    });
+
+    NullDevice device(callOverheadNs);
+
+    FrameResult separate = Measure(device, frames, [&]()
+    {
+        VertPosTex strip[4];
+        device.BeginScene();
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            MakeQuad(objects[i], strip);
+            device.SetTexture(0, &textures[objects[i].texture]);
+            device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, strip, sizeof(VertPosTex));
+        }
+        device.EndScene();
+        device.Present();
+    });
+
+    std::vector<VertPosTex> batch;
+    batch.reserve(atlasObjects.size() * 6);
+    FrameResult batched = Measure(device, frames, [&]()
+    {
+        VertPosTex strip[4];
+        device.BeginScene();
+        size_t first = 0;
+        while (first < atlasObjects.size())
+        {
+            unsigned page = layout.regions[atlasObjects[first].texture].atlas;
+            batch.clear();
+
+            size_t last = first;
+            for (; last < atlasObjects.size() && layout.regions[atlasObjects[last].texture].atlas == page; ++last)
+            {
+                MakeQuad(atlasObjects[last], strip);
+                ApplyUvRemap(layout.remaps[atlasObjects[last].texture], &strip[0].u, 4, sizeof(VertPosTex));
+
+                // Strips are not mergeable, emit two triangles per quad
+                batch.push_back(strip[0]);
+                batch.push_back(strip[1]);
+                batch.push_back(strip[2]);
+                batch.push_back(strip[2]);
+                batch.push_back(strip[1]);
+                batch.push_back(strip[3]);
+            }
+
+            device.SetTexture(0, &pages[page]);
+            device.DrawPrimitiveUP(NULL_PT_TRIANGLELIST, static_cast<unsigned>(batch.size() / 3), batch.data(), sizeof(VertPosTex));
+            first = last;
+        }
+        device.EndScene();
+        device.Present();
+    });
+
+    printf("%u objects, %u textures packed into %u atlas pages, call overhead %u ns, %u frames\n",
+        objectCount, textureCount, layout.pageCount, callOverheadNs, frames);
+    printf("%-10s %12s %12s %12s\n", "mode", "binds/frame", "draws/frame", "ms/frame");
+    printf("%-10s %12u %12u %12.3f\n", "separate",
+        separate.counters.textureBinds / frames, separate.counters.draws / frames, separate.milliseconds);
+    printf("%-10s %12u %12u %12.3f\n", "atlas",
+        batched.counters.textureBinds / frames, batched.counters.draws / frames, batched.milliseconds);
+    printf("speedup %.2fx\n", batched.milliseconds > 0 ? separate.milliseconds / batched.milliseconds : 0.0);
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+// Draw merging benchmark: one state change, world matrix upload and draw per object
+// against draws sorted by state and merged, with world matrices applied on the CPU
+// (SSE2 and scalar) or uploaded as a constant array indexed per vertex. The geometry
+// reaching the device is captured in every mode and compared: the merged frames must
+// draw exactly the same world space triangles and normals with the same state. Exits with 1 if not
+
+#include "deterministic_random.h"
+#include "draw_merger.h"
+#include "null_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+struct SceneVertex
+{
+    float x, y, z;
+
+    /// Index of the world matrix in the constant array mode
+    float matrixIndex;
+
+    float nx, ny, nz;
+    uint32_t color;
+    float u, v;
+};
+
+struct SceneObject
+{
+    DrawState state;
+    float world[16];
+
+    /// Quads are strips, boxes are indexed lists
+    bool box;
+};
+
+float RandomFloat(unsigned& state, float low, float high)
+{
+    return low + (high - low) * (NextRandom(state) % 10000) / 10000.0f;
+}
+
+/// @brief Rotation around Y, uniform scale and translation, row-major with row vectors
+void MakeWorld(float angle, float scale, float x, float y, float z, float world[16])
+{
+    const float c = cosf(angle) * scale, s = sinf(angle) * scale;
+    const float matrix[16] = { c, 0, -s, 0,  0, scale, 0, 0,  s, 0, c, 0,  x, y, z, 1 };
+    std::copy(matrix, matrix + 16, world);
+}
+
+/// D3DFVF_XYZB1 | D3DFVF_NORMAL | D3DFVF_DIFFUSE | D3DFVF_TEX1
+const uint32_t SCENE_FVF = 0x156;
+
+/// @brief Records world space triangles with their normals and the state they are drawn with
+class CaptureBackend : public DrawBackend
+{
+public:
+
+    struct Triangle
+    {
+        uint64_t state[4];
+        uint32_t positionBits[9];
+        uint32_t normalBits[9];
+
+        bool operator<(const Triangle& other) const { return memcmp(this, &other, sizeof(Triangle)) < 0; }
+        bool operator==(const Triangle& other) const { return 0 == memcmp(this, &other, sizeof(Triangle)); }
+    };
+
+    CaptureBackend(bool constantArray, unsigned worldRegister)
+        : m_constantArray(constantArray), m_worldRegister(worldRegister), m_state(), m_constants(256 * 4, 0.0f) {}
+
+    virtual void SetState(const DrawState& state, unsigned changed)
+    {
+        (void)changed;
+        m_state = state;
+    }
+
+    virtual void SetWorldMatrices(unsigned startRegister, const float* matrices, unsigned count)
+    {
+        std::copy(matrices, matrices + 16 * count, m_constants.begin() + startRegister * 4);
+    }
+
+    virtual void DrawTriangles(const void* vertices, unsigned vertexCount, unsigned stride,
+        const uint16_t* indices, unsigned triangleCount)
+    {
+        (void)vertexCount;
+        const SceneVertex* sceneVertices = static_cast<const SceneVertex*>(vertices);
+        for (unsigned t = 0; t < triangleCount; ++t)
+        {
+            Triangle triangle = {};
+            triangle.state[0] = reinterpret_cast<uintptr_t>(m_state.vertexShader);
+            triangle.state[1] = reinterpret_cast<uintptr_t>(m_state.pixelShader);
+            triangle.state[2] = reinterpret_cast<uintptr_t>(m_state.texture);
+            triangle.state[3] = static_cast<uint64_t>(m_state.vertexFormat) << 32 | m_state.renderState;
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                SceneVertex vertex = sceneVertices[indices[3 * t + c]];
+                const unsigned matrix = m_constantArray ? static_cast<unsigned>(vertex.matrixIndex) : 0;
+                const float* world = &m_constants[(m_worldRegister + 4 * matrix) * 4];
+                TransformPositions(world, &vertex.x, 1, stride, false);
+                TransformDirections(world, &vertex.nx, 1, stride, false);
+                memcpy(&triangle.positionBits[3 * c], &vertex.x, 3 * sizeof(float));
+                memcpy(&triangle.normalBits[3 * c], &vertex.nx, 3 * sizeof(float));
+            }
+            m_triangles.push_back(triangle);
+        }
+    }
+
+    /// @brief Triangles in a canonical order
+    std::vector<Triangle> Triangles() const
+    {
+        std::vector<Triangle> sorted(m_triangles);
+        std::sort(sorted.begin(), sorted.end());
+        return sorted;
+    }
+
+private:
+
+    bool m_constantArray;
+    unsigned m_worldRegister;
+    DrawState m_state;
+    std::vector<float> m_constants;
+    std::vector<Triangle> m_triangles;
+};
+
+struct ModeResult
+{
+    const char* name;
+    double milliseconds;
+    DeviceCounters counters;
+    DrawMergeReport report;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned objectCount = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 5000;
+    const unsigned textureCount = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 16;
+    const unsigned callOverheadNs = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 1000;
+    const unsigned frames = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], NULL, 10)) : 20;
+    if (0 == objectCount || 0 == textureCount || 0 == frames)
+    {
+        printf("Usage: draw_merge_benchmark [objects = 5000] [textures = 16] [call overhead ns = 1000] [frames = 20]\n");
+        return 1;
+    }
+
+    // Shader and texture handles only have to be distinct for the null device
+    const unsigned shaderCount = 3, renderStateCount = 2;
+    std::vector<int> shaders(2 * shaderCount);
+    std::vector<int> textures(textureCount);
+
+    unsigned seed = 12345;
+    std::vector<SceneObject> objects(objectCount);
+    for (unsigned i = 0; i < objectCount; ++i)
+    {
+        SceneObject& object = objects[i];
+        const unsigned shader = NextRandom(seed) % shaderCount;
+        object.state.vertexShader = &shaders[2 * shader];
+        object.state.pixelShader = &shaders[2 * shader + 1];
+        object.state.texture = &textures[NextRandom(seed) % textureCount];
+        object.state.vertexFormat = SCENE_FVF;
+        object.state.renderState = NextRandom(seed) % renderStateCount;
+        MakeWorld(RandomFloat(seed, 0, 6.28f), RandomFloat(seed, 0.02f, 0.1f),
+            RandomFloat(seed, -10, 10), RandomFloat(seed, -10, 10), RandomFloat(seed, 1, 20), object.world);
+        object.box = 0 == NextRandom(seed) % 4;
+    }
+
+    SceneVertex quad[4] =
+    {
+        { -1, -1, 0, 0, 0, 0, -1, 0xffffffff, 0, 1 },
+        { -1,  1, 0, 0, 0, 0, -1, 0xffffffff, 0, 0 },
+        {  1, -1, 0, 0, 0, 0, -1, 0xffffffff, 1, 1 },
+        {  1,  1, 0, 0, 0, 0, -1, 0xffffffff, 1, 0 }
+    };
+    // Box corners are shared by three faces, their normals point away from the center
+    SceneVertex box[8];
+    const float diagonal = 1.0f / sqrtf(3.0f);
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        const float x = i & 1 ? 1.0f : -1.0f, y = i & 2 ? 1.0f : -1.0f, z = i & 4 ? 1.0f : -1.0f;
+        SceneVertex corner = { x, y, z, 0, x * diagonal, y * diagonal, z * diagonal, 0xff000000 | i * 0x1f1f1f, 0, 0 };
+        box[i] = corner;
+    }
+    static const uint16_t BOX_INDICES[36] =
+    {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 1, 4,  1, 5, 4,
+        2, 6, 3,  3, 6, 7,  0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+    };
+
+    const unsigned worldRegister = 4;
+    const unsigned maxMatrices = (256 - worldRegister) / 4;
+    DrawMerger merger;
+    merger.SetWorldRegisters(worldRegister, maxMatrices, offsetof(SceneVertex, matrixIndex));
+    merger.SetNormalOffset(offsetof(SceneVertex, nx));
+
+    auto submitScene = [&]()
+    {
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            const SceneObject& object = objects[i];
+            if (object.box)
+            {
+                merger.SubmitIndexed(object.state, object.world, NULL_PT_TRIANGLELIST, 12, BOX_INDICES, box, 8, sizeof(SceneVertex));
+            }
+            else
+            {
+                merger.Submit(object.state, object.world, NULL_PT_TRIANGLESTRIP, 2, quad, sizeof(SceneVertex));
+            }
+        }
+    };
+
+    struct ModeDesc
+    {
+        const char* name;
+        DrawMergeMode mode;
+        bool simd;
+    };
+    const ModeDesc modes[] =
+    {
+        { "separate", DRAW_MERGE_DISABLED, true },
+        { "cpu sse2", DRAW_MERGE_CPU_TRANSFORM, true },
+        { "cpu scalar", DRAW_MERGE_CPU_TRANSFORM, false },
+        { "constants", DRAW_MERGE_CONSTANT_ARRAY, true }
+    };
+    const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+    bool succeeded = true;
+    std::vector<ModeResult> results;
+    std::vector<CaptureBackend::Triangle> reference;
+    for (size_t m = 0; m < modeCount; ++m)
+    {
+        merger.SetMode(modes[m].mode);
+        merger.SetSimd(modes[m].simd);
+
+        // Geometry of every mode must equal the one of separate draws
+        CaptureBackend capture(DRAW_MERGE_CONSTANT_ARRAY == modes[m].mode, worldRegister);
+        submitScene();
+        merger.Flush(capture);
+        std::vector<CaptureBackend::Triangle> triangles = capture.Triangles();
+        if (0 == m)
+        {
+            reference.swap(triangles);
+        }
+        else if (triangles != reference)
+        {
+            printf("%s: drawn triangles differ from separate draws\n", modes[m].name);
+            succeeded = false;
+        }
+
+        NullDevice device(callOverheadNs);
+        NullDrawBackend backend(device);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned frame = 0; frame < frames; ++frame)
+        {
+            device.BeginScene();
+            submitScene();
+            merger.Flush(backend);
+            device.EndScene();
+            device.Present();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        ModeResult result = { modes[m].name, elapsed.count() / frames, device.Counters(), merger.Report() };
+        results.push_back(result);
+    }
+
+    printf("%u objects, %u shaders, %u textures, %u render states, call overhead %u ns, %u frames\n",
+        objectCount, shaderCount, textureCount, renderStateCount, callOverheadNs, frames);
+    printf("%s\n", FormatDrawMergeReport(results[1].report).c_str());
+    printf("%-12s %12s %14s %12s %12s %10s\n", "mode", "draws/frame", "state/frame", "uploads", "ms/frame", "speedup");
+    for (size_t m = 0; m < results.size(); ++m)
+    {
+        const DeviceCounters& counters = results[m].counters;
+        const unsigned stateCalls = counters.textureBinds + counters.renderStateChanges + counters.shaderBinds;
+        printf("%-12s %12u %14u %12u %12.3f %9.2fx\n", results[m].name, counters.draws / frames, stateCalls / frames,
+            counters.constantUploads / frames, results[m].milliseconds,
+            results[m].milliseconds > 0 ? results[0].milliseconds / results[m].milliseconds : 0.0);
+    }
+
+    // One draw per object without merging, at most one per state run and matrix batch with it
+    const DrawMergeReport& constants = results[3].report;
+    if (results[0].report.drawsAfter != objectCount || results[1].report.drawsAfter != results[1].report.stateRuns ||
+        constants.drawsAfter < constants.stateRuns || constants.drawsAfter > constants.stateRuns + objectCount / maxMatrices)
+    {
+        printf("unexpected number of merged draws\n");
+        succeeded = false;
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
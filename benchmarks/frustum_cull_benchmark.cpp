@@ -0,0 +1,326 @@
+// Frustum culling benchmark: moving objects around an orbiting camera, culled over the
+// bounding volume hierarchy with scalar and SSE2 plane tests, on one thread and split into
+// parallel subtrees. Every frame the visible objects of every path must equal a test of
+// every object box against the frustum. Every path is also checked on rounds of independent
+// random boxes against a brute-force test of the 8 corners of each box against each plane.
+// Prints the time per frame of each path, the visible and tested objects and the rebuilds.
+// Exits with 1 on failure
+
+#include "deterministic_random.h"
+#include "frustum_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+/// @brief Row-major product, as D3DXMatrixMultiply
+void MultiplyMatrix(const float a[16], const float b[16], float result[16])
+{
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        for (unsigned column = 0; column < 4; ++column)
+        {
+            result[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] +
+                a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+        }
+    }
+}
+
+/// @brief Camera at the height looking at the origin from the angle, as D3DXMatrixLookAtLH
+/// followed by D3DXMatrixPerspectiveFovLH
+void MakeViewProjection(float angle, float distance, float viewProjection[16])
+{
+    const float eye[3] = { distance * cosf(angle), distance / 4, distance * sinf(angle) };
+    float zAxis[3] = { -eye[0], -eye[1], -eye[2] };
+    const float zLength = sqrtf(zAxis[0] * zAxis[0] + zAxis[1] * zAxis[1] + zAxis[2] * zAxis[2]);
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        zAxis[i] /= zLength;
+    }
+
+    // up = (0, 1, 0): x = normalize(up x z), y = z x x
+    float xAxis[3] = { zAxis[2], 0.0f, -zAxis[0] };
+    const float xLength = sqrtf(xAxis[0] * xAxis[0] + xAxis[2] * xAxis[2]);
+    xAxis[0] /= xLength;
+    xAxis[2] /= xLength;
+    const float yAxis[3] =
+    {
+        zAxis[1] * xAxis[2] - zAxis[2] * xAxis[1],
+        zAxis[2] * xAxis[0] - zAxis[0] * xAxis[2],
+        zAxis[0] * xAxis[1] - zAxis[1] * xAxis[0]
+    };
+    const float view[16] =
+    {
+        xAxis[0], yAxis[0], zAxis[0], 0,
+        xAxis[1], yAxis[1], zAxis[1], 0,
+        xAxis[2], yAxis[2], zAxis[2], 0,
+        -(xAxis[0] * eye[0] + xAxis[1] * eye[1] + xAxis[2] * eye[2]),
+        -(yAxis[0] * eye[0] + yAxis[1] * eye[1] + yAxis[2] * eye[2]),
+        -(zAxis[0] * eye[0] + zAxis[1] * eye[1] + zAxis[2] * eye[2]), 1
+    };
+
+    const float zn = 0.1f, zf = 2 * distance;
+    const float yScale = 1.0f / tanf(3.14159265f / 6);
+    const float projection[16] =
+    {
+        yScale / (800.0f / 600), 0, 0, 0,
+        0, yScale, 0, 0,
+        0, 0, zf / (zf - zn), 1,
+        0, 0, -zn * zf / (zf - zn), 0
+    };
+    MultiplyMatrix(view, projection, viewProjection);
+}
+
+/// @brief Objects of a scene: local box, position and velocity
+struct Scene
+{
+    std::vector<BoundingBox> localBoxes;
+    std::vector<float> positions;
+    std::vector<float> velocities;
+    std::vector<BoundingBox> worldBoxes;
+};
+
+void MakeScene(unsigned objects, float extent, Scene& scene)
+{
+    unsigned seed = 31337;
+    scene.localBoxes.resize(objects);
+    scene.positions.resize(3 * objects);
+    scene.velocities.resize(3 * objects);
+    for (unsigned i = 0; i < objects; ++i)
+    {
+        const float size = 0.2f + (NextRandom(seed) % 1000) / 1000.0f;
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            scene.localBoxes[i].min[axis] = -size;
+            scene.localBoxes[i].max[axis] = size;
+            scene.positions[3 * i + axis] = (NextRandom(seed) % 20000) / 10000.0f * extent - extent;
+            scene.velocities[3 * i + axis] = (NextRandom(seed) % 2000) / 10000.0f - 0.1f;
+        }
+    }
+}
+
+/// @brief Move the objects, the world boxes are the local ones translated and scaled by the time
+void MoveScene(Scene& scene, float time)
+{
+    const size_t objects = scene.localBoxes.size();
+    scene.worldBoxes.resize(objects);
+    const float scale = 1.0f + 0.5f * sinf(time);
+    float world[16] = { scale, 0, 0, 0,  0, scale, 0, 0,  0, 0, scale, 0,  0, 0, 0, 1 };
+    for (size_t i = 0; i < objects; ++i)
+    {
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            scene.positions[3 * i + axis] += scene.velocities[3 * i + axis];
+            world[12 + axis] = scene.positions[3 * i + axis];
+        }
+        scene.worldBoxes[i] = TransformBoundingBox(scene.localBoxes[i], world);
+    }
+}
+
+/// @brief Brute-force test of every corner of the box against every plane, false if all
+/// corners are outside of one plane. Sums in the order of BoxIntersectsFrustum
+bool CornersIntersectFrustum(const BoundingBox& box, const Frustum& frustum)
+{
+    for (unsigned p = 0; p < 6; ++p)
+    {
+        const float* plane = frustum.planes[p];
+        bool outside = true;
+        for (unsigned corner = 0; corner < 8 && outside; ++corner)
+        {
+            const float x = corner & 1 ? box.max[0] : box.min[0];
+            const float y = corner & 2 ? box.max[1] : box.min[1];
+            const float z = corner & 4 ? box.max[2] : box.min[2];
+            outside = ((plane[0] * x + plane[1] * y) + plane[2] * z) + plane[3] < 0.0f;
+        }
+        if (outside)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Rounds of independent random boxes, from flat to larger than the frustum, under
+/// random cameras. Each culler must report exactly the boxes the corner test keeps
+bool CheckRandomBoxes(FrustumCuller* const cullers[], const char* const names[], size_t cullerCount)
+{
+    const unsigned rounds = 20, boxes = 5000;
+    const float extent = 50.0f;
+    unsigned seed = 4242;
+    std::vector<BoundingBox> randomBoxes(boxes);
+    std::vector<uint32_t> expected, visible;
+    bool succeeded = true;
+    for (unsigned round = 0; round < rounds; ++round)
+    {
+        for (unsigned i = 0; i < boxes; ++i)
+        {
+            // Sizes from 0 to the extent, on a logarithmic scale so that small boxes dominate
+            for (unsigned axis = 0; axis < 3; ++axis)
+            {
+                const float center = (NextRandom(seed) % 20000) / 10000.0f * extent - extent;
+                const float size = 0 == NextRandom(seed) % 16 ? 0.0f :
+                    extent * powf(10.0f, -3.0f * (NextRandom(seed) % 1000) / 1000.0f);
+                randomBoxes[i].min[axis] = center - size;
+                randomBoxes[i].max[axis] = center + size;
+            }
+        }
+
+        float viewProjection[16];
+        MakeViewProjection((NextRandom(seed) % 6283) / 1000.0f, (0.2f + (NextRandom(seed) % 1000) / 1000.0f) * extent,
+            viewProjection);
+        const Frustum frustum = ExtractFrustum(viewProjection);
+        expected.clear();
+        for (unsigned i = 0; i < boxes; ++i)
+        {
+            if (CornersIntersectFrustum(randomBoxes[i], frustum))
+            {
+                expected.push_back(i);
+            }
+        }
+
+        for (size_t c = 0; c < cullerCount; ++c)
+        {
+            // Every round is a new scene of the same size, so the hierarchy is rebuilt on request
+            cullers[c]->RequestRebuild();
+            cullers[c]->Update(&randomBoxes[0], boxes);
+            cullers[c]->Cull(frustum, visible);
+            std::sort(visible.begin(), visible.end());
+            if (visible != expected)
+            {
+                printf("random boxes round %u %s: %u visible, %u expected by the corner test\n", round, names[c],
+                    static_cast<unsigned>(visible.size()), static_cast<unsigned>(expected.size()));
+                succeeded = false;
+            }
+        }
+    }
+    printf("random boxes: %u rounds of %u boxes against the corner test %s\n", rounds, boxes, succeeded ? "ok" : "FAILED");
+    return succeeded;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned objects = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 100000;
+    const unsigned frames = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 100;
+    const unsigned threads = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 0;
+    if (0 == objects || 0 == frames)
+    {
+        printf("Usage: frustum_cull_benchmark [objects = 100000] [frames = 100] [threads = 0]\n");
+        return 1;
+    }
+
+    const float extent = 10.0f * cbrtf(static_cast<float>(objects));
+    Scene scene;
+    MakeScene(objects, extent, scene);
+
+    FrustumCuller scalar(1), simd(1), parallel(threads);
+    scalar.SetSimd(false);
+    parallel.SetParallelThreshold(0);
+
+    struct Mode
+    {
+        const char* name;
+        FrustumCuller* culler;
+        double updateMilliseconds;
+        double cullMilliseconds;
+        size_t tested;
+        size_t rebuilds;
+    };
+    Mode modes[] =
+    {
+        { "scalar", &scalar, 0.0, 0.0, 0, 0 },
+        { "sse2", &simd, 0.0, 0.0, 0, 0 },
+        { "sse2 tasks", &parallel, 0.0, 0.0, 0, 0 },
+    };
+    const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+    bool succeeded = true;
+    double bruteMilliseconds = 0.0;
+    size_t visibleTotal = 0;
+    std::vector<uint32_t> expected, visible;
+    for (unsigned frame = 0; frame < frames; ++frame)
+    {
+        MoveScene(scene, frame * 0.05f);
+        float viewProjection[16];
+        MakeViewProjection(frame * 0.03f, 0.5f * extent, viewProjection);
+        const Frustum frustum = ExtractFrustum(viewProjection);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        expected.clear();
+        for (unsigned i = 0; i < objects; ++i)
+        {
+            if (BoxIntersectsFrustum(scene.worldBoxes[i], frustum))
+            {
+                expected.push_back(i);
+            }
+        }
+        bruteMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        visibleTotal += expected.size();
+
+        // Every 25th frame asks for a rebuild, as an editor would after large changes
+        for (size_t m = 0; m < modeCount; ++m)
+        {
+            FrustumCuller& culler = *modes[m].culler;
+            if (frame && 0 == frame % 25)
+            {
+                culler.RequestRebuild();
+            }
+            culler.Update(&scene.worldBoxes[0], objects);
+            culler.Cull(frustum, visible);
+            const CullStats& stats = culler.Stats();
+            modes[m].updateMilliseconds += stats.updateMilliseconds;
+            modes[m].cullMilliseconds += stats.cullMilliseconds;
+            modes[m].tested += stats.objectsTested;
+            modes[m].rebuilds += stats.rebuilt;
+            if (0 == frame % 25)
+            {
+                printf("frame %u %s: %s\n", frame, modes[m].name, FormatCullStats(stats).c_str());
+            }
+
+            std::sort(visible.begin(), visible.end());
+            if (visible != expected || stats.visible != expected.size() ||
+                stats.objectsTested + stats.objectsAccepted < stats.visible)
+            {
+                printf("frame %u %s: %u visible, %u expected\n", frame, modes[m].name,
+                    static_cast<unsigned>(visible.size()), static_cast<unsigned>(expected.size()));
+                succeeded = false;
+            }
+        }
+        if (frame && 0 == frame % 25 && !(modes[0].culler->Stats().rebuilt && modes[1].culler->Stats().rebuilt))
+        {
+            printf("frame %u: requested rebuild not done\n", frame);
+            succeeded = false;
+        }
+    }
+
+    {
+        FrustumCuller randomScalar(1), randomSimd(1), randomParallel(threads);
+        randomScalar.SetSimd(false);
+        randomParallel.SetParallelThreshold(0);
+        FrustumCuller* const cullers[] = { &randomScalar, &randomSimd, &randomParallel };
+        const char* const names[] = { "scalar", "sse2", "sse2 tasks" };
+        succeeded = CheckRandomBoxes(cullers, names, sizeof(cullers) / sizeof(cullers[0])) && succeeded;
+    }
+
+    printf("%u objects, %u frames, %.0f visible per frame, SSE2 %s, tasks on %u threads (0: one per hardware thread)\n",
+        objects, frames, static_cast<double>(visibleTotal) / frames, simd.Simd() ? "available" : "not available", threads);
+    printf("%-12s %12s %12s %16s %10s\n", "mode", "update ms", "cull ms", "tested/frame", "rebuilds");
+    printf("%-12s %12s %12.3f %16u %10s\n", "every box", "-", bruteMilliseconds / frames, objects, "-");
+    for (size_t m = 0; m < modeCount; ++m)
+    {
+        printf("%-12s %12.3f %12.3f %16.0f %10u\n", modes[m].name, modes[m].updateMilliseconds / frames,
+            modes[m].cullMilliseconds / frames,
+            static_cast<double>(modes[m].tested) / frames, static_cast<unsigned>(modes[m].rebuilds));
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// Performance HUD benchmark: a scene on the null backend without the HUD, with the HUD
+// hidden and with the HUD shown. The shown HUD must add exactly one draw per frame and
+// write its vertex buffer at most once per update interval, only when a displayed value
+// changed: constant frame times and device calls must not upload once the graph covers
+// the whole history window. The hidden HUD must
+// not draw. Prints the CPU cost of the HUD per frame. Exits with 1 on failure
+
+#include "deterministic_random.h"
+#include "hud.h"
+#include "null_device.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+/// @brief Calls of the frame, the device counters are totals
+DeviceCounters Difference(const DeviceCounters& after, const DeviceCounters& before)
+{
+    DeviceCounters counters;
+    counters.draws = after.draws - before.draws;
+    counters.primitives = after.primitives - before.primitives;
+    counters.vertices = after.vertices - before.vertices;
+    counters.textureBinds = after.textureBinds - before.textureBinds;
+    counters.renderStateChanges = after.renderStateChanges - before.renderStateChanges;
+    counters.samplerStateChanges = after.samplerStateChanges - before.samplerStateChanges;
+    counters.shaderBinds = after.shaderBinds - before.shaderBinds;
+    counters.constantUploads = after.constantUploads - before.constantUploads;
+    counters.renderTargetChanges = after.renderTargetChanges - before.renderTargetChanges;
+    counters.queryIssues = after.queryIssues - before.queryIssues;
+    counters.frames = after.frames - before.frames;
+    return counters;
+}
+
+struct ModeResult
+{
+    const char* name;
+    double milliseconds;
+    DeviceCounters counters;
+    HudStats stats;
+};
+
+/// @brief Textured quads, a texture change every few draws
+void DrawScene(NullDevice& device, unsigned draws)
+{
+    static const float quad[] = { -1, -1, 0.5f, 1,  -1, 1, 0.5f, 1,  1, -1, 0.5f, 1,  1, 1, 0.5f, 1 };
+    static const int textures[4] = {};
+    for (unsigned i = 0; i < draws; ++i)
+    {
+        if (0 == i % 8)
+        {
+            device.SetTexture(0, &textures[i / 8 % 4]);
+        }
+        device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, quad, 4 * sizeof(float));
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned draws = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 200;
+    const unsigned overheadNs = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 1000;
+    const unsigned frames = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 600;
+    if (0 == draws || 0 == frames)
+    {
+        printf("Usage: hud_benchmark [draws = 200] [call overhead ns = 1000] [frames = 600]\n");
+        return 1;
+    }
+
+    const unsigned updateInterval = 30;
+    std::vector<std::string> shaderNames;
+    shaderNames.push_back("vs: shader.vs");
+    shaderNames.push_back("ps: shader.ps");
+
+    // Hidden and shown HUD against the scene alone
+    enum Mode { NO_HUD, HUD_HIDDEN, HUD_SHOWN, MODE_COUNT };
+    static const char* const names[MODE_COUNT] = { "no hud", "hud hidden", "hud shown" };
+    ModeResult results[MODE_COUNT];
+    for (unsigned m = 0; m < MODE_COUNT; ++m)
+    {
+        NullDevice device(overheadNs);
+        NullHudBackend backend(device);
+        PerformanceHud hud(updateInterval);
+        hud.SetEnabled(HUD_SHOWN == m);
+        hud.SetShaderNames(shaderNames);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point previous = start;
+        DeviceCounters before = device.Counters();
+        for (unsigned frame = 0; frame < frames; ++frame)
+        {
+            device.BeginScene();
+            device.Clear(0xff808080, 1.0f, 0);
+            DrawScene(device, draws);
+            if (NO_HUD != m)
+            {
+                // The calls of the HUD are not part of the scene it reports
+                const DeviceCounters after = device.Counters();
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                hud.AddFrame(std::chrono::duration<double, std::milli>(now - previous).count(), Difference(after, before));
+                previous = now;
+                hud.Draw(backend);
+            }
+            device.EndScene();
+            device.Present();
+            before = device.Counters();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        ModeResult result = { names[m], elapsed.count() / frames, device.Counters(), hud.Stats() };
+        results[m] = result;
+    }
+
+    printf("%u draws per frame, call overhead %u ns, %u frames, update every %u frames\n", draws, overheadNs, frames, updateInterval);
+    printf("%-12s %12s %10s %10s %12s\n", "mode", "draws/frame", "rebuilds", "uploads", "ms/frame");
+    for (unsigned m = 0; m < MODE_COUNT; ++m)
+    {
+        printf("%-12s %12.2f %10u %10u %12.4f\n", results[m].name, static_cast<double>(results[m].counters.draws) / frames,
+            results[m].stats.rebuilds, results[m].stats.uploads, results[m].milliseconds);
+    }
+    printf("hud cost %.4f ms per frame\n", results[HUD_SHOWN].milliseconds - results[NO_HUD].milliseconds);
+
+    bool succeeded = true;
+    if (results[HUD_SHOWN].counters.draws != results[NO_HUD].counters.draws + frames)
+    {
+        printf("shown hud does not add exactly one draw per frame\n");
+        succeeded = false;
+    }
+    if (results[HUD_HIDDEN].counters.draws != results[NO_HUD].counters.draws || results[HUD_HIDDEN].stats.uploads)
+    {
+        printf("hidden hud draws\n");
+        succeeded = false;
+    }
+    const HudStats& shown = results[HUD_SHOWN].stats;
+    if (shown.uploads > shown.rebuilds || shown.rebuilds > shown.intervals || shown.intervals > frames / updateInterval + 1)
+    {
+        printf("hud uploads more often than once per update interval\n");
+        succeeded = false;
+    }
+
+    // Unchanged values: no upload once the history window is full; changed values: one upload per interval
+    const unsigned historyFrames = 120;
+    NullDevice device;
+    NullHudBackend backend(device);
+    PerformanceHud constant(updateInterval, historyFrames), varying(updateInterval, historyFrames);
+    DeviceCounters counters = {};
+    counters.draws = draws;
+    counters.textureBinds = draws / 8;
+    unsigned seed = 12345;
+    unsigned fillUploads = 0;
+    for (unsigned frame = 0; frame < frames; ++frame)
+    {
+        constant.AddFrame(16.0, counters);
+        constant.Draw(backend);
+        // The first update after the window filled shows the full graph
+        if (historyFrames + updateInterval == frame + 1)
+        {
+            fillUploads = constant.Stats().uploads;
+        }
+        varying.AddFrame(10.0 + NextRandom(seed) % 1000 / 100.0, counters);
+        varying.Draw(backend);
+    }
+    printf("constant frames: %u uploads, %u after the history window filled, varying frames: %u uploads in %u intervals\n",
+        constant.Stats().uploads, constant.Stats().uploads - fillUploads, varying.Stats().uploads, varying.Stats().intervals);
+    if (frames > historyFrames + updateInterval && constant.Stats().uploads != fillUploads)
+    {
+        printf("hud uploads unchanged values\n");
+        succeeded = false;
+    }
+    if (varying.Stats().uploads != varying.Stats().intervals)
+    {
+        printf("hud does not show changed values\n");
+        succeeded = false;
+    }
+
+    // Toggling shows the last layout again after an update
+    varying.Toggle();
+    const unsigned drawsBefore = varying.Stats().draws;
+    varying.Draw(backend);
+    varying.Toggle();
+    varying.AddFrame(16.0, counters);
+    varying.Draw(backend);
+    if (varying.Stats().draws != drawsBefore + 1)
+    {
+        printf("toggled hud draws while hidden or not after being shown again\n");
+        succeeded = false;
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
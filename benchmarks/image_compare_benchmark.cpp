@@ -0,0 +1,230 @@
+// Image comparison benchmark: synthetic renders compared to altered copies, with the
+// scalar and SSE2 kernels and on one thread against parallel tiles. Identical images,
+// noise within the tolerance and a patch over it must be reported exactly, all paths must
+// give the same results, and the heatmap must mark exactly the patch. Prints the time per
+// image with and without SSIM and heatmap. Exits with 1 on failure
+
+#include "deterministic_random.h"
+#include "image_compare.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+/// @brief Gradients and random discs, something like a shaded scene
+Image MakeRender(unsigned width, unsigned height, unsigned seed)
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(4 * static_cast<size_t>(width) * height);
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = &image.pixels[4 * (static_cast<size_t>(y) * width + x)];
+            pixel[0] = static_cast<uint8_t>(x * 255 / width);
+            pixel[1] = static_cast<uint8_t>(y * 255 / height);
+            pixel[2] = static_cast<uint8_t>((x + y) / 4);
+            pixel[3] = 255;
+        }
+    }
+    for (unsigned disc = 0; disc < 40; ++disc)
+    {
+        const int cx = NextRandom(seed) % width, cy = NextRandom(seed) % height, radius = 10 + NextRandom(seed) % 60;
+        const uint32_t color = NextRandom(seed);
+        for (int y = std::max(0, cy - radius); y < std::min(static_cast<int>(height), cy + radius); ++y)
+        {
+            for (int x = std::max(0, cx - radius); x < std::min(static_cast<int>(width), cx + radius); ++x)
+            {
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < radius * radius)
+                {
+                    uint8_t* pixel = &image.pixels[4 * (static_cast<size_t>(y) * width + x)];
+                    pixel[0] = static_cast<uint8_t>(color);
+                    pixel[1] = static_cast<uint8_t>(color >> 8);
+                    pixel[2] = static_cast<uint8_t>(color >> 16);
+                }
+            }
+        }
+    }
+    return image;
+}
+
+/// @brief Change one color channel of about one pixel in a hundred by 1, returns the pixels changed
+unsigned AddNoise(Image& image, unsigned seed)
+{
+    unsigned changed = 0;
+    for (size_t i = 0; i < image.pixels.size() / 4; ++i)
+    {
+        if (0 == NextRandom(seed) % 100)
+        {
+            uint8_t& channel = image.pixels[4 * i + NextRandom(seed) % 3];
+            channel = channel ? channel - 1 : 1;
+            ++changed;
+        }
+    }
+    return changed;
+}
+
+const unsigned PATCH_SIZE = 32;
+
+/// @brief Flip the top bit of green in a square, every pixel differs by 128
+void AddPatch(Image& image, unsigned left, unsigned top)
+{
+    for (unsigned y = top; y < top + PATCH_SIZE; ++y)
+    {
+        for (unsigned x = left; x < left + PATCH_SIZE; ++x)
+        {
+            image.pixels[4 * (static_cast<size_t>(y) * image.width + x) + 1] ^= 0x80;
+        }
+    }
+}
+
+bool SameResult(const ImageCompareResult& a, const ImageCompareResult& b)
+{
+    return a.sizeMatches == b.sizeMatches && a.identical == b.identical && a.differentPixels == b.differentPixels &&
+        a.failedPixels == b.failedPixels && 0 == memcmp(a.maxDifference, b.maxDifference, 4) &&
+        a.mse == b.mse && a.ssim == b.ssim;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned images = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 200;
+    const unsigned width = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 800;
+    const unsigned height = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 600;
+    const unsigned threads = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], NULL, 10)) : 0;
+    if (0 == images || width < 2 * PATCH_SIZE || height < 2 * PATCH_SIZE)
+    {
+        printf("Usage: image_compare_benchmark [images = 200] [width = 800, at least 64] [height = 600, at least 64] [threads = 0]\n");
+        return 1;
+    }
+
+    ImageComparer serial(1), parallel(threads);
+    const ImageCompareSettings settings = DefaultImageCompareSettings(1);
+    bool succeeded = true;
+
+    // Odd sizes exercise the scalar tails of the SSE2 kernels
+    const unsigned sizes[2][2] = { { width, height }, { width + 3, height + 1 } };
+    for (unsigned s = 0; s < 2; ++s)
+    {
+        const Image reference = MakeRender(sizes[s][0], sizes[s][1], 777);
+        Image noisy = reference, patched = reference;
+        const unsigned noisePixels = AddNoise(noisy, 4242);
+        AddPatch(patched, sizes[s][0] / 2, sizes[s][1] / 3);
+        const Image* tests[3] = { &reference, &noisy, &patched };
+        static const char* const names[3] = { "identical", "noise", "patch" };
+
+        for (unsigned t = 0; t < 3; ++t)
+        {
+            Image heatmap;
+            serial.SetSimd(false);
+            const ImageCompareResult scalar = serial.Compare(MakeImageView(reference), MakeImageView(*tests[t]), settings);
+            serial.SetSimd(true);
+            const ImageCompareResult simd = serial.Compare(MakeImageView(reference), MakeImageView(*tests[t]), settings);
+            const ImageCompareResult tiled = parallel.Compare(MakeImageView(reference), MakeImageView(*tests[t]), settings, &heatmap);
+            printf("%ux%u %s: %s\n", sizes[s][0], sizes[s][1], names[t], FormatImageCompareResult(tiled).c_str());
+
+            if (!SameResult(scalar, simd) || !SameResult(simd, tiled))
+            {
+                printf("%s: scalar, SSE2 and parallel results differ\n", names[t]);
+                succeeded = false;
+            }
+
+            bool expected = true;
+            unsigned marked = 0;
+            for (size_t i = 0; i < heatmap.pixels.size(); i += 4)
+            {
+                marked += 255 == heatmap.pixels[i + 2] && 0 == heatmap.pixels[i];
+            }
+            switch (t)
+            {
+            case 0:
+                expected = tiled.identical && std::isinf(tiled.psnr) && 1.0 == tiled.ssim && 0 == marked;
+                break;
+            case 1:
+                expected = !tiled.identical && 0 == tiled.failedPixels && noisePixels == tiled.differentPixels &&
+                    tiled.ssim > 0.99 && tiled.ssim < 1.0 && 0 == marked;
+                break;
+            case 2:
+                expected = PATCH_SIZE * PATCH_SIZE == tiled.failedPixels && tiled.failedPixels == tiled.differentPixels &&
+                    128 == tiled.maxDifference[1] && tiled.ssim < 1.0 && PATCH_SIZE * PATCH_SIZE == marked;
+                break;
+            }
+            if (!expected)
+            {
+                printf("%s: unexpected result, %u heatmap pixels marked\n", names[t], marked);
+                succeeded = false;
+            }
+        }
+    }
+
+    // Throughput on a set of renders, every fourth one with a patch
+    std::vector<Image> references, tests;
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        references.push_back(MakeRender(width, height, 1000 + i));
+        tests.push_back(references.back());
+        if (0 == i % 4)
+        {
+            AddPatch(tests.back(), width / 4, height / 4);
+        }
+        else
+        {
+            AddNoise(tests.back(), 2000 + i);
+        }
+    }
+
+    struct Mode
+    {
+        const char* name;
+        ImageComparer* comparer;
+        bool simd;
+        bool ssim;
+        bool heatmap;
+    };
+    const Mode modes[] =
+    {
+        { "scalar", &serial, false, true, false },
+        { "sse2", &serial, true, true, false },
+        { "sse2 tiles", &parallel, true, true, false },
+        { "no ssim", &parallel, true, false, false },
+        { "heatmap", &parallel, true, true, true },
+    };
+    printf("%u images of %ux%u, tiles on %u threads (0: one per hardware thread), SSE2 %s\n",
+        images, width, height, threads, serial.Simd() ? "available" : "not available");
+    printf("%-12s %12s %12s\n", "mode", "ms/image", "images/s");
+    Image heatmap;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+    {
+        ImageCompareSettings modeSettings = settings;
+        modeSettings.ssim = modes[m].ssim;
+        modes[m].comparer->SetSimd(modes[m].simd);
+        uint64_t failed = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < images; ++i)
+        {
+            const ImageCompareResult result = modes[m].comparer->Compare(MakeImageView(references[i % references.size()]),
+                MakeImageView(tests[i % tests.size()]), modeSettings, modes[m].heatmap ? &heatmap : NULL);
+            failed += result.failedPixels;
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%-12s %12.3f %12.1f\n", modes[m].name, elapsed.count() / images, elapsed.count() > 0 ? images * 1000.0 / elapsed.count() : 0.0);
+        if (failed != static_cast<uint64_t>((images + 3) / 4) * PATCH_SIZE * PATCH_SIZE)
+        {
+            printf("%s: unexpected number of failed pixels\n", modes[m].name);
+            succeeded = false;
+        }
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+// Shader compile daemon benchmark: several client threads, standing for test processes,
+// request the same set of shaders from a daemon running the stub compiler with an
+// emulated compile cost. Reports how many compilations the deduplication saved, then
+// restarts the service on the same cache directory to show the disk store, and stops it
+// with a client still connected. Exits with 1 if a shader is compiled more than once,
+// clients get different results, stopping waits for a connected client or a client
+// waits for a daemon which does not answer longer than its timeout
+
+#include "shader_compile.h"
+#include "shader_daemon.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+/// @brief Distinct sources, tagged by the run so that the disk store of earlier runs is not hit
+std::vector<ShaderCompileRequest> MakeRequests(unsigned shaderCount, unsigned run)
+{
+    std::vector<ShaderCompileRequest> requests(shaderCount);
+    for (unsigned i = 0; i < shaderCount; ++i)
+    {
+        char source[256] = {};
+        snprintf(source, sizeof(source),
+            "// run %u\nfloat4 main(float4 position : POSITION) : POSITION { return position * %u.0; }\n", run, i + 1);
+        requests[i].source = source;
+        requests[i].entryPoint = "main";
+        requests[i].profile = "vs_3_0";
+        requests[i].flags = 0;
+    }
+
+    // Failing shader is reported to every client, but never stored on disk
+    requests.back().source = "#error unsupported\n" + requests.back().source;
+    return requests;
+}
+
+/// @brief Every client requests all shaders, starting at a different one
+void RunClient(const std::string& address, const std::vector<ShaderCompileRequest>& requests, unsigned client,
+    std::vector<ShaderCompileResult>& results, bool& connected)
+{
+    ShaderDaemonClient daemon(address);
+    results.resize(requests.size());
+    connected = true;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const size_t index = (i + client) % requests.size();
+        connected = daemon.Compile(requests[index], results[index]) && connected;
+    }
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PrintStats(const char* name, const ShaderServiceStats& stats, double milliseconds)
+{
+    printf("%-8s %3u requests: %3u compiled (%u failed), %3u joined, %3u memory, %3u disk, %8.1f ms\n", name,
+        stats.requests, stats.compiles, stats.failures, stats.joined, stats.memoryHits, stats.diskHits, milliseconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned clientCount = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 8;
+    const unsigned shaderCount = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 16;
+    const unsigned compileMs = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 20;
+    const std::string cacheDirectory = argc > 4 ? argv[4] : "shader_daemon_benchmark_cache";
+    if (0 == clientCount || shaderCount < 2)
+    {
+        printf("Usage: shader_daemon_benchmark [clients = 8] [shaders = 16] [compile ms = 20] [cache directory]\n");
+        return 1;
+    }
+
+    const unsigned run = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
+    const std::vector<ShaderCompileRequest> requests = MakeRequests(shaderCount, run);
+    const std::string address = DefaultShaderDaemonAddress() + ".benchmark";
+    ShaderCompiler compiler = [compileMs](const ShaderCompileRequest& request) { return StubShaderCompile(request, compileMs); };
+
+    printf("%u clients, %u shaders, %u ms per compilation, %u hardware threads\n",
+        clientCount, shaderCount, compileMs, std::thread::hardware_concurrency());
+    printf("without the daemon every client compiles all shaders: %u compilations, ~%u ms of compiler time\n",
+        clientCount * shaderCount, clientCount * shaderCount * compileMs);
+
+    bool succeeded = true;
+    for (unsigned pass = 0; pass < 2; ++pass)
+    {
+        // Second pass restarts the daemon, memory is empty and the results come from disk
+        ShaderCompileService service(compiler, cacheDirectory);
+        ShaderDaemonServer server(service);
+        if (!server.Start(address))
+        {
+            printf("Unable to listen on %s\n", address.c_str());
+            return 1;
+        }
+
+        std::vector<std::vector<ShaderCompileResult> > results(clientCount);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        std::unique_ptr<bool[]> connected(new bool[clientCount]);
+        for (unsigned i = 0; i < clientCount; ++i)
+        {
+            clients.push_back(std::thread(RunClient, std::cref(address), std::cref(requests), i,
+                std::ref(results[i]), std::ref(connected[i])));
+        }
+        for (size_t i = 0; i < clients.size(); ++i)
+        {
+            clients[i].join();
+        }
+        const double milliseconds = MillisecondsSince(start);
+        server.Stop();
+
+        const ShaderServiceStats stats = service.Stats();
+        PrintStats(0 == pass ? "daemon" : "restart", stats, milliseconds);
+
+        // Every shader is compiled once in the first pass, only the failed one in the second
+        const unsigned expectedCompiles = 0 == pass ? shaderCount : 1;
+        if (stats.compiles != expectedCompiles || stats.failures != 1 || stats.requests != clientCount * shaderCount)
+        {
+            printf("expected %u compilations with 1 failure and %u requests\n", expectedCompiles, clientCount * shaderCount);
+            succeeded = false;
+        }
+        if (1 == pass && stats.diskHits != shaderCount - 1)
+        {
+            printf("expected %u results from disk\n", shaderCount - 1);
+            succeeded = false;
+        }
+
+        for (unsigned client = 0; client < clientCount; ++client)
+        {
+            if (!connected[client])
+            {
+                printf("client %u lost the connection\n", client);
+                succeeded = false;
+                continue;
+            }
+            for (size_t i = 0; i < requests.size(); ++i)
+            {
+                const ShaderCompileResult expected = StubShaderCompile(requests[i], 0);
+                const ShaderCompileResult& result = results[client][i];
+                if (result.succeeded != expected.succeeded || result.bytecode != expected.bytecode)
+                {
+                    printf("client %u got a wrong result for shader %u\n", client, static_cast<unsigned>(i));
+                    succeeded = false;
+                }
+            }
+        }
+    }
+
+    // Stopping with a client still connected closes its connection instead of waiting for it
+    {
+        ShaderCompileService service(compiler, cacheDirectory);
+        ShaderDaemonServer server(service);
+        ShaderDaemonClient client(address);
+        ShaderCompileResult result;
+        if (!server.Start(address) || !client.Compile(requests[0], result))
+        {
+            printf("Unable to compile on %s\n", address.c_str());
+            return 1;
+        }
+
+        std::atomic<bool> stopped(false);
+        std::thread stopper([&server, &stopped]() { server.Stop(); stopped = true; });
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (!stopped && MillisecondsSince(start) < 5000)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (!stopped)
+        {
+            // The stopping thread can't be joined, the process is ended without unwinding
+            printf("Stop() blocked by a connected client\nFAILED\n");
+            fflush(stdout);
+            _Exit(1);
+        }
+        stopper.join();
+        if (client.Compile(requests[0], result))
+        {
+            printf("connected client reached a stopped daemon\n");
+            succeeded = false;
+        }
+    }
+
+    // Daemon which does not answer in time is given up, the samples then compile in-process
+    {
+        const unsigned timeoutMs = 100;
+        ShaderCompiler stalled = [timeoutMs](const ShaderCompileRequest& request) { return StubShaderCompile(request, timeoutMs * 5); };
+        ShaderCompileService service(stalled, std::string());
+        ShaderDaemonServer server(service);
+        ShaderDaemonClient impatient(address, timeoutMs);
+        ShaderCompileResult result;
+        if (!server.Start(address))
+        {
+            printf("Unable to listen on %s\n", address.c_str());
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool answered = impatient.Compile(requests[0], result);
+        const double milliseconds = MillisecondsSince(start);
+        if (answered || milliseconds > timeoutMs * 4)
+        {
+            printf("client waited %.1f ms for a stalled daemon with a %u ms timeout\n", milliseconds, timeoutMs);
+            succeeded = false;
+        }
+    }
+
+    // Requests after the daemon is gone fail, so that the samples fall back to in-process compilation
+    ShaderDaemonClient orphan(address);
+    ShaderCompileResult result;
+    if (orphan.Compile(requests[0], result))
+    {
+        printf("client reached a stopped daemon\n");
+        succeeded = false;
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
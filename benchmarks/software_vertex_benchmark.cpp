@@ -0,0 +1,262 @@
+// Software vertex processing benchmark: scalar against SSE2 transform to XYZRHW,
+// with the results of both paths compared, and submission of the pre-transformed
+// vertices to the null backend. Triangles crossing the near plane are clipped and their
+// new vertices compared with the projected intersection of the edge and the near plane.
+// Exits with 1 if the paths disagree or clipping is wrong
+
+#include "deterministic_random.h"
+#include "mesh.h"
+#include "null_device.h"
+#include "software_vertex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+/// @brief Random triangles in a cube around the origin, partially outside of the frustum
+void MakeRandomMesh(unsigned triangleCount, Mesh& mesh)
+{
+    unsigned seed = 12345;
+    mesh.vertices.resize(triangleCount * 3);
+    mesh.indices.resize(triangleCount * 3);
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        MeshVertex& vertex = mesh.vertices[i];
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            vertex.position[c] = (NextRandom(seed) % 4000) / 1000.0f - 2.0f;
+            vertex.normal[c] = 0.0f;
+        }
+        vertex.texCoord[0] = (NextRandom(seed) % 1000) / 1000.0f;
+        vertex.texCoord[1] = (NextRandom(seed) % 1000) / 1000.0f;
+        mesh.indices[i] = static_cast<uint32_t>(i);
+    }
+}
+
+/// @brief Row-major perspective projection and look-at, as D3DXMatrixPerspectiveFovLH and D3DXMatrixLookAtLH
+void MakeViewProjection(float aspect, float viewProjection[16])
+{
+    const float fovY = 3.14159265f / 3;
+    const float zn = 0.01f, zf = 20.0f;
+    const float yScale = 1.0f / tanf(fovY / 2);
+    const float projection[16] =
+    {
+        yScale / aspect, 0, 0, 0,
+        0, yScale, 0, 0,
+        0, 0, zf / (zf - zn), 1,
+        0, 0, -zn * zf / (zf - zn), 0
+    };
+
+    // Eye at (0, 0, -3) looking at the origin
+    const float view[16] =
+    {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 3, 1
+    };
+
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        for (unsigned column = 0; column < 4; ++column)
+        {
+            float value = 0.0f;
+            for (unsigned k = 0; k < 4; ++k)
+            {
+                value += view[row * 4 + k] * projection[k * 4 + column];
+            }
+            viewProjection[row * 4 + column] = value;
+        }
+    }
+}
+
+double MeasureTransform(SoftwareVertexPipeline& pipeline, const Mesh& mesh, unsigned iterations)
+{
+    const MeshVertex& first = mesh.vertices[0];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        pipeline.Process(first.position, sizeof(MeshVertex), NULL, 0, first.texCoord, sizeof(MeshVertex), mesh.vertices.size());
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+/// @brief One triangle with a vertex behind the eye, clipped into two, and one with two, clipped into one
+bool CheckNearClipping(const float viewProjection[16], const ScreenViewport& viewport)
+{
+    // Eye is at z = -3 and the near plane 0.01 in front of it
+    const float positions[] =
+    {
+        -0.5f, -0.5f, 0.0f,   0.5f, -0.5f, 0.0f,   0.5f, 0.5f, -4.0f,
+         0.0f, -0.5f, 0.0f,  -0.5f, 0.5f, -4.0f,   0.5f, 0.5f, -4.0f
+    };
+    const float texCoords[] = { 0, 0, 1, 0, 1, 1, 0.5f, 0, 0, 1, 1, 1 };
+    const uint32_t indices[] = { 0, 1, 2, 3, 4, 5 };
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    SoftwareVertexPipeline pipeline;
+    pipeline.SetTransform(identity, viewProjection);
+    pipeline.SetViewport(viewport);
+    pipeline.Process(positions, 3 * sizeof(float), NULL, 0, texCoords, 2 * sizeof(float), 6);
+    std::vector<uint32_t> visible;
+    const size_t culled = pipeline.CullTriangles(indices, 6, visible);
+    if (0 != culled || 9 != visible.size() || 10 != pipeline.Vertices().size())
+    {
+        printf("near clipping: %u culled, %u triangles and %u vertices, 0, 3 and 10 expected\n", static_cast<unsigned>(culled),
+            static_cast<unsigned>(visible.size() / 3), static_cast<unsigned>(pipeline.Vertices().size()));
+        return false;
+    }
+
+    // Clipped vertices are where the edges from the inside vertices cross the near plane at z = -2.99
+    const float nearZ = -2.99f;
+    const unsigned edges[4][2] = { { 1, 2 }, { 0, 2 }, { 3, 4 }, { 3, 5 } };
+    for (unsigned e = 0; e < 4; ++e)
+    {
+        const float* a = &positions[3 * edges[e][0]];
+        const float* b = &positions[3 * edges[e][1]];
+        const float t = (nearZ - a[2]) / (b[2] - a[2]);
+        const float point[3] = { a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t, nearZ };
+        const float* ta = &texCoords[2 * edges[e][0]];
+        const float* tb = &texCoords[2 * edges[e][1]];
+
+        SoftwareVertexPipeline reference;
+        reference.SetTransform(identity, viewProjection);
+        reference.SetViewport(viewport);
+        reference.Process(point, 3 * sizeof(float), NULL, 0, NULL, 0, 1);
+        const TransformedVertex& expected = reference.Vertices()[0];
+
+        bool found = false;
+        for (size_t i = 0; i < visible.size() && !found; ++i)
+        {
+            const TransformedVertex& vertex = pipeline.Vertices()[visible[i]];
+            found = visible[i] >= 6 && fabsf(vertex.x - expected.x) < 0.05f && fabsf(vertex.y - expected.y) < 0.05f &&
+                fabsf(vertex.z - viewport.minZ) < 1e-4f && fabsf(vertex.rhw - expected.rhw) < 1e-3f * expected.rhw &&
+                fabsf(vertex.u - (ta[0] + (tb[0] - ta[0]) * t)) < 1e-3f && fabsf(vertex.v - (ta[1] + (tb[1] - ta[1]) * t)) < 1e-3f;
+        }
+        if (!found)
+        {
+            printf("near clipping: no vertex where edge %u-%u crosses the near plane\n", edges[e][0], edges[e][1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* meshFile = argc > 1 ? argv[1] : "";
+    unsigned iterations = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 50;
+    if (0 == iterations)
+    {
+        printf("Usage: software_vertex_benchmark [mesh file or \"\" for random triangles] [iterations = 50]\n");
+        return 1;
+    }
+
+    Mesh mesh;
+    if (*meshFile)
+    {
+        if (!LoadMesh(meshFile, mesh))
+        {
+            printf("Unable to load %s\n", meshFile);
+            return 1;
+        }
+    }
+    else
+    {
+        MakeRandomMesh(100000, mesh);
+    }
+    if (mesh.vertices.empty())
+    {
+        printf("Mesh has no vertices\n");
+        return 1;
+    }
+
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    float viewProjection[16];
+    MakeViewProjection(800.0f / 600.0f, viewProjection);
+    const ScreenViewport viewport = { 0, 0, 800, 600, 0.0f, 1.0f };
+
+    SoftwareVertexPipeline scalar;
+    scalar.SetSimd(false);
+    scalar.SetTransform(identity, viewProjection);
+    scalar.SetViewport(viewport);
+
+    SoftwareVertexPipeline simd;
+    simd.SetTransform(identity, viewProjection);
+    simd.SetViewport(viewport);
+
+    const double scalarMs = MeasureTransform(scalar, mesh, iterations);
+    const double simdMs = MeasureTransform(simd, mesh, iterations);
+
+    // Both paths perform the same operations in the same order
+    float maxDifference = 0.0f;
+    size_t clipMismatches = 0;
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        if (scalar.ClipCodes()[i] != simd.ClipCodes()[i])
+        {
+            ++clipMismatches;
+            continue;
+        }
+        if (scalar.ClipCodes()[i] & CLIP_NEAR)
+        {
+            continue;
+        }
+        const TransformedVertex& a = scalar.Vertices()[i];
+        const TransformedVertex& b = simd.Vertices()[i];
+        maxDifference = std::max(maxDifference, std::max(fabsf(a.x - b.x), fabsf(a.y - b.y)));
+        maxDifference = std::max(maxDifference, std::max(fabsf(a.z - b.z), fabsf(a.rhw - b.rhw)));
+    }
+
+    std::vector<uint32_t> visible;
+    const size_t culled = simd.CullTriangles(mesh.indices.data(), mesh.indices.size(), visible);
+
+    // Pre-transformed vertices go to the device with 16-bit indices in chunks
+    NullDevice device;
+    device.BeginScene();
+    device.SetFVF(TRANSFORMED_VERTEX_FVF);
+    std::vector<uint16_t> chunk;
+    std::vector<TransformedVertex> chunkVertices;
+    for (size_t first = 0; first < visible.size(); first += 3 * 20000)
+    {
+        const size_t last = std::min(visible.size(), first + 3 * 20000);
+        chunk.clear();
+        chunkVertices.clear();
+        for (size_t i = first; i < last; ++i)
+        {
+            chunk.push_back(static_cast<uint16_t>(chunkVertices.size()));
+            chunkVertices.push_back(simd.Vertices()[visible[i]]);
+        }
+        device.DrawIndexedPrimitiveUP(NULL_PT_TRIANGLELIST, 0, static_cast<unsigned>(chunkVertices.size()),
+            static_cast<unsigned>(chunk.size() / 3), chunk.data(), chunkVertices.data(), sizeof(TransformedVertex));
+    }
+    device.EndScene();
+    device.Present();
+
+    const double vertices = static_cast<double>(mesh.vertices.size());
+    printf("%u vertices, %u triangles, %u iterations, SSE2 %s\n",
+        static_cast<unsigned>(mesh.vertices.size()), static_cast<unsigned>(mesh.TriangleCount()), iterations,
+        simd.Simd() ? "enabled" : "unavailable");
+    printf("%-8s %12s %14s\n", "path", "ms/batch", "Mvertices/s");
+    printf("%-8s %12.3f %14.1f\n", "scalar", scalarMs, scalarMs > 0 ? vertices / scalarMs / 1000.0 : 0.0);
+    printf("%-8s %12.3f %14.1f\n", "simd", simdMs, simdMs > 0 ? vertices / simdMs / 1000.0 : 0.0);
+    printf("speedup %.2fx, max difference %g, clip code mismatches %u\n",
+        simdMs > 0 ? scalarMs / simdMs : 0.0, maxDifference, static_cast<unsigned>(clipMismatches));
+    printf("culled %u of %u triangles, %u draws, %u primitives submitted\n",
+        static_cast<unsigned>(culled), static_cast<unsigned>(mesh.TriangleCount()),
+        device.Counters().draws, device.Counters().primitives);
+
+    const bool clippingOk = CheckNearClipping(viewProjection, viewport);
+    printf("near plane clipping %s\n", clippingOk ? "ok" : "FAILED");
+
+    return (0 == clipMismatches && maxDifference <= 1e-3f && clippingOk) ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+// Microbenchmarks of the CPU cost of what the samples submit every frame: draws of
+// several sizes, render and sampler state, shader constant uploads through a constant
+// table and directly, the per-frame matrix math and the software vertex pipeline.
+// Runs on the null backend, every benchmark is warmed up, calibrated and sampled on a
+// pinned thread. Results are printed and optionally written as JSON and CSV; with a
+// baseline CSV, exits with 1 if a median is slower than the baseline by the threshold
+//
+// ID3DXConstantTable is not available off Windows, SetMatrix is emulated as D3DX does
+// it for a column-major matrix: the constant is looked up by name, the matrix is
+// transposed and uploaded as four registers
+
+#include "deterministic_random.h"
+#include "microbench.h"
+#include "null_device.h"
+#include "software_vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// @brief D3DRS_ZENABLE, D3DRS_ALPHABLENDENABLE, D3DRS_CULLMODE
+const unsigned RS_ZENABLE = 7;
+const unsigned RS_ALPHABLENDENABLE = 27;
+const unsigned RS_CULLMODE = 22;
+
+/// @brief D3DSAMP_MAGFILTER, D3DSAMP_MINFILTER, D3DTEXF_POINT, D3DTEXF_LINEAR
+const unsigned SAMP_MAGFILTER = 5;
+const unsigned SAMP_MINFILTER = 6;
+const unsigned TEXF_POINT = 1;
+const unsigned TEXF_LINEAR = 2;
+
+/// @brief Row-major product, as D3DXMatrixMultiply
+void MultiplyMatrix(const float a[16], const float b[16], float result[16])
+{
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        for (unsigned column = 0; column < 4; ++column)
+        {
+            result[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] +
+                a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+        }
+    }
+}
+
+/// @brief As D3DXMatrixRotationY
+void RotationY(float angle, float result[16])
+{
+    const float c = cosf(angle), s = sinf(angle);
+    const float matrix[16] = { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1 };
+    memcpy(result, matrix, sizeof(matrix));
+}
+
+/// @brief As D3DXMatrixPerspectiveFovLH
+void PerspectiveFovLH(float fovY, float aspect, float zn, float zf, float result[16])
+{
+    const float yScale = 1.0f / tanf(fovY / 2);
+    const float matrix[16] =
+    {
+        yScale / aspect, 0, 0, 0,
+        0, yScale, 0, 0,
+        0, 0, zf / (zf - zn), 1,
+        0, 0, -zn * zf / (zf - zn), 0
+    };
+    memcpy(result, matrix, sizeof(matrix));
+}
+
+void Normalize(float v[3])
+{
+    const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+}
+
+void Cross(const float a[3], const float b[3], float result[3])
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+float Dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/// @brief As D3DXMatrixLookAtLH
+void LookAtLH(const float eye[3], const float at[3], const float up[3], float result[16])
+{
+    float zAxis[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+    Normalize(zAxis);
+    float xAxis[3];
+    Cross(up, zAxis, xAxis);
+    Normalize(xAxis);
+    float yAxis[3];
+    Cross(zAxis, xAxis, yAxis);
+    const float matrix[16] =
+    {
+        xAxis[0], yAxis[0], zAxis[0], 0,
+        xAxis[1], yAxis[1], zAxis[1], 0,
+        xAxis[2], yAxis[2], zAxis[2], 0,
+        -Dot(xAxis, eye), -Dot(yAxis, eye), -Dot(zAxis, eye), 1
+    };
+    memcpy(result, matrix, sizeof(matrix));
+}
+
+/// @brief World and view-projection of a frame of dynamic_shaders
+void FrameMatrices(float angle, float world[16], float viewProjection[16])
+{
+    static const float eye[3] = { 0, 2, 2 }, at[3] = { 0, 0, 0 }, up[3] = { 0, 1, 0 };
+    float view[16], projection[16];
+    RotationY(angle, world);
+    PerspectiveFovLH(3.14159265f / 3, 800.0f / 600, 0.01f, 20.0f, projection);
+    LookAtLH(eye, at, up, view);
+    MultiplyMatrix(view, projection, viewProjection);
+}
+
+/// @brief Constants of the sample vertex shaders as a compiled constant table describes them
+class EmulatedConstantTable
+{
+public:
+
+    EmulatedConstantTable()
+    {
+        static const char* const names[] = { "fTime", "vLightDirection", "mWorld", "mViewProjection" };
+        static const unsigned registers[] = { 0, 1, 2, 6 };
+        static const unsigned counts[] = { 1, 1, 4, 4 };
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            Constant constant = { names[i], registers[i], counts[i] };
+            m_constants.push_back(constant);
+        }
+    }
+
+    /// @brief As ID3DXConstantTable::SetMatrix with a name as the handle, false if the name is unknown
+    bool SetMatrix(NullDevice& device, const char* name, const float matrix[16]) const
+    {
+        for (size_t i = 0; i < m_constants.size(); ++i)
+        {
+            if (0 == strcmp(m_constants[i].name.c_str(), name))
+            {
+                float transposed[16];
+                for (unsigned row = 0; row < 4; ++row)
+                {
+                    for (unsigned column = 0; column < 4; ++column)
+                    {
+                        transposed[column * 4 + row] = matrix[row * 4 + column];
+                    }
+                }
+                device.SetVertexShaderConstantF(m_constants[i].registerIndex, transposed, std::min(m_constants[i].registerCount, 4u));
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+
+    struct Constant
+    {
+        std::string name;
+        unsigned registerIndex;
+        unsigned registerCount;
+    };
+    std::vector<Constant> m_constants;
+};
+
+/// @brief Random vertices on the screen, the draws only count them but the stride and size are real
+std::vector<TransformedVertex> MakeScreenVertices(unsigned count)
+{
+    unsigned seed = 4321;
+    std::vector<TransformedVertex> vertices(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        TransformedVertex& vertex = vertices[i];
+        vertex.x = static_cast<float>(NextRandom(seed) % 800);
+        vertex.y = static_cast<float>(NextRandom(seed) % 600);
+        vertex.z = 0.5f;
+        vertex.rhw = 1.0f;
+        vertex.color = 0xffffffff;
+        vertex.u = (NextRandom(seed) % 1000) / 1000.0f;
+        vertex.v = (NextRandom(seed) % 1000) / 1000.0f;
+    }
+    return vertices;
+}
+
+/// @brief Random positions in a cube around the origin, partially outside of the frustum
+std::vector<float> MakePositions(unsigned count)
+{
+    unsigned seed = 12345;
+    std::vector<float> positions(count * 3);
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        positions[i] = (NextRandom(seed) % 4000) / 1000.0f - 2.0f;
+    }
+    return positions;
+}
+
+void PrintUsage()
+{
+    printf("Usage: submission_microbench [--json file] [--csv file] [--baseline csv file] [--threshold percent = 10]\n"
+           "                             [--cpu n = 0, -1 unpinned] [--samples n = 15] [--filter substring]\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    MicrobenchSettings settings = DefaultMicrobenchSettings();
+    std::string jsonFile, csvFile, baselineFile, filter;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+        const char* value = argv[++i];
+        if ("--json" == option)
+        {
+            jsonFile = value;
+        }
+        else if ("--csv" == option)
+        {
+            csvFile = value;
+        }
+        else if ("--baseline" == option)
+        {
+            baselineFile = value;
+        }
+        else if ("--threshold" == option)
+        {
+            threshold = strtod(value, NULL);
+        }
+        else if ("--cpu" == option)
+        {
+            settings.cpu = static_cast<int>(strtol(value, NULL, 10));
+        }
+        else if ("--samples" == option)
+        {
+            settings.samples = static_cast<unsigned>(strtoul(value, NULL, 10));
+        }
+        else if ("--filter" == option)
+        {
+            filter = value;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (0 == settings.samples || threshold <= 0.0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<MicrobenchResult> baseline;
+    if (!baselineFile.empty() && !LoadMicrobenchCsv(baselineFile, baseline))
+    {
+        printf("Unable to load %s\n", baselineFile.c_str());
+        return 1;
+    }
+
+    NullDevice device;
+    MicrobenchSuite suite(settings);
+
+    // Draws: the device only counts, the cost is the call and the vertex count computation
+    static const unsigned vertexCounts[] = { 3, 30, 300, 3000 };
+    const std::vector<TransformedVertex> screenVertices = MakeScreenVertices(3000);
+    for (unsigned v = 0; v < sizeof(vertexCounts) / sizeof(vertexCounts[0]); ++v)
+    {
+        const unsigned triangles = vertexCounts[v] / 3;
+        suite.Add("null/draw_up/" + std::to_string(vertexCounts[v]), [&device, &screenVertices, triangles](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                device.DrawPrimitiveUP(NULL_PT_TRIANGLELIST, triangles, &screenVertices[0], sizeof(TransformedVertex));
+            }
+        });
+    }
+    std::vector<uint16_t> indices(3000);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = static_cast<uint16_t>(i);
+    }
+    suite.Add("null/draw_indexed_up/3000", [&device, &screenVertices, &indices](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.DrawIndexedPrimitiveUP(NULL_PT_TRIANGLELIST, 0, static_cast<unsigned>(screenVertices.size()),
+                static_cast<unsigned>(indices.size() / 3), &indices[0], &screenVertices[0], sizeof(TransformedVertex));
+        }
+    });
+
+    // State: alternating values, as objects with different materials do
+    suite.Add("null/set_render_state", [&device](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetRenderState(RS_ALPHABLENDENABLE, static_cast<uint32_t>(i & 1));
+        }
+    });
+    suite.Add("null/set_render_state/frame_set", [&device](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetRenderState(RS_ZENABLE, 1);
+            device.SetRenderState(RS_CULLMODE, 1);
+            device.SetRenderState(RS_ALPHABLENDENABLE, static_cast<uint32_t>(i & 1));
+        }
+    });
+    suite.Add("null/set_sampler_state", [&device](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetSamplerState(0, SAMP_MINFILTER, i & 1 ? TEXF_LINEAR : TEXF_POINT);
+        }
+    });
+    suite.Add("null/set_sampler_state/filters", [&device](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            const uint32_t filter = i & 1 ? TEXF_LINEAR : TEXF_POINT;
+            device.SetSamplerState(0, SAMP_MINFILTER, filter);
+            device.SetSamplerState(0, SAMP_MAGFILTER, filter);
+        }
+    });
+    static const int textures[2] = {};
+    suite.Add("null/set_texture", [&device](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetTexture(0, &textures[i & 1]);
+        }
+    });
+
+    // Constants: the two matrices of the sample vertex shaders each frame
+    const EmulatedConstantTable constantTable;
+    float world[16], viewProjection[16];
+    FrameMatrices(0.5f, world, viewProjection);
+    suite.Add("null/constant_table_set_matrix/2", [&device, &constantTable, &world, &viewProjection](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            constantTable.SetMatrix(device, "mWorld", world);
+            constantTable.SetMatrix(device, "mViewProjection", viewProjection);
+        }
+    });
+    suite.Add("null/set_vertex_shader_constant_f/4+4", [&device, &world, &viewProjection](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetVertexShaderConstantF(2, world, 4);
+            device.SetVertexShaderConstantF(6, viewProjection, 4);
+        }
+    });
+    float worldViewProjection[32];
+    memcpy(worldViewProjection, world, sizeof(world));
+    memcpy(worldViewProjection + 16, viewProjection, sizeof(viewProjection));
+    suite.Add("null/set_vertex_shader_constant_f/8", [&device, &worldViewProjection](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            device.SetVertexShaderConstantF(2, worldViewProjection, 8);
+        }
+    });
+
+    // Matrix math of a frame
+    suite.Add("math/matrix_multiply", [&world, &viewProjection](uint64_t iterations)
+    {
+        float result[16];
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            MultiplyMatrix(world, viewProjection, result);
+            MicrobenchKeep(result);
+        }
+    });
+    suite.Add("math/frame_matrices", [](uint64_t iterations)
+    {
+        float frameWorld[16], frameViewProjection[16];
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            FrameMatrices(static_cast<float>(i & 1023) * 0.01f, frameWorld, frameViewProjection);
+            MicrobenchKeep(frameWorld);
+            MicrobenchKeep(frameViewProjection);
+        }
+    });
+
+    // Software vertex pipeline, per call of the sizes drawn above
+    const ScreenViewport viewport = { 0, 0, 800, 600, 0.0f, 1.0f };
+    SoftwareVertexPipeline scalarPipeline, simdPipeline;
+    scalarPipeline.SetSimd(false);
+    scalarPipeline.SetViewport(viewport);
+    simdPipeline.SetViewport(viewport);
+    suite.Add("software/set_transform", [&simdPipeline, &world, &viewProjection](uint64_t iterations)
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            simdPipeline.SetTransform(world, viewProjection);
+        }
+    });
+    scalarPipeline.SetTransform(world, viewProjection);
+    simdPipeline.SetTransform(world, viewProjection);
+    const std::vector<float> positions = MakePositions(3000);
+    for (unsigned v = 0; v < sizeof(vertexCounts) / sizeof(vertexCounts[0]); ++v)
+    {
+        const unsigned count = vertexCounts[v];
+        SoftwareVertexPipeline* pipelines[2] = { &scalarPipeline, &simdPipeline };
+        static const char* const names[2] = { "software/process_scalar/", "software/process_sse2/" };
+        for (unsigned p = 0; p < 2; ++p)
+        {
+            if (pipelines[p]->Simd() || 0 == p)
+            {
+                SoftwareVertexPipeline* pipeline = pipelines[p];
+                suite.Add(names[p] + std::to_string(count), [pipeline, &positions, count](uint64_t iterations)
+                {
+                    for (uint64_t i = 0; i < iterations; ++i)
+                    {
+                        pipeline->Process(&positions[0], 3 * sizeof(float), NULL, 0, NULL, 0, count);
+                    }
+                });
+            }
+        }
+    }
+    suite.Add("software/cull/3000", [&simdPipeline, &positions, &indices](uint64_t iterations)
+    {
+        simdPipeline.Process(&positions[0], 3 * sizeof(float), NULL, 0, NULL, 0, positions.size() / 3);
+        std::vector<uint16_t> visible;
+        visible.reserve(indices.size());
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            simdPipeline.CullTriangles(&indices[0], indices.size(), visible);
+        }
+    });
+
+    const std::vector<MicrobenchResult>& results = suite.Run(filter);
+    if (results.empty())
+    {
+        printf("No benchmark matches %s\n", filter.c_str());
+        return 1;
+    }
+    printf("%u samples, %.1f ms warm-up, %s\n", suite.Settings().samples, suite.Settings().warmupMilliseconds,
+        suite.Pinned() ? ("pinned to CPU " + std::to_string(settings.cpu)).c_str() : "not pinned");
+
+    bool succeeded = true;
+    if (!jsonFile.empty() && !WriteMicrobenchJson(jsonFile, "submission", suite))
+    {
+        printf("Unable to write %s\n", jsonFile.c_str());
+        succeeded = false;
+    }
+    if (!csvFile.empty() && !WriteMicrobenchCsv(csvFile, results))
+    {
+        printf("Unable to write %s\n", csvFile.c_str());
+        succeeded = false;
+    }
+    if (!baseline.empty())
+    {
+        const std::vector<std::string> regressions = FindMicrobenchRegressions(baseline, results, threshold);
+        for (size_t i = 0; i < regressions.size(); ++i)
+        {
+            printf("regression %s\n", regressions[i].c_str());
+        }
+        printf("%u regressions over %.1f%% against %s\n", static_cast<unsigned>(regressions.size()), threshold, baselineFile.c_str());
+        succeeded = succeeded && regressions.empty();
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
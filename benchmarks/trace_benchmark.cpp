@@ -0,0 +1,318 @@
+// Trace recording benchmark: cost of a scope with the trace macros compiled out and of
+// a recorded scope, on one and on several threads. Recorded events are written in the
+// Chrome JSON and Perfetto formats and both files are read back and counted.
+// Zero-length scopes are recorded inside a parent scope, at its start and in its middle.
+// Exits with 1 if an event is missing from either file or the Perfetto slices of a
+// thread do not nest
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+volatile unsigned g_sink = 0;
+
+/// @brief Scope around a trivial body, as written in the samples
+void MacroScopes(unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        TRACE_SCOPE("macro scope");
+        g_sink = g_sink + i;
+    }
+}
+
+/// @brief Recorded scopes regardless of the build option
+void RecordedScopes(unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        TraceScope scope("recorded scope");
+        g_sink = g_sink + i;
+    }
+}
+
+double NanosecondsPerScope(void (*scopes)(unsigned), unsigned threadCount, unsigned count)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < threadCount; ++i)
+    {
+        threads.push_back(std::thread([scopes, count] { TraceSetThreadName("benchmark"); scopes(count); }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (static_cast<double>(threadCount) * count);
+}
+
+std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+size_t CountOccurrences(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for (size_t position = text.find(pattern); std::string::npos != position; position = text.find(pattern, position + 1))
+    {
+        ++count;
+    }
+    return count;
+}
+
+bool ReadVarint(const std::string& data, size_t& position, uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; position < data.size() && shift < 64; shift += 7)
+    {
+        const unsigned char byte = static_cast<unsigned char>(data[position++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Top-level packets of a Perfetto trace, 0 if the file is malformed
+size_t CountPerfettoPackets(const std::string& data)
+{
+    size_t packets = 0;
+    size_t position = 0;
+    while (position < data.size())
+    {
+        uint64_t key = 0, size = 0;
+        if (!ReadVarint(data, position, key) || (1 << 3 | 2) != key || !ReadVarint(data, position, size) || size > data.size() - position)
+        {
+            return 0;
+        }
+        position += static_cast<size_t>(size);
+        ++packets;
+    }
+    return packets;
+}
+
+bool SkipField(const std::string& data, size_t& position, uint64_t key)
+{
+    uint64_t value = 0;
+    if (!ReadVarint(data, position, value))
+    {
+        return false;
+    }
+    if (2 == (key & 7))
+    {
+        if (value > data.size() - position)
+        {
+            return false;
+        }
+        position += static_cast<size_t>(value);
+    }
+    return 0 == (key & 7) || 2 == (key & 7);
+}
+
+/// @brief Every end closes a slice begun on its track, and zero-length slices named
+/// "zero length" begin inside a slice named "parent". Field numbers as in trace.cpp
+bool CheckPerfettoNesting(const std::string& data)
+{
+    std::map<uint64_t, std::vector<std::string> > openSlices;
+    size_t position = 0;
+    while (position < data.size())
+    {
+        uint64_t key = 0, size = 0;
+        if (!ReadVarint(data, position, key) || !ReadVarint(data, position, size) || size > data.size() - position)
+        {
+            return false;
+        }
+        const std::string packet = data.substr(position, static_cast<size_t>(size));
+        position += static_cast<size_t>(size);
+
+        // Track event of the packet: type 9, track 11, name 23
+        uint64_t type = 0, track = 0;
+        std::string name;
+        bool trackEvent = false;
+        for (size_t field = 0; field < packet.size();)
+        {
+            uint64_t packetKey = 0, eventSize = 0;
+            if (!ReadVarint(packet, field, packetKey))
+            {
+                return false;
+            }
+            if ((11 << 3 | 2) != packetKey)
+            {
+                if (!SkipField(packet, field, packetKey))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (!ReadVarint(packet, field, eventSize) || eventSize > packet.size() - field)
+            {
+                return false;
+            }
+            const std::string event = packet.substr(field, static_cast<size_t>(eventSize));
+            field += static_cast<size_t>(eventSize);
+            trackEvent = true;
+            for (size_t eventField = 0; eventField < event.size();)
+            {
+                uint64_t eventKey = 0, value = 0;
+                if (!ReadVarint(event, eventField, eventKey))
+                {
+                    return false;
+                }
+                if ((9 << 3) == eventKey || (11 << 3) == eventKey)
+                {
+                    if (!ReadVarint(event, eventField, value))
+                    {
+                        return false;
+                    }
+                    ((9 << 3) == eventKey ? type : track) = value;
+                }
+                else if ((23 << 3 | 2) == eventKey)
+                {
+                    if (!ReadVarint(event, eventField, value) || value > event.size() - eventField)
+                    {
+                        return false;
+                    }
+                    name = event.substr(eventField, static_cast<size_t>(value));
+                    eventField += static_cast<size_t>(value);
+                }
+                else if (!SkipField(event, eventField, eventKey))
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (!trackEvent)
+        {
+            continue;
+        }
+        std::vector<std::string>& slices = openSlices[track];
+        if (1 == type)
+        {
+            if ("zero length" == name && std::find(slices.begin(), slices.end(), "parent") == slices.end())
+            {
+                printf("zero-length slice begins outside of its parent\n");
+                return false;
+            }
+            slices.push_back(name);
+        }
+        else if (2 == type)
+        {
+            if (slices.empty())
+            {
+                printf("slice ends before it begins\n");
+                return false;
+            }
+            slices.pop_back();
+        }
+    }
+
+    for (std::map<uint64_t, std::vector<std::string> >::const_iterator track = openSlices.begin(); track != openSlices.end(); ++track)
+    {
+        if (!track->second.empty())
+        {
+            printf("slice %s is never ended\n", track->second.back().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned count = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 200000;
+    const unsigned threadCount = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 4;
+    const std::string prefix = argc > 3 ? argv[3] : "trace_benchmark";
+    if (0 == count || 0 == threadCount)
+    {
+        printf("Usage: trace_benchmark [scopes per thread = 200000] [threads = 4] [output prefix]\n");
+        return 1;
+    }
+
+#ifdef D3D_TRACE_ENABLED
+    printf("trace macros compiled in (D3D_TRACE=ON)\n");
+#else
+    printf("trace macros compiled out (D3D_TRACE=OFF)\n");
+#endif
+    printf("macro scope, 1 thread:    %6.1f ns\n", NanosecondsPerScope(MacroScopes, 1, count));
+    printf("recorded scope, 1 thread: %6.1f ns\n", NanosecondsPerScope(RecordedScopes, 1, count));
+    printf("recorded scope, %u threads: %6.1f ns per scope and thread\n", threadCount, NanosecondsPerScope(RecordedScopes, threadCount, count));
+
+    // Scopes shorter than the clock resolution, children are recorded before their parent
+    std::thread nesting([]
+    {
+        TraceSetThreadName("nesting");
+        const uint64_t start = TraceNow();
+        TraceRecord("zero length", start, start);
+        TraceRecord("zero length", start + 500, start + 500);
+        TraceRecord("parent", start, start + 1000);
+    });
+    nesting.join();
+
+    uint64_t recorded = 0, dropped = 0;
+    TraceEventCounts(recorded, dropped);
+    printf("%llu events recorded, %llu dropped\n", static_cast<unsigned long long>(recorded), static_cast<unsigned long long>(dropped));
+
+    const std::string jsonPath = prefix + ".json";
+    const std::string perfettoPath = prefix + ".pftrace";
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool succeeded = TraceWrite(jsonPath);
+    std::chrono::duration<double, std::milli> jsonTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    succeeded = TraceWrite(perfettoPath) && succeeded;
+    std::chrono::duration<double, std::milli> perfettoTime = std::chrono::steady_clock::now() - start;
+    if (!succeeded)
+    {
+        printf("unable to write the traces\n");
+        return 1;
+    }
+
+    const std::string json = ReadFile(jsonPath);
+    const std::string perfetto = ReadFile(perfettoPath);
+    printf("%s: %.1f MB in %.1f ms, %s: %.1f MB in %.1f ms\n",
+        jsonPath.c_str(), json.size() / (1024.0 * 1024.0), jsonTime.count(),
+        perfettoPath.c_str(), perfetto.size() / (1024.0 * 1024.0), perfettoTime.count());
+
+    // Every scope is one complete event in JSON, a begin and an end packet in Perfetto
+    // after the process descriptor and one descriptor per benchmark thread
+    const uint64_t expected = recorded;
+    const size_t jsonEvents = CountOccurrences(json, "\"ph\":\"X\"");
+    const size_t threads = 1 + 1 + threadCount + 1;
+    const size_t perfettoPackets = CountPerfettoPackets(perfetto);
+    if (jsonEvents != expected)
+    {
+        printf("JSON trace has %u complete events, %u expected\n", static_cast<unsigned>(jsonEvents), static_cast<unsigned>(expected));
+        succeeded = false;
+    }
+    if (perfettoPackets != 1 + threads + 2 * expected)
+    {
+        printf("Perfetto trace has %u packets, %u expected\n", static_cast<unsigned>(perfettoPackets),
+            static_cast<unsigned>(1 + threads + 2 * expected));
+        succeeded = false;
+    }
+    succeeded = CheckPerfettoNesting(perfetto) && succeeded;
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+// Transform hierarchy benchmark: a random forest of nodes whose local matrices change a
+// few at a time. Incremental updates of the dirty subtrees are compared to a full scalar
+// update after every frame, must recompute exactly the nodes below the changes, and must
+// survive reparenting. World matrices are also compared to products of the local matrices
+// along every node's chain of parents, computed in double precision, and parents which are
+// not nodes or would make a cycle must be rejected. Prints the time per frame of full and
+// incremental updates for a growing number of changed nodes. Exits with 1 on failure
+
+#include "deterministic_random.h"
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+/// @brief Rotation about Y followed by a translation, as a scene node would have
+void MakeLocal(unsigned& seed, float local[16])
+{
+    const float angle = (NextRandom(seed) % 6283) / 1000.0f;
+    const float c = cosf(angle), s = sinf(angle);
+    const float matrix[16] =
+    {
+        c, 0, -s, 0,
+        0, 1, 0, 0,
+        s, 0, c, 0,
+        (NextRandom(seed) % 2000) / 1000.0f - 1.0f, (NextRandom(seed) % 2000) / 1000.0f - 1.0f, (NextRandom(seed) % 2000) / 1000.0f - 1.0f, 1
+    };
+    memcpy(local, matrix, sizeof(matrix));
+}
+
+/// @brief Random forest: most nodes hang below an earlier one, one in a hundred is a root
+void MakeHierarchy(unsigned nodes, TransformHierarchy& hierarchy)
+{
+    unsigned seed = 2024;
+    for (unsigned i = 0; i < nodes; ++i)
+    {
+        float local[16];
+        MakeLocal(seed, local);
+        const uint32_t parent = 0 == i || 0 == NextRandom(seed) % 100 ? TransformHierarchy::NO_PARENT : NextRandom(seed) % i;
+        hierarchy.AddNode(parent, local);
+    }
+}
+
+/// @brief Nodes at or below one of the changed nodes
+size_t AffectedNodes(const TransformHierarchy& hierarchy, const std::vector<uint32_t>& changed)
+{
+    std::vector<uint8_t> marked(hierarchy.NodeCount(), 0);
+    for (size_t i = 0; i < changed.size(); ++i)
+    {
+        marked[changed[i]] = 1;
+    }
+    size_t affected = 0;
+    for (uint32_t node = 0; node < hierarchy.NodeCount(); ++node)
+    {
+        for (uint32_t ancestor = node; TransformHierarchy::NO_PARENT != ancestor; ancestor = hierarchy.Parent(ancestor))
+        {
+            if (marked[ancestor])
+            {
+                ++affected;
+                break;
+            }
+        }
+    }
+    return affected;
+}
+
+bool SameWorld(const TransformHierarchy& a, const TransformHierarchy& b)
+{
+    for (uint32_t node = 0; node < a.NodeCount(); ++node)
+    {
+        if (0 != memcmp(a.World(node), b.World(node), 16 * sizeof(float)))
+        {
+            printf("node %u: world matrices differ\n", node);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief World matrices against local * parent local * ... * root local, walked node by node
+bool MatchesParentChains(const TransformHierarchy& hierarchy)
+{
+    double maxError = 0.0;
+    for (uint32_t node = 0; node < hierarchy.NodeCount(); ++node)
+    {
+        double world[16];
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            world[i] = hierarchy.Local(node)[i];
+        }
+        for (uint32_t ancestor = hierarchy.Parent(node); TransformHierarchy::NO_PARENT != ancestor; ancestor = hierarchy.Parent(ancestor))
+        {
+            const float* local = hierarchy.Local(ancestor);
+            double product[16];
+            for (unsigned row = 0; row < 4; ++row)
+            {
+                for (unsigned column = 0; column < 4; ++column)
+                {
+                    product[row * 4 + column] = 0.0;
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        product[row * 4 + column] += world[row * 4 + k] * local[k * 4 + column];
+                    }
+                }
+            }
+            memcpy(world, product, sizeof(world));
+        }
+
+        // Translations grow with the depth, the error is relative to the largest element
+        double scale = 1.0, error = 0.0;
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            scale = std::max(scale, fabs(world[i]));
+            error = std::max(error, fabs(world[i] - hierarchy.World(node)[i]));
+        }
+        maxError = std::max(maxError, error / scale);
+    }
+    if (maxError > 1e-5)
+    {
+        printf("world matrices differ from the parent chains by %g\n", maxError);
+        return false;
+    }
+    return true;
+}
+
+/// @brief Parents which are not nodes are rejected and leave the hierarchy unchanged
+bool RejectsInvalidParents(TransformHierarchy& hierarchy)
+{
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    const uint32_t count = static_cast<uint32_t>(hierarchy.NodeCount());
+    const uint32_t parent = hierarchy.Parent(count - 1);
+    const bool rejected = TransformHierarchy::INVALID_NODE == hierarchy.AddNode(count, identity) &&
+        !hierarchy.SetParent(count - 1, count + 10) && !hierarchy.SetParent(count, 0) &&
+        hierarchy.NodeCount() == count && hierarchy.Parent(count - 1) == parent;
+    if (!rejected)
+    {
+        printf("parent which is not a node accepted\n");
+    }
+    return rejected;
+}
+
+/// @brief Change the local matrices of random nodes, the same ones in both hierarchies
+std::vector<uint32_t> ChangeNodes(unsigned& seed, unsigned count, TransformHierarchy& a, TransformHierarchy& b)
+{
+    std::vector<uint32_t> changed(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        float local[16];
+        changed[i] = NextRandom(seed) % a.NodeCount();
+        MakeLocal(seed, local);
+        a.SetLocal(changed[i], local);
+        b.SetLocal(changed[i], local);
+    }
+    return changed;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned nodes = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 10000;
+    const unsigned changes = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 100;
+    const unsigned frames = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 200;
+    if (nodes < 2 || 0 == frames)
+    {
+        printf("Usage: transform_hierarchy_benchmark [nodes = 10000, at least 2] [changed nodes per frame = 100] [frames = 200]\n");
+        return 1;
+    }
+
+    TransformHierarchy incremental, reference;
+    MakeHierarchy(nodes, incremental);
+    MakeHierarchy(nodes, reference);
+    reference.SetSimd(false);
+    incremental.Update();
+    reference.UpdateAll();
+    bool succeeded = SameWorld(incremental, reference) && MatchesParentChains(incremental);
+    succeeded = RejectsInvalidParents(incremental) && succeeded;
+    if (incremental.LastUpdate().nodesUpdated != nodes || !incremental.LastUpdate().restructured)
+    {
+        printf("first update: %u of %u nodes updated\n", static_cast<unsigned>(incremental.LastUpdate().nodesUpdated), nodes);
+        succeeded = false;
+    }
+
+    // Incremental updates must match full ones and touch only the subtrees of the changes
+    unsigned seed = 99;
+    for (unsigned frame = 0; frame < 20 && succeeded; ++frame)
+    {
+        const std::vector<uint32_t> changed = ChangeNodes(seed, changes, incremental, reference);
+        incremental.Update();
+        reference.UpdateAll();
+        const size_t affected = AffectedNodes(incremental, changed);
+        if (incremental.LastUpdate().nodesUpdated != affected || incremental.LastUpdate().restructured)
+        {
+            printf("frame %u: %u nodes updated, %u below the changes\n", frame,
+                static_cast<unsigned>(incremental.LastUpdate().nodesUpdated), static_cast<unsigned>(affected));
+            succeeded = false;
+        }
+        succeeded = SameWorld(incremental, reference) && succeeded;
+    }
+
+    // Reparenting moves subtrees, a node can't be moved below its own descendant
+    for (unsigned i = 0; i < 50 && succeeded; ++i)
+    {
+        const uint32_t node = 1 + NextRandom(seed) % (nodes - 1);
+        const uint32_t parent = NextRandom(seed) % nodes;
+        bool cycle = false;
+        for (uint32_t ancestor = parent; TransformHierarchy::NO_PARENT != ancestor; ancestor = incremental.Parent(ancestor))
+        {
+            cycle = cycle || ancestor == node;
+        }
+        if (incremental.SetParent(node, parent) == cycle || reference.SetParent(node, parent) == cycle)
+        {
+            printf("reparenting %u below %u: cycle %s\n", node, parent, cycle ? "not detected" : "reported");
+            succeeded = false;
+        }
+    }
+    incremental.Update();
+    reference.UpdateAll();
+    succeeded = SameWorld(incremental, reference) && MatchesParentChains(incremental) && succeeded;
+    for (size_t position = 0; position < incremental.NodeCount(); ++position)
+    {
+        const uint32_t parent = incremental.Parent(incremental.NodeAt(position));
+        if (TransformHierarchy::NO_PARENT != parent && incremental.Position(parent) >= position)
+        {
+            printf("node %u stored before its parent\n", incremental.NodeAt(position));
+            succeeded = false;
+            break;
+        }
+    }
+
+    // Update cost against the number of changed nodes
+    printf("%u nodes, %u frames, SSE2 %s\n", nodes, frames, incremental.Simd() ? "available" : "not available");
+    printf("%10s %14s %14s %14s %14s\n", "changed", "nodes/frame", "incr us", "full us", "full scalar us");
+    const unsigned counts[] = { 1, 10, 100, 1000, nodes };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        const unsigned count = counts[c] < nodes ? counts[c] : nodes;
+        double milliseconds[3] = {};
+        size_t updated = 0;
+        for (unsigned mode = 0; mode < 3; ++mode)
+        {
+            unsigned frameSeed = 7;
+            incremental.SetSimd(2 != mode);
+            for (unsigned frame = 0; frame < frames; ++frame)
+            {
+                ChangeNodes(frameSeed, count, incremental, reference);
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                if (0 == mode)
+                {
+                    incremental.Update();
+                    updated += incremental.LastUpdate().nodesUpdated;
+                }
+                else
+                {
+                    incremental.UpdateAll();
+                }
+                milliseconds[mode] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+        printf("%10u %14.0f %14.2f %14.2f %14.2f\n", count, static_cast<double>(updated) / frames,
+            milliseconds[0] * 1000 / frames, milliseconds[1] * 1000 / frames, milliseconds[2] * 1000 / frames);
+        incremental.SetSimd(true);
+    }
+    reference.UpdateAll();
+    succeeded = SameWorld(incremental, reference) && succeeded;
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+/// @brief Deterministic generator, results must not depend on the platform
+/// Linear congruential step of the state, the low 8 bits of the state are dropped
+inline unsigned NextRandom(unsigned& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
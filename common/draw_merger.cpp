@@ -0,0 +1,423 @@
+#include "draw_merger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DRAW_MERGER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+/// 16-bit indices address this many vertices per draw
+const size_t MAX_BATCH_VERTICES = 0x10000;
+
+const float IDENTITY[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+/// @brief Triangle list indices of a list, strip or fan, strips keep their winding
+void AppendTriangleList(unsigned primitiveType, unsigned primitiveCount, const uint16_t* indices, std::vector<uint16_t>& out)
+{
+    for (unsigned i = 0; i < primitiveCount; ++i)
+    {
+        unsigned corners[3] = {};
+        switch (primitiveType)
+        {
+        case NULL_PT_TRIANGLELIST:
+            corners[0] = 3 * i;
+            corners[1] = 3 * i + 1;
+            corners[2] = 3 * i + 2;
+            break;
+        case NULL_PT_TRIANGLESTRIP:
+            corners[0] = i % 2 ? i + 1 : i;
+            corners[1] = i % 2 ? i : i + 1;
+            corners[2] = i + 2;
+            break;
+        case NULL_PT_TRIANGLEFAN:
+            corners[0] = 0;
+            corners[1] = i + 1;
+            corners[2] = i + 2;
+            break;
+        }
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            out.push_back(indices ? indices[corners[c]] : static_cast<uint16_t>(corners[c]));
+        }
+    }
+}
+
+/// @brief float3 times a row-major matrix in place, the translation row is added to positions only
+void TransformFloat3(const float world[16], void* vertices, size_t count, size_t stride, bool translate, bool simd)
+{
+    unsigned char* bytes = static_cast<unsigned char*>(vertices);
+
+#ifdef DRAW_MERGER_SSE2
+    // Whole row per multiply, summed in the order of the scalar path so that results are equal
+    if (simd)
+    {
+        const __m128 row0 = _mm_loadu_ps(world);
+        const __m128 row1 = _mm_loadu_ps(world + 4);
+        const __m128 row2 = _mm_loadu_ps(world + 8);
+        const __m128 row3 = translate ? _mm_loadu_ps(world + 12) : _mm_setzero_ps();
+        for (size_t i = 0; i < count; ++i, bytes += stride)
+        {
+            float* value = reinterpret_cast<float*>(bytes);
+            __m128 result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(value[0]), row0), _mm_mul_ps(_mm_set1_ps(value[1]), row1));
+            result = _mm_add_ps(_mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(value[2]), row2)), row3);
+            _mm_storel_pi(reinterpret_cast<__m64*>(value), result);
+            _mm_store_ss(value + 2, _mm_movehl_ps(result, result));
+        }
+        return;
+    }
+#else
+    (void)simd;
+#endif
+
+    for (size_t i = 0; i < count; ++i, bytes += stride)
+    {
+        float* value = reinterpret_cast<float*>(bytes);
+        const float x = value[0], y = value[1], z = value[2];
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            value[c] = x * world[c] + y * world[4 + c] + z * world[8 + c] + (translate ? world[12 + c] : 0.0f);
+        }
+    }
+}
+
+} // namespace
+
+void NullDrawBackend::SetState(const DrawState& state, unsigned changed)
+{
+    if (changed & DRAW_STATE_SHADERS)
+    {
+        m_device.SetVertexShader(state.vertexShader);
+        m_device.SetPixelShader(state.pixelShader);
+    }
+    if (changed & DRAW_STATE_TEXTURE)
+    {
+        m_device.SetTexture(0, state.texture);
+    }
+    if (changed & DRAW_STATE_VERTEX_FORMAT)
+    {
+        m_device.SetFVF(state.vertexFormat);
+    }
+    if (changed & DRAW_STATE_RENDER_STATE)
+    {
+        m_device.SetRenderState(0, state.renderState);
+    }
+}
+
+void NullDrawBackend::SetWorldMatrices(unsigned startRegister, const float* matrices, unsigned count)
+{
+    m_device.SetVertexShaderConstantF(startRegister, matrices, 4 * count);
+}
+
+void NullDrawBackend::DrawTriangles(const void* vertices, unsigned vertexCount, unsigned stride,
+    const uint16_t* indices, unsigned triangleCount)
+{
+    m_device.DrawIndexedPrimitiveUP(NULL_PT_TRIANGLELIST, 0, vertexCount, triangleCount, indices, vertices, stride);
+}
+
+std::string FormatDrawMergeReport(const DrawMergeReport& report)
+{
+    char text[512] = {};
+    snprintf(text, sizeof(text),
+        "%u objects, %u state runs\n"
+        "before merging: %u draws, %u state changes, %u matrix uploads\n"
+        "after merging:  %u draws, %u state changes, %u matrix uploads, %u vertices transformed on the CPU",
+        report.objects, report.stateRuns,
+        report.drawsBefore, report.stateChangesBefore, report.matrixUploadsBefore,
+        report.drawsAfter, report.stateChangesAfter, report.matrixUploadsAfter, report.transformedVertices);
+    return text;
+}
+
+void TransformPositions(const float world[16], void* vertices, size_t count, size_t stride, bool simd)
+{
+    TransformFloat3(world, vertices, count, stride, true, simd);
+}
+
+void TransformDirections(const float world[16], void* vertices, size_t count, size_t stride, bool simd)
+{
+    TransformFloat3(world, vertices, count, stride, false, simd);
+}
+
+const unsigned DrawMerger::NO_NORMAL;
+
+DrawMerger::DrawMerger(DrawMergeMode mode)
+    : m_mode(mode)
+    , m_worldRegister(0)
+    , m_maxMatrices(1)
+    , m_indexOffset(0)
+    , m_positionOffset(0)
+    , m_normalOffset(NO_NORMAL)
+    , m_simd(true)
+    , m_report()
+{
+}
+
+void DrawMerger::SetWorldRegisters(unsigned startRegister, unsigned maxMatrices, unsigned indexOffset)
+{
+    m_worldRegister = startRegister;
+    m_maxMatrices = std::max(maxMatrices, 1u);
+    m_indexOffset = indexOffset;
+}
+
+void DrawMerger::Submit(const DrawState& state, const float world[16], unsigned primitiveType, unsigned primitiveCount,
+    const void* vertices, unsigned stride)
+{
+    const unsigned vertexCount = PrimitiveVertexCount(primitiveType, primitiveCount);
+    if (vertexCount > MAX_BATCH_VERTICES)
+    {
+        return;
+    }
+    SubmitIndexed(state, world, primitiveType, primitiveCount, NULL, vertices, vertexCount, stride);
+}
+
+void DrawMerger::SubmitIndexed(const DrawState& state, const float world[16], unsigned primitiveType, unsigned primitiveCount,
+    const uint16_t* indices, const void* vertices, unsigned vertexCount, unsigned stride)
+{
+    if (NULL_PT_TRIANGLELIST != primitiveType && NULL_PT_TRIANGLESTRIP != primitiveType && NULL_PT_TRIANGLEFAN != primitiveType)
+    {
+        return;
+    }
+    if (0 == primitiveCount || 0 == vertexCount || vertexCount > MAX_BATCH_VERTICES)
+    {
+        return;
+    }
+
+    QueuedDraw draw;
+    draw.key = Key(state, stride);
+    draw.state = state;
+    draw.stride = stride;
+    draw.firstByte = m_vertices.size();
+    draw.vertexCount = vertexCount;
+    draw.firstIndex = m_indices.size();
+    draw.matrix = m_matrices.size();
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(vertices);
+    m_vertices.insert(m_vertices.end(), bytes, bytes + static_cast<size_t>(vertexCount) * stride);
+    AppendTriangleList(primitiveType, primitiveCount, indices, m_indices);
+    draw.indexCount = static_cast<unsigned>(m_indices.size() - draw.firstIndex);
+    m_matrices.insert(m_matrices.end(), world, world + 16);
+    m_draws.push_back(draw);
+}
+
+template <typename T>
+unsigned DrawMerger::Intern(std::map<T, unsigned>& ids, const T& value, unsigned bits)
+{
+    // Ids wrap around beyond the field width: sorting gets worse, merging compares full state
+    const unsigned id = ids.insert(std::make_pair(value, static_cast<unsigned>(ids.size()))).first->second;
+    return id & ((1u << bits) - 1);
+}
+
+size_t DrawMerger::KeyedStateHash::operator()(const KeyedState& keyed) const
+{
+    // FNV-1a over the fields, padding of the structure is not hashed
+    const uintptr_t fields[] =
+    {
+        reinterpret_cast<uintptr_t>(keyed.state.vertexShader), reinterpret_cast<uintptr_t>(keyed.state.pixelShader),
+        reinterpret_cast<uintptr_t>(keyed.state.texture), keyed.state.vertexFormat, keyed.state.renderState, keyed.stride
+    };
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        hash = (hash ^ fields[i]) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+uint64_t DrawMerger::Key(const DrawState& state, unsigned stride)
+{
+    const KeyedState keyed = { state, stride };
+    std::unordered_map<KeyedState, uint64_t, KeyedStateHash>::const_iterator found = m_keys.find(keyed);
+    if (found != m_keys.end())
+    {
+        return found->second;
+    }
+
+    const uint64_t shaders = Intern(m_shaderIds, std::make_pair(state.vertexShader, state.pixelShader), 16);
+    const uint64_t format = Intern(m_formatIds, std::make_pair(state.vertexFormat, stride), 12);
+    const uint64_t texture = Intern(m_textureIds, state.texture, 20);
+    const uint64_t renderState = Intern(m_renderStateIds, state.renderState, 16);
+    const uint64_t key = shaders << 48 | format << 36 | texture << 16 | renderState;
+    m_keys.insert(std::make_pair(keyed, key));
+    return key;
+}
+
+unsigned DrawMerger::StateChanges(const DrawState* previous, const DrawState& state)
+{
+    if (!previous)
+    {
+        return DRAW_STATE_ALL;
+    }
+
+    unsigned changed = 0;
+    if (previous->vertexShader != state.vertexShader || previous->pixelShader != state.pixelShader)
+    {
+        changed |= DRAW_STATE_SHADERS;
+    }
+    if (previous->texture != state.texture)
+    {
+        changed |= DRAW_STATE_TEXTURE;
+    }
+    if (previous->vertexFormat != state.vertexFormat)
+    {
+        changed |= DRAW_STATE_VERTEX_FORMAT;
+    }
+    if (previous->renderState != state.renderState)
+    {
+        changed |= DRAW_STATE_RENDER_STATE;
+    }
+    return changed;
+}
+
+void DrawMerger::Flush(DrawBackend& backend)
+{
+    m_report = DrawMergeReport();
+    m_report.objects = static_cast<unsigned>(m_draws.size());
+    m_report.drawsBefore = m_report.objects;
+    m_report.matrixUploadsBefore = m_report.objects;
+    for (size_t i = 0; i < m_draws.size(); ++i)
+    {
+        m_report.stateChangesBefore += StateChanges(i ? &m_draws[i - 1].state : NULL, m_draws[i].state) ? 1 : 0;
+    }
+
+    if (DRAW_MERGE_DISABLED == m_mode)
+    {
+        FlushSeparate(backend);
+    }
+    else
+    {
+        FlushMerged(backend);
+    }
+
+    m_draws.clear();
+    m_vertices.clear();
+    m_indices.clear();
+    m_matrices.clear();
+}
+
+void DrawMerger::FlushSeparate(DrawBackend& backend)
+{
+    for (size_t i = 0; i < m_draws.size(); ++i)
+    {
+        const QueuedDraw& draw = m_draws[i];
+        const unsigned changed = StateChanges(i ? &m_draws[i - 1].state : NULL, draw.state);
+        if (changed)
+        {
+            backend.SetState(draw.state, changed);
+            ++m_report.stateChangesAfter;
+            ++m_report.stateRuns;
+        }
+        backend.SetWorldMatrices(m_worldRegister, &m_matrices[draw.matrix], 1);
+        backend.DrawTriangles(&m_vertices[draw.firstByte], draw.vertexCount, draw.stride,
+            &m_indices[draw.firstIndex], draw.indexCount / 3);
+        ++m_report.matrixUploadsAfter;
+        ++m_report.drawsAfter;
+    }
+}
+
+void DrawMerger::FlushMerged(DrawBackend& backend)
+{
+    m_order.resize(m_draws.size());
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        m_order[i] = std::make_pair(m_draws[i].key, i);
+    }
+    std::sort(m_order.begin(), m_order.end());
+
+    // Positions are in world space, shaders multiply them by the identity
+    if (DRAW_MERGE_CPU_TRANSFORM == m_mode && !m_draws.empty())
+    {
+        backend.SetWorldMatrices(m_worldRegister, IDENTITY, 1);
+        ++m_report.matrixUploadsAfter;
+    }
+
+    const QueuedDraw* bound = NULL;
+    m_batchVertices.clear();
+    m_batchIndices.clear();
+    m_batchMatrices.clear();
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        const QueuedDraw& draw = m_draws[m_order[i].second];
+        const bool sameState = bound && !StateChanges(&bound->state, draw.state) && bound->stride == draw.stride;
+        m_report.stateRuns += sameState ? 0 : 1;
+
+        size_t batchVertexCount = bound ? m_batchVertices.size() / bound->stride : 0;
+        const bool full = batchVertexCount + draw.vertexCount > MAX_BATCH_VERTICES ||
+            (DRAW_MERGE_CONSTANT_ARRAY == m_mode && m_batchMatrices.size() / 16 == m_maxMatrices);
+        if (bound && (!sameState || full))
+        {
+            IssueBatch(backend, bound->stride);
+            batchVertexCount = 0;
+        }
+        if (!sameState)
+        {
+            const unsigned changed = StateChanges(bound ? &bound->state : NULL, draw.state);
+            if (changed)
+            {
+                backend.SetState(draw.state, changed);
+                ++m_report.stateChangesAfter;
+            }
+            bound = &draw;
+        }
+
+        const size_t firstByte = m_batchVertices.size();
+        const size_t bytes = static_cast<size_t>(draw.vertexCount) * draw.stride;
+        m_batchVertices.resize(firstByte + bytes);
+        unsigned char* vertices = &m_batchVertices[firstByte];
+        memcpy(vertices, &m_vertices[draw.firstByte], bytes);
+        if (DRAW_MERGE_CPU_TRANSFORM == m_mode)
+        {
+            TransformPositions(&m_matrices[draw.matrix], vertices + m_positionOffset, draw.vertexCount, draw.stride, m_simd);
+            if (NO_NORMAL != m_normalOffset)
+            {
+                TransformDirections(&m_matrices[draw.matrix], vertices + m_normalOffset, draw.vertexCount, draw.stride, m_simd);
+            }
+            m_report.transformedVertices += draw.vertexCount;
+        }
+        else
+        {
+            const float matrixIndex = static_cast<float>(m_batchMatrices.size() / 16);
+            for (unsigned v = 0; v < draw.vertexCount; ++v)
+            {
+                memcpy(vertices + static_cast<size_t>(v) * draw.stride + m_indexOffset, &matrixIndex, sizeof(matrixIndex));
+            }
+            m_batchMatrices.insert(m_batchMatrices.end(), m_matrices.begin() + draw.matrix, m_matrices.begin() + draw.matrix + 16);
+        }
+
+        const size_t firstIndex = m_batchIndices.size();
+        m_batchIndices.resize(firstIndex + draw.indexCount);
+        for (unsigned k = 0; k < draw.indexCount; ++k)
+        {
+            m_batchIndices[firstIndex + k] = static_cast<uint16_t>(batchVertexCount + m_indices[draw.firstIndex + k]);
+        }
+    }
+    if (bound)
+    {
+        IssueBatch(backend, bound->stride);
+    }
+}
+
+void DrawMerger::IssueBatch(DrawBackend& backend, unsigned stride)
+{
+    if (m_batchIndices.empty())
+    {
+        return;
+    }
+
+    if (DRAW_MERGE_CONSTANT_ARRAY == m_mode)
+    {
+        backend.SetWorldMatrices(m_worldRegister, m_batchMatrices.data(), static_cast<unsigned>(m_batchMatrices.size() / 16));
+        ++m_report.matrixUploadsAfter;
+    }
+    backend.DrawTriangles(m_batchVertices.data(), static_cast<unsigned>(m_batchVertices.size() / stride), stride,
+        m_batchIndices.data(), static_cast<unsigned>(m_batchIndices.size() / 3));
+    ++m_report.drawsAfter;
+
+    m_batchVertices.clear();
+    m_batchIndices.clear();
+    m_batchMatrices.clear();
+}
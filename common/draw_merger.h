@@ -0,0 +1,246 @@
+#pragma once
+
+#include "null_device.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// @brief Pipeline state of a draw, handles are compared by identity
+struct DrawState
+{
+    const void* vertexShader;
+    const void* pixelShader;
+    const void* texture;
+
+    /// FVF code or vertex declaration id, draws with different formats are never merged
+    uint32_t vertexFormat;
+
+    /// Application defined render state block, e.g. blending and depth mode
+    uint32_t renderState;
+};
+
+/// @brief Parts of the state which differ from the previously bound one
+enum DrawStateChange
+{
+    DRAW_STATE_SHADERS = 1,
+    DRAW_STATE_TEXTURE = 2,
+    DRAW_STATE_VERTEX_FORMAT = 4,
+    DRAW_STATE_RENDER_STATE = 8,
+    DRAW_STATE_ALL = 15
+};
+
+/// @brief How merged draws get the world matrices of their objects
+enum DrawMergeMode
+{
+    /// No merging: state, world matrix and draw of every object in submission order
+    DRAW_MERGE_DISABLED,
+
+    /// Positions and normals are transformed to world space on the CPU, merged draws use the identity
+    /// world matrix. Other direction vectors, e.g. tangents, stay in object space, so formats which
+    /// carry them are merged with the constant array
+    DRAW_MERGE_CPU_TRANSFORM,
+
+    /// World matrices are uploaded as a constant array, every vertex carries the index of its matrix
+    DRAW_MERGE_CONSTANT_ARRAY
+};
+
+/// @brief Device calls of the merged submission
+class DrawBackend
+{
+public:
+
+    virtual ~DrawBackend() {}
+
+    /// @brief Bind state, changed is a mask of DrawStateChange
+    virtual void SetState(const DrawState& state, unsigned changed) = 0;
+
+    /// @brief Row-major world matrices into consecutive vertex shader constants, 4 registers each
+    virtual void SetWorldMatrices(unsigned startRegister, const float* matrices, unsigned count) = 0;
+
+    /// @brief Indexed triangle list from user memory
+    virtual void DrawTriangles(const void* vertices, unsigned vertexCount, unsigned stride,
+        const uint16_t* indices, unsigned triangleCount) = 0;
+};
+
+/// @brief Submission to the null device, the render state block is a single render state
+class NullDrawBackend : public DrawBackend
+{
+public:
+
+    explicit NullDrawBackend(NullDevice& device) : m_device(device) {}
+
+    virtual void SetState(const DrawState& state, unsigned changed);
+    virtual void SetWorldMatrices(unsigned startRegister, const float* matrices, unsigned count);
+    virtual void DrawTriangles(const void* vertices, unsigned vertexCount, unsigned stride,
+        const uint16_t* indices, unsigned triangleCount);
+
+private:
+
+    NullDevice& m_device;
+};
+
+/// @brief Draws and state changes of one flush without and with merging
+struct DrawMergeReport
+{
+    unsigned objects;
+
+    /// One draw and one world matrix upload per object in submission order
+    unsigned drawsBefore;
+    unsigned stateChangesBefore;
+    unsigned matrixUploadsBefore;
+
+    /// Issued by the flush
+    unsigned drawsAfter;
+    unsigned stateChangesAfter;
+    unsigned matrixUploadsAfter;
+
+    /// Runs of consecutive draws with equal state after sorting
+    unsigned stateRuns;
+
+    /// Vertices transformed on the CPU
+    unsigned transformedVertices;
+};
+
+/// @brief Draws, state changes and matrix uploads before and after merging as one line
+std::string FormatDrawMergeReport(const DrawMergeReport& report);
+
+/// @brief Transform float3 positions by a row-major matrix, in place, with SSE2 where available
+void TransformPositions(const float world[16], void* vertices, size_t count, size_t stride, bool simd = true);
+
+/// @brief Transform float3 directions by the upper 3x3 of a row-major matrix, in place
+/// Same result as a vertex shader multiplying the normal by (float3x3)world: not normalized and,
+/// for non-uniform scales, not the inverse transpose, so lighting matches the unmerged draw
+void TransformDirections(const float world[16], void* vertices, size_t count, size_t stride, bool simd = true);
+
+/// @brief Submission layer which merges compatible draws
+/// Objects are queued with their state and world matrix. Flush() sorts them by a key packing
+/// shaders, vertex format, texture and render state, most expensive change first, and issues
+/// every run of equal state as few indexed draws as 16-bit indices allow. Sorting is stable,
+/// objects of equal state keep their order; draws whose order matters across states, such
+/// as blended ones, have to be flushed separately
+class DrawMerger
+{
+public:
+
+    /// @brief Normal offset of vertex formats without a normal
+    static const unsigned NO_NORMAL = ~0u;
+
+    explicit DrawMerger(DrawMergeMode mode = DRAW_MERGE_CPU_TRANSFORM);
+
+    void SetMode(DrawMergeMode mode) { m_mode = mode; }
+    DrawMergeMode Mode() const { return m_mode; }
+
+    /// @brief Vertex shader register of the world matrix, of the first one in the constant array mode
+    /// Constant array mode merges at most maxMatrices objects into one draw and writes the matrix
+    /// index as float at indexOffset of every vertex
+    void SetWorldRegisters(unsigned startRegister, unsigned maxMatrices, unsigned indexOffset);
+
+    /// @brief Byte offset of the float3 position in the vertex, 0 by default
+    void SetPositionOffset(unsigned positionOffset) { m_positionOffset = positionOffset; }
+
+    /// @brief Byte offset of the float3 normal in the vertex, NO_NORMAL by default
+    /// The CPU transform mode rotates normals with their positions, vertex formats with
+    /// a normal must set it or they are lit in object space
+    void SetNormalOffset(unsigned normalOffset) { m_normalOffset = normalOffset; }
+
+    /// @brief Disable SSE2 transform, for comparison with the scalar one
+    void SetSimd(bool enabled) { m_simd = enabled; }
+
+    /// @brief Queue a triangle list or strip, vertices and matrix are copied
+    void Submit(const DrawState& state, const float world[16], unsigned primitiveType, unsigned primitiveCount,
+        const void* vertices, unsigned stride);
+
+    /// @brief Queue an indexed triangle list or strip
+    void SubmitIndexed(const DrawState& state, const float world[16], unsigned primitiveType, unsigned primitiveCount,
+        const uint16_t* indices, const void* vertices, unsigned vertexCount, unsigned stride);
+
+    /// @brief Issue all queued objects and clear the queue
+    /// State bound by the backend before is unknown, the first draw binds all of it
+    void Flush(DrawBackend& backend);
+
+    /// @brief Report of the last flush
+    const DrawMergeReport& Report() const { return m_report; }
+
+private:
+
+    /// @brief Queued object, vertices and triangle list indices live in the shared arrays
+    struct QueuedDraw
+    {
+        uint64_t key;
+        DrawState state;
+        unsigned stride;
+        size_t firstByte;
+        unsigned vertexCount;
+        size_t firstIndex;
+        unsigned indexCount;
+        size_t matrix;
+    };
+
+    /// @brief State and vertex stride, which together decide whether draws can be merged
+    struct KeyedState
+    {
+        DrawState state;
+        unsigned stride;
+
+        bool operator==(const KeyedState& other) const
+        {
+            return state.vertexShader == other.state.vertexShader && state.pixelShader == other.state.pixelShader &&
+                state.texture == other.state.texture && state.vertexFormat == other.state.vertexFormat &&
+                state.renderState == other.state.renderState && stride == other.stride;
+        }
+    };
+
+    struct KeyedStateHash
+    {
+        size_t operator()(const KeyedState& keyed) const;
+    };
+
+    /// @brief Small id of the value, in order of the first appearance
+    template <typename T>
+    static unsigned Intern(std::map<T, unsigned>& ids, const T& value, unsigned bits);
+
+    /// @brief Sort key of the state, packed once for every distinct state
+    uint64_t Key(const DrawState& state, unsigned stride);
+
+    /// @brief Bits of the state which differ, all of them without a previous state
+    static unsigned StateChanges(const DrawState* previous, const DrawState& state);
+
+    void FlushSeparate(DrawBackend& backend);
+    void FlushMerged(DrawBackend& backend);
+
+    /// @brief Issue the merged vertices and indices and start a new batch
+    void IssueBatch(DrawBackend& backend, unsigned stride);
+
+    DrawMergeMode m_mode;
+    unsigned m_worldRegister;
+    unsigned m_maxMatrices;
+    unsigned m_indexOffset;
+    unsigned m_positionOffset;
+    unsigned m_normalOffset;
+    bool m_simd;
+
+    std::vector<QueuedDraw> m_draws;
+    std::vector<unsigned char> m_vertices;
+    std::vector<uint16_t> m_indices;
+    std::vector<float> m_matrices;
+
+    /// Sort key and queue index, sorting the pairs keeps the queue order of equal keys
+    std::vector<std::pair<uint64_t, size_t> > m_order;
+
+    /// Merged batch being built
+    std::vector<unsigned char> m_batchVertices;
+    std::vector<uint16_t> m_batchIndices;
+    std::vector<float> m_batchMatrices;
+
+    std::map<std::pair<const void*, const void*>, unsigned> m_shaderIds;
+    std::map<std::pair<uint32_t, unsigned>, unsigned> m_formatIds;
+    std::map<const void*, unsigned> m_textureIds;
+    std::map<uint32_t, unsigned> m_renderStateIds;
+    std::unordered_map<KeyedState, uint64_t, KeyedStateHash> m_keys;
+
+    DrawMergeReport m_report;
+};
@@ -0,0 +1,149 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+DynamicResolutionSettings DefaultDynamicResolutionSettings(double budgetMilliseconds)
+{
+    DynamicResolutionSettings settings;
+    settings.budgetMilliseconds = budgetMilliseconds;
+    settings.minScale = 0.5f;
+    settings.maxScale = 1.0f;
+    settings.scaleStep = 0.05f;
+    settings.decreaseThreshold = 0.95;
+    settings.decreaseDelayFrames = 4;
+    settings.increaseThreshold = 0.8;
+    settings.increaseDelayFrames = 30;
+    settings.smoothing = 0.2;
+    return settings;
+}
+
+std::string FormatDynamicResolutionLog(const std::vector<DynamicResolutionChange>& log)
+{
+    std::string text;
+    for (size_t i = 0; i < log.size(); ++i)
+    {
+        const DynamicResolutionChange& change = log[i];
+        char line[128] = {};
+        if (0 == i)
+        {
+            snprintf(line, sizeof(line), "frame %u: scale %.2f, %ux%u\n", change.frame, change.scale, change.width, change.height);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "frame %u: scale %.2f, %ux%u, frame time was %.3f ms\n",
+                change.frame, change.scale, change.width, change.height, change.milliseconds);
+        }
+        text += line;
+    }
+    return text;
+}
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings, unsigned fullWidth, unsigned fullHeight)
+    : m_settings(settings)
+    , m_fullWidth(fullWidth)
+    , m_fullHeight(fullHeight)
+    , m_scale(0.0f)
+    , m_renderWidth(0)
+    , m_renderHeight(0)
+    , m_scaleFrame(0)
+    , m_average(0.0)
+    , m_samples(0)
+    , m_newSamples(0)
+    , m_framesBelow(0)
+{
+    m_settings.minScale = std::max(m_settings.minScale, 0.01f);
+    m_settings.maxScale = std::max(m_settings.maxScale, m_settings.minScale);
+    m_settings.scaleStep = std::max(m_settings.scaleStep, 0.01f);
+    SetScale(0, Quantize(m_settings.maxScale));
+}
+
+void DynamicResolutionController::SetFullSize(unsigned fullWidth, unsigned fullHeight)
+{
+    m_fullWidth = fullWidth;
+    m_fullHeight = fullHeight;
+    m_renderWidth = std::max(1u, static_cast<unsigned>(m_fullWidth * m_scale + 0.5f));
+    m_renderHeight = std::max(1u, static_cast<unsigned>(m_fullHeight * m_scale + 0.5f));
+    m_samples = 0;
+    m_newSamples = 0;
+    m_framesBelow = 0;
+}
+
+void DynamicResolutionController::AddFrameTime(unsigned frame, double milliseconds)
+{
+    if (frame < m_scaleFrame)
+    {
+        return;
+    }
+
+    m_average = m_samples ? m_average + m_settings.smoothing * (milliseconds - m_average) : milliseconds;
+    ++m_samples;
+    ++m_newSamples;
+    m_framesBelow = m_average < m_settings.budgetMilliseconds * m_settings.increaseThreshold ? m_framesBelow + 1 : 0;
+}
+
+bool DynamicResolutionController::Update(unsigned frame)
+{
+    if (0 == m_newSamples)
+    {
+        return false;
+    }
+    m_newSamples = 0;
+
+    // Pixel count follows the square of the scale, changes aim at the middle of the band
+    const double aim = m_settings.budgetMilliseconds * (m_settings.decreaseThreshold + m_settings.increaseThreshold) / 2;
+    const bool overBudget = m_average > m_settings.budgetMilliseconds;
+    if (m_average > m_settings.budgetMilliseconds * m_settings.decreaseThreshold && m_scale > m_settings.minScale &&
+        (overBudget || m_samples >= m_settings.decreaseDelayFrames))
+    {
+        float scale = Quantize(static_cast<float>(m_scale * sqrt(aim / m_average)));
+        if (scale >= m_scale)
+        {
+            scale = Quantize(m_scale - m_settings.scaleStep);
+        }
+        if (scale < m_scale)
+        {
+            SetScale(frame, scale);
+            return true;
+        }
+    }
+    else if (m_framesBelow >= m_settings.increaseDelayFrames && m_scale < m_settings.maxScale)
+    {
+        // Only as far as the predicted time stays in the middle of the band, so that noise
+        // does not take the frame over the decrease threshold and the scale down again
+        const float scale = Quantize(static_cast<float>(m_scale * sqrt(aim / m_average)));
+        if (scale > m_scale)
+        {
+            SetScale(frame, scale);
+            return true;
+        }
+    }
+    return false;
+}
+
+float DynamicResolutionController::Quantize(float scale) const
+{
+    // Tolerance keeps exact multiples from rounding down a step
+    const float steps = floorf(scale / m_settings.scaleStep + 0.001f);
+    return std::min(std::max(steps * m_settings.scaleStep, m_settings.minScale), m_settings.maxScale);
+}
+
+void DynamicResolutionController::SetScale(unsigned frame, float scale)
+{
+    DynamicResolutionChange change;
+    change.frame = frame;
+    change.scale = scale;
+    change.width = std::max(1u, static_cast<unsigned>(m_fullWidth * scale + 0.5f));
+    change.height = std::max(1u, static_cast<unsigned>(m_fullHeight * scale + 0.5f));
+    change.milliseconds = AverageMilliseconds();
+    m_log.push_back(change);
+
+    m_scale = scale;
+    m_renderWidth = change.width;
+    m_renderHeight = change.height;
+    m_scaleFrame = frame;
+    m_samples = 0;
+    m_newSamples = 0;
+    m_framesBelow = 0;
+}
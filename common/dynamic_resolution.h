@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// @brief Budget, bounds and hysteresis of the resolution controller
+struct DynamicResolutionSettings
+{
+    /// Frame time the controller holds, e.g. 16.7 ms for 60 Hz
+    double budgetMilliseconds;
+
+    /// Bounds of the scale of both dimensions, relative to the back buffer
+    float minScale;
+    float maxScale;
+
+    /// Scales are multiples of the step, so that small variations keep the resolution
+    float scaleStep;
+
+    /// Fraction of the budget above which the scale goes down, after decreaseDelayFrames
+    /// measured frames at the current scale, at once if the frame is over the whole budget
+    double decreaseThreshold;
+    unsigned decreaseDelayFrames;
+
+    /// Fraction of the budget below which the scale goes up, only after increaseDelayFrames
+    /// measured frames in a row and only if the predicted time stays in the middle of the band
+    double increaseThreshold;
+    unsigned increaseDelayFrames;
+
+    /// Weight of a new measurement in the moving average of the frame time
+    double smoothing;
+};
+
+/// @brief Settings for the budget: 0.5 to 1.0 in steps of 0.05, down above 95% of the budget
+/// for 4 frames, up below 80% for 30 frames
+DynamicResolutionSettings DefaultDynamicResolutionSettings(double budgetMilliseconds);
+
+/// @brief Scale chosen by the controller from the given frame on
+struct DynamicResolutionChange
+{
+    unsigned frame;
+    float scale;
+    unsigned width;
+    unsigned height;
+
+    /// Average frame time at the scale before the change
+    double milliseconds;
+};
+
+/// @brief Format the log of changes, one line per change
+std::string FormatDynamicResolutionLog(const std::vector<DynamicResolutionChange>& log);
+
+/// @brief Chooses the render resolution from measured frame times
+/// Scenes render into an intermediate target of RenderWidth() x RenderHeight() which is
+/// upscaled to the back buffer. GPU time of the scene is assumed to follow the pixel count,
+/// so the scale changes by the square root of the ratio of the frame time to the middle of
+/// the hysteresis band: within a few frames when going down, after the frame time stayed
+/// low for a while when going up. Timings arrive several frames late: frames rendered before
+/// the last change are measured at the previous scale and are ignored
+class DynamicResolutionController
+{
+public:
+
+    DynamicResolutionController(const DynamicResolutionSettings& settings, unsigned fullWidth, unsigned fullHeight);
+
+    /// @brief Back buffer dimensions, the scale is kept
+    void SetFullSize(unsigned fullWidth, unsigned fullHeight);
+
+    /// @brief Measured time of a rendered frame, GPU time when available, CPU time otherwise
+    void AddFrameTime(unsigned frame, double milliseconds);
+
+    /// @brief Choose the scale of the frame about to be rendered, true if it changed
+    bool Update(unsigned frame);
+
+    float Scale() const { return m_scale; }
+    unsigned RenderWidth() const { return m_renderWidth; }
+    unsigned RenderHeight() const { return m_renderHeight; }
+
+    /// @brief Smoothed frame time at the current scale, 0 before the first measurement
+    double AverageMilliseconds() const { return m_samples ? m_average : 0.0; }
+
+    /// @brief Every change of the scale, starting with the initial one at frame 0
+    const std::vector<DynamicResolutionChange>& Log() const { return m_log; }
+
+    const DynamicResolutionSettings& Settings() const { return m_settings; }
+
+private:
+
+    /// @brief Largest multiple of the step not above the scale, within the bounds
+    float Quantize(float scale) const;
+
+    void SetScale(unsigned frame, float scale);
+
+    DynamicResolutionSettings m_settings;
+    unsigned m_fullWidth;
+    unsigned m_fullHeight;
+
+    float m_scale;
+    unsigned m_renderWidth;
+    unsigned m_renderHeight;
+
+    /// First frame rendered at the current scale
+    unsigned m_scaleFrame;
+
+    double m_average;
+    unsigned m_samples;
+
+    /// Measurements not yet seen by Update()
+    unsigned m_newSamples;
+
+    /// Consecutive measurements below the increase threshold
+    unsigned m_framesBelow;
+
+    std::vector<DynamicResolutionChange> m_log;
+};
@@ -0,0 +1,524 @@
+#include "frustum_culler.h"
+#include "task_scheduler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const uint32_t OBJECT_CHILD = 0x80000000u;
+const uint32_t EMPTY_CHILD = 0xffffffffu;
+
+/// @brief Rows of Node::bounds
+enum BoundsRow
+{
+    MIN_X, MIN_Y, MIN_Z, MAX_X, MAX_Y, MAX_Z
+};
+
+/// @brief Distance of the corner made of the rows to the plane, summed in the order of the SSE2 path
+inline float CornerDistance(const float plane[4], const float bounds[6][4], const unsigned rows[3], unsigned child)
+{
+    return ((plane[0] * bounds[rows[0]][child] + plane[1] * bounds[rows[1]][child]) + plane[2] * bounds[rows[2]][child]) + plane[3];
+}
+
+double SurfaceArea(const float min[3], const float max[3])
+{
+    const double x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+    return 2.0 * (x * y + y * z + z * x);
+}
+
+/// @brief Order the objects so that the ones before the split have the smaller centers
+/// along the axis where the centers spread the most
+void SplitObjects(std::vector<uint32_t>& objects, size_t first, size_t split, size_t end, const BoundingBox* boxes)
+{
+    if (split <= first || split >= end)
+    {
+        return;
+    }
+
+    float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = first; i < end; ++i)
+    {
+        const BoundingBox& box = boxes[objects[i]];
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            const float center = box.min[axis] + box.max[axis];
+            low[axis] = std::min(low[axis], center);
+            high[axis] = std::max(high[axis], center);
+        }
+    }
+    unsigned axis = 0;
+    for (unsigned a = 1; a < 3; ++a)
+    {
+        if (high[a] - low[a] > high[axis] - low[axis])
+        {
+            axis = a;
+        }
+    }
+
+    std::nth_element(objects.begin() + first, objects.begin() + split, objects.begin() + end,
+        [boxes, axis](uint32_t a, uint32_t b)
+        {
+            return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+        });
+}
+
+} // namespace
+
+BoundingBox ComputeBoundingBox(const float* positions, size_t stride, size_t count)
+{
+    BoundingBox box = {};
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(positions);
+    for (size_t i = 0; i < count; ++i, bytes += stride)
+    {
+        const float* position = reinterpret_cast<const float*>(bytes);
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            box.min[axis] = 0 == i ? position[axis] : std::min(box.min[axis], position[axis]);
+            box.max[axis] = 0 == i ? position[axis] : std::max(box.max[axis], position[axis]);
+        }
+    }
+    return box;
+}
+
+BoundingBox TransformBoundingBox(const BoundingBox& box, const float world[16])
+{
+    // Every world axis gets the smaller and the larger product of each local extent
+    BoundingBox result;
+    for (unsigned column = 0; column < 3; ++column)
+    {
+        result.min[column] = result.max[column] = world[12 + column];
+        for (unsigned row = 0; row < 3; ++row)
+        {
+            const float a = world[row * 4 + column] * box.min[row], b = world[row * 4 + column] * box.max[row];
+            result.min[column] += std::min(a, b);
+            result.max[column] += std::max(a, b);
+        }
+    }
+    return result;
+}
+
+Frustum ExtractFrustum(const float viewProjection[16])
+{
+    // Clip coordinates are dot products of the position with the columns of the matrix
+    Frustum frustum;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        const float* row = viewProjection + 4 * i;
+        const float x = row[0], y = row[1], z = row[2], w = row[3];
+        frustum.planes[0][i] = w + x;
+        frustum.planes[1][i] = w - x;
+        frustum.planes[2][i] = w + y;
+        frustum.planes[3][i] = w - y;
+        frustum.planes[4][i] = z;
+        frustum.planes[5][i] = w - z;
+    }
+    for (unsigned p = 0; p < 6; ++p)
+    {
+        float* plane = frustum.planes[p];
+        const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f)
+        {
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                plane[i] /= length;
+            }
+        }
+    }
+    return frustum;
+}
+
+bool BoxIntersectsFrustum(const BoundingBox& box, const Frustum& frustum)
+{
+    for (unsigned p = 0; p < 6; ++p)
+    {
+        const float* plane = frustum.planes[p];
+        const float x = plane[0] >= 0.0f ? box.max[0] : box.min[0];
+        const float y = plane[1] >= 0.0f ? box.max[1] : box.min[1];
+        const float z = plane[2] >= 0.0f ? box.max[2] : box.min[2];
+        if (((plane[0] * x + plane[1] * y) + plane[2] * z) + plane[3] < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string FormatCullStats(const CullStats& stats)
+{
+    char text[256] = {};
+    snprintf(text, sizeof(text),
+        "%u objects, %u visible, %u tested, %u accepted inside, %u nodes, %u tasks, update %.3f ms%s, cull %.3f ms",
+        static_cast<unsigned>(stats.objects), static_cast<unsigned>(stats.visible), static_cast<unsigned>(stats.objectsTested),
+        static_cast<unsigned>(stats.objectsAccepted), static_cast<unsigned>(stats.nodesVisited), static_cast<unsigned>(stats.tasks),
+        stats.updateMilliseconds, stats.rebuilt ? " (rebuilt)" : "", stats.cullMilliseconds);
+    return text;
+}
+
+FrustumCuller::FrustumCuller(unsigned threads)
+    : m_scheduler(1 == threads ? NULL : new TaskScheduler(threads))
+    , m_simd(true)
+    , m_parallelThreshold(16384)
+    , m_rebuildRatio(2.0f)
+    , m_rebuildRequested(false)
+    , m_objectCount(0)
+    , m_builtArea(0.0)
+    , m_stats()
+{
+}
+
+FrustumCuller::~FrustumCuller()
+{
+    delete m_scheduler;
+}
+
+bool FrustumCuller::Simd() const
+{
+#ifdef FRUSTUM_CULLER_SSE2
+    return m_simd;
+#else
+    return false;
+#endif
+}
+
+void FrustumCuller::Update(const BoundingBox* boxes, size_t count)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_stats.rebuilt = false;
+    if (m_rebuildRequested || count != m_objectCount)
+    {
+        Build(boxes, count);
+        m_stats.rebuilt = true;
+    }
+    else if (count && Refit(boxes) > m_rebuildRatio * m_builtArea)
+    {
+        Build(boxes, count);
+        m_stats.rebuilt = true;
+    }
+    m_stats.objects = count;
+    m_stats.updateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrustumCuller::Build(const BoundingBox* boxes, size_t count)
+{
+    m_objectCount = count;
+    m_rebuildRequested = false;
+    m_nodes.clear();
+    m_builtArea = 0.0;
+    if (0 == count)
+    {
+        return;
+    }
+    m_buildObjects.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_buildObjects[i] = static_cast<uint32_t>(i);
+    }
+    m_nodes.reserve(count / 3 + 1);
+    BuildNode(0, count, boxes);
+    m_builtArea = Refit(boxes);
+}
+
+uint32_t FrustumCuller::BuildNode(size_t first, size_t end, const BoundingBox* boxes)
+{
+    const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    Node node = {};
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        node.children[c] = EMPTY_CHILD;
+    }
+    m_nodes.push_back(node);
+
+    // Children get whole subtrees of a power of 4 objects, only the last one is partially filled,
+    // so that nodes stay full. The range is split in two and both halves in two again
+    size_t childObjects = 1;
+    while (4 * childObjects < end - first)
+    {
+        childObjects *= 4;
+    }
+    size_t groups[5];
+    for (unsigned g = 0; g < 5; ++g)
+    {
+        groups[g] = std::min(end, first + g * childObjects);
+    }
+    SplitObjects(m_buildObjects, first, groups[2], end, boxes);
+    SplitObjects(m_buildObjects, first, groups[1], groups[2], boxes);
+    SplitObjects(m_buildObjects, groups[2], groups[3], end, boxes);
+
+    // Children are built after the node, so that refits can run from the last node to the first
+    for (unsigned g = 0; g < 4 && groups[g] < end; ++g)
+    {
+        const uint32_t child = 1 == groups[g + 1] - groups[g] ?
+            OBJECT_CHILD | m_buildObjects[groups[g]] : BuildNode(groups[g], groups[g + 1], boxes);
+        m_nodes[index].children[g] = child;
+    }
+    return index;
+}
+
+double FrustumCuller::Refit(const BoundingBox* boxes)
+{
+    double area = 0.0;
+    for (size_t n = m_nodes.size(); n-- > 0;)
+    {
+        Node& node = m_nodes[n];
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            const uint32_t child = node.children[c];
+            float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            if (EMPTY_CHILD == child)
+            {
+                // Inverted box, outside of every plane
+            }
+            else if (child & OBJECT_CHILD)
+            {
+                const BoundingBox& box = boxes[child & ~OBJECT_CHILD];
+                for (unsigned axis = 0; axis < 3; ++axis)
+                {
+                    min[axis] = box.min[axis];
+                    max[axis] = box.max[axis];
+                }
+            }
+            else
+            {
+                const Node& childNode = m_nodes[child];
+#ifdef FRUSTUM_CULLER_SSE2
+                // Min and max across the lanes of every row, min and max are exact so both paths agree
+                for (unsigned axis = 0; axis < 3; ++axis)
+                {
+                    __m128 low = _mm_loadu_ps(childNode.bounds[MIN_X + axis]);
+                    __m128 high = _mm_loadu_ps(childNode.bounds[MAX_X + axis]);
+                    low = _mm_min_ps(low, _mm_shuffle_ps(low, low, _MM_SHUFFLE(1, 0, 3, 2)));
+                    high = _mm_max_ps(high, _mm_shuffle_ps(high, high, _MM_SHUFFLE(1, 0, 3, 2)));
+                    low = _mm_min_ps(low, _mm_shuffle_ps(low, low, _MM_SHUFFLE(2, 3, 0, 1)));
+                    high = _mm_max_ps(high, _mm_shuffle_ps(high, high, _MM_SHUFFLE(2, 3, 0, 1)));
+                    min[axis] = _mm_cvtss_f32(low);
+                    max[axis] = _mm_cvtss_f32(high);
+                }
+#else
+                for (unsigned axis = 0; axis < 3; ++axis)
+                {
+                    for (unsigned g = 0; g < 4; ++g)
+                    {
+                        min[axis] = std::min(min[axis], childNode.bounds[MIN_X + axis][g]);
+                        max[axis] = std::max(max[axis], childNode.bounds[MAX_X + axis][g]);
+                    }
+                }
+#endif
+            }
+            for (unsigned axis = 0; axis < 3; ++axis)
+            {
+                node.bounds[MIN_X + axis][c] = min[axis];
+                node.bounds[MAX_X + axis][c] = max[axis];
+            }
+            if (EMPTY_CHILD != child)
+            {
+                area += SurfaceArea(min, max);
+            }
+        }
+    }
+    return area;
+}
+
+void FrustumCuller::TestChildren(const Node& node, const CullPlanes& planes, unsigned& outside, unsigned& inside) const
+{
+#ifdef FRUSTUM_CULLER_SSE2
+    if (m_simd)
+    {
+        // One plane against the 4 children at a time
+        const __m128 zero = _mm_setzero_ps();
+        __m128 outsideMask = zero, crossingMask = zero;
+        for (unsigned p = 0; p < 6; ++p)
+        {
+            const float* plane = planes.planes[p];
+            const __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]), d = _mm_set1_ps(plane[3]);
+            const unsigned* farthest = planes.farthest[p];
+            const unsigned* nearest = planes.nearest[p];
+            __m128 distance = _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(node.bounds[farthest[0]])), _mm_mul_ps(b, _mm_loadu_ps(node.bounds[farthest[1]])));
+            distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(c, _mm_loadu_ps(node.bounds[farthest[2]]))), d);
+            outsideMask = _mm_or_ps(outsideMask, _mm_cmplt_ps(distance, zero));
+            distance = _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(node.bounds[nearest[0]])), _mm_mul_ps(b, _mm_loadu_ps(node.bounds[nearest[1]])));
+            distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(c, _mm_loadu_ps(node.bounds[nearest[2]]))), d);
+            crossingMask = _mm_or_ps(crossingMask, _mm_cmplt_ps(distance, zero));
+        }
+        outside = static_cast<unsigned>(_mm_movemask_ps(outsideMask));
+        inside = ~static_cast<unsigned>(_mm_movemask_ps(crossingMask)) & ~outside & 15u;
+        return;
+    }
+#endif
+
+    outside = 0;
+    inside = 15;
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        for (unsigned p = 0; p < 6; ++p)
+        {
+            if (CornerDistance(planes.planes[p], node.bounds, planes.farthest[p], c) < 0.0f)
+            {
+                outside |= 1u << c;
+            }
+            if (CornerDistance(planes.planes[p], node.bounds, planes.nearest[p], c) < 0.0f)
+            {
+                inside &= ~(1u << c);
+            }
+        }
+    }
+    inside &= ~outside;
+}
+
+void FrustumCuller::CullNode(uint32_t index, const CullPlanes& planes, std::vector<uint32_t>& stack,
+    std::vector<uint32_t>& visible, CullCounters& counters) const
+{
+    const Node& node = m_nodes[index];
+    unsigned outside = 0, inside = 0;
+    TestChildren(node, planes, outside, inside);
+    ++counters.nodesVisited;
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        const uint32_t child = node.children[c];
+        if (EMPTY_CHILD == child)
+        {
+            continue;
+        }
+        if (child & OBJECT_CHILD)
+        {
+            ++counters.objectsTested;
+            if (!(outside & (1u << c)))
+            {
+                visible.push_back(child & ~OBJECT_CHILD);
+            }
+        }
+        else if (inside & (1u << c))
+        {
+            AppendObjects(child, stack, visible, counters);
+        }
+        else if (!(outside & (1u << c)))
+        {
+            stack.push_back(child);
+        }
+    }
+}
+
+void FrustumCuller::AppendObjects(uint32_t index, std::vector<uint32_t>& stack, std::vector<uint32_t>& visible,
+    CullCounters& counters) const
+{
+    const size_t base = stack.size();
+    stack.push_back(index);
+    while (stack.size() > base)
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            const uint32_t child = node.children[c];
+            if (EMPTY_CHILD == child)
+            {
+                continue;
+            }
+            if (child & OBJECT_CHILD)
+            {
+                visible.push_back(child & ~OBJECT_CHILD);
+                ++counters.objectsAccepted;
+            }
+            else
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    visible.clear();
+    CullCounters counters = {};
+    m_stats.tasks = 0;
+
+    CullPlanes planes;
+    for (unsigned p = 0; p < 6; ++p)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            planes.planes[p][i] = frustum.planes[p][i];
+        }
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            const bool positive = frustum.planes[p][axis] >= 0.0f;
+            planes.farthest[p][axis] = (positive ? MAX_X : MIN_X) + axis;
+            planes.nearest[p][axis] = (positive ? MIN_X : MAX_X) + axis;
+        }
+    }
+
+    if (!m_nodes.empty() && m_scheduler && m_objectCount >= m_parallelThreshold)
+    {
+        // Top of the hierarchy is culled here until there are a few subtrees for every worker
+        const size_t taskTarget = 4 * (m_scheduler->WorkerCount() + 1);
+        std::vector<uint32_t> frontier(1, 0), next;
+        while (!frontier.empty() && frontier.size() < taskTarget)
+        {
+            next.clear();
+            for (size_t i = 0; i < frontier.size(); ++i)
+            {
+                CullNode(frontier[i], planes, next, visible, counters);
+            }
+            frontier.swap(next);
+        }
+
+        m_tasks.resize(frontier.size());
+        for (size_t i = 0; i < frontier.size(); ++i)
+        {
+            m_tasks[i].node = frontier[i];
+            m_scheduler->Add("CullSubtree", [this, i, &planes]() -> bool
+            {
+                CullTask& task = m_tasks[i];
+                CullCounters taskCounters = {};
+                task.visible.clear();
+                task.stack.assign(1, task.node);
+                while (!task.stack.empty())
+                {
+                    const uint32_t node = task.stack.back();
+                    task.stack.pop_back();
+                    CullNode(node, planes, task.stack, task.visible, taskCounters);
+                }
+                task.counters = taskCounters;
+                return true;
+            });
+        }
+        m_scheduler->Run();
+
+        for (size_t i = 0; i < frontier.size(); ++i)
+        {
+            const CullTask& task = m_tasks[i];
+            visible.insert(visible.end(), task.visible.begin(), task.visible.end());
+            counters.objectsTested += task.counters.objectsTested;
+            counters.objectsAccepted += task.counters.objectsAccepted;
+            counters.nodesVisited += task.counters.nodesVisited;
+        }
+        m_stats.tasks = frontier.size();
+    }
+    else if (!m_nodes.empty())
+    {
+        m_stack.assign(1, 0);
+        while (!m_stack.empty())
+        {
+            const uint32_t node = m_stack.back();
+            m_stack.pop_back();
+            CullNode(node, planes, m_stack, visible, counters);
+        }
+    }
+
+    m_stats.visible = visible.size();
+    m_stats.objectsTested = counters.objectsTested;
+    m_stats.objectsAccepted = counters.objectsAccepted;
+    m_stats.nodesVisited = counters.nodesVisited;
+    m_stats.cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
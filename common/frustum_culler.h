@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TaskScheduler;
+
+/// @brief Axis-aligned box
+struct BoundingBox
+{
+    float min[3];
+    float max[3];
+};
+
+/// @brief Box around the positions, float3 every stride bytes
+BoundingBox ComputeBoundingBox(const float* positions, size_t stride, size_t count);
+
+/// @brief Axis-aligned box around the box transformed by the row-major world matrix
+BoundingBox TransformBoundingBox(const BoundingBox& box, const float world[16]);
+
+/// @brief Planes a * x + b * y + c * z + d >= 0 of the inside, normals have unit length
+/// Order: left, right, bottom, top, near, far
+struct Frustum
+{
+    float planes[6][4];
+};
+
+/// @brief View frustum of a row-major view-projection matrix with D3D clip space, 0 <= z <= w
+Frustum ExtractFrustum(const float viewProjection[16]);
+
+/// @brief False if the box is entirely outside of one of the planes
+/// Boxes near a corner of the frustum may be reported as intersecting although they are outside
+bool BoxIntersectsFrustum(const BoundingBox& box, const Frustum& frustum);
+
+/// @brief Work of the last update and cull
+struct CullStats
+{
+    size_t objects;
+    size_t visible;
+
+    /// Object boxes tested against the planes
+    size_t objectsTested;
+
+    /// Objects accepted without a test because their subtree is entirely inside
+    size_t objectsAccepted;
+
+    /// Hierarchy nodes whose children were tested, 4 boxes each
+    size_t nodesVisited;
+
+    /// Tasks the hierarchy was split into, 0 if it was culled on the calling thread
+    size_t tasks;
+
+    /// The hierarchy was built again in the last update instead of refitted
+    bool rebuilt;
+
+    double updateMilliseconds;
+    double cullMilliseconds;
+};
+
+/// @brief Objects, visible, tested and time as one line
+std::string FormatCullStats(const CullStats& stats);
+
+/// @brief Frustum culling of object boxes over a bounding volume hierarchy
+/// Every node holds the boxes of up to 4 children, nodes or objects, as arrays of each
+/// coordinate, so one node is tested against a plane with one SSE2 operation per coordinate.
+/// Children outside of a plane are skipped, children inside of all planes are accepted with
+/// everything below them, the others are descended into. Update() refits the boxes of the
+/// existing hierarchy to moved objects and builds it again when the number of objects changes
+/// or refitting made the boxes of the nodes too large. Large scenes are split into subtrees
+/// culled in parallel on a TaskScheduler
+class FrustumCuller
+{
+public:
+
+    /// @brief Worker threads of the parallel cull, 0 means one per hardware thread, 1 culls on the calling thread
+    explicit FrustumCuller(unsigned threads = 1);
+    ~FrustumCuller();
+
+    /// @brief Disable SSE2 plane tests, for comparison with the scalar ones
+    void SetSimd(bool enabled) { m_simd = enabled; }
+    bool Simd() const;
+
+    /// @brief Scenes of at least this many objects are culled in parallel, 16384 by default
+    void SetParallelThreshold(size_t objects) { m_parallelThreshold = objects; }
+
+    /// @brief Growth of the total node surface area by refits which causes a rebuild, 2 by default
+    void SetRebuildRatio(float ratio) { m_rebuildRatio = ratio; }
+
+    /// @brief World space boxes of the objects, indexed by object
+    void Update(const BoundingBox* boxes, size_t count);
+
+    /// @brief Build the hierarchy again on the next Update()
+    void RequestRebuild() { m_rebuildRequested = true; }
+
+    /// @brief Indices of the objects intersecting the frustum, in hierarchy order
+    void Cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+    const CullStats& Stats() const { return m_stats; }
+    size_t NodeCount() const { return m_nodes.size(); }
+
+private:
+
+    FrustumCuller(const FrustumCuller&);
+    FrustumCuller& operator=(const FrustumCuller&);
+
+    /// @brief Boxes of 4 children, minX, minY, minZ, maxX, maxY, maxZ of every child
+    struct Node
+    {
+        float bounds[6][4];
+
+        /// Node index, object index with OBJECT_CHILD set, or EMPTY_CHILD
+        uint32_t children[4];
+    };
+
+    /// @brief Frustum prepared for the tests
+    /// For every plane, the rows of the node bounds which give the corner farthest along
+    /// the normal, whose distance decides outside, and the nearest one, which decides inside
+    struct CullPlanes
+    {
+        float planes[6][4];
+        unsigned farthest[6][3];
+        unsigned nearest[6][3];
+    };
+
+    struct CullCounters
+    {
+        size_t objectsTested;
+        size_t objectsAccepted;
+        size_t nodesVisited;
+    };
+
+    /// @brief Work of one subtree of the parallel cull
+    struct CullTask
+    {
+        uint32_t node;
+        std::vector<uint32_t> visible;
+        std::vector<uint32_t> stack;
+        CullCounters counters;
+    };
+
+    void Build(const BoundingBox* boxes, size_t count);
+
+    /// @brief Node of the objects in [first, end) of m_buildObjects, its children are built after it
+    uint32_t BuildNode(size_t first, size_t end, const BoundingBox* boxes);
+
+    /// @brief Node bounds from the object boxes, returns the total surface area of the child boxes
+    double Refit(const BoundingBox* boxes);
+
+    /// @brief Test the children of the node, push visible objects and the nodes to descend into
+    void CullNode(uint32_t node, const CullPlanes& planes, std::vector<uint32_t>& stack,
+        std::vector<uint32_t>& visible, CullCounters& counters) const;
+
+    /// @brief Bits of the children outside of a plane and inside of all planes
+    void TestChildren(const Node& node, const CullPlanes& planes, unsigned& outside, unsigned& inside) const;
+
+    /// @brief All objects below the node
+    void AppendObjects(uint32_t node, std::vector<uint32_t>& stack, std::vector<uint32_t>& visible,
+        CullCounters& counters) const;
+
+    TaskScheduler* m_scheduler;
+    bool m_simd;
+    size_t m_parallelThreshold;
+    float m_rebuildRatio;
+    bool m_rebuildRequested;
+
+    std::vector<Node> m_nodes;
+    size_t m_objectCount;
+
+    /// Surface area of the child boxes after the last build
+    double m_builtArea;
+
+    /// Objects reordered while building
+    std::vector<uint32_t> m_buildObjects;
+
+    std::vector<uint32_t> m_stack;
+    std::vector<CullTask> m_tasks;
+    CullStats m_stats;
+};
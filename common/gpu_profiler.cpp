@@ -0,0 +1,328 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+double Milliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+void* NullGpuQueries::CreateQuery(GpuQueryType type)
+{
+    return const_cast<void*>(m_device.CreateQuery(static_cast<unsigned>(type)));
+}
+
+void NullGpuQueries::ReleaseQuery(void* query)
+{
+    m_device.ReleaseQuery(query);
+}
+
+void NullGpuQueries::IssueBegin(void* query)
+{
+    m_device.IssueQuery(query, NULL_ISSUE_BEGIN);
+}
+
+void NullGpuQueries::IssueEnd(void* query)
+{
+    m_device.IssueQuery(query, NULL_ISSUE_END);
+}
+
+GpuQueryStatus NullGpuQueries::GetData(void* query, uint64_t& value)
+{
+    return m_device.GetQueryData(query, value) ? GPU_QUERY_READY : GPU_QUERY_PENDING;
+}
+
+std::string FormatGpuFrameTiming(const GpuFrameTiming& timing)
+{
+    char text[256] = {};
+    snprintf(text, sizeof(text), "frame %u: cpu %.3f ms, gpu %.3f ms, read back %u frames later",
+        timing.frame, timing.cpuMilliseconds, timing.gpuMilliseconds, timing.readbackLatency);
+    std::string line = text;
+    for (size_t i = 0; i < timing.passes.size(); ++i)
+    {
+        const GpuPassTiming& pass = timing.passes[i];
+        snprintf(text, sizeof(text), "; %s%s %.3f / %.3f ms", std::string(pass.depth, '>').c_str(),
+            pass.name.c_str(), pass.cpuMilliseconds, pass.gpuMilliseconds);
+        line += text;
+    }
+    return line;
+}
+
+GpuProfiler::GpuProfiler(GpuQueryBackend& backend, unsigned frameLatency)
+    : m_backend(backend)
+    , m_supported(false)
+    , m_slots(std::max(frameLatency, 1u))
+    , m_frame(0)
+    , m_nextResolve(0)
+    , m_recording(NULL)
+    , m_stats()
+{
+    // Timestamps are only meaningful together with the frequency and disjoint queries
+    FrameSlot& slot = m_slots[0];
+    slot.disjoint = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP_DISJOINT);
+    slot.frequency = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP_FREQ);
+    void* timestamp = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP);
+    if (timestamp)
+    {
+        slot.timestamps.push_back(timestamp);
+    }
+    m_supported = slot.disjoint && slot.frequency && timestamp;
+    m_stats.queriesCreated = (slot.disjoint ? 1 : 0) + (slot.frequency ? 1 : 0) + (timestamp ? 1 : 0);
+
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        m_slots[i].state = SLOT_FREE;
+        m_slots[i].frame = 0;
+        m_slots[i].usedTimestamps = 0;
+        m_slots[i].frameEnd = 0;
+        m_slots[i].passCount = 0;
+        if (i > 0)
+        {
+            m_slots[i].disjoint = m_slots[i].frequency = NULL;
+        }
+    }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        FrameSlot& slot = m_slots[i];
+        if (slot.disjoint)
+        {
+            m_backend.ReleaseQuery(slot.disjoint);
+        }
+        if (slot.frequency)
+        {
+            m_backend.ReleaseQuery(slot.frequency);
+        }
+        for (size_t t = 0; t < slot.timestamps.size(); ++t)
+        {
+            m_backend.ReleaseQuery(slot.timestamps[t]);
+        }
+    }
+}
+
+void GpuProfiler::BeginFrame()
+{
+    if (m_recording)
+    {
+        EndFrame();
+    }
+    Poll();
+
+    FrameSlot& slot = m_slots[m_frame % m_slots.size()];
+    if (SLOT_IN_FLIGHT == slot.state)
+    {
+        // Results are late, waiting for them would stall the CPU on the GPU
+        ++m_stats.framesDropped;
+    }
+
+    slot.state = SLOT_RECORDING;
+    slot.frame = m_frame++;
+    slot.usedTimestamps = 0;
+    slot.passCount = 0;
+    m_openPasses.clear();
+    m_recording = &slot;
+
+    if (m_supported)
+    {
+        if (!slot.disjoint)
+        {
+            slot.disjoint = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP_DISJOINT);
+            slot.frequency = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP_FREQ);
+            m_stats.queriesCreated += 2;
+        }
+        m_backend.IssueBegin(slot.disjoint);
+    }
+    IssueTimestamp(slot);
+    slot.cpuBegin = Clock::now();
+}
+
+void GpuProfiler::EndFrame()
+{
+    if (!m_recording)
+    {
+        return;
+    }
+
+    while (!m_openPasses.empty())
+    {
+        EndPass();
+    }
+
+    FrameSlot& slot = *m_recording;
+    slot.cpuEnd = Clock::now();
+    slot.frameEnd = IssueTimestamp(slot);
+    if (m_supported)
+    {
+        m_backend.IssueEnd(slot.frequency);
+        m_backend.IssueEnd(slot.disjoint);
+    }
+    slot.state = SLOT_IN_FLIGHT;
+    m_recording = NULL;
+    ++m_stats.framesIssued;
+}
+
+void GpuProfiler::BeginPass(const std::string& name)
+{
+    if (!m_recording)
+    {
+        return;
+    }
+
+    FrameSlot& slot = *m_recording;
+    if (slot.passCount == slot.passes.size())
+    {
+        slot.passes.push_back(PassRecord());
+    }
+    PassRecord& pass = slot.passes[slot.passCount];
+    pass.name = name;
+    pass.depth = static_cast<unsigned>(m_openPasses.size());
+    pass.beginQuery = IssueTimestamp(slot);
+    pass.endQuery = pass.beginQuery;
+    pass.cpuBegin = Clock::now();
+    m_openPasses.push_back(slot.passCount++);
+}
+
+void GpuProfiler::EndPass()
+{
+    if (!m_recording || m_openPasses.empty())
+    {
+        return;
+    }
+
+    PassRecord& pass = m_recording->passes[m_openPasses.back()];
+    m_openPasses.pop_back();
+    pass.cpuEnd = Clock::now();
+    pass.endQuery = IssueTimestamp(*m_recording);
+}
+
+bool GpuProfiler::PopFrame(GpuFrameTiming& timing)
+{
+    Poll();
+    if (m_resolved.empty())
+    {
+        return false;
+    }
+    timing = m_resolved.front();
+    m_resolved.pop_front();
+    return true;
+}
+
+size_t GpuProfiler::IssueTimestamp(FrameSlot& slot)
+{
+    if (!m_supported)
+    {
+        return 0;
+    }
+
+    if (slot.usedTimestamps == slot.timestamps.size())
+    {
+        void* query = m_backend.CreateQuery(GPU_QUERY_TIMESTAMP);
+        if (!query)
+        {
+            return 0;
+        }
+        slot.timestamps.push_back(query);
+        ++m_stats.queriesCreated;
+    }
+    m_backend.IssueEnd(slot.timestamps[slot.usedTimestamps]);
+    return slot.usedTimestamps++;
+}
+
+void GpuProfiler::Poll()
+{
+    // GPU executes frames in order, a pending frame means the later ones are pending too
+    const unsigned ended = m_recording ? m_frame - 1 : m_frame;
+    for (; m_nextResolve < ended; ++m_nextResolve)
+    {
+        FrameSlot& slot = m_slots[m_nextResolve % m_slots.size()];
+        if (SLOT_IN_FLIGHT != slot.state || slot.frame != m_nextResolve)
+        {
+            continue;
+        }
+
+        GpuFrameTiming timing;
+        const GpuQueryStatus status = Resolve(slot, timing);
+        if (GPU_QUERY_PENDING == status)
+        {
+            break;
+        }
+
+        slot.state = SLOT_FREE;
+        if (GPU_QUERY_FAILED == status)
+        {
+            continue;
+        }
+
+        ++m_stats.framesResolved;
+        m_resolved.push_back(timing);
+        if (m_resolved.size() > MAX_RESOLVED_FRAMES)
+        {
+            m_resolved.pop_front();
+        }
+    }
+}
+
+GpuQueryStatus GpuProfiler::Resolve(const FrameSlot& slot, GpuFrameTiming& timing)
+{
+    timing.frame = slot.frame;
+    timing.cpuMilliseconds = Milliseconds(slot.cpuEnd - slot.cpuBegin);
+    timing.gpuMilliseconds = 0.0;
+    timing.readbackLatency = m_frame - slot.frame - 1;
+    timing.passes.resize(slot.passCount);
+    for (size_t i = 0; i < slot.passCount; ++i)
+    {
+        timing.passes[i].name = slot.passes[i].name;
+        timing.passes[i].depth = slot.passes[i].depth;
+        timing.passes[i].cpuMilliseconds = Milliseconds(slot.passes[i].cpuEnd - slot.passes[i].cpuBegin);
+        timing.passes[i].gpuMilliseconds = 0.0;
+    }
+    if (!m_supported)
+    {
+        return GPU_QUERY_READY;
+    }
+
+    // Disjoint query ends last, once it is ready all timestamps of the frame are
+    uint64_t disjoint = 0, frequency = 0;
+    GpuQueryStatus status = m_backend.GetData(slot.disjoint, disjoint);
+    if (GPU_QUERY_READY == status)
+    {
+        status = m_backend.GetData(slot.frequency, frequency);
+    }
+    m_ticks.assign(slot.usedTimestamps, 0);
+    for (size_t i = 0; i < slot.usedTimestamps && GPU_QUERY_READY == status; ++i)
+    {
+        status = m_backend.GetData(slot.timestamps[i], m_ticks[i]);
+    }
+    if (GPU_QUERY_FAILED == status)
+    {
+        ++m_stats.framesDropped;
+    }
+    if (GPU_QUERY_READY != status)
+    {
+        return status;
+    }
+
+    if (disjoint || 0 == frequency || slot.frameEnd >= m_ticks.size())
+    {
+        ++m_stats.framesDisjoint;
+        return GPU_QUERY_FAILED;
+    }
+
+    const double millisecondsPerTick = 1000.0 / frequency;
+    timing.gpuMilliseconds = (m_ticks[slot.frameEnd] - m_ticks[0]) * millisecondsPerTick;
+    for (size_t i = 0; i < slot.passCount; ++i)
+    {
+        const PassRecord& pass = slot.passes[i];
+        timing.passes[i].gpuMilliseconds = (m_ticks[pass.endQuery] - m_ticks[pass.beginQuery]) * millisecondsPerTick;
+    }
+    return GPU_QUERY_READY;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "null_device.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/// @brief Query types used by the profiler, values match D3DQUERYTYPE
+enum GpuQueryType
+{
+    GPU_QUERY_TIMESTAMP = 10,
+    GPU_QUERY_TIMESTAMP_DISJOINT = 11,
+    GPU_QUERY_TIMESTAMP_FREQ = 12
+};
+
+enum GpuQueryStatus
+{
+    GPU_QUERY_READY,
+    GPU_QUERY_PENDING,
+
+    /// Device lost or query failed, the frame is discarded
+    GPU_QUERY_FAILED
+};
+
+/// @brief Queries of a Direct3D 9 device or of an emulating backend
+class GpuQueryBackend
+{
+public:
+
+    virtual ~GpuQueryBackend() {}
+
+    /// @brief NULL if the device does not support the query type
+    virtual void* CreateQuery(GpuQueryType type) = 0;
+    virtual void ReleaseQuery(void* query) = 0;
+
+    /// @brief Begin is issued only for disjoint queries
+    virtual void IssueBegin(void* query) = 0;
+    virtual void IssueEnd(void* query) = 0;
+
+    /// @brief Result without flushing or waiting
+    /// Timestamps and frequency as ticks, disjoint as 0 or 1
+    virtual GpuQueryStatus GetData(void* query, uint64_t& value) = 0;
+};
+
+/// @brief Queries emulated by the null device
+class NullGpuQueries : public GpuQueryBackend
+{
+public:
+
+    explicit NullGpuQueries(NullDevice& device) : m_device(device) {}
+
+    virtual void* CreateQuery(GpuQueryType type);
+    virtual void ReleaseQuery(void* query);
+    virtual void IssueBegin(void* query);
+    virtual void IssueEnd(void* query);
+    virtual GpuQueryStatus GetData(void* query, uint64_t& value);
+
+private:
+
+    NullDevice& m_device;
+};
+
+/// @brief CPU and GPU time of one pass
+struct GpuPassTiming
+{
+    std::string name;
+
+    /// Nesting level, 0 for passes opened directly in the frame
+    unsigned depth;
+
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+};
+
+/// @brief Timings of a frame, available several frames after it was rendered
+struct GpuFrameTiming
+{
+    /// Index counted by GpuProfiler::BeginFrame()
+    unsigned frame;
+
+    /// BeginFrame() to EndFrame() on the CPU, first to last timestamp on the GPU
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+
+    /// Frames rendered between this one and its readback
+    unsigned readbackLatency;
+
+    std::vector<GpuPassTiming> passes;
+};
+
+struct GpuProfilerStats
+{
+    unsigned framesIssued;
+    unsigned framesResolved;
+
+    /// GPU clock was not continuous, timestamps are meaningless
+    unsigned framesDisjoint;
+
+    /// Results were not available when the ring slot was needed again or a query failed
+    unsigned framesDropped;
+
+    unsigned queriesCreated;
+};
+
+/// @brief Frame timing as a single log line: frame totals, then CPU / GPU milliseconds of every pass
+std::string FormatGpuFrameTiming(const GpuFrameTiming& timing);
+
+/// @brief Per-pass GPU timestamps read back asynchronously
+/// Every frame is bracketed by a disjoint query and a frequency query, every pass by two
+/// timestamps. Queries of a frame live in one slot of a ring of frameLatency slots and are
+/// polled without flushing, so results are read when they are ready, usually a few frames
+/// later. The profiler never waits: if the results of a slot are still not available when
+/// the slot is needed again, the frame is dropped. CPU time of the frame and of every pass
+/// is measured alongside and reported together with the GPU time
+class GpuProfiler
+{
+public:
+
+    /// @brief Queries are created on demand from the backend, which must outlive the profiler
+    explicit GpuProfiler(GpuQueryBackend& backend, unsigned frameLatency = 4);
+
+    /// @brief Release all queries, frames in flight are discarded
+    ~GpuProfiler();
+
+    /// @brief False if the device has no timestamp queries, the profiler measures CPU time only
+    bool Supported() const { return m_supported; }
+
+    /// @brief Poll the frames in flight, then start a frame in the next ring slot
+    void BeginFrame();
+
+    /// @brief Close the passes left open and issue the end of the frame, before Present
+    void EndFrame();
+
+    /// @brief Passes nest, EndPass() closes the innermost open pass
+    void BeginPass(const std::string& name);
+    void EndPass();
+
+    /// @brief Oldest resolved frame not returned yet, false if there is none
+    /// Frames in flight are polled first. Frames which are never popped are dropped
+    /// from the queue after MAX_RESOLVED_FRAMES
+    bool PopFrame(GpuFrameTiming& timing);
+
+    const GpuProfilerStats& Stats() const { return m_stats; }
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t MAX_RESOLVED_FRAMES = 64;
+
+    struct PassRecord
+    {
+        std::string name;
+        unsigned depth;
+        size_t beginQuery;
+        size_t endQuery;
+        Clock::time_point cpuBegin;
+        Clock::time_point cpuEnd;
+    };
+
+    enum SlotState
+    {
+        SLOT_FREE,
+        SLOT_RECORDING,
+        SLOT_IN_FLIGHT
+    };
+
+    /// @brief Queries and passes of one frame, timestamp 0 and frameEnd bracket the frame
+    struct FrameSlot
+    {
+        SlotState state;
+        unsigned frame;
+        void* disjoint;
+        void* frequency;
+        std::vector<void*> timestamps;
+        size_t usedTimestamps;
+        size_t frameEnd;
+        std::vector<PassRecord> passes;
+        size_t passCount;
+        Clock::time_point cpuBegin;
+        Clock::time_point cpuEnd;
+    };
+
+    GpuProfiler(const GpuProfiler&);
+    GpuProfiler& operator=(const GpuProfiler&);
+
+    /// @brief Issue the next timestamp of the recording slot, its index in the slot
+    size_t IssueTimestamp(FrameSlot& slot);
+
+    /// @brief Resolve the frames in flight in order, stop at the first pending one
+    void Poll();
+
+    /// @brief GPU_QUERY_READY if the timing was filled in, failed and disjoint frames are counted
+    GpuQueryStatus Resolve(const FrameSlot& slot, GpuFrameTiming& timing);
+
+    GpuQueryBackend& m_backend;
+    bool m_supported;
+    std::vector<FrameSlot> m_slots;
+
+    /// Frames begun so far and the oldest one which may still be in flight
+    unsigned m_frame;
+    unsigned m_nextResolve;
+
+    FrameSlot* m_recording;
+    std::vector<size_t> m_openPasses;
+    std::deque<GpuFrameTiming> m_resolved;
+    std::vector<uint64_t> m_ticks;
+    GpuProfilerStats m_stats;
+};
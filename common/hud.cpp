@@ -0,0 +1,327 @@
+#include "hud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+
+/// Rows of the glyphs from the top, bit 4 is the leftmost pixel
+const uint8_t GLYPHS[][7] =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04,  0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00,  0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a,
+    0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04,  0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03,  0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d,  0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02,  0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08,  0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00,  0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08,  0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c,  0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00,
+    0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e,  0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e,  0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f,  0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e,
+    0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02,  0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e,  0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e,  0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08,
+    0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e,  0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c,  0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00,  0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08,
+    0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02,  0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00,  0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08,  0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04,
+    0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e,  0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11,  0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e,  0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e,
+    0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c,  0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f,  0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10,  0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f,
+    0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11,  0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e,  0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c,  0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f,  0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11,  0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11,  0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,
+    0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10,  0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d,  0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11,  0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e,
+    0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,  0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04,  0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a,
+    0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11,  0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04,  0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f,  0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e,
+    0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00,  0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e,  0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f,
+    0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f,  0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e,  0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e,
+    0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f,  0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e,  0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08,  0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e,
+    0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11,  0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e,  0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c,  0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12,
+    0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e,  0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11,  0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11,  0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e,
+    0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10,  0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01,  0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10,  0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e,
+    0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06,  0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d,  0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04,  0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a,
+    0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11,  0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e,  0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f,  0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02,
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08,  0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00
+};
+
+const unsigned FIRST_CHARACTER = 32;
+const unsigned CHARACTER_COUNT = sizeof(GLYPHS) / sizeof(GLYPHS[0]);
+const unsigned SOLID_CELL = CHARACTER_COUNT;
+
+const uint32_t TEXT_COLOR = 0xffffffff;
+const uint32_t LABEL_COLOR = 0xffa0c8ff;
+const uint32_t PANEL_COLOR = 0xa0000000;
+const uint32_t BAR_COLOR = 0xff40d040;
+const uint32_t SLOW_BAR_COLOR = 0xffe04040;
+const uint32_t P99_COLOR = 0xffffd040;
+
+/// Graph height in font texels, scaled like the text
+const unsigned GRAPH_HEIGHT = 24;
+
+/// @brief Smallest multiple of 5 ms not below the frame time, the top of the graph
+double GraphTop(double milliseconds)
+{
+    return std::max(5.0, ceil(milliseconds / 5.0) * 5.0);
+}
+
+} // namespace
+
+HudFontAtlas BuildHudFontAtlas()
+{
+    HudFontAtlas atlas;
+    atlas.cellWidth = 6;
+    atlas.cellHeight = 8;
+    atlas.columns = 16;
+    atlas.width = 128;
+    atlas.height = 64;
+    atlas.alpha.assign(atlas.width * atlas.height, 0);
+
+    for (unsigned cell = 0; cell <= SOLID_CELL; ++cell)
+    {
+        const unsigned left = cell % atlas.columns * atlas.cellWidth, top = cell / atlas.columns * atlas.cellHeight;
+        for (unsigned y = 0; y < atlas.cellHeight; ++y)
+        {
+            for (unsigned x = 0; x < atlas.cellWidth; ++x)
+            {
+                const bool set = SOLID_CELL == cell || (x < 5 && y < 7 && (GLYPHS[cell][y] >> (4 - x) & 1));
+                atlas.alpha[(top + y) * atlas.width + left + x] = set ? 255 : 0;
+            }
+        }
+    }
+    return atlas;
+}
+
+bool NullHudBackend::Upload(const HudVertex* vertices, unsigned vertexCount)
+{
+    m_buffer.assign(vertices, vertices + vertexCount);
+    return true;
+}
+
+void NullHudBackend::Draw(unsigned vertexCount)
+{
+    m_device.SetTexture(0, &m_atlas);
+    m_device.SetFVF(HUD_VERTEX_FVF);
+    m_device.DrawPrimitiveUP(NULL_PT_TRIANGLELIST, std::min(vertexCount, static_cast<unsigned>(m_buffer.size())) / 3,
+        m_buffer.data(), sizeof(HudVertex));
+}
+
+PerformanceHud::PerformanceHud(unsigned updateIntervalFrames, unsigned historyFrames)
+    : m_updateInterval(std::max(updateIntervalFrames, 1u))
+    , m_historyFrames(std::max(historyFrames, 1u))
+    , m_enabled(true)
+    , m_dirty(true)
+    , m_x(8.0f)
+    , m_y(8.0f)
+    , m_scale(2)
+    , m_font(BuildHudFontAtlas())
+    , m_historyNext(0)
+    , m_intervalMilliseconds(0.0)
+    , m_intervalFrames(0)
+    , m_intervalDraws(0)
+    , m_intervalStateChanges(0)
+    , m_gpuMilliseconds(-1.0)
+    , m_p99(0.0)
+    , m_p99Bar(0)
+    , m_version(0)
+    , m_uploadedVersion(0)
+    , m_stats()
+{
+    m_history.reserve(m_historyFrames);
+}
+
+void PerformanceHud::SetEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    m_dirty = true;
+}
+
+void PerformanceHud::SetShaderNames(const std::vector<std::string>& names)
+{
+    if (names != m_shaderNames)
+    {
+        m_shaderNames = names;
+        m_dirty = true;
+    }
+}
+
+bool PerformanceHud::AddFrame(double milliseconds, const DeviceCounters& frameCounters)
+{
+    ++m_stats.frames;
+    if (m_history.size() < m_historyFrames)
+    {
+        m_history.push_back(milliseconds);
+    }
+    else
+    {
+        m_history[m_historyNext] = milliseconds;
+    }
+    m_historyNext = (m_historyNext + 1) % m_historyFrames;
+
+    // Same sum as the draw merging benchmark reports as state changes
+    m_intervalMilliseconds += milliseconds;
+    m_intervalDraws += frameCounters.draws;
+    m_intervalStateChanges += frameCounters.textureBinds + frameCounters.renderStateChanges +
+        frameCounters.samplerStateChanges + frameCounters.shaderBinds;
+    if (++m_intervalFrames < m_updateInterval && !(m_dirty && m_enabled))
+    {
+        return false;
+    }
+
+    ++m_stats.intervals;
+    bool changed = false;
+    if (m_enabled && (Layout() || m_dirty))
+    {
+        BuildVertices();
+        ++m_stats.rebuilds;
+        ++m_version;
+        m_dirty = false;
+        changed = true;
+    }
+    m_intervalMilliseconds = 0.0;
+    m_intervalFrames = 0;
+    m_intervalDraws = 0;
+    m_intervalStateChanges = 0;
+    return changed;
+}
+
+void PerformanceHud::Draw(HudBackend& backend)
+{
+    if (!m_enabled || m_vertices.empty())
+    {
+        return;
+    }
+    if (m_uploadedVersion != m_version)
+    {
+        if (!backend.Upload(m_vertices.data(), static_cast<unsigned>(m_vertices.size())))
+        {
+            return;
+        }
+        m_uploadedVersion = m_version;
+        ++m_stats.uploads;
+    }
+    backend.Draw(static_cast<unsigned>(m_vertices.size()));
+    ++m_stats.draws;
+}
+
+bool PerformanceHud::Layout()
+{
+    // Nearest rank percentile of the history window
+    m_sorted.assign(m_history.begin(), m_history.end());
+    const size_t rank = (m_sorted.size() * 99 + 99) / 100 - 1;
+    std::nth_element(m_sorted.begin(), m_sorted.begin() + rank, m_sorted.end());
+    m_p99 = m_sorted[rank];
+    const double top = GraphTop(*std::max_element(m_history.begin(), m_history.end()));
+
+    const double frames = m_intervalFrames ? m_intervalFrames : 1;
+    const double average = m_intervalMilliseconds / frames;
+    std::vector<std::string> lines;
+    char line[256] = {};
+    snprintf(line, sizeof(line), "frame %.2f ms  %.1f fps  p99 %.2f ms", average, average > 0 ? 1000.0 / average : 0.0, m_p99);
+    lines.push_back(line);
+    if (m_gpuMilliseconds >= 0.0)
+    {
+        snprintf(line, sizeof(line), "gpu %.2f ms", m_gpuMilliseconds);
+        lines.push_back(line);
+    }
+    snprintf(line, sizeof(line), "%.0f draws  %.0f state changes per frame", m_intervalDraws / frames, m_intervalStateChanges / frames);
+    lines.push_back(line);
+    for (size_t i = 0; i < m_shaderNames.size(); ++i)
+    {
+        lines.push_back(m_shaderNames[i]);
+    }
+    snprintf(line, sizeof(line), "last %u frames, 0-%.0f ms", static_cast<unsigned>(m_history.size()), top);
+    lines.push_back(line);
+
+    // Bar heights in font texels, oldest frame on the left
+    std::vector<unsigned> bars(m_history.size());
+    const size_t oldest = m_history.size() < m_historyFrames ? 0 : m_historyNext;
+    for (size_t i = 0; i < bars.size(); ++i)
+    {
+        const double milliseconds = m_history[(oldest + i) % m_history.size()];
+        bars[i] = std::max(1u, static_cast<unsigned>(milliseconds / top * GRAPH_HEIGHT * m_scale + 0.5));
+    }
+    const unsigned p99Bar = static_cast<unsigned>(m_p99 / top * GRAPH_HEIGHT * m_scale + 0.5);
+
+    if (lines == m_lines && bars == m_bars && p99Bar == m_p99Bar)
+    {
+        return false;
+    }
+    m_lines.swap(lines);
+    m_bars.swap(bars);
+    m_p99Bar = p99Bar;
+    return true;
+}
+
+void PerformanceHud::BuildVertices()
+{
+    m_vertices.clear();
+    const float cellWidth = static_cast<float>(m_font.cellWidth * m_scale);
+    const float cellHeight = static_cast<float>(m_font.cellHeight * m_scale);
+    const float padding = static_cast<float>(2 * m_scale);
+    const float graphHeight = static_cast<float>(GRAPH_HEIGHT * m_scale);
+
+    size_t columns = 0;
+    for (size_t i = 0; i < m_lines.size(); ++i)
+    {
+        columns = std::max(columns, m_lines[i].size());
+    }
+    const float width = std::max(columns * cellWidth, static_cast<float>(m_bars.size() * m_scale));
+    const float height = m_lines.size() * cellHeight + graphHeight;
+    AddSolid(m_x - padding, m_y - padding, width + 2 * padding, height + 2 * padding, PANEL_COLOR);
+
+    float y = m_y;
+    for (size_t i = 0; i < m_lines.size(); ++i, y += cellHeight)
+    {
+        // Shader names and the graph caption are labels
+        AddText(m_x, y, m_lines[i], i + m_shaderNames.size() + 1 >= m_lines.size() ? LABEL_COLOR : TEXT_COLOR);
+    }
+
+    const float bottom = y + graphHeight;
+    for (size_t i = 0; i < m_bars.size(); ++i)
+    {
+        AddSolid(m_x + i * m_scale, bottom - m_bars[i], static_cast<float>(m_scale), static_cast<float>(m_bars[i]),
+            m_bars[i] > m_p99Bar ? SLOW_BAR_COLOR : BAR_COLOR);
+    }
+    AddSolid(m_x, bottom - m_p99Bar, m_bars.size() * static_cast<float>(m_scale), static_cast<float>(m_scale) / 2, P99_COLOR);
+}
+
+void PerformanceHud::AddQuad(float x, float y, float width, float height, float u0, float v0, float u1, float v1, uint32_t color)
+{
+    // Pixel centers at texel centers, as Direct3D 9 rasterizes pre-transformed vertices
+    const float left = x - 0.5f, top = y - 0.5f, right = x + width - 0.5f, bottom = y + height - 0.5f;
+    const HudVertex corners[4] =
+    {
+        { left, top, 0.0f, 1.0f, color, u0, v0 },
+        { right, top, 0.0f, 1.0f, color, u1, v0 },
+        { left, bottom, 0.0f, 1.0f, color, u0, v1 },
+        { right, bottom, 0.0f, 1.0f, color, u1, v1 }
+    };
+    static const unsigned LIST[6] = { 0, 1, 2, 2, 1, 3 };
+    for (unsigned i = 0; i < 6; ++i)
+    {
+        m_vertices.push_back(corners[LIST[i]]);
+    }
+}
+
+void PerformanceHud::AddSolid(float x, float y, float width, float height, uint32_t color)
+{
+    // Center of the solid cell, every pixel samples the same texel
+    const float u = (SOLID_CELL % m_font.columns * m_font.cellWidth + m_font.cellWidth / 2.0f) / m_font.width;
+    const float v = (SOLID_CELL / m_font.columns * m_font.cellHeight + m_font.cellHeight / 2.0f) / m_font.height;
+    AddQuad(x, y, width, height, u, v, u, v, color);
+}
+
+void PerformanceHud::AddText(float x, float y, const std::string& text, uint32_t color)
+{
+    const float cellWidth = static_cast<float>(m_font.cellWidth * m_scale);
+    const float cellHeight = static_cast<float>(m_font.cellHeight * m_scale);
+    for (size_t i = 0; i < text.size(); ++i, x += cellWidth)
+    {
+        unsigned cell = static_cast<unsigned char>(text[i]) - FIRST_CHARACTER;
+        if (' ' == text[i])
+        {
+            continue;
+        }
+        if (cell >= CHARACTER_COUNT)
+        {
+            cell = '?' - FIRST_CHARACTER;
+        }
+        const float u0 = static_cast<float>(cell % m_font.columns * m_font.cellWidth) / m_font.width;
+        const float v0 = static_cast<float>(cell / m_font.columns * m_font.cellHeight) / m_font.height;
+        const float u1 = u0 + static_cast<float>(m_font.cellWidth) / m_font.width;
+        const float v1 = v0 + static_cast<float>(m_font.cellHeight) / m_font.height;
+        AddQuad(x, y, cellWidth, cellHeight, u0, v0, u1, v1, color);
+    }
+}
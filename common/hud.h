@@ -0,0 +1,176 @@
+#pragma once
+
+#include "null_device.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Pre-transformed, colored and textured vertex, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1
+struct HudVertex
+{
+    float x, y, z, rhw;
+
+    /// ARGB, modulates the white glyphs of the atlas
+    uint32_t color;
+
+    float u, v;
+};
+
+const uint32_t HUD_VERTEX_FVF = 0x144;
+
+/// @brief Font texture of the HUD: 5x7 glyphs of the printable ASCII characters in 6x8 cells
+/// The cell after the last character is solid and used for panels and graph bars.
+/// Pixels are alpha values, the texture is white with this alpha
+struct HudFontAtlas
+{
+    unsigned width;
+    unsigned height;
+    unsigned cellWidth;
+    unsigned cellHeight;
+    unsigned columns;
+    std::vector<uint8_t> alpha;
+};
+
+/// @brief Built-in font, no font files or system font rasterizer needed
+HudFontAtlas BuildHudFontAtlas();
+
+/// @brief Draws the HUD vertices, Direct3D 9 or null
+/// Vertices live in one dynamic vertex buffer, the whole HUD is one draw with the font atlas
+class HudBackend
+{
+public:
+
+    virtual ~HudBackend() {}
+
+    /// @brief Replace the vertex buffer content, false if it could not be written
+    virtual bool Upload(const HudVertex* vertices, unsigned vertexCount) = 0;
+
+    /// @brief Triangle list of the uploaded vertices
+    virtual void Draw(unsigned vertexCount) = 0;
+};
+
+/// @brief HUD on the null device: uploads are copied, the draw is one null device draw
+class NullHudBackend : public HudBackend
+{
+public:
+
+    explicit NullHudBackend(NullDevice& device) : m_device(device), m_atlas(0) {}
+
+    virtual bool Upload(const HudVertex* vertices, unsigned vertexCount);
+    virtual void Draw(unsigned vertexCount);
+
+private:
+
+    NullDevice& m_device;
+
+    /// Stands for the atlas texture
+    int m_atlas;
+
+    /// Stands for the dynamic vertex buffer
+    std::vector<HudVertex> m_buffer;
+};
+
+/// @brief Work done by the HUD
+struct HudStats
+{
+    unsigned frames;
+    unsigned intervals;
+
+    /// Intervals whose text or graph differed from the previous ones
+    unsigned rebuilds;
+
+    unsigned uploads;
+    unsigned draws;
+};
+
+/// @brief On-screen frame time, p99 graph, device calls and shader names
+/// Frame times and device calls are recorded every frame, the text and the graph are laid
+/// out once per update interval and only if they differ from the ones on screen, so the
+/// vertex buffer is written only when a displayed value changes. The frame time graph
+/// covers the history window, frames over its 99th percentile are drawn red
+class PerformanceHud
+{
+public:
+
+    /// @brief Update every updateIntervalFrames frames, percentile and graph over historyFrames
+    explicit PerformanceHud(unsigned updateIntervalFrames = 30, unsigned historyFrames = 120);
+
+    /// @brief Hidden HUD records frames but neither lays out nor draws
+    void SetEnabled(bool enabled);
+    void Toggle() { SetEnabled(!m_enabled); }
+    bool Enabled() const { return m_enabled; }
+
+    /// @brief Top left corner in pixels and integer magnification of the font
+    void SetPosition(float x, float y) { m_x = x; m_y = y; m_dirty = true; }
+    void SetScale(unsigned scale) { m_scale = scale ? scale : 1; m_dirty = true; }
+
+    /// @brief Names shown below the counters, e.g. the vertex and pixel shader files
+    void SetShaderNames(const std::vector<std::string>& names);
+
+    /// @brief GPU time of a recent frame, negative hides the line
+    void SetGpuMilliseconds(double milliseconds) { m_gpuMilliseconds = milliseconds; }
+
+    /// @brief Time since the previous frame and the device calls of the frame
+    /// Returns true if the vertices changed
+    bool AddFrame(double milliseconds, const DeviceCounters& frameCounters);
+
+    /// @brief Upload the vertices if they changed since the last upload, then draw them once
+    void Draw(HudBackend& backend);
+
+    /// @brief Upload on the next Draw(), e.g. after the vertex buffer was recreated
+    void Invalidate() { m_uploadedVersion = m_version - 1; }
+
+    const std::vector<std::string>& Lines() const { return m_lines; }
+    const std::vector<HudVertex>& Vertices() const { return m_vertices; }
+
+    /// @brief 99th percentile of the frame times in the history window
+    double Percentile99() const { return m_p99; }
+
+    const HudStats& Stats() const { return m_stats; }
+
+private:
+
+    /// @brief Format the text and the graph, true if they differ from the previous ones
+    bool Layout();
+
+    void BuildVertices();
+    void AddQuad(float x, float y, float width, float height, float u0, float v0, float u1, float v1, uint32_t color);
+    void AddSolid(float x, float y, float width, float height, uint32_t color);
+    void AddText(float x, float y, const std::string& text, uint32_t color);
+
+    unsigned m_updateInterval;
+    unsigned m_historyFrames;
+    bool m_enabled;
+    bool m_dirty;
+    float m_x;
+    float m_y;
+    unsigned m_scale;
+    HudFontAtlas m_font;
+
+    /// Ring of frame times
+    std::vector<double> m_history;
+    size_t m_historyNext;
+    std::vector<double> m_sorted;
+
+    /// Sums of the current interval
+    double m_intervalMilliseconds;
+    unsigned m_intervalFrames;
+    uint64_t m_intervalDraws;
+    uint64_t m_intervalStateChanges;
+
+    std::vector<std::string> m_shaderNames;
+    double m_gpuMilliseconds;
+    double m_p99;
+
+    /// Displayed text and graph bar heights in pixels, compared to skip unchanged layouts
+    std::vector<std::string> m_lines;
+    std::vector<unsigned> m_bars;
+    unsigned m_p99Bar;
+
+    std::vector<HudVertex> m_vertices;
+    unsigned m_version;
+    unsigned m_uploadedVersion;
+
+    HudStats m_stats;
+};
@@ -0,0 +1,651 @@
+#include "image_compare.h"
+#include "task_scheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_COMPARE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+/// Differences of a row or a tile
+struct DifferenceStats
+{
+    uint64_t differentPixels;
+    uint64_t failedPixels;
+    uint64_t squaredError;
+    uint8_t maxDifference[4];
+};
+
+/// Stabilizers of the SSIM terms for 8-bit values, (0.01 * 255)^2 and (0.03 * 255)^2
+const double SSIM_C1 = 6.5025;
+const double SSIM_C2 = 58.5225;
+
+/// @brief Rec. 601 luma in 8 bits from BGRA
+inline uint8_t Luma(const uint8_t* pixel)
+{
+    return static_cast<uint8_t>((29 * pixel[0] + 150 * pixel[1] + 77 * pixel[2] + 128) >> 8);
+}
+
+void CompareRowScalar(const uint8_t* reference, const uint8_t* test, unsigned first, unsigned end,
+    const uint8_t tolerance[4], unsigned channels, DifferenceStats& stats)
+{
+    for (unsigned x = first; x < end; ++x)
+    {
+        bool different = false, failed = false;
+        for (unsigned c = 0; c < channels; ++c)
+        {
+            const int a = reference[4 * x + c], b = test[4 * x + c];
+            const uint8_t difference = static_cast<uint8_t>(a > b ? a - b : b - a);
+            different = different || difference;
+            failed = failed || difference > tolerance[c];
+            stats.maxDifference[c] = std::max(stats.maxDifference[c], difference);
+            stats.squaredError += difference * difference;
+        }
+        stats.differentPixels += different;
+        stats.failedPixels += failed;
+    }
+}
+
+void LumaRowScalar(const uint8_t* pixels, unsigned first, unsigned end, uint8_t* luma)
+{
+    for (unsigned x = first; x < end; ++x)
+    {
+        luma[x] = Luma(pixels + 4 * x);
+    }
+}
+
+/// @brief Add a row of both lumas to the sums of its 4x4 blocks
+void AccumulateBlocksScalar(const uint8_t* x, const uint8_t* y, unsigned firstBlock, unsigned endBlock,
+    uint32_t* sumX, uint32_t* sumY, uint32_t* sumXX, uint32_t* sumYY, uint32_t* sumXY)
+{
+    for (unsigned block = firstBlock; block < endBlock; ++block)
+    {
+        for (unsigned i = 4 * block; i < 4 * block + 4; ++i)
+        {
+            sumX[block] += x[i];
+            sumY[block] += y[i];
+            sumXX[block] += x[i] * x[i];
+            sumYY[block] += y[i] * y[i];
+            sumXY[block] += x[i] * y[i];
+        }
+    }
+}
+
+#ifdef IMAGE_COMPARE_SSE2
+
+const uint8_t PIXEL_COUNT[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+/// @brief Sums of adjacent 32-bit lanes: a0 + a1, a2 + a3, b0 + b1, b2 + b3
+inline __m128i AddPairs(__m128i a, __m128i b)
+{
+    const __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+/// @brief Compare 4 pixels at a time, returns the number of pixels compared
+unsigned CompareRowSimd(const uint8_t* reference, const uint8_t* test, unsigned width,
+    const uint8_t tolerance[4], unsigned channels, DifferenceStats& stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(4 == channels ? -1 : 0x00ffffff);
+    const __m128i limit = _mm_set1_epi32(static_cast<int>(tolerance[0] | tolerance[1] << 8 | tolerance[2] << 16 |
+        static_cast<uint32_t>(tolerance[3]) << 24));
+    __m128i maximum = zero;
+    unsigned x = 0;
+    while (x + 4 <= width)
+    {
+        // Squares of up to 16384 groups fit the 32-bit lanes, flushed before
+        const unsigned end = std::min(width & ~3u, x + 4 * 8192);
+        __m128i squares = zero;
+        for (; x < end; x += 4)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference + 4 * x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(test + 4 * x));
+            const __m128i difference = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)), mask);
+            maximum = _mm_max_epu8(maximum, difference);
+
+            const int equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(difference, zero)));
+            const int within = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_subs_epu8(difference, limit), zero)));
+            stats.differentPixels += 4 - PIXEL_COUNT[equal];
+            stats.failedPixels += 4 - PIXEL_COUNT[within];
+
+            const __m128i low = _mm_unpacklo_epi8(difference, zero), high = _mm_unpackhi_epi8(difference, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), squares);
+        stats.squaredError += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    uint8_t maximumBytes[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maximumBytes), maximum);
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        stats.maxDifference[i % 4] = std::max(stats.maxDifference[i % 4], maximumBytes[i]);
+    }
+    return x;
+}
+
+/// @brief Luma of 16 pixels at a time, returns the number of pixels converted
+unsigned LumaRowSimd(const uint8_t* pixels, unsigned width, uint8_t* luma)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    const __m128i rounding = _mm_set1_epi32(128);
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i groups[4];
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 4 * (x + 4 * i)));
+            const __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);
+            const __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);
+            groups[i] = _mm_srli_epi32(_mm_add_epi32(AddPairs(low, high), rounding), 8);
+        }
+        const __m128i words = _mm_packus_epi16(_mm_packs_epi32(groups[0], groups[1]), _mm_packs_epi32(groups[2], groups[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma + x), words);
+    }
+    return x;
+}
+
+inline void AddLanes(uint32_t* sums, __m128i values)
+{
+    __m128i* target = reinterpret_cast<__m128i*>(sums);
+    _mm_storeu_si128(target, _mm_add_epi32(_mm_loadu_si128(target), values));
+}
+
+/// @brief Block sums of 4 blocks at a time, returns the number of blocks accumulated
+unsigned AccumulateBlocksSimd(const uint8_t* x, const uint8_t* y, unsigned blocks,
+    uint32_t* sumX, uint32_t* sumY, uint32_t* sumXX, uint32_t* sumYY, uint32_t* sumXY)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    unsigned block = 0;
+    for (; block + 4 <= blocks; block += 4)
+    {
+        const __m128i vx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 4 * block));
+        const __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + 4 * block));
+        const __m128i xl = _mm_unpacklo_epi8(vx, zero), xh = _mm_unpackhi_epi8(vx, zero);
+        const __m128i yl = _mm_unpacklo_epi8(vy, zero), yh = _mm_unpackhi_epi8(vy, zero);
+        AddLanes(sumX + block, AddPairs(_mm_madd_epi16(xl, ones), _mm_madd_epi16(xh, ones)));
+        AddLanes(sumY + block, AddPairs(_mm_madd_epi16(yl, ones), _mm_madd_epi16(yh, ones)));
+        AddLanes(sumXX + block, AddPairs(_mm_madd_epi16(xl, xl), _mm_madd_epi16(xh, xh)));
+        AddLanes(sumYY + block, AddPairs(_mm_madd_epi16(yl, yl), _mm_madd_epi16(yh, yh)));
+        AddLanes(sumXY + block, AddPairs(_mm_madd_epi16(xl, yl), _mm_madd_epi16(xh, yh)));
+    }
+    return block;
+}
+
+#endif // IMAGE_COMPARE_SSE2
+
+/// @brief Heatmap pixels of a row from the luma of the reference, see ImageComparer
+void HeatmapRow(const uint8_t* reference, const uint8_t* test, const uint8_t* luma, bool equal, unsigned width,
+    const uint8_t tolerance[4], unsigned channels, uint8_t* heatmap)
+{
+    uint32_t* pixels = reinterpret_cast<uint32_t*>(heatmap);
+    if (equal)
+    {
+        for (unsigned x = 0; x < width; ++x)
+        {
+            const uint32_t gray = luma[x] / 4;
+            pixels[x] = 0xff000000 | gray << 16 | gray << 8 | gray;
+        }
+        return;
+    }
+    for (unsigned x = 0; x < width; ++x)
+    {
+        uint8_t maximum = 0;
+        bool failed = false;
+        for (unsigned c = 0; c < channels; ++c)
+        {
+            const int a = reference[4 * x + c], b = test[4 * x + c];
+            const uint8_t difference = static_cast<uint8_t>(a > b ? a - b : b - a);
+            maximum = std::max(maximum, difference);
+            failed = failed || difference > tolerance[c];
+        }
+
+        uint8_t* pixel = heatmap + 4 * x;
+        if (failed)
+        {
+            pixel[0] = 0;
+            pixel[1] = static_cast<uint8_t>(255 - maximum);
+            pixel[2] = 255;
+        }
+        else if (maximum)
+        {
+            pixel[0] = 255;
+            pixel[1] = 96;
+            pixel[2] = 32;
+        }
+        else
+        {
+            pixel[0] = pixel[1] = pixel[2] = static_cast<uint8_t>(luma[x] / 4);
+        }
+        pixel[3] = 255;
+    }
+}
+
+/// @brief Next header token of a Netpbm file, comments skipped
+bool NextToken(const std::string& content, size_t& position, std::string& token)
+{
+    while (position < content.size())
+    {
+        if ('#' == content[position])
+        {
+            position = content.find('\n', position);
+            position = std::string::npos == position ? content.size() : position;
+        }
+        else if (isspace(static_cast<unsigned char>(content[position])))
+        {
+            ++position;
+        }
+        else
+        {
+            break;
+        }
+    }
+    const size_t start = position;
+    while (position < content.size() && !isspace(static_cast<unsigned char>(content[position])))
+    {
+        ++position;
+    }
+    token = content.substr(start, position - start);
+    return !token.empty();
+}
+
+} // namespace
+
+ImageView MakeImageView(const Image& image)
+{
+    ImageView view = { image.pixels.empty() ? NULL : &image.pixels[0], image.width, image.height, 4 * image.width };
+    return view;
+}
+
+bool LoadNetpbmImage(const std::string& filename, Image& image)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t position = 0;
+    std::string token;
+    unsigned width = 0, height = 0, depth = 0, maxValue = 0;
+    if (!NextToken(content, position, token))
+    {
+        return false;
+    }
+    if ("P6" == token)
+    {
+        std::string w, h, m;
+        if (!NextToken(content, position, w) || !NextToken(content, position, h) || !NextToken(content, position, m))
+        {
+            return false;
+        }
+        width = static_cast<unsigned>(strtoul(w.c_str(), NULL, 10));
+        height = static_cast<unsigned>(strtoul(h.c_str(), NULL, 10));
+        maxValue = static_cast<unsigned>(strtoul(m.c_str(), NULL, 10));
+        depth = 3;
+
+        // Single whitespace character before the pixels
+        ++position;
+    }
+    else if ("P7" == token)
+    {
+        std::string tupleType;
+        while (NextToken(content, position, token) && "ENDHDR" != token)
+        {
+            std::string value;
+            if (!NextToken(content, position, value))
+            {
+                return false;
+            }
+            const unsigned number = static_cast<unsigned>(strtoul(value.c_str(), NULL, 10));
+            if ("WIDTH" == token)
+            {
+                width = number;
+            }
+            else if ("HEIGHT" == token)
+            {
+                height = number;
+            }
+            else if ("DEPTH" == token)
+            {
+                depth = number;
+            }
+            else if ("MAXVAL" == token)
+            {
+                maxValue = number;
+            }
+            else if ("TUPLTYPE" == token)
+            {
+                tupleType = value;
+            }
+        }
+        if ("ENDHDR" != token || (tupleType != "RGB" && tupleType != "RGB_ALPHA"))
+        {
+            return false;
+        }
+        ++position;
+    }
+    else
+    {
+        return false;
+    }
+
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    if (0 == pixelCount || 255 != maxValue || (3 != depth && 4 != depth) || content.size() < position + pixelCount * depth)
+    {
+        return false;
+    }
+
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(4 * pixelCount);
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(content.data() + position);
+    for (size_t i = 0; i < pixelCount; ++i, source += depth)
+    {
+        uint8_t* pixel = &image.pixels[4 * i];
+        pixel[0] = source[2];
+        pixel[1] = source[1];
+        pixel[2] = source[0];
+        pixel[3] = 4 == depth ? source[3] : 255;
+    }
+    return true;
+}
+
+bool SaveNetpbmImage(const std::string& filename, const Image& image, bool alpha)
+{
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::ostringstream header;
+    if (alpha)
+    {
+        header << "P7\nWIDTH " << image.width << "\nHEIGHT " << image.height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    }
+    else
+    {
+        header << "P6\n" << image.width << " " << image.height << "\n255\n";
+    }
+    file << header.str();
+
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    const unsigned depth = alpha ? 4 : 3;
+    std::vector<uint8_t> data(pixelCount * depth);
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        const uint8_t* pixel = &image.pixels[4 * i];
+        data[depth * i] = pixel[2];
+        data[depth * i + 1] = pixel[1];
+        data[depth * i + 2] = pixel[0];
+        if (alpha)
+        {
+            data[depth * i + 3] = pixel[3];
+        }
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(file);
+}
+
+ImageCompareSettings DefaultImageCompareSettings(uint8_t tolerance)
+{
+    ImageCompareSettings settings;
+    std::fill(settings.tolerance, settings.tolerance + 4, tolerance);
+    settings.compareAlpha = true;
+    settings.ssim = true;
+    settings.tileRows = 64;
+    return settings;
+}
+
+std::string FormatImageCompareResult(const ImageCompareResult& result)
+{
+    if (!result.sizeMatches)
+    {
+        return "size differs";
+    }
+    char line[256] = {};
+    if (result.identical)
+    {
+        snprintf(line, sizeof(line), "identical");
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "%llu pixels over tolerance, %llu different, max difference %u %u %u %u (BGRA), PSNR %.2f dB",
+            static_cast<unsigned long long>(result.failedPixels), static_cast<unsigned long long>(result.differentPixels),
+            result.maxDifference[0], result.maxDifference[1], result.maxDifference[2], result.maxDifference[3], result.psnr);
+    }
+    std::string text(line);
+    if (result.ssim >= 0.0 && !result.identical)
+    {
+        snprintf(line, sizeof(line), ", SSIM %.5f", result.ssim);
+        text += line;
+    }
+    return text;
+}
+
+ImageComparer::ImageComparer(unsigned threads)
+    : m_scheduler(1 == threads ? NULL : new TaskScheduler(threads))
+    , m_simd(true)
+{
+}
+
+ImageComparer::~ImageComparer()
+{
+    delete m_scheduler;
+}
+
+bool ImageComparer::Simd() const
+{
+#ifdef IMAGE_COMPARE_SSE2
+    return m_simd;
+#else
+    return false;
+#endif
+}
+
+ImageCompareResult ImageComparer::Compare(const ImageView& reference, const ImageView& test,
+    const ImageCompareSettings& settings, Image* heatmap)
+{
+    ImageCompareResult result = {};
+    result.ssim = -1.0;
+    result.sizeMatches = reference.width == test.width && reference.height == test.height;
+    if (!result.sizeMatches)
+    {
+        return result;
+    }
+
+    const unsigned width = reference.width, height = reference.height;
+    const unsigned blocksWide = width / 4, blocksHigh = height / 4;
+    if (settings.ssim)
+    {
+        const size_t blockCount = static_cast<size_t>(blocksWide) * blocksHigh;
+        m_sumX.assign(blockCount, 0);
+        m_sumY.assign(blockCount, 0);
+        m_sumXX.assign(blockCount, 0);
+        m_sumYY.assign(blockCount, 0);
+        m_sumXY.assign(blockCount, 0);
+    }
+    if (heatmap)
+    {
+        heatmap->width = width;
+        heatmap->height = height;
+        heatmap->pixels.resize(4 * static_cast<size_t>(width) * height);
+    }
+
+    // Tiles start at block rows, so every block is accumulated by one tile
+    const unsigned tileRows = std::max(4u, (settings.tileRows + 3) & ~3u);
+    const unsigned tileCount = (height + tileRows - 1) / tileRows;
+    m_tiles.resize(tileCount);
+    for (unsigned i = 0; i < tileCount; ++i)
+    {
+        m_tiles[i].firstRow = i * tileRows;
+        m_tiles[i].endRow = std::min(height, (i + 1) * tileRows);
+    }
+    if (m_scheduler && tileCount > 1)
+    {
+        for (unsigned i = 0; i < tileCount; ++i)
+        {
+            m_scheduler->Add("CompareTile", [&, i]() -> bool
+            {
+                CompareTile(m_tiles[i], reference, test, settings, heatmap);
+                return true;
+            });
+        }
+        m_scheduler->Run();
+    }
+    else
+    {
+        for (unsigned i = 0; i < tileCount; ++i)
+        {
+            CompareTile(m_tiles[i], reference, test, settings, heatmap);
+        }
+    }
+
+    uint64_t squaredError = 0;
+    for (unsigned i = 0; i < tileCount; ++i)
+    {
+        const Tile& tile = m_tiles[i];
+        result.differentPixels += tile.differentPixels;
+        result.failedPixels += tile.failedPixels;
+        squaredError += tile.squaredError;
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            result.maxDifference[c] = std::max(result.maxDifference[c], tile.maxDifference[c]);
+        }
+    }
+
+    const unsigned channels = settings.compareAlpha ? 4 : 3;
+    const double samples = static_cast<double>(width) * height * channels;
+    result.identical = 0 == result.differentPixels;
+    result.mse = samples > 0 ? squaredError / samples : 0.0;
+    result.psnr = result.mse > 0 ? 10.0 * log10(255.0 * 255.0 / result.mse) : std::numeric_limits<double>::infinity();
+    if (settings.ssim)
+    {
+        result.ssim = blocksWide >= 2 && blocksHigh >= 2 ? WindowSsim(blocksWide, blocksHigh) : (result.identical ? 1.0 : 0.0);
+    }
+    return result;
+}
+
+void ImageComparer::CompareTile(Tile& tile, const ImageView& reference, const ImageView& test,
+    const ImageCompareSettings& settings, Image* heatmap)
+{
+    const unsigned width = reference.width;
+    const unsigned channels = settings.compareAlpha ? 4 : 3;
+    const unsigned blocksWide = width / 4, blocksHigh = reference.height / 4;
+    const bool simd = Simd();
+
+    DifferenceStats stats = {};
+    tile.referenceLuma.resize(width);
+    tile.testLuma.resize(width);
+    for (unsigned y = tile.firstRow; y < tile.endRow; ++y)
+    {
+        const uint8_t* a = reference.pixels + static_cast<size_t>(y) * reference.pitch;
+        const uint8_t* b = test.pixels + static_cast<size_t>(y) * test.pitch;
+
+        // Equal rows are the common case of regression runs
+        const bool equal = 0 == memcmp(a, b, 4 * static_cast<size_t>(width));
+        if (!equal)
+        {
+            unsigned x = 0;
+#ifdef IMAGE_COMPARE_SSE2
+            if (simd)
+            {
+                x = CompareRowSimd(a, b, width, settings.tolerance, channels, stats);
+            }
+#endif
+            CompareRowScalar(a, b, x, width, settings.tolerance, channels, stats);
+        }
+
+        // Heatmap shows the luma of the reference, SSIM needs both
+        const bool blockRow = settings.ssim && y / 4 < blocksHigh;
+        uint8_t* lumaX = &tile.referenceLuma[0];
+        uint8_t* lumaY = &tile.testLuma[0];
+        if (heatmap || blockRow)
+        {
+            unsigned x = 0;
+#ifdef IMAGE_COMPARE_SSE2
+            if (simd)
+            {
+                x = LumaRowSimd(a, width, lumaX);
+            }
+#endif
+            LumaRowScalar(a, x, width, lumaX);
+        }
+        if (heatmap)
+        {
+            HeatmapRow(a, b, lumaX, equal, width, settings.tolerance, channels, &heatmap->pixels[4 * static_cast<size_t>(y) * width]);
+        }
+
+        if (blockRow)
+        {
+            const size_t row = static_cast<size_t>(y / 4) * blocksWide;
+            unsigned x = 0, block = 0;
+#ifdef IMAGE_COMPARE_SSE2
+            if (simd)
+            {
+                x = LumaRowSimd(b, width, lumaY);
+            }
+#endif
+            LumaRowScalar(b, x, width, lumaY);
+#ifdef IMAGE_COMPARE_SSE2
+            if (simd)
+            {
+                block = AccumulateBlocksSimd(lumaX, lumaY, blocksWide,
+                    &m_sumX[row], &m_sumY[row], &m_sumXX[row], &m_sumYY[row], &m_sumXY[row]);
+            }
+#endif
+            AccumulateBlocksScalar(lumaX, lumaY, block, blocksWide,
+                &m_sumX[row], &m_sumY[row], &m_sumXX[row], &m_sumYY[row], &m_sumXY[row]);
+        }
+    }
+
+    tile.differentPixels = stats.differentPixels;
+    tile.failedPixels = stats.failedPixels;
+    tile.squaredError = stats.squaredError;
+    std::copy(stats.maxDifference, stats.maxDifference + 4, tile.maxDifference);
+}
+
+double ImageComparer::WindowSsim(unsigned blocksWide, unsigned blocksHigh) const
+{
+    double total = 0.0;
+    for (unsigned by = 0; by + 1 < blocksHigh; ++by)
+    {
+        for (unsigned bx = 0; bx + 1 < blocksWide; ++bx)
+        {
+            // 8x8 window of four blocks
+            const size_t i[4] = { by * blocksWide + bx, by * blocksWide + bx + 1, (by + 1) * blocksWide + bx, (by + 1) * blocksWide + bx + 1 };
+            const double sx = m_sumX[i[0]] + m_sumX[i[1]] + m_sumX[i[2]] + m_sumX[i[3]];
+            const double sy = m_sumY[i[0]] + m_sumY[i[1]] + m_sumY[i[2]] + m_sumY[i[3]];
+            const double sxx = m_sumXX[i[0]] + m_sumXX[i[1]] + m_sumXX[i[2]] + m_sumXX[i[3]];
+            const double syy = m_sumYY[i[0]] + m_sumYY[i[1]] + m_sumYY[i[2]] + m_sumYY[i[3]];
+            const double sxy = m_sumXY[i[0]] + m_sumXY[i[1]] + m_sumXY[i[2]] + m_sumXY[i[3]];
+
+            const double meanX = sx / 64, meanY = sy / 64;
+            const double varianceX = sxx / 64 - meanX * meanX, varianceY = syy / 64 - meanY * meanY;
+            const double covariance = sxy / 64 - meanX * meanY;
+            total += (2 * meanX * meanY + SSIM_C1) * (2 * covariance + SSIM_C2) /
+                ((meanX * meanX + meanY * meanY + SSIM_C1) * (varianceX + varianceY + SSIM_C2));
+        }
+    }
+    return total / (static_cast<double>(blocksWide - 1) * (blocksHigh - 1));
+}
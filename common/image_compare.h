@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TaskScheduler;
+
+/// @brief 8-bit BGRA pixels, the memory layout of D3DFMT_A8R8G8B8, rows without padding
+struct Image
+{
+    unsigned width;
+    unsigned height;
+    std::vector<uint8_t> pixels;
+};
+
+/// @brief BGRA pixels owned elsewhere, e.g. a locked render target, rows pitch bytes apart
+struct ImageView
+{
+    const uint8_t* pixels;
+    unsigned width;
+    unsigned height;
+    unsigned pitch;
+};
+
+ImageView MakeImageView(const Image& image);
+
+/// @brief Load binary Netpbm: P6 (RGB, alpha is 255) or P7 with TUPLTYPE RGB_ALPHA, 8 bits per channel
+bool LoadNetpbmImage(const std::string& filename, Image& image);
+
+/// @brief Save as P6, or P7 RGB_ALPHA if alpha is true
+bool SaveNetpbmImage(const std::string& filename, const Image& image, bool alpha = false);
+
+/// @brief What the comparison computes and how much difference it accepts
+struct ImageCompareSettings
+{
+    /// Largest difference of a channel still within tolerance, B, G, R, A
+    uint8_t tolerance[4];
+
+    /// Alpha of X8R8G8B8 targets is undefined and has to be ignored
+    bool compareAlpha;
+
+    /// Mean SSIM of the luma in 8x8 windows 4 pixels apart
+    bool ssim;
+
+    /// Rows of the tiles compared in parallel, rounded up to a multiple of 4
+    unsigned tileRows;
+};
+
+/// @brief Same tolerance for every channel, alpha compared, SSIM on, tiles of 64 rows
+ImageCompareSettings DefaultImageCompareSettings(uint8_t tolerance = 0);
+
+/// @brief Differences of two images of the same size
+struct ImageCompareResult
+{
+    bool sizeMatches;
+
+    /// No compared channel differs
+    bool identical;
+
+    /// Pixels with any compared channel different, and over the tolerance
+    uint64_t differentPixels;
+    uint64_t failedPixels;
+
+    /// Largest difference of every channel, B, G, R, A
+    uint8_t maxDifference[4];
+
+    /// Mean squared error of the compared channels and PSNR in dB, infinite if identical
+    double mse;
+    double psnr;
+
+    /// Mean SSIM of the windows, 1 if identical; images under 8x8 pixels have no windows
+    /// and an SSIM of 1 if identical, 0 otherwise. Negative if not computed
+    double ssim;
+};
+
+/// @brief One line: identical, or the failed and different pixels, maximum difference, PSNR and SSIM
+std::string FormatImageCompareResult(const ImageCompareResult& result);
+
+/// @brief Compares rendered images, e.g. outputs of the same shader on different hosts
+/// Rows are split into tiles compared in parallel. Every row is compared 4 pixels at a time
+/// with SSE2 where available: absolute differences, tolerance mask, maximum and squared error.
+/// SSIM sums of luma, luma squared and the luma product are accumulated per 4x4 block, each
+/// window adds four blocks. Integer sums make the SSE2 and scalar results identical.
+/// The optional heatmap shows pixels over the tolerance from yellow to red by their largest
+/// channel difference, pixels within the tolerance in blue and equal pixels as dark gray luma
+class ImageComparer
+{
+public:
+
+    /// @brief Worker threads of the tiles, 0 means one per hardware thread, 1 compares on the calling thread
+    explicit ImageComparer(unsigned threads = 0);
+    ~ImageComparer();
+
+    /// @brief Disable SSE2 kernels, for comparison with the scalar ones
+    void SetSimd(bool enabled) { m_simd = enabled; }
+    bool Simd() const;
+
+    /// @brief Compare the test image to the reference, the heatmap is written if not NULL
+    ImageCompareResult Compare(const ImageView& reference, const ImageView& test,
+        const ImageCompareSettings& settings, Image* heatmap = NULL);
+
+private:
+
+    ImageComparer(const ImageComparer&);
+    ImageComparer& operator=(const ImageComparer&);
+
+    /// @brief Differences and SSIM block sums of the rows of a tile
+    struct Tile
+    {
+        unsigned firstRow;
+        unsigned endRow;
+        uint64_t differentPixels;
+        uint64_t failedPixels;
+        uint64_t squaredError;
+        uint8_t maxDifference[4];
+
+        /// Luma rows of the reference and the test image
+        std::vector<uint8_t> referenceLuma;
+        std::vector<uint8_t> testLuma;
+    };
+
+    void CompareTile(Tile& tile, const ImageView& reference, const ImageView& test,
+        const ImageCompareSettings& settings, Image* heatmap);
+
+    /// @brief Mean SSIM of the windows from the block sums
+    double WindowSsim(unsigned blocksWide, unsigned blocksHigh) const;
+
+    TaskScheduler* m_scheduler;
+    bool m_simd;
+    std::vector<Tile> m_tiles;
+
+    /// Sums of every 4x4 block: luma of both images, their squares and their product
+    std::vector<uint32_t> m_sumX;
+    std::vector<uint32_t> m_sumY;
+    std::vector<uint32_t> m_sumXX;
+    std::vector<uint32_t> m_sumYY;
+    std::vector<uint32_t> m_sumXY;
+};
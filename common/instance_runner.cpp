@@ -0,0 +1,116 @@
+#include "instance_runner.h"
+#include "trace.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+
+/// @brief Releases all threads once every instance is initialized
+class StartBarrier
+{
+public:
+
+    explicit StartBarrier(unsigned count) : m_waiting(count) {}
+
+    void Arrive()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (0 == --m_waiting)
+        {
+            m_released.notify_all();
+            return;
+        }
+        m_released.wait(lock, [this] { return 0 == m_waiting; });
+    }
+
+private:
+
+    std::mutex m_lock;
+    std::condition_variable m_released;
+    unsigned m_waiting;
+};
+
+void RunInstance(const RenderInstanceFactory& factory, unsigned frames, StartBarrier& barrier, InstanceResult& result)
+{
+    TRACE_THREAD_NAME(TRACE_INTERN("Instance " + std::to_string(result.instance)));
+    std::unique_ptr<RenderInstance> instance = factory(result.instance);
+    bool initialized = false;
+    {
+        TRACE_SCOPE("Init");
+        initialized = instance && instance->Init();
+    }
+    barrier.Arrive();
+    if (!initialized)
+    {
+        return;
+    }
+
+    // Results of neighbouring instances share cache lines, so they are written once at the end
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool succeeded = true;
+    unsigned frame = 0;
+    for (; frame < frames; ++frame)
+    {
+        TRACE_SCOPE("Frame");
+        if (!instance->RenderFrame(frame))
+        {
+            succeeded = false;
+            break;
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    result.succeeded = succeeded;
+    result.frames = frame;
+    result.milliseconds = elapsed.count();
+    result.counters = instance->Counters();
+    result.output = instance->Output();
+}
+
+} // namespace
+
+std::string FormatInstanceResult(const InstanceResult& result)
+{
+    char line[256] = {};
+    snprintf(line, sizeof(line), "instance %u: %s, %u frames in %.2f ms, %.1f fps, %u draws, %u primitives",
+        result.instance, result.succeeded ? "ok" : "failed", result.frames, result.milliseconds,
+        result.milliseconds > 0 ? result.frames * 1000.0 / result.milliseconds : 0.0,
+        result.counters.draws, result.counters.primitives);
+
+    std::string formatted(line);
+    if (!result.output.empty())
+    {
+        formatted += ", " + result.output;
+    }
+    return formatted;
+}
+
+std::vector<InstanceResult> RunInstances(const RenderInstanceFactory& factory, unsigned instanceCount, unsigned frames)
+{
+    std::vector<InstanceResult> results(instanceCount);
+    for (unsigned i = 0; i < instanceCount; ++i)
+    {
+        results[i].instance = i;
+        results[i].frames = 0;
+        results[i].milliseconds = 0.0;
+        results[i].counters = DeviceCounters();
+        results[i].succeeded = false;
+    }
+
+    StartBarrier barrier(instanceCount);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < instanceCount; ++i)
+    {
+        threads.push_back(std::thread(RunInstance, std::cref(factory), frames, std::ref(barrier), std::ref(results[i])));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+    return results;
+}
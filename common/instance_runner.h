@@ -0,0 +1,59 @@
+#pragma once
+
+#include "null_device.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// @brief Timing and output of one instance run
+struct InstanceResult
+{
+    unsigned instance;
+    unsigned frames;
+
+    /// Wall time of all frames, initialization excluded
+    double milliseconds;
+
+    /// Calls of the instance device
+    DeviceCounters counters;
+
+    /// Instance specific summary of the rendered scene
+    std::string output;
+
+    bool succeeded;
+};
+
+/// @brief Format result as a single log line
+std::string FormatInstanceResult(const InstanceResult& result);
+
+/// @brief Independent rendering context driven by one runner thread
+/// Instances share nothing: each one owns its device, scene and timing,
+/// and is created, rendered and destroyed on its own thread
+class RenderInstance
+{
+public:
+
+    virtual ~RenderInstance() {}
+
+    /// @brief Create device and scene
+    virtual bool Init() = 0;
+
+    /// @brief Render and present one frame
+    virtual bool RenderFrame(unsigned frame) = 0;
+
+    /// @brief Calls of the instance device so far
+    virtual DeviceCounters Counters() const = 0;
+
+    /// @brief Summary written into the result after the last frame
+    virtual std::string Output() const { return std::string(); }
+};
+
+/// @brief Creates instance with the given index
+typedef std::function<std::unique_ptr<RenderInstance>(unsigned instance)> RenderInstanceFactory;
+
+/// @brief Run instanceCount instances for the given number of frames, each on its own thread
+/// All instances are initialized before any of them starts rendering, so that the timings
+/// overlap. Results are indexed by instance
+std::vector<InstanceResult> RunInstances(const RenderInstanceFactory& factory, unsigned instanceCount, unsigned frames);
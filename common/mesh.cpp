@@ -0,0 +1,259 @@
+#include "mesh.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+
+const char BINARY_MESH_MAGIC[4] = { 'D', '3', 'M', 'S' };
+const uint32_t BINARY_MESH_VERSION = 1;
+
+struct BinaryMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+};
+
+/// @brief OBJ face corner: position, texture coordinate and normal indices, 0 if absent
+struct ObjCorner
+{
+    int position;
+    int texCoord;
+    int normal;
+
+    bool operator<(const ObjCorner& other) const
+    {
+        if (position != other.position)
+            return position < other.position;
+        if (texCoord != other.texCoord)
+            return texCoord < other.texCoord;
+        return normal < other.normal;
+    }
+};
+
+/// @brief Resolve 1-based or negative relative OBJ index, returns 0 if invalid
+int ResolveObjIndex(int index, size_t count)
+{
+    if (index < 0)
+    {
+        index += static_cast<int>(count) + 1;
+    }
+    return (index > 0 && index <= static_cast<int>(count)) ? index : 0;
+}
+
+/// @brief Parse "v", "v/vt", "v//vn" or "v/vt/vn"
+bool ParseObjCorner(const std::string& token, ObjCorner& corner)
+{
+    corner.position = corner.texCoord = corner.normal = 0;
+
+    const char* text = token.c_str();
+    char* end = NULL;
+    corner.position = static_cast<int>(strtol(text, &end, 10));
+    if (end == text)
+    {
+        return false;
+    }
+    if ('/' == *end)
+    {
+        text = end + 1;
+        if ('/' != *text)
+        {
+            corner.texCoord = static_cast<int>(strtol(text, &end, 10));
+        }
+        else
+        {
+            end = const_cast<char*>(text);
+        }
+        if ('/' == *end)
+        {
+            text = end + 1;
+            corner.normal = static_cast<int>(strtol(text, &end, 10));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool LoadObjMesh(const std::string& filename, Mesh& mesh)
+{
+    std::ifstream in(filename);
+    if (!in)
+    {
+        return false;
+    }
+
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<float> normals;
+    std::map<ObjCorner, uint32_t> sharedVertices;
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream tokens(line);
+        std::string type;
+        tokens >> type;
+
+        if ("v" == type)
+        {
+            float x = 0, y = 0, z = 0;
+            tokens >> x >> y >> z;
+            positions.push_back(x);
+            positions.push_back(y);
+            positions.push_back(z);
+        }
+        else if ("vt" == type)
+        {
+            float u = 0, v = 0;
+            tokens >> u >> v;
+            texCoords.push_back(u);
+            // OBJ origin is bottom-left, Direct3D is top-left
+            texCoords.push_back(1.0f - v);
+        }
+        else if ("vn" == type)
+        {
+            float x = 0, y = 0, z = 0;
+            tokens >> x >> y >> z;
+            normals.push_back(x);
+            normals.push_back(y);
+            normals.push_back(z);
+        }
+        else if ("f" == type)
+        {
+            std::vector<uint32_t> polygon;
+            std::string token;
+            while (tokens >> token)
+            {
+                ObjCorner corner;
+                if (!ParseObjCorner(token, corner))
+                {
+                    return false;
+                }
+                corner.position = ResolveObjIndex(corner.position, positions.size() / 3);
+                corner.texCoord = ResolveObjIndex(corner.texCoord, texCoords.size() / 2);
+                corner.normal = ResolveObjIndex(corner.normal, normals.size() / 3);
+                if (0 == corner.position)
+                {
+                    return false;
+                }
+
+                std::map<ObjCorner, uint32_t>::const_iterator it = sharedVertices.find(corner);
+                if (it != sharedVertices.end())
+                {
+                    polygon.push_back(it->second);
+                    continue;
+                }
+
+                MeshVertex vertex;
+                memset(&vertex, 0, sizeof(vertex));
+                memcpy(vertex.position, &positions[(corner.position - 1) * 3], sizeof(vertex.position));
+                if (corner.texCoord)
+                {
+                    memcpy(vertex.texCoord, &texCoords[(corner.texCoord - 1) * 2], sizeof(vertex.texCoord));
+                }
+                if (corner.normal)
+                {
+                    memcpy(vertex.normal, &normals[(corner.normal - 1) * 3], sizeof(vertex.normal));
+                }
+
+                uint32_t index = static_cast<uint32_t>(mesh.vertices.size());
+                mesh.vertices.push_back(vertex);
+                sharedVertices[corner] = index;
+                polygon.push_back(index);
+            }
+
+            for (size_t i = 2; i < polygon.size(); ++i)
+            {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i - 1]);
+                mesh.indices.push_back(polygon[i]);
+            }
+        }
+    }
+    return !mesh.indices.empty();
+}
+
+bool LoadBinaryMesh(const std::string& filename, Mesh& mesh)
+{
+    std::ifstream in(filename, std::ios::binary);
+    BinaryMeshHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        return false;
+    }
+    if (memcmp(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic)) || BINARY_MESH_VERSION != header.version)
+    {
+        return false;
+    }
+
+    if (header.indexCount % 3)
+    {
+        return false;
+    }
+
+    // The counts are checked against the file size so that a corrupt header can't allocate gigabytes
+    const std::streampos dataStart = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff remaining = in.tellg() - dataStart;
+    in.seekg(dataStart);
+    if (!in || remaining < 0 || static_cast<uint64_t>(header.vertexCount) * sizeof(MeshVertex) +
+        static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t) > static_cast<uint64_t>(remaining))
+    {
+        return false;
+    }
+
+    mesh.vertices.resize(header.vertexCount);
+    mesh.indices.resize(header.indexCount);
+    in.read(reinterpret_cast<char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(MeshVertex));
+    in.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+    if (!in)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < mesh.indices.size(); ++i)
+    {
+        if (mesh.indices[i] >= header.vertexCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SaveBinaryMesh(const std::string& filename, const Mesh& mesh)
+{
+    std::ofstream out(filename, std::ios::binary);
+
+    BinaryMeshHeader header;
+    memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MESH_VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(MeshVertex));
+    out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+    return static_cast<bool>(out);
+}
+
+bool LoadMesh(const std::string& filename, Mesh& mesh)
+{
+    std::string::size_type dot = filename.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? std::string() : filename.substr(dot);
+    if (".obj" == extension || ".OBJ" == extension)
+    {
+        return LoadObjMesh(filename, mesh);
+    }
+    return LoadBinaryMesh(filename, mesh);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Vertex of the imported mesh
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+};
+
+/// @brief Indexed triangle list
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+
+    size_t TriangleCount() const { return indices.size() / 3; }
+};
+
+/// @brief Load Wavefront OBJ: positions, texture coordinates, normals and polygonal faces
+/// Polygons are triangulated as fans, vertices with equal attributes are shared
+bool LoadObjMesh(const std::string& filename, Mesh& mesh);
+
+/// @brief Load mesh in the compact binary format written by SaveBinaryMesh()
+bool LoadBinaryMesh(const std::string& filename, Mesh& mesh);
+
+/// @brief Save mesh in the compact binary format
+/// Header of magic, version, vertex and index counts followed by raw vertex and index arrays
+bool SaveBinaryMesh(const std::string& filename, const Mesh& mesh);
+
+/// @brief Load OBJ or binary mesh depending on the file extension
+bool LoadMesh(const std::string& filename, Mesh& mesh);
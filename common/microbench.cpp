@@ -0,0 +1,306 @@
+#include "microbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+
+/// @brief Milliseconds of one run of the iterations
+double TimeRun(const MicrobenchFunction& function, uint64_t iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    function(iterations);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Names are written without quoting, characters of CSV and JSON syntax are replaced
+std::string SafeName(const std::string& name)
+{
+    std::string safe(name);
+    for (size_t i = 0; i < safe.size(); ++i)
+    {
+        if (',' == safe[i] || '"' == safe[i] || '\\' == safe[i] || static_cast<unsigned char>(safe[i]) < 32)
+        {
+            safe[i] = '_';
+        }
+    }
+    return safe;
+}
+
+/// @brief Pins the calling thread to the CPU and restores its previous affinity when destroyed
+/// The thread is not pinned if the platform can't pin it or its affinity can't be read back
+class ScopedThreadPin
+{
+public:
+
+    explicit ScopedThreadPin(int cpu)
+        : m_pinned(false)
+    {
+        if (cpu < 0)
+        {
+            return;
+        }
+#ifdef _WIN32
+        m_previous = cpu < 64 ? SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) : 0;
+        m_pinned = 0 != m_previous;
+#elif defined(__linux__)
+        if (cpu >= CPU_SETSIZE || 0 != pthread_getaffinity_np(pthread_self(), sizeof(m_previous), &m_previous))
+        {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        m_pinned = 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+    ~ScopedThreadPin()
+    {
+        if (!m_pinned)
+        {
+            return;
+        }
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), m_previous);
+#elif defined(__linux__)
+        pthread_setaffinity_np(pthread_self(), sizeof(m_previous), &m_previous);
+#endif
+    }
+
+    bool Pinned() const { return m_pinned; }
+
+private:
+
+    ScopedThreadPin(const ScopedThreadPin&);
+    ScopedThreadPin& operator=(const ScopedThreadPin&);
+
+    bool m_pinned;
+#ifdef _WIN32
+    DWORD_PTR m_previous;
+#elif defined(__linux__)
+    cpu_set_t m_previous;
+#endif
+};
+
+} // namespace
+
+MicrobenchSettings DefaultMicrobenchSettings()
+{
+    MicrobenchSettings settings;
+    settings.samples = 15;
+    settings.sampleMilliseconds = 5.0;
+    settings.warmupMilliseconds = 50.0;
+    settings.cpu = 0;
+    return settings;
+}
+
+MicrobenchSuite::MicrobenchSuite(const MicrobenchSettings& settings)
+    : m_settings(settings)
+    , m_pinned(false)
+{
+    m_settings.samples = std::max(m_settings.samples, 1u);
+    m_settings.sampleMilliseconds = std::max(m_settings.sampleMilliseconds, 0.1);
+}
+
+void MicrobenchSuite::Add(const std::string& name, const MicrobenchFunction& function)
+{
+    m_benchmarks.push_back(std::make_pair(name, function));
+}
+
+const std::vector<MicrobenchResult>& MicrobenchSuite::Run(const std::string& filter)
+{
+    // Thread is pinned only while the benchmarks run, the caller gets its affinity back
+    ScopedThreadPin pin(m_settings.cpu);
+    m_pinned = pin.Pinned();
+    m_results.clear();
+    for (size_t i = 0; i < m_benchmarks.size(); ++i)
+    {
+        if (filter.empty() || std::string::npos != m_benchmarks[i].first.find(filter))
+        {
+            m_results.push_back(Measure(m_benchmarks[i].first, m_benchmarks[i].second));
+            printf("%s\n", FormatMicrobenchResult(m_results.back()).c_str());
+            fflush(stdout);
+        }
+    }
+    return m_results;
+}
+
+MicrobenchResult MicrobenchSuite::Measure(const std::string& name, const MicrobenchFunction& function)
+{
+    // Warm-up doubles as calibration: grow until a run takes half a sample
+    uint64_t iterations = 1;
+    double spent = 0.0, milliseconds = 0.0;
+    for (;;)
+    {
+        milliseconds = TimeRun(function, iterations);
+        spent += milliseconds;
+        const bool calibrated = milliseconds >= m_settings.sampleMilliseconds / 2;
+        if (calibrated && spent >= m_settings.warmupMilliseconds)
+        {
+            break;
+        }
+        if (!calibrated)
+        {
+            const double factor = milliseconds > 0.0 ? m_settings.sampleMilliseconds / milliseconds : 10.0;
+            iterations = static_cast<uint64_t>(iterations * std::min(10.0, std::max(2.0, factor)));
+        }
+    }
+    iterations = std::max<uint64_t>(1, static_cast<uint64_t>(iterations * m_settings.sampleMilliseconds / milliseconds));
+
+    std::vector<double> nanoseconds(m_settings.samples);
+    for (unsigned i = 0; i < m_settings.samples; ++i)
+    {
+        nanoseconds[i] = TimeRun(function, iterations) * 1e6 / iterations;
+    }
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+
+    MicrobenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.samples = m_settings.samples;
+    result.minNs = nanoseconds.front();
+    result.maxNs = nanoseconds.back();
+    const size_t middle = nanoseconds.size() / 2;
+    result.medianNs = nanoseconds.size() % 2 ? nanoseconds[middle] : (nanoseconds[middle - 1] + nanoseconds[middle]) / 2;
+    double sum = 0.0;
+    for (size_t i = 0; i < nanoseconds.size(); ++i)
+    {
+        sum += nanoseconds[i];
+    }
+    result.meanNs = sum / nanoseconds.size();
+    double squares = 0.0;
+    for (size_t i = 0; i < nanoseconds.size(); ++i)
+    {
+        squares += (nanoseconds[i] - result.meanNs) * (nanoseconds[i] - result.meanNs);
+    }
+    result.stddevNs = nanoseconds.size() > 1 ? sqrt(squares / (nanoseconds.size() - 1)) : 0.0;
+    return result;
+}
+
+std::string FormatMicrobenchResult(const MicrobenchResult& result)
+{
+    char line[256] = {};
+    snprintf(line, sizeof(line), "%-40s %12.2f ns median, %10.2f min, %10.2f max, %5.1f%% stddev, %llu iterations x %u",
+        result.name.c_str(), result.medianNs, result.minNs, result.maxNs,
+        result.meanNs > 0 ? 100.0 * result.stddevNs / result.meanNs : 0.0,
+        static_cast<unsigned long long>(result.iterations), result.samples);
+    return line;
+}
+
+bool WriteMicrobenchJson(const std::string& filename, const std::string& suite, const MicrobenchSuite& benchmarks)
+{
+    std::ofstream file(filename.c_str());
+    if (!file)
+    {
+        return false;
+    }
+    const MicrobenchSettings& settings = benchmarks.Settings();
+    const std::vector<MicrobenchResult>& results = benchmarks.Results();
+    file.precision(6);
+    file << std::fixed;
+    file << "{\n  \"suite\": \"" << SafeName(suite) << "\",\n";
+    file << "  \"settings\": { \"samples\": " << settings.samples << ", \"sample_ms\": " << settings.sampleMilliseconds
+        << ", \"warmup_ms\": " << settings.warmupMilliseconds << ", \"cpu\": " << settings.cpu
+        << ", \"pinned\": " << (benchmarks.Pinned() ? "true" : "false") << " },\n";
+    file << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicrobenchResult& result = results[i];
+        file << "    { \"name\": \"" << SafeName(result.name) << "\", \"iterations\": " << result.iterations
+            << ", \"samples\": " << result.samples << ", \"min_ns\": " << result.minNs << ", \"median_ns\": " << result.medianNs
+            << ", \"mean_ns\": " << result.meanNs << ", \"max_ns\": " << result.maxNs << ", \"stddev_ns\": " << result.stddevNs
+            << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+bool WriteMicrobenchCsv(const std::string& filename, const std::vector<MicrobenchResult>& results)
+{
+    std::ofstream file(filename.c_str());
+    if (!file)
+    {
+        return false;
+    }
+    file.precision(6);
+    file << std::fixed;
+    file << "name,iterations,samples,min_ns,median_ns,mean_ns,max_ns,stddev_ns\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicrobenchResult& result = results[i];
+        file << SafeName(result.name) << "," << result.iterations << "," << result.samples << "," << result.minNs << ","
+            << result.medianNs << "," << result.meanNs << "," << result.maxNs << "," << result.stddevNs << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+bool LoadMicrobenchCsv(const std::string& filename, std::vector<MicrobenchResult>& results)
+{
+    std::ifstream file(filename.c_str());
+    std::string line;
+    if (!file || !std::getline(file, line) || 0 != line.compare(0, 5, "name,"))
+    {
+        return false;
+    }
+    results.clear();
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        MicrobenchResult result;
+        std::string iterations, samples, minNs, medianNs, meanNs, maxNs, stddevNs;
+        if (!std::getline(fields, result.name, ',') || !std::getline(fields, iterations, ',') || !std::getline(fields, samples, ',') ||
+            !std::getline(fields, minNs, ',') || !std::getline(fields, medianNs, ',') || !std::getline(fields, meanNs, ',') ||
+            !std::getline(fields, maxNs, ',') || !std::getline(fields, stddevNs))
+        {
+            return false;
+        }
+        result.iterations = strtoull(iterations.c_str(), NULL, 10);
+        result.samples = static_cast<unsigned>(strtoul(samples.c_str(), NULL, 10));
+        result.minNs = strtod(minNs.c_str(), NULL);
+        result.medianNs = strtod(medianNs.c_str(), NULL);
+        result.meanNs = strtod(meanNs.c_str(), NULL);
+        result.maxNs = strtod(maxNs.c_str(), NULL);
+        result.stddevNs = strtod(stddevNs.c_str(), NULL);
+        results.push_back(result);
+    }
+    return true;
+}
+
+std::vector<std::string> FindMicrobenchRegressions(const std::vector<MicrobenchResult>& baseline,
+    const std::vector<MicrobenchResult>& results, double thresholdPercent)
+{
+    std::vector<std::string> regressions;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        for (size_t j = 0; j < baseline.size(); ++j)
+        {
+            if (baseline[j].name != results[i].name || baseline[j].medianNs <= 0.0)
+            {
+                continue;
+            }
+            const double change = 100.0 * (results[i].medianNs / baseline[j].medianNs - 1.0);
+            if (change > thresholdPercent)
+            {
+                char line[256] = {};
+                snprintf(line, sizeof(line), "%s: %.2f ns, baseline %.2f ns, %+.1f%%",
+                    results[i].name.c_str(), results[i].medianNs, baseline[j].medianNs, change);
+                regressions.push_back(line);
+            }
+        }
+    }
+    return regressions;
+}
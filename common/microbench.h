@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// @brief Repetition, warm-up and pinning of the microbenchmarks
+struct MicrobenchSettings
+{
+    /// Timed samples of every benchmark
+    unsigned samples;
+
+    /// Duration of one sample, the iterations per sample are calibrated to it
+    double sampleMilliseconds;
+
+    /// Minimum time run before sampling, the calibration runs count towards it
+    double warmupMilliseconds;
+
+    /// CPU the benchmark thread is pinned to, -1 leaves it unpinned
+    int cpu;
+};
+
+/// @brief 15 samples of 5 ms after 50 ms of warm-up, pinned to CPU 0
+MicrobenchSettings DefaultMicrobenchSettings();
+
+/// @brief Time of one iteration over the samples, in nanoseconds
+struct MicrobenchResult
+{
+    std::string name;
+    uint64_t iterations;
+    unsigned samples;
+    double minNs;
+    double medianNs;
+    double meanNs;
+    double maxNs;
+    double stddevNs;
+};
+
+/// @brief Runs the given number of iterations of the measured operation
+typedef std::function<void(uint64_t iterations)> MicrobenchFunction;
+
+/// @brief Keeps a computed value alive, so that the compiler can't remove the computation
+template <typename T>
+inline void MicrobenchKeep(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile char sink;
+    sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+}
+
+/// @brief Set of named benchmarks measured one after the other on the calling thread
+/// Every benchmark is run with a growing number of iterations until one run takes half a
+/// sample and the warm-up time has passed, then the iterations per sample are fixed and the
+/// samples are timed. Statistics are per iteration; the median is compared to baselines
+class MicrobenchSuite
+{
+public:
+
+    explicit MicrobenchSuite(const MicrobenchSettings& settings);
+
+    void Add(const std::string& name, const MicrobenchFunction& function);
+
+    /// @brief Run the benchmarks whose name contains the filter, all if it is empty
+    /// Results are printed as they complete. The thread is pinned to the CPU of the settings
+    /// while they run, its previous affinity is restored on return
+    const std::vector<MicrobenchResult>& Run(const std::string& filter = std::string());
+
+    const std::vector<MicrobenchResult>& Results() const { return m_results; }
+    const MicrobenchSettings& Settings() const { return m_settings; }
+
+    /// @brief Whether the thread was pinned to the CPU of the settings
+    bool Pinned() const { return m_pinned; }
+
+private:
+
+    MicrobenchResult Measure(const std::string& name, const MicrobenchFunction& function);
+
+    MicrobenchSettings m_settings;
+    bool m_pinned;
+    std::vector<std::pair<std::string, MicrobenchFunction> > m_benchmarks;
+    std::vector<MicrobenchResult> m_results;
+};
+
+/// @brief One line per result: name, iterations per sample and statistics
+std::string FormatMicrobenchResult(const MicrobenchResult& result);
+
+/// @brief JSON object with the settings and an array of the results
+bool WriteMicrobenchJson(const std::string& filename, const std::string& suite,
+    const MicrobenchSuite& benchmarks);
+
+/// @brief CSV with a header line, readable by LoadMicrobenchCsv()
+bool WriteMicrobenchCsv(const std::string& filename, const std::vector<MicrobenchResult>& results);
+bool LoadMicrobenchCsv(const std::string& filename, std::vector<MicrobenchResult>& results);
+
+/// @brief Benchmarks whose median is slower than in the baseline by more than the threshold
+/// One line per regression; benchmarks missing from either side are skipped
+std::vector<std::string> FindMicrobenchRegressions(const std::vector<MicrobenchResult>& baseline,
+    const std::vector<MicrobenchResult>& results, double thresholdPercent);
@@ -0,0 +1,369 @@
+#include "null_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+unsigned PrimitiveVertexCount(unsigned primitiveType, unsigned primitiveCount)
+{
+    if (0 == primitiveCount)
+    {
+        return 0;
+    }
+
+    switch (primitiveType)
+    {
+    case NULL_PT_POINTLIST:
+        return primitiveCount;
+    case NULL_PT_LINELIST:
+        return primitiveCount * 2;
+    case NULL_PT_LINESTRIP:
+        return primitiveCount + 1;
+    case NULL_PT_TRIANGLELIST:
+        return primitiveCount * 3;
+    case NULL_PT_TRIANGLESTRIP:
+    case NULL_PT_TRIANGLEFAN:
+        return primitiveCount + 2;
+    default:
+        return 0;
+    }
+}
+
+NullDevice::NullDevice(unsigned callOverheadNs)
+    : m_callOverheadNs(callOverheadNs)
+    , m_counters()
+    , m_vsConstants(MAX_VS_CONSTANTS * 4, 0.0f)
+    , m_backBuffer()
+    , m_viewportWidth(0)
+    , m_viewportHeight(0)
+    , m_renderTargetBytes(0)
+    , m_peakRenderTargetBytes(0)
+    , m_gpuDrawNs(2000)
+    , m_gpuVertexNs(4)
+    , m_gpuClearNs(50000)
+    , m_gpuPixelPs(0)
+    , m_gpuLatencyFrames(2)
+    , m_disjointEpoch(0)
+    , m_gpuNs(0)
+    , m_presents(0)
+{
+    std::fill(m_textures, m_textures + MAX_TEXTURE_STAGES, static_cast<const void*>(NULL));
+    std::fill(m_renderTargets, m_renderTargets + MAX_RENDER_TARGETS, static_cast<const void*>(NULL));
+    m_renderTargets[0] = &m_backBuffer;
+}
+
+void NullDevice::Call()
+{
+    if (0 == m_callOverheadNs)
+    {
+        return;
+    }
+
+    // Busy wait, sleeping is far too coarse for sub-microsecond costs
+    std::chrono::steady_clock::time_point until =
+        std::chrono::steady_clock::now() + std::chrono::nanoseconds(m_callOverheadNs);
+    while (std::chrono::steady_clock::now() < until)
+    {
+    }
+}
+
+void NullDevice::BeginScene()
+{
+    Call();
+}
+
+void NullDevice::EndScene()
+{
+    Call();
+}
+
+void NullDevice::Clear(uint32_t color, float z, uint32_t stencil)
+{
+    (void)color;
+    (void)z;
+    (void)stencil;
+    Call();
+    m_gpuNs += m_gpuClearNs + GpuFillNanoseconds();
+}
+
+void NullDevice::Present()
+{
+    Call();
+    ++m_counters.frames;
+    ++m_presents;
+}
+
+void NullDevice::SetTexture(unsigned stage, const void* texture)
+{
+    Call();
+    if (stage < MAX_TEXTURE_STAGES)
+    {
+        m_textures[stage] = texture;
+    }
+    ++m_counters.textureBinds;
+}
+
+void NullDevice::SetRenderState(unsigned state, uint32_t value)
+{
+    (void)state;
+    (void)value;
+    Call();
+    ++m_counters.renderStateChanges;
+}
+
+void NullDevice::SetSamplerState(unsigned sampler, unsigned type, uint32_t value)
+{
+    (void)sampler;
+    (void)type;
+    (void)value;
+    Call();
+    ++m_counters.samplerStateChanges;
+}
+
+void NullDevice::SetFVF(uint32_t fvf)
+{
+    (void)fvf;
+    Call();
+    ++m_counters.renderStateChanges;
+}
+
+void NullDevice::SetVertexShader(const void* shader)
+{
+    (void)shader;
+    Call();
+    ++m_counters.shaderBinds;
+}
+
+void NullDevice::SetPixelShader(const void* shader)
+{
+    (void)shader;
+    Call();
+    ++m_counters.shaderBinds;
+}
+
+void NullDevice::SetVertexShaderConstantF(unsigned startRegister, const float* data, unsigned vector4fCount)
+{
+    Call();
+    if (startRegister < MAX_VS_CONSTANTS)
+    {
+        unsigned count = std::min(vector4fCount, MAX_VS_CONSTANTS - startRegister);
+        memcpy(&m_vsConstants[startRegister * 4], data, count * 4 * sizeof(float));
+    }
+    ++m_counters.constantUploads;
+}
+
+const void* NullDevice::CreateRenderTarget(unsigned width, unsigned height, uint32_t format, unsigned bitsPerPixel)
+{
+    Call();
+    std::unique_ptr<NullRenderTarget> target(new NullRenderTarget);
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->bytes = static_cast<uint64_t>(width) * height * bitsPerPixel / 8;
+
+    m_renderTargetBytes += target->bytes;
+    m_peakRenderTargetBytes = std::max(m_peakRenderTargetBytes, m_renderTargetBytes);
+    m_createdTargets.push_back(std::move(target));
+    return m_createdTargets.back().get();
+}
+
+void NullDevice::ReleaseRenderTarget(const void* target)
+{
+    Call();
+    for (size_t i = 0; i < m_createdTargets.size(); ++i)
+    {
+        if (m_createdTargets[i].get() == target)
+        {
+            m_renderTargetBytes -= m_createdTargets[i]->bytes;
+            m_createdTargets.erase(m_createdTargets.begin() + i);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < MAX_RENDER_TARGETS; ++i)
+    {
+        if (m_renderTargets[i] == target)
+        {
+            m_renderTargets[i] = NULL;
+        }
+    }
+}
+
+void NullDevice::SetBackBufferSize(unsigned width, unsigned height)
+{
+    m_backBuffer.width = width;
+    m_backBuffer.height = height;
+    if (&m_backBuffer == m_renderTargets[0])
+    {
+        m_viewportWidth = width;
+        m_viewportHeight = height;
+    }
+}
+
+void NullDevice::SetRenderTarget(unsigned index, const void* target)
+{
+    Call();
+    if (index < MAX_RENDER_TARGETS)
+    {
+        m_renderTargets[index] = target;
+    }
+    if (0 == index)
+    {
+        const NullRenderTarget* renderTarget = static_cast<const NullRenderTarget*>(target);
+        m_viewportWidth = renderTarget ? renderTarget->width : 0;
+        m_viewportHeight = renderTarget ? renderTarget->height : 0;
+    }
+    ++m_counters.renderTargetChanges;
+}
+
+void NullDevice::SetViewport(unsigned x, unsigned y, unsigned width, unsigned height)
+{
+    (void)x;
+    (void)y;
+    Call();
+    m_viewportWidth = width;
+    m_viewportHeight = height;
+}
+
+const void* NullDevice::CreateQuery(unsigned type)
+{
+    Call();
+    if (NULL_QUERYTYPE_TIMESTAMP != type && NULL_QUERYTYPE_TIMESTAMPDISJOINT != type && NULL_QUERYTYPE_TIMESTAMPFREQ != type)
+    {
+        return NULL;
+    }
+
+    std::unique_ptr<NullQuery> query(new NullQuery());
+    query->type = type;
+    m_queries.push_back(std::move(query));
+    return m_queries.back().get();
+}
+
+void NullDevice::ReleaseQuery(const void* query)
+{
+    Call();
+    for (size_t i = 0; i < m_queries.size(); ++i)
+    {
+        if (m_queries[i].get() == query)
+        {
+            m_queries.erase(m_queries.begin() + i);
+            break;
+        }
+    }
+}
+
+void NullDevice::IssueQuery(const void* query, unsigned issueFlags)
+{
+    Call();
+    ++m_counters.queryIssues;
+    NullQuery* nullQuery = static_cast<NullQuery*>(const_cast<void*>(query));
+    if (!nullQuery)
+    {
+        return;
+    }
+
+    if (NULL_QUERYTYPE_TIMESTAMPDISJOINT == nullQuery->type && (issueFlags & NULL_ISSUE_BEGIN))
+    {
+        nullQuery->issued = false;
+        nullQuery->disjointEpoch = m_disjointEpoch;
+        return;
+    }
+    if (!(issueFlags & NULL_ISSUE_END))
+    {
+        return;
+    }
+
+    switch (nullQuery->type)
+    {
+    case NULL_QUERYTYPE_TIMESTAMP:
+        nullQuery->value = m_gpuNs * GPU_FREQUENCY / 1000000000;
+        break;
+    case NULL_QUERYTYPE_TIMESTAMPDISJOINT:
+        nullQuery->value = nullQuery->disjointEpoch != m_disjointEpoch ? 1 : 0;
+        break;
+    case NULL_QUERYTYPE_TIMESTAMPFREQ:
+        nullQuery->value = GPU_FREQUENCY;
+        break;
+    }
+    nullQuery->issued = true;
+    nullQuery->readyPresent = m_presents + m_gpuLatencyFrames;
+}
+
+bool NullDevice::GetQueryData(const void* query, uint64_t& data)
+{
+    Call();
+    const NullQuery* nullQuery = static_cast<const NullQuery*>(query);
+    if (!nullQuery || !nullQuery->issued || m_presents < nullQuery->readyPresent)
+    {
+        return false;
+    }
+    data = nullQuery->value;
+    return true;
+}
+
+void NullDevice::SetGpuCost(unsigned drawNs, unsigned vertexNs, unsigned clearNs)
+{
+    m_gpuDrawNs = drawNs;
+    m_gpuVertexNs = vertexNs;
+    m_gpuClearNs = clearNs;
+}
+
+void NullDevice::GpuDraw(unsigned vertexCount)
+{
+    m_gpuNs += m_gpuDrawNs + static_cast<uint64_t>(m_gpuVertexNs) * vertexCount + GpuFillNanoseconds();
+}
+
+uint64_t NullDevice::GpuFillNanoseconds() const
+{
+    return static_cast<uint64_t>(m_viewportWidth) * m_viewportHeight * m_gpuPixelPs / 1000;
+}
+
+void NullDevice::DrawPrimitiveUP(unsigned primitiveType, unsigned primitiveCount, const void* vertices, unsigned stride)
+{
+    Call();
+    unsigned vertexCount = PrimitiveVertexCount(primitiveType, primitiveCount);
+    size_t bytes = static_cast<size_t>(vertexCount) * stride;
+    if (m_staging.size() < bytes)
+    {
+        m_staging.resize(bytes);
+    }
+    if (bytes)
+    {
+        memcpy(m_staging.data(), vertices, bytes);
+    }
+
+    ++m_counters.draws;
+    m_counters.primitives += primitiveCount;
+    m_counters.vertices += vertexCount;
+    GpuDraw(vertexCount);
+}
+
+void NullDevice::DrawIndexedPrimitiveUP(unsigned primitiveType, unsigned minVertexIndex, unsigned numVertices,
+    unsigned primitiveCount, const uint16_t* indices, const void* vertices, unsigned stride)
+{
+    Call();
+    unsigned indexCount = PrimitiveVertexCount(primitiveType, primitiveCount);
+    size_t vertexBytes = static_cast<size_t>(numVertices) * stride;
+    size_t indexBytes = indexCount * sizeof(uint16_t);
+    if (m_staging.size() < vertexBytes + indexBytes)
+    {
+        m_staging.resize(vertexBytes + indexBytes);
+    }
+    if (vertexBytes)
+    {
+        memcpy(m_staging.data(), static_cast<const unsigned char*>(vertices) + minVertexIndex * stride, vertexBytes);
+    }
+    if (indexBytes)
+    {
+        memcpy(m_staging.data() + vertexBytes, indices, indexBytes);
+    }
+
+    ++m_counters.draws;
+    m_counters.primitives += primitiveCount;
+    m_counters.vertices += indexCount;
+    GpuDraw(indexCount);
+}
+
+void NullDevice::ResetCounters()
+{
+    m_counters = DeviceCounters();
+}
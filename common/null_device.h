@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// @brief Primitive types, values match D3DPRIMITIVETYPE
+enum NullPrimitiveType
+{
+    NULL_PT_POINTLIST = 1,
+    NULL_PT_LINELIST = 2,
+    NULL_PT_LINESTRIP = 3,
+    NULL_PT_TRIANGLELIST = 4,
+    NULL_PT_TRIANGLESTRIP = 5,
+    NULL_PT_TRIANGLEFAN = 6
+};
+
+/// @brief Query types, values match D3DQUERYTYPE
+enum NullQueryType
+{
+    NULL_QUERYTYPE_TIMESTAMP = 10,
+    NULL_QUERYTYPE_TIMESTAMPDISJOINT = 11,
+    NULL_QUERYTYPE_TIMESTAMPFREQ = 12
+};
+
+/// @brief Query issue flags, values match D3DISSUE
+enum NullIssueFlags
+{
+    NULL_ISSUE_END = 1,
+    NULL_ISSUE_BEGIN = 2
+};
+
+/// @brief Number of vertices referenced by primitiveCount primitives
+unsigned PrimitiveVertexCount(unsigned primitiveType, unsigned primitiveCount);
+
+/// @brief Calls passed through the device since the last reset
+struct DeviceCounters
+{
+    unsigned draws;
+    unsigned primitives;
+    unsigned vertices;
+    unsigned textureBinds;
+    unsigned renderStateChanges;
+    unsigned samplerStateChanges;
+    unsigned shaderBinds;
+    unsigned constantUploads;
+    unsigned renderTargetChanges;
+    unsigned queryIssues;
+    unsigned frames;
+};
+
+/// @brief Null rendering backend
+/// Mirrors the Direct3D 9 device calls made by the samples, so that submission
+/// code can be measured and validated without a GPU. Nothing is rendered:
+/// calls are counted, user pointer vertices are copied into a staging buffer
+/// the same way the runtime does, and optional per-call overhead emulates
+/// the cost of a virtualized driver. Timestamp queries are answered by an
+/// emulated GPU clock which advances by a modelled cost of every command
+class NullDevice
+{
+public:
+
+    /// @brief Ticks per second of the emulated GPU clock
+    static const uint64_t GPU_FREQUENCY = 100000000;
+
+    /// @brief Every call spins for callOverheadNs nanoseconds
+    explicit NullDevice(unsigned callOverheadNs = 0);
+
+    void BeginScene();
+    void EndScene();
+    void Clear(uint32_t color, float z, uint32_t stencil);
+    void Present();
+
+    void SetTexture(unsigned stage, const void* texture);
+    void SetRenderState(unsigned state, uint32_t value);
+    void SetSamplerState(unsigned sampler, unsigned type, uint32_t value);
+    void SetFVF(uint32_t fvf);
+    void SetVertexShader(const void* shader);
+    void SetPixelShader(const void* shader);
+    void SetVertexShaderConstantF(unsigned startRegister, const float* data, unsigned vector4fCount);
+
+    /// @brief Render target owned by the device, released with ReleaseRenderTarget()
+    const void* CreateRenderTarget(unsigned width, unsigned height, uint32_t format, unsigned bitsPerPixel);
+    void ReleaseRenderTarget(const void* target);
+
+    /// @brief Back buffer dimensions, 0 x 0 until set
+    void SetBackBufferSize(unsigned width, unsigned height);
+
+    /// @brief Render target 0 is the back buffer after the device is created
+    /// Setting render target 0 resets the viewport to the whole target, as Direct3D 9 does
+    void SetRenderTarget(unsigned index, const void* target);
+
+    /// @brief Rectangle of render target 0 which clears and draws cover
+    void SetViewport(unsigned x, unsigned y, unsigned width, unsigned height);
+    const void* RenderTarget(unsigned index) const { return index < MAX_RENDER_TARGETS ? m_renderTargets[index] : NULL; }
+    const void* BackBuffer() const { return &m_backBuffer; }
+
+    /// @brief Memory of the render targets created and not released, the back buffer is not included
+    uint64_t RenderTargetBytes() const { return m_renderTargetBytes; }
+    uint64_t PeakRenderTargetBytes() const { return m_peakRenderTargetBytes; }
+
+    /// @brief Timestamp, disjoint and frequency queries, NULL for other types
+    const void* CreateQuery(unsigned type);
+    void ReleaseQuery(const void* query);
+
+    /// @brief NULL_ISSUE_BEGIN is used only by disjoint queries
+    void IssueQuery(const void* query, unsigned issueFlags);
+
+    /// @brief Result of the query, false while it is in flight
+    /// Results become available gpuLatencyFrames presents after the query was issued,
+    /// as the emulated GPU runs that far behind. Timestamps are in GPU_FREQUENCY ticks,
+    /// disjoint result is 1 if SimulateGpuDisjoint() was called between its begin and end
+    bool GetQueryData(const void* query, uint64_t& data);
+
+    /// @brief Emulated GPU time of every draw, of every vertex drawn and of every clear
+    void SetGpuCost(unsigned drawNs, unsigned vertexNs, unsigned clearNs);
+    void SetGpuLatency(unsigned gpuLatencyFrames) { m_gpuLatencyFrames = gpuLatencyFrames; }
+
+    /// @brief Emulated GPU time per pixel of the viewport, in picoseconds, 0 by default
+    /// Every clear and every draw is charged as covering the whole viewport, as full-screen
+    /// passes and fill-bound shaders do, so GPU time follows the rendered resolution
+    void SetGpuPixelCost(unsigned pixelPs) { m_gpuPixelPs = pixelPs; }
+
+    /// @brief Disjoint queries in progress report a disjoint interval, as after a GPU clock change
+    void SimulateGpuDisjoint() { ++m_disjointEpoch; }
+
+    /// @brief Emulated GPU time of all commands so far
+    uint64_t GpuNanoseconds() const { return m_gpuNs; }
+
+    void DrawPrimitiveUP(unsigned primitiveType, unsigned primitiveCount, const void* vertices, unsigned stride);
+    void DrawIndexedPrimitiveUP(unsigned primitiveType, unsigned minVertexIndex, unsigned numVertices,
+        unsigned primitiveCount, const uint16_t* indices, const void* vertices, unsigned stride);
+
+    /// @brief Emulated per-call cost
+    void SetCallOverhead(unsigned callOverheadNs) { m_callOverheadNs = callOverheadNs; }
+
+    /// @brief Texture bound to the stage
+    const void* Texture(unsigned stage) const { return m_textures[stage]; }
+
+    /// @brief Vertex shader constant registers
+    const float* VertexShaderConstants() const { return m_vsConstants.data(); }
+
+    const DeviceCounters& Counters() const { return m_counters; }
+    void ResetCounters();
+
+private:
+
+    struct NullRenderTarget
+    {
+        unsigned width;
+        unsigned height;
+        uint32_t format;
+        uint64_t bytes;
+    };
+
+    struct NullQuery
+    {
+        unsigned type;
+        bool issued;
+
+        /// Present count at which the result is available
+        uint64_t readyPresent;
+        uint64_t value;
+        unsigned disjointEpoch;
+    };
+
+    NullDevice(const NullDevice&);
+    NullDevice& operator=(const NullDevice&);
+
+    /// @brief Emulate driver cost of a single call
+    void Call();
+
+    /// @brief Advance the emulated GPU clock by the cost of a draw
+    void GpuDraw(unsigned vertexCount);
+
+    /// @brief Emulated GPU time of shading every pixel of the viewport once
+    uint64_t GpuFillNanoseconds() const;
+
+    unsigned m_callOverheadNs;
+    DeviceCounters m_counters;
+
+    static const unsigned MAX_TEXTURE_STAGES = 16;
+    static const unsigned MAX_VS_CONSTANTS = 256;
+    static const unsigned MAX_RENDER_TARGETS = 4;
+
+    const void* m_textures[MAX_TEXTURE_STAGES];
+    std::vector<float> m_vsConstants;
+
+    /// Copy of the user pointer vertex data, as the runtime does
+    std::vector<unsigned char> m_staging;
+
+    NullRenderTarget m_backBuffer;
+    const void* m_renderTargets[MAX_RENDER_TARGETS];
+    unsigned m_viewportWidth;
+    unsigned m_viewportHeight;
+    std::vector<std::unique_ptr<NullRenderTarget> > m_createdTargets;
+    uint64_t m_renderTargetBytes;
+    uint64_t m_peakRenderTargetBytes;
+
+    std::vector<std::unique_ptr<NullQuery> > m_queries;
+    unsigned m_gpuDrawNs;
+    unsigned m_gpuVertexNs;
+    unsigned m_gpuClearNs;
+    unsigned m_gpuPixelPs;
+    unsigned m_gpuLatencyFrames;
+    unsigned m_disjointEpoch;
+    uint64_t m_gpuNs;
+
+    /// Presents since creation, not reset with the counters
+    uint64_t m_presents;
+};
@@ -0,0 +1,308 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+bool SameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b)
+{
+    return a.width == b.width && a.height == b.height && a.format == b.format;
+}
+
+} // namespace
+
+uint64_t EstimateRenderTargetBytes(const RenderTargetDesc& desc)
+{
+    return static_cast<uint64_t>(desc.width) * desc.height * desc.bitsPerPixel / 8;
+}
+
+std::string FormatRenderGraphReport(const RenderGraphReport& report)
+{
+    char text[512] = {};
+    snprintf(text, sizeof(text),
+        "%u passes, %u culled; %u of %u transient targets used, %u surfaces\n"
+        "target memory: %.2f MB without aliasing, %.2f MB aliased, %.2f MB live at most",
+        report.passes, report.culledPasses, report.usedTargets, report.transientTargets, report.surfaces,
+        report.unaliasedBytes / (1024.0 * 1024.0), report.aliasedBytes / (1024.0 * 1024.0),
+        report.peakLiveBytes / (1024.0 * 1024.0));
+    return text;
+}
+
+RenderGraph::RenderGraph()
+    : m_backend(NULL)
+    , m_compiled(false)
+    , m_report()
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    ReleaseSurfaces();
+}
+
+RenderResourceId RenderGraph::CreateTarget(const std::string& name, const RenderTargetDesc& desc)
+{
+    Resource resource = { name, desc, false, -1, -1, -1 };
+    m_resources.push_back(resource);
+    m_resourceSurfaces.push_back(NULL);
+    m_compiled = false;
+    return static_cast<RenderResourceId>(m_resources.size() - 1);
+}
+
+RenderResourceId RenderGraph::ImportTarget(const std::string& name, const RenderTargetDesc& desc)
+{
+    RenderResourceId id = CreateTarget(name, desc);
+    m_resources[id].imported = true;
+    return id;
+}
+
+void RenderGraph::SetImportedTarget(RenderResourceId resource, void* surface)
+{
+    if (resource < m_resources.size() && m_resources[resource].imported)
+    {
+        m_resourceSurfaces[resource] = surface;
+    }
+}
+
+RenderPassId RenderGraph::AddPass(const std::string& name, const std::vector<RenderResourceId>& reads,
+    const std::vector<RenderResourceId>& writes, const RenderPassExecute& execute)
+{
+    Pass pass = { name, reads, writes, execute, false };
+    m_passes.push_back(pass);
+    m_compiled = false;
+    return static_cast<RenderPassId>(m_passes.size() - 1);
+}
+
+bool RenderGraph::Compile()
+{
+    ReleaseSurfaces();
+    m_compiled = false;
+    m_error.clear();
+    m_report = RenderGraphReport();
+    if (!Validate())
+    {
+        return false;
+    }
+
+    CullPasses();
+    AssignSurfaces();
+    m_compiled = true;
+    return true;
+}
+
+bool RenderGraph::Validate()
+{
+    std::vector<bool> written(m_resources.size(), false);
+    for (size_t p = 0; p < m_passes.size(); ++p)
+    {
+        const Pass& pass = m_passes[p];
+        if (pass.writes.empty())
+        {
+            m_error = "pass " + pass.name + " writes no target";
+            return false;
+        }
+        for (size_t i = 0; i < pass.reads.size(); ++i)
+        {
+            const RenderResourceId read = pass.reads[i];
+            if (read >= m_resources.size())
+            {
+                m_error = "pass " + pass.name + " reads an unknown target";
+                return false;
+            }
+            if (!written[read] && !m_resources[read].imported)
+            {
+                m_error = "pass " + pass.name + " reads " + m_resources[read].name + " before it is written";
+                return false;
+            }
+        }
+        for (size_t i = 0; i < pass.writes.size(); ++i)
+        {
+            if (pass.writes[i] >= m_resources.size())
+            {
+                m_error = "pass " + pass.name + " writes an unknown target";
+                return false;
+            }
+            written[pass.writes[i]] = true;
+        }
+    }
+    return true;
+}
+
+void RenderGraph::CullPasses()
+{
+    // Backward liveness: imported targets are the frame output, a pass is kept if it
+    // writes a target needed later. Target overwritten without being read is not needed before the pass
+    std::vector<bool> needed(m_resources.size(), false);
+    for (size_t r = 0; r < m_resources.size(); ++r)
+    {
+        needed[r] = m_resources[r].imported;
+    }
+
+    for (size_t p = m_passes.size(); p-- > 0;)
+    {
+        Pass& pass = m_passes[p];
+        pass.culled = true;
+        for (size_t i = 0; i < pass.writes.size(); ++i)
+        {
+            pass.culled = pass.culled && !needed[pass.writes[i]];
+        }
+        if (pass.culled)
+        {
+            ++m_report.culledPasses;
+            continue;
+        }
+
+        for (size_t i = 0; i < pass.writes.size(); ++i)
+        {
+            if (!m_resources[pass.writes[i]].imported)
+            {
+                needed[pass.writes[i]] = false;
+            }
+        }
+        for (size_t i = 0; i < pass.reads.size(); ++i)
+        {
+            needed[pass.reads[i]] = true;
+        }
+    }
+    m_report.passes = static_cast<unsigned>(m_passes.size());
+}
+
+void RenderGraph::AssignSurfaces()
+{
+    for (size_t r = 0; r < m_resources.size(); ++r)
+    {
+        m_resources[r].firstUse = m_resources[r].lastUse = m_resources[r].surface = -1;
+        m_report.transientTargets += m_resources[r].imported ? 0 : 1;
+    }
+
+    for (size_t p = 0; p < m_passes.size(); ++p)
+    {
+        const Pass& pass = m_passes[p];
+        if (pass.culled)
+        {
+            continue;
+        }
+        std::vector<RenderResourceId> used(pass.reads);
+        used.insert(used.end(), pass.writes.begin(), pass.writes.end());
+        for (size_t i = 0; i < used.size(); ++i)
+        {
+            Resource& resource = m_resources[used[i]];
+            if (resource.firstUse < 0)
+            {
+                resource.firstUse = static_cast<int>(p);
+            }
+            resource.lastUse = static_cast<int>(p);
+        }
+    }
+
+    // Resources ordered by the first use, every one takes the first free surface of its description
+    std::vector<RenderResourceId> order;
+    for (size_t r = 0; r < m_resources.size(); ++r)
+    {
+        if (!m_resources[r].imported && m_resources[r].firstUse >= 0)
+        {
+            order.push_back(static_cast<RenderResourceId>(r));
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](RenderResourceId a, RenderResourceId b)
+    {
+        return m_resources[a].firstUse < m_resources[b].firstUse;
+    });
+
+    m_surfaces.clear();
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        Resource& resource = m_resources[order[i]];
+        for (size_t s = 0; s < m_surfaces.size() && resource.surface < 0; ++s)
+        {
+            if (m_surfaces[s].lastUse < resource.firstUse && SameDesc(m_surfaces[s].desc, resource.desc))
+            {
+                resource.surface = static_cast<int>(s);
+            }
+        }
+        if (resource.surface < 0)
+        {
+            Surface surface = { resource.desc, -1, NULL };
+            m_surfaces.push_back(surface);
+            resource.surface = static_cast<int>(m_surfaces.size() - 1);
+            m_report.aliasedBytes += EstimateRenderTargetBytes(resource.desc);
+        }
+        m_surfaces[resource.surface].lastUse = resource.lastUse;
+
+        ++m_report.usedTargets;
+        m_report.unaliasedBytes += EstimateRenderTargetBytes(resource.desc);
+    }
+    m_report.surfaces = static_cast<unsigned>(m_surfaces.size());
+
+    for (size_t p = 0; p < m_passes.size(); ++p)
+    {
+        uint64_t liveBytes = 0;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const Resource& resource = m_resources[order[i]];
+            if (resource.firstUse <= static_cast<int>(p) && static_cast<int>(p) <= resource.lastUse)
+            {
+                liveBytes += EstimateRenderTargetBytes(resource.desc);
+            }
+        }
+        m_report.peakLiveBytes = std::max(m_report.peakLiveBytes, liveBytes);
+    }
+}
+
+bool RenderGraph::Execute(RenderTargetBackend& backend)
+{
+    if (!m_compiled)
+    {
+        m_error = "graph is not compiled";
+        return false;
+    }
+    if (m_backend && m_backend != &backend)
+    {
+        ReleaseSurfaces();
+    }
+
+    m_backend = &backend;
+    for (size_t s = 0; s < m_surfaces.size(); ++s)
+    {
+        if (!m_surfaces[s].target)
+        {
+            m_surfaces[s].target = backend.CreateTarget(m_surfaces[s].desc);
+            if (!m_surfaces[s].target)
+            {
+                m_error = "unable to create a render target";
+                return false;
+            }
+        }
+    }
+    for (size_t r = 0; r < m_resources.size(); ++r)
+    {
+        if (!m_resources[r].imported)
+        {
+            m_resourceSurfaces[r] = m_resources[r].surface >= 0 ? m_surfaces[m_resources[r].surface].target : NULL;
+        }
+    }
+
+    for (size_t p = 0; p < m_passes.size(); ++p)
+    {
+        if (!m_passes[p].culled && m_passes[p].execute)
+        {
+            m_passes[p].execute(RenderPassContext(m_resourceSurfaces, static_cast<RenderPassId>(p)));
+        }
+    }
+    return true;
+}
+
+void RenderGraph::ReleaseSurfaces()
+{
+    for (size_t s = 0; s < m_surfaces.size(); ++s)
+    {
+        if (m_surfaces[s].target)
+        {
+            m_backend->ReleaseTarget(m_surfaces[s].target);
+            m_surfaces[s].target = NULL;
+        }
+    }
+    m_backend = NULL;
+}
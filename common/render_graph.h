@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// @brief Render target identifier inside of the graph
+typedef unsigned RenderResourceId;
+
+/// @brief Pass identifier inside of the graph
+typedef unsigned RenderPassId;
+
+/// @brief Render target dimensions and format
+/// Targets with equal descriptions are interchangeable, so they may share a surface
+struct RenderTargetDesc
+{
+    unsigned width;
+    unsigned height;
+
+    /// Format, D3DFORMAT value on Direct3D
+    uint32_t format;
+
+    /// Bits per pixel of the format, used for memory estimation
+    unsigned bitsPerPixel;
+};
+
+/// @brief Estimated size of the render target in bytes
+uint64_t EstimateRenderTargetBytes(const RenderTargetDesc& desc);
+
+/// @brief Creates the surfaces of transient targets
+/// All methods are called on the thread which owns the device
+class RenderTargetBackend
+{
+public:
+
+    virtual ~RenderTargetBackend() {}
+
+    /// @brief Returns NULL on failure
+    virtual void* CreateTarget(const RenderTargetDesc& desc) = 0;
+    virtual void ReleaseTarget(void* target) = 0;
+};
+
+/// @brief Surfaces of the targets the pass uses, valid while the pass runs
+class RenderPassContext
+{
+public:
+
+    RenderPassContext(const std::vector<void*>& surfaces, RenderPassId pass) : m_surfaces(surfaces), m_pass(pass) {}
+
+    void* Target(RenderResourceId resource) const { return m_surfaces[resource]; }
+    RenderPassId Pass() const { return m_pass; }
+
+private:
+
+    const std::vector<void*>& m_surfaces;
+    RenderPassId m_pass;
+};
+
+typedef std::function<void(const RenderPassContext&)> RenderPassExecute;
+
+/// @brief Result of the graph compilation
+struct RenderGraphReport
+{
+    unsigned passes;
+    unsigned culledPasses;
+    unsigned transientTargets;
+
+    /// Transient targets used by the passes which were not culled
+    unsigned usedTargets;
+
+    /// Surfaces created for the used targets
+    unsigned surfaces;
+
+    /// Memory of the used targets if every one had its own surface
+    uint64_t unaliasedBytes;
+
+    /// Memory of the surfaces actually created
+    uint64_t aliasedBytes;
+
+    /// Largest memory of the targets alive during one pass, the lower bound of aliasing
+    uint64_t peakLiveBytes;
+};
+
+/// @brief Format the report as several log lines
+std::string FormatRenderGraphReport(const RenderGraphReport& report);
+
+/// @brief Declarative frame description
+/// Passes declare the targets they read and write and are executed in the order
+/// they were added. Passes which do not contribute to an imported target are culled.
+/// Transient targets are created by the graph, targets with the same description and
+/// non-overlapping lifetimes share one surface. Imported targets, e.g. the back buffer,
+/// belong to the caller and are never aliased
+class RenderGraph
+{
+public:
+
+    RenderGraph();
+
+    /// @brief Releases surfaces through the backend passed to Execute()
+    ~RenderGraph();
+
+    /// @brief Target created and owned by the graph
+    RenderResourceId CreateTarget(const std::string& name, const RenderTargetDesc& desc);
+
+    /// @brief Target owned by the caller, its surface is set with SetImportedTarget()
+    RenderResourceId ImportTarget(const std::string& name, const RenderTargetDesc& desc);
+    void SetImportedTarget(RenderResourceId resource, void* surface);
+
+    /// @brief Pass writing all of its write targets
+    /// A target both read and written is modified, the previous content is kept
+    RenderPassId AddPass(const std::string& name, const std::vector<RenderResourceId>& reads,
+        const std::vector<RenderResourceId>& writes, const RenderPassExecute& execute);
+
+    /// @brief Validate, cull passes and assign surfaces
+    /// Fails if a target is read before it is written or a pass writes nothing,
+    /// the reason is returned by Error()
+    bool Compile();
+
+    /// @brief Run the passes which were not culled
+    /// Surfaces are created on the first call, the graph must be compiled
+    bool Execute(RenderTargetBackend& backend);
+
+    /// @brief Release the surfaces, they are created again by the next Execute()
+    void ReleaseSurfaces();
+
+    const RenderGraphReport& Report() const { return m_report; }
+    const std::string& Error() const { return m_error; }
+
+    bool PassCulled(RenderPassId pass) const { return m_passes[pass].culled; }
+    const std::string& PassName(RenderPassId pass) const { return m_passes[pass].name; }
+    const std::string& TargetName(RenderResourceId resource) const { return m_resources[resource].name; }
+
+    /// @brief Surface slot of the transient target, -1 for unused and imported targets
+    int TargetSurface(RenderResourceId resource) const { return m_resources[resource].surface; }
+
+private:
+
+    struct Resource
+    {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+
+        /// First and last not culled pass using the target
+        int firstUse;
+        int lastUse;
+
+        int surface;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<RenderResourceId> reads;
+        std::vector<RenderResourceId> writes;
+        RenderPassExecute execute;
+        bool culled;
+    };
+
+    struct Surface
+    {
+        RenderTargetDesc desc;
+        int lastUse;
+        void* target;
+    };
+
+    RenderGraph(const RenderGraph&);
+    RenderGraph& operator=(const RenderGraph&);
+
+    bool Validate();
+    void CullPasses();
+    void AssignSurfaces();
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<Surface> m_surfaces;
+
+    /// Surface of every resource, handed to the passes
+    std::vector<void*> m_resourceSurfaces;
+
+    RenderTargetBackend* m_backend;
+    bool m_compiled;
+    RenderGraphReport m_report;
+    std::string m_error;
+};
@@ -0,0 +1,360 @@
+#include "shader_compile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+
+const uint32_t REQUEST_MAGIC = 0x43533344; // "D3SC"
+const uint32_t RESULT_MAGIC = 0x52533344;  // "D3SR"
+const uint32_t PROTOCOL_VERSION = 1;
+
+void AppendU32(std::string& payload, uint32_t value)
+{
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        payload.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void AppendString(std::string& payload, const std::string& value)
+{
+    AppendU32(payload, static_cast<uint32_t>(value.size()));
+    payload.append(value);
+}
+
+/// @brief Bounds-checked reader of a payload
+class PayloadReader
+{
+public:
+
+    explicit PayloadReader(const std::string& payload) : m_payload(payload), m_position(0) {}
+
+    bool ReadU32(uint32_t& value)
+    {
+        if (m_payload.size() - m_position < 4)
+        {
+            return false;
+        }
+        value = 0;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(m_payload[m_position + i])) << (8 * i);
+        }
+        m_position += 4;
+        return true;
+    }
+
+    bool ReadString(std::string& value)
+    {
+        uint32_t size = 0;
+        if (!ReadU32(size) || m_payload.size() - m_position < size)
+        {
+            return false;
+        }
+        value.assign(m_payload, m_position, size);
+        m_position += size;
+        return true;
+    }
+
+    bool AtEnd() const { return m_position == m_payload.size(); }
+
+private:
+
+    const std::string& m_payload;
+    size_t m_position;
+};
+
+/// @brief FNV-1a, 64 bit
+uint64_t HashBytes(uint64_t hash, const std::string& bytes)
+{
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+} // namespace
+
+std::string ShaderRequestKey(const ShaderCompileRequest& request)
+{
+    // Encoded request is unambiguous, every field is length-prefixed
+    std::string payload;
+    EncodeShaderRequest(request, payload);
+
+    char key[17] = {};
+    snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(HashBytes(14695981039346656037ull, payload)));
+    return key;
+}
+
+ShaderCompileResult StubShaderCompile(const ShaderCompileRequest& request, unsigned delayMs)
+{
+    if (delayMs)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+    }
+
+    ShaderCompileResult result;
+    result.origin = SHADER_RESULT_COMPILED;
+    if (std::string::npos != request.source.find("#error"))
+    {
+        result.succeeded = false;
+        result.errors = "stub compiler: #error directive in " + request.entryPoint;
+        return result;
+    }
+
+    result.succeeded = true;
+    result.bytecode = "STUB" + request.profile + ":" + request.entryPoint + ":" + ShaderRequestKey(request);
+    return result;
+}
+
+void EncodeShaderRequest(const ShaderCompileRequest& request, std::string& payload)
+{
+    payload.clear();
+    AppendU32(payload, REQUEST_MAGIC);
+    AppendU32(payload, PROTOCOL_VERSION);
+    AppendString(payload, request.source);
+    AppendString(payload, request.entryPoint);
+    AppendString(payload, request.profile);
+    AppendU32(payload, request.flags);
+}
+
+bool DecodeShaderRequest(const std::string& payload, ShaderCompileRequest& request)
+{
+    PayloadReader reader(payload);
+    uint32_t magic = 0, version = 0;
+    return reader.ReadU32(magic) && REQUEST_MAGIC == magic &&
+        reader.ReadU32(version) && PROTOCOL_VERSION == version &&
+        reader.ReadString(request.source) &&
+        reader.ReadString(request.entryPoint) &&
+        reader.ReadString(request.profile) &&
+        reader.ReadU32(request.flags) &&
+        reader.AtEnd();
+}
+
+void EncodeShaderResult(const ShaderCompileResult& result, std::string& payload)
+{
+    payload.clear();
+    AppendU32(payload, RESULT_MAGIC);
+    AppendU32(payload, PROTOCOL_VERSION);
+    AppendU32(payload, result.succeeded ? 1 : 0);
+    AppendU32(payload, static_cast<uint32_t>(result.origin));
+    AppendString(payload, result.bytecode);
+    AppendString(payload, result.errors);
+}
+
+bool DecodeShaderResult(const std::string& payload, ShaderCompileResult& result)
+{
+    PayloadReader reader(payload);
+    uint32_t magic = 0, version = 0, succeeded = 0, origin = 0;
+    if (!(reader.ReadU32(magic) && RESULT_MAGIC == magic &&
+        reader.ReadU32(version) && PROTOCOL_VERSION == version &&
+        reader.ReadU32(succeeded) && reader.ReadU32(origin) && origin <= SHADER_RESULT_JOINED &&
+        reader.ReadString(result.bytecode) &&
+        reader.ReadString(result.errors) &&
+        reader.AtEnd()))
+    {
+        return false;
+    }
+    result.succeeded = 0 != succeeded;
+    result.origin = static_cast<ShaderResultOrigin>(origin);
+    return true;
+}
+
+ShaderCompileService::ShaderCompileService(const ShaderCompiler& compiler, const std::string& cacheDirectory, unsigned workerCount)
+    : m_compiler(compiler)
+    , m_cacheDirectory(cacheDirectory)
+    , m_stats()
+    , m_stop(false)
+{
+    if (!m_cacheDirectory.empty())
+    {
+        MakeDirectory(m_cacheDirectory);
+    }
+
+    if (0 == workerCount)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < workerCount; ++i)
+    {
+        m_workers.push_back(std::thread(&ShaderCompileService::WorkerProc, this));
+    }
+}
+
+ShaderCompileService::~ShaderCompileService()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_jobReady.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i].join();
+    }
+}
+
+ShaderCompileResult ShaderCompileService::Compile(const ShaderCompileRequest& request)
+{
+    const std::string key = ShaderRequestKey(request);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    ++m_stats.requests;
+
+    std::map<std::string, ShaderCompileResult>::const_iterator stored = m_memory.find(key);
+    if (stored != m_memory.end())
+    {
+        ++m_stats.memoryHits;
+        ShaderCompileResult result = stored->second;
+        result.origin = SHADER_RESULT_MEMORY;
+        return result;
+    }
+
+    // Join the compilation requested by another client, or queue a new one
+    std::shared_ptr<Job> job;
+    std::map<std::string, std::shared_ptr<Job> >::iterator inFlight = m_inFlight.find(key);
+    bool joined = inFlight != m_inFlight.end();
+    if (joined)
+    {
+        ++m_stats.joined;
+        job = inFlight->second;
+    }
+    else
+    {
+        job = std::make_shared<Job>();
+        job->key = key;
+        job->request = request;
+        job->done = false;
+        m_inFlight[key] = job;
+        m_queue.push_back(job);
+        m_jobReady.notify_one();
+    }
+
+    m_jobDone.wait(lock, [&job] { return job->done; });
+
+    ShaderCompileResult result = job->result;
+    if (joined)
+    {
+        result.origin = SHADER_RESULT_JOINED;
+    }
+    return result;
+}
+
+ShaderServiceStats ShaderCompileService::Stats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+void ShaderCompileService::WorkerProc()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;)
+    {
+        // Queued jobs are finished before stopping, their callers are waiting
+        m_jobReady.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            return;
+        }
+
+        std::shared_ptr<Job> job = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+
+        ShaderCompileResult result;
+        bool fromDisk = ReadDiskResult(job->key, result);
+        if (fromDisk)
+        {
+            result.origin = SHADER_RESULT_DISK;
+        }
+        else
+        {
+            result = m_compiler(job->request);
+            result.origin = SHADER_RESULT_COMPILED;
+            if (result.succeeded)
+            {
+                WriteDiskResult(job->key, result);
+            }
+        }
+
+        lock.lock();
+        if (fromDisk)
+        {
+            ++m_stats.diskHits;
+        }
+        else
+        {
+            ++m_stats.compiles;
+            m_stats.failures += result.succeeded ? 0 : 1;
+        }
+        m_memory[job->key] = result;
+        m_inFlight.erase(job->key);
+        job->result = result;
+        job->done = true;
+        m_jobDone.notify_all();
+    }
+}
+
+bool ShaderCompileService::ReadDiskResult(const std::string& key, ShaderCompileResult& result) const
+{
+    if (m_cacheDirectory.empty())
+    {
+        return false;
+    }
+
+    std::ifstream file((m_cacheDirectory + "/" + key + ".bin").c_str(), std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return DecodeShaderResult(buffer.str(), result);
+}
+
+void ShaderCompileService::WriteDiskResult(const std::string& key, const ShaderCompileResult& result) const
+{
+    if (m_cacheDirectory.empty())
+    {
+        return;
+    }
+
+    // Written under a temporary name, so that a reader never sees a partial file
+    const std::string path = m_cacheDirectory + "/" + key + ".bin";
+    const std::string temporaryPath = path + ".tmp";
+    std::string payload;
+    EncodeShaderResult(result, payload);
+    {
+        std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file.write(payload.data(), payload.size()))
+        {
+            return;
+        }
+    }
+    if (0 != std::rename(temporaryPath.c_str(), path.c_str()))
+    {
+        std::remove(temporaryPath.c_str());
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief HLSL compilation parameters, mirror the arguments of D3DXCompileShader
+struct ShaderCompileRequest
+{
+    std::string source;
+    std::string entryPoint;
+    std::string profile;
+    uint32_t flags;
+};
+
+/// @brief Where the result came from
+enum ShaderResultOrigin
+{
+    SHADER_RESULT_COMPILED = 0,
+    SHADER_RESULT_MEMORY = 1,
+    SHADER_RESULT_DISK = 2,
+
+    /// Same request was already being compiled for another client
+    SHADER_RESULT_JOINED = 3
+};
+
+struct ShaderCompileResult
+{
+    bool succeeded;
+    ShaderResultOrigin origin;
+
+    /// Shader bytecode, as returned in the D3DX shader buffer
+    std::string bytecode;
+
+    /// Compiler messages
+    std::string errors;
+};
+
+/// @brief Compiler used by the service, D3DX on Windows or a stub
+typedef std::function<ShaderCompileResult(const ShaderCompileRequest&)> ShaderCompiler;
+
+/// @brief Hex digest identifying the request, used as the cache key
+std::string ShaderRequestKey(const ShaderCompileRequest& request);
+
+/// @brief Deterministic compiler emulation for platforms without D3DX
+/// Bytecode is derived from the request, sources containing "#error" fail.
+/// Delay emulates the compilation cost
+ShaderCompileResult StubShaderCompile(const ShaderCompileRequest& request, unsigned delayMs);
+
+/// @brief Message payloads of the compile protocol
+/// Every message is sent as 32-bit little-endian payload size followed by the payload
+void EncodeShaderRequest(const ShaderCompileRequest& request, std::string& payload);
+bool DecodeShaderRequest(const std::string& payload, ShaderCompileRequest& request);
+void EncodeShaderResult(const ShaderCompileResult& result, std::string& payload);
+bool DecodeShaderResult(const std::string& payload, ShaderCompileResult& result);
+
+/// @brief Counters of the compile service
+struct ShaderServiceStats
+{
+    unsigned requests;
+    unsigned memoryHits;
+    unsigned diskHits;
+
+    /// Requests which waited for the same shader compiled for another client
+    unsigned joined;
+
+    unsigned compiles;
+    unsigned failures;
+};
+
+/// @brief Shader compilation with deduplication and result store
+/// Identical requests in flight are compiled once and all callers get the result.
+/// Results are kept in memory, successful ones also in the cache directory,
+/// so that they survive the restart. Compilation runs on the worker pool
+class ShaderCompileService
+{
+public:
+
+    /// @brief Empty cache directory disables the disk store, 0 workers means one per hardware thread
+    ShaderCompileService(const ShaderCompiler& compiler, const std::string& cacheDirectory, unsigned workerCount = 0);
+
+    /// @brief Finish queued compilations and stop workers
+    ~ShaderCompileService();
+
+    /// @brief Compile or take from the store, blocks until the result is ready
+    /// Safe to call from any number of threads
+    ShaderCompileResult Compile(const ShaderCompileRequest& request);
+
+    ShaderServiceStats Stats() const;
+
+private:
+
+    struct Job
+    {
+        std::string key;
+        ShaderCompileRequest request;
+        bool done;
+        ShaderCompileResult result;
+    };
+
+    ShaderCompileService(const ShaderCompileService&);
+    ShaderCompileService& operator=(const ShaderCompileService&);
+
+    void WorkerProc();
+
+    bool ReadDiskResult(const std::string& key, ShaderCompileResult& result) const;
+    void WriteDiskResult(const std::string& key, const ShaderCompileResult& result) const;
+
+    ShaderCompiler m_compiler;
+    std::string m_cacheDirectory;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_jobDone;
+    std::deque<std::shared_ptr<Job> > m_queue;
+    std::map<std::string, std::shared_ptr<Job> > m_inFlight;
+    std::map<std::string, ShaderCompileResult> m_memory;
+    ShaderServiceStats m_stats;
+    bool m_stop;
+
+    std::vector<std::thread> m_workers;
+};
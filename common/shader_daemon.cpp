@@ -0,0 +1,502 @@
+#include "shader_daemon.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const intptr_t INVALID_CONNECTION = -1;
+
+/// Larger frames are rejected as corrupted
+const uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+/// Transfers of the daemon connections wait for the peer without a limit
+const unsigned NO_TIMEOUT = 0;
+
+#ifdef _WIN32
+
+/// @brief Read or write on a pipe opened with FILE_FLAG_OVERLAPPED, cancelled after the timeout
+bool TransferOverlapped(HANDLE handle, char* data, DWORD size, bool write, unsigned timeoutMs, DWORD& transferred)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (NULL == overlapped.hEvent)
+    {
+        return false;
+    }
+
+    BOOL done = write ? WriteFile(handle, data, size, NULL, &overlapped) : ReadFile(handle, data, size, NULL, &overlapped);
+    if (done || ERROR_IO_PENDING == GetLastError())
+    {
+        // Cancelled transfer completes with ERROR_OPERATION_ABORTED
+        if (!done && WAIT_OBJECT_0 != WaitForSingleObject(overlapped.hEvent, timeoutMs))
+        {
+            CancelIo(handle);
+        }
+        done = GetOverlappedResult(handle, &overlapped, &transferred, TRUE);
+    }
+    CloseHandle(overlapped.hEvent);
+    return done && transferred > 0;
+}
+
+#else
+
+/// @brief Wait until the socket is ready for the events, false after the timeout
+bool WaitSocket(int handle, short events, unsigned timeoutMs)
+{
+    pollfd descriptor = { handle, events, 0 };
+    return NO_TIMEOUT == timeoutMs || poll(&descriptor, 1, static_cast<int>(timeoutMs)) > 0;
+}
+
+#endif
+
+/// @brief Timeout applies to every transfer, the pipe of a transfer with a timeout has to be overlapped
+bool ReadBytes(intptr_t handle, char* data, size_t size, unsigned timeoutMs)
+{
+    while (size)
+    {
+#ifdef _WIN32
+        DWORD read = 0;
+        if (NO_TIMEOUT != timeoutMs)
+        {
+            if (!TransferOverlapped(reinterpret_cast<HANDLE>(handle), data, static_cast<DWORD>(size), false, timeoutMs, read))
+            {
+                return false;
+            }
+        }
+        else if (!ReadFile(reinterpret_cast<HANDLE>(handle), data, static_cast<DWORD>(size), &read, NULL) || 0 == read)
+        {
+            return false;
+        }
+#else
+        if (!WaitSocket(static_cast<int>(handle), POLLIN, timeoutMs))
+        {
+            return false;
+        }
+        ssize_t read = recv(static_cast<int>(handle), data, size, 0);
+        if (read <= 0)
+        {
+            return false;
+        }
+#endif
+        data += read;
+        size -= read;
+    }
+    return true;
+}
+
+bool WriteBytes(intptr_t handle, const char* data, size_t size, unsigned timeoutMs)
+{
+    while (size)
+    {
+#ifdef _WIN32
+        DWORD written = 0;
+        if (NO_TIMEOUT != timeoutMs)
+        {
+            if (!TransferOverlapped(reinterpret_cast<HANDLE>(handle), const_cast<char*>(data), static_cast<DWORD>(size), true, timeoutMs, written))
+            {
+                return false;
+            }
+        }
+        else if (!WriteFile(reinterpret_cast<HANDLE>(handle), data, static_cast<DWORD>(size), &written, NULL) || 0 == written)
+        {
+            return false;
+        }
+#else
+        if (!WaitSocket(static_cast<int>(handle), POLLOUT, timeoutMs))
+        {
+            return false;
+        }
+#ifdef MSG_NOSIGNAL
+        ssize_t written = send(static_cast<int>(handle), data, size, MSG_NOSIGNAL);
+#else
+        ssize_t written = send(static_cast<int>(handle), data, size, 0);
+#endif
+        if (written <= 0)
+        {
+            return false;
+        }
+#endif
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool ReadFrame(intptr_t handle, std::string& payload, unsigned timeoutMs)
+{
+    unsigned char header[4] = {};
+    if (!ReadBytes(handle, reinterpret_cast<char*>(header), sizeof(header), timeoutMs))
+    {
+        return false;
+    }
+    const uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24);
+    if (size > MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+    payload.resize(size);
+    return 0 == size || ReadBytes(handle, &payload[0], size, timeoutMs);
+}
+
+bool WriteFrame(intptr_t handle, const std::string& payload, unsigned timeoutMs)
+{
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+    const char header[4] =
+    {
+        static_cast<char>(size & 0xFF),
+        static_cast<char>((size >> 8) & 0xFF),
+        static_cast<char>((size >> 16) & 0xFF),
+        static_cast<char>((size >> 24) & 0xFF)
+    };
+    return WriteBytes(handle, header, sizeof(header), timeoutMs) && WriteBytes(handle, payload.data(), payload.size(), timeoutMs);
+}
+
+/// @brief Unblock the thread reading the connection
+void InterruptConnection(intptr_t handle)
+{
+#ifdef _WIN32
+    DisconnectNamedPipe(reinterpret_cast<HANDLE>(handle));
+#else
+    shutdown(static_cast<int>(handle), SHUT_RDWR);
+#endif
+}
+
+void CloseConnection(intptr_t handle)
+{
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+    close(static_cast<int>(handle));
+#endif
+}
+
+#ifdef _WIN32
+
+HANDLE CreatePipeInstance(const std::string& address)
+{
+    return CreateNamedPipeA(address.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+        PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, NULL);
+}
+
+#else
+
+bool MakeSocketAddress(const std::string& address, sockaddr_un& socketAddress)
+{
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    socketAddress.sun_family = AF_UNIX;
+    if (address.empty() || address.size() >= sizeof(socketAddress.sun_path))
+    {
+        return false;
+    }
+    memcpy(socketAddress.sun_path, address.c_str(), address.size());
+    return true;
+}
+
+#endif
+
+} // namespace
+
+std::string DefaultShaderDaemonAddress()
+{
+    const char* address = getenv("D3D_SHADER_DAEMON");
+    if (address && *address)
+    {
+        return address;
+    }
+#ifdef _WIN32
+    return "\\\\.\\pipe\\d3d_shader_daemon";
+#else
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory && *directory ? directory : "/tmp") + "/d3d_shader_daemon.sock";
+#endif
+}
+
+ShaderDaemonServer::ShaderDaemonServer(ShaderCompileService& service)
+    : m_service(service)
+    , m_listener(INVALID_CONNECTION)
+    , m_stop(false)
+    , m_connectionCount(0)
+{
+}
+
+ShaderDaemonServer::~ShaderDaemonServer()
+{
+    Stop();
+}
+
+bool ShaderDaemonServer::Start(const std::string& address)
+{
+    if (m_acceptThread.joinable())
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    // The first instance fails if another daemon owns the pipe name
+    HANDLE pipe = CreateNamedPipeA(address.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, NULL);
+    if (INVALID_HANDLE_VALUE == pipe)
+    {
+        return false;
+    }
+    m_listener = reinterpret_cast<intptr_t>(pipe);
+#else
+    sockaddr_un socketAddress;
+    if (!MakeSocketAddress(address, socketAddress))
+    {
+        return false;
+    }
+
+    // Socket file left by a daemon that was killed is removed, a live daemon is not replaced
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        return false;
+    }
+    const bool alive = 0 == connect(listener, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress));
+    close(listener);
+    if (alive)
+    {
+        return false;
+    }
+    unlink(address.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        return false;
+    }
+    if (0 != bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) || 0 != listen(listener, 64))
+    {
+        close(listener);
+        return false;
+    }
+    m_listener = listener;
+#endif
+
+    m_address = address;
+    m_stop = false;
+    m_acceptThread = std::thread(&ShaderDaemonServer::AcceptProc, this);
+    return true;
+}
+
+void ShaderDaemonServer::Stop()
+{
+    if (!m_acceptThread.joinable())
+    {
+        return;
+    }
+
+    m_stop = true;
+#ifdef _WIN32
+    // Accept thread waits in ConnectNamedPipe, connecting to the pipe wakes it
+    HANDLE wake = CreateFileA(m_address.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (INVALID_HANDLE_VALUE != wake)
+    {
+        CloseHandle(wake);
+    }
+#else
+    shutdown(static_cast<int>(m_listener), SHUT_RDWR);
+#endif
+    m_acceptThread.join();
+
+#ifndef _WIN32
+    close(static_cast<int>(m_listener));
+    unlink(m_address.c_str());
+#endif
+    m_listener = INVALID_CONNECTION;
+
+    // Connection threads take the lock when they finish, so they are joined without it
+    std::list<Connection> connections;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        connections.splice(connections.end(), m_connections);
+        for (std::list<Connection>::iterator connection = connections.begin(); connection != connections.end(); ++connection)
+        {
+            InterruptConnection(connection->handle);
+        }
+    }
+    for (std::list<Connection>::iterator connection = connections.begin(); connection != connections.end(); ++connection)
+    {
+        connection->thread.join();
+        CloseConnection(connection->handle);
+    }
+}
+
+void ShaderDaemonServer::AcceptProc()
+{
+    for (;;)
+    {
+        intptr_t handle = INVALID_CONNECTION;
+#ifdef _WIN32
+        // Listener is the pipe instance waiting for the next client
+        HANDLE pipe = reinterpret_cast<HANDLE>(m_listener);
+        BOOL connected = ConnectNamedPipe(pipe, NULL) || ERROR_PIPE_CONNECTED == GetLastError();
+        if (m_stop)
+        {
+            CloseHandle(pipe);
+            return;
+        }
+        if (!connected)
+        {
+            continue;
+        }
+        HANDLE next = CreatePipeInstance(m_address);
+        if (INVALID_HANDLE_VALUE == next)
+        {
+            DisconnectNamedPipe(pipe);
+            continue;
+        }
+        handle = reinterpret_cast<intptr_t>(pipe);
+        m_listener = reinterpret_cast<intptr_t>(next);
+#else
+        int socketHandle = accept(static_cast<int>(m_listener), NULL, NULL);
+        if (m_stop)
+        {
+            if (socketHandle >= 0)
+            {
+                close(socketHandle);
+            }
+            return;
+        }
+        if (socketHandle < 0)
+        {
+            continue;
+        }
+        handle = socketHandle;
+#endif
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        ReapConnections();
+        m_connections.push_back(Connection());
+        Connection& connection = m_connections.back();
+        connection.handle = handle;
+        connection.finished = false;
+        connection.thread = std::thread(&ShaderDaemonServer::ConnectionProc, this, &connection);
+        ++m_connectionCount;
+    }
+}
+
+void ShaderDaemonServer::ConnectionProc(Connection* connection)
+{
+    std::string payload;
+    ShaderCompileRequest request;
+    while (ReadFrame(connection->handle, payload, NO_TIMEOUT) && DecodeShaderRequest(payload, request))
+    {
+        EncodeShaderResult(m_service.Compile(request), payload);
+        if (!WriteFrame(connection->handle, payload, NO_TIMEOUT))
+        {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    connection->finished = true;
+}
+
+void ShaderDaemonServer::ReapConnections()
+{
+    std::list<Connection>::iterator connection = m_connections.begin();
+    while (connection != m_connections.end())
+    {
+        if (connection->finished)
+        {
+            connection->thread.join();
+            CloseConnection(connection->handle);
+            connection = m_connections.erase(connection);
+        }
+        else
+        {
+            ++connection;
+        }
+    }
+}
+
+const unsigned ShaderDaemonClient::DEFAULT_TIMEOUT_MS;
+
+ShaderDaemonClient::ShaderDaemonClient(const std::string& address, unsigned timeoutMs)
+    : m_address(address)
+    , m_timeoutMs(timeoutMs)
+    , m_handle(INVALID_CONNECTION)
+{
+}
+
+ShaderDaemonClient::~ShaderDaemonClient()
+{
+    Disconnect();
+}
+
+bool ShaderDaemonClient::Compile(const ShaderCompileRequest& request, ShaderCompileResult& result)
+{
+    if (INVALID_CONNECTION == m_handle && !Connect())
+    {
+        return false;
+    }
+
+    std::string payload;
+    EncodeShaderRequest(request, payload);
+    if (!WriteFrame(m_handle, payload, m_timeoutMs) || !ReadFrame(m_handle, payload, m_timeoutMs) || 
+        !DecodeShaderResult(payload, result))
+    {
+        // Daemon restarted, stopped or did not answer in time, the next request reconnects
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+bool ShaderDaemonClient::Connect()
+{
+#ifdef _WIN32
+    // Overlapped, so that reads and writes are cancelled after the timeout
+    const DWORD attributes = NO_TIMEOUT != m_timeoutMs ? FILE_FLAG_OVERLAPPED : 0;
+    HANDLE pipe = CreateFileA(m_address.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, attributes, NULL);
+    if (INVALID_HANDLE_VALUE == pipe && ERROR_PIPE_BUSY == GetLastError() && WaitNamedPipeA(m_address.c_str(), 1000))
+    {
+        pipe = CreateFileA(m_address.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, attributes, NULL);
+    }
+    if (INVALID_HANDLE_VALUE == pipe)
+    {
+        return false;
+    }
+    m_handle = reinterpret_cast<intptr_t>(pipe);
+#else
+    sockaddr_un socketAddress;
+    if (!MakeSocketAddress(m_address, socketAddress))
+    {
+        return false;
+    }
+    int socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketHandle < 0)
+    {
+        return false;
+    }
+    if (0 != connect(socketHandle, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)))
+    {
+        close(socketHandle);
+        return false;
+    }
+    m_handle = socketHandle;
+#endif
+    return true;
+}
+
+void ShaderDaemonClient::Disconnect()
+{
+    if (INVALID_CONNECTION != m_handle)
+    {
+        CloseConnection(m_handle);
+        m_handle = INVALID_CONNECTION;
+    }
+}
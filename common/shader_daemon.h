@@ -0,0 +1,98 @@
+#pragma once
+
+#include "shader_compile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// @brief Address from the D3D_SHADER_DAEMON environment variable, or the default
+/// Named pipe on Windows, Unix-domain socket in the temporary directory elsewhere
+std::string DefaultShaderDaemonAddress();
+
+/// @brief Serves a compile service to other processes
+/// Every connection is served by its own thread and may send any number of requests,
+/// each answered in order. Requests of all connections share the service, so the same
+/// shader requested by several processes is compiled once
+class ShaderDaemonServer
+{
+public:
+
+    explicit ShaderDaemonServer(ShaderCompileService& service);
+
+    /// @brief Stops serving, if started
+    ~ShaderDaemonServer();
+
+    /// @brief Start listening, fails if the address is in use or invalid
+    bool Start(const std::string& address);
+
+    /// @brief Close the listener and all connections, wait for the connection threads
+    void Stop();
+
+    /// @brief Connections accepted since start
+    unsigned Connections() const { return m_connectionCount; }
+
+private:
+
+    struct Connection
+    {
+        intptr_t handle;
+        std::thread thread;
+        bool finished;
+    };
+
+    ShaderDaemonServer(const ShaderDaemonServer&);
+    ShaderDaemonServer& operator=(const ShaderDaemonServer&);
+
+    void AcceptProc();
+    void ConnectionProc(Connection* connection);
+
+    /// @brief Join the threads of closed connections, called with the lock held
+    void ReapConnections();
+
+    ShaderCompileService& m_service;
+    std::string m_address;
+    intptr_t m_listener;
+
+    std::atomic<bool> m_stop;
+    std::atomic<unsigned> m_connectionCount;
+    std::thread m_acceptThread;
+
+    std::mutex m_lock;
+    std::list<Connection> m_connections;
+};
+
+/// @brief Connection to the daemon, connected on first use and kept open
+/// Not thread-safe, every thread should use its own client
+class ShaderDaemonClient
+{
+public:
+
+    /// Time a request waits for every read and write of the daemon connection
+    static const unsigned DEFAULT_TIMEOUT_MS = 10000;
+
+    /// @brief Zero timeout waits for the daemon without a limit
+    explicit ShaderDaemonClient(const std::string& address, unsigned timeoutMs = DEFAULT_TIMEOUT_MS);
+    ~ShaderDaemonClient();
+
+    /// @brief Compile on the daemon
+    /// Returns false if the daemon is not running, the connection failed or the daemon did
+    /// not answer within the timeout, the caller should then compile in-process.
+    /// Failed compilation is reported in the result
+    bool Compile(const ShaderCompileRequest& request, ShaderCompileResult& result);
+
+private:
+
+    ShaderDaemonClient(const ShaderDaemonClient&);
+    ShaderDaemonClient& operator=(const ShaderDaemonClient&);
+
+    bool Connect();
+    void Disconnect();
+
+    std::string m_address;
+    unsigned m_timeoutMs;
+    intptr_t m_handle;
+};
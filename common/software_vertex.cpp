@@ -0,0 +1,489 @@
+#include "software_vertex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_VERTEX_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const char* VERTEX_PROCESSING_NAMES[] = { "hardware", "mixed", "software" };
+const VertexProcessingMode VERTEX_PROCESSING_MODES[] =
+{
+    VERTEX_PROCESSING_HARDWARE,
+    VERTEX_PROCESSING_MIXED,
+    VERTEX_PROCESSING_SOFTWARE
+};
+
+inline const float* StridedFloats(const void* base, size_t stride, size_t index)
+{
+    return reinterpret_cast<const float*>(static_cast<const char*>(base) + stride * index);
+}
+
+/// @brief Pack decoded RGBA into D3DCOLOR
+uint32_t PackColor(const float rgba[4])
+{
+    uint32_t packed = 0;
+    static const unsigned SHIFTS[] = { 16, 8, 0, 24 };
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        float value = std::min(std::max(rgba[c], 0.0f), 1.0f);
+        packed |= static_cast<uint32_t>(value * 255.0f + 0.5f) << SHIFTS[c];
+    }
+    return packed;
+}
+
+/// @brief Per channel interpolation of D3DCOLOR
+uint32_t LerpColor(uint32_t a, uint32_t b, float t)
+{
+    uint32_t color = 0;
+    for (unsigned shift = 0; shift < 32; shift += 8)
+    {
+        const float ca = static_cast<float>((a >> shift) & 0xFF);
+        const float cb = static_cast<float>((b >> shift) & 0xFF);
+        color |= static_cast<uint32_t>(ca + (cb - ca) * t + 0.5f) << shift;
+    }
+    return color;
+}
+
+} // namespace
+
+std::vector<VertexProcessingMode> VertexProcessingCandidates(unsigned devCaps, unsigned vertexShaderVersion,
+    unsigned requiredVertexShaderVersion, const char* override)
+{
+    std::vector<VertexProcessingMode> candidates;
+    if (devCaps & DEVCAPS_HW_TRANSFORM_AND_LIGHT)
+    {
+        // Low word holds major and minor version, high word the shader type token
+        if ((vertexShaderVersion & 0xFFFF) >= (requiredVertexShaderVersion & 0xFFFF))
+        {
+            candidates.push_back(VERTEX_PROCESSING_HARDWARE);
+        }
+        candidates.push_back(VERTEX_PROCESSING_MIXED);
+    }
+    candidates.push_back(VERTEX_PROCESSING_SOFTWARE);
+
+    if (override && *override)
+    {
+        for (size_t i = 0; i < sizeof(VERTEX_PROCESSING_NAMES) / sizeof(VERTEX_PROCESSING_NAMES[0]); ++i)
+        {
+            if (0 == strcmp(override, VERTEX_PROCESSING_NAMES[i]))
+            {
+                const VertexProcessingMode mode = VERTEX_PROCESSING_MODES[i];
+                candidates.erase(std::remove(candidates.begin(), candidates.end(), mode), candidates.end());
+                candidates.insert(candidates.begin(), mode);
+            }
+        }
+    }
+    return candidates;
+}
+
+const char* VertexProcessingName(VertexProcessingMode mode)
+{
+    for (size_t i = 0; i < sizeof(VERTEX_PROCESSING_MODES) / sizeof(VERTEX_PROCESSING_MODES[0]); ++i)
+    {
+        if (VERTEX_PROCESSING_MODES[i] == mode)
+        {
+            return VERTEX_PROCESSING_NAMES[i];
+        }
+    }
+    return "unknown";
+}
+
+SoftwareVertexPipeline::SoftwareVertexPipeline()
+    : m_simd(true)
+    , m_processedCount(0)
+{
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        m_matrix[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+    ScreenViewport viewport = { 0, 0, 1, 1, 0.0f, 1.0f };
+    m_viewport = viewport;
+}
+
+void SoftwareVertexPipeline::SetTransform(const float world[16], const float viewProjection[16])
+{
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        for (unsigned column = 0; column < 4; ++column)
+        {
+            float value = 0.0f;
+            for (unsigned k = 0; k < 4; ++k)
+            {
+                value += world[row * 4 + k] * viewProjection[k * 4 + column];
+            }
+            m_matrix[row * 4 + column] = value;
+        }
+    }
+}
+
+void SoftwareVertexPipeline::SetViewport(const ScreenViewport& viewport)
+{
+    m_viewport = viewport;
+}
+
+bool SoftwareVertexPipeline::Simd() const
+{
+#ifdef SOFTWARE_VERTEX_SSE2
+    return m_simd;
+#else
+    return false;
+#endif
+}
+
+void SoftwareVertexPipeline::Process(const float* positions, size_t positionStride,
+    const uint32_t* colors, size_t colorStride,
+    const float* texCoords, size_t texCoordStride,
+    size_t count)
+{
+    m_vertices.resize(count);
+    m_clipCodes.resize(count);
+    m_clipPositions.resize(4 * count);
+    m_processedCount = count;
+    if (0 == count)
+    {
+        return;
+    }
+
+    if (Simd())
+    {
+        TransformSimd(positions, positionStride, count);
+    }
+    else
+    {
+        TransformScalar(positions, positionStride, 0, count);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        TransformedVertex& vertex = m_vertices[i];
+        vertex.color = colors ? *reinterpret_cast<const uint32_t*>(reinterpret_cast<const char*>(colors) + colorStride * i) : 0xFFFFFFFF;
+        if (texCoords)
+        {
+            const float* texCoord = StridedFloats(texCoords, texCoordStride, i);
+            vertex.u = texCoord[0];
+            vertex.v = texCoord[1];
+        }
+        else
+        {
+            vertex.u = vertex.v = 0.0f;
+        }
+    }
+}
+
+void SoftwareVertexPipeline::Process(const VertexLayout& layout, const void* vertices, size_t count)
+{
+    const char* base = static_cast<const char*>(vertices);
+    const size_t stride = layout.Stride();
+
+    const float* positions = NULL;
+    size_t positionStride = 0;
+    const uint32_t* colors = NULL;
+    const float* texCoords = NULL;
+    size_t texCoordStride = 0;
+
+    const std::vector<VertexElement>& elements = layout.Elements();
+    for (size_t e = 0; e < elements.size(); ++e)
+    {
+        const VertexElement& element = elements[e];
+        const bool floats = VET_FLOAT1 <= element.type && element.type <= VET_FLOAT4;
+        if (VEU_POSITION == element.usage && !positions)
+        {
+            if (VET_FLOAT3 == element.type || VET_FLOAT4 == element.type)
+            {
+                positions = reinterpret_cast<const float*>(base + element.offset);
+                positionStride = stride;
+                continue;
+            }
+            m_decodedPositions.resize(count * 3);
+            for (size_t i = 0; i < count; ++i)
+            {
+                float value[4];
+                DecodeVertexAttribute(element.type, base + stride * i + element.offset, value);
+                std::copy(value, value + 3, &m_decodedPositions[i * 3]);
+            }
+            positions = m_decodedPositions.data();
+            positionStride = 3 * sizeof(float);
+        }
+        else if (VEU_COLOR == element.usage && !colors)
+        {
+            m_decodedColors.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                float value[4];
+                DecodeVertexAttribute(element.type, base + stride * i + element.offset, value);
+                m_decodedColors[i] = PackColor(value);
+            }
+            colors = m_decodedColors.data();
+        }
+        else if (VEU_TEXCOORD == element.usage && 0 == element.usageIndex && !texCoords)
+        {
+            if (floats && VET_FLOAT1 != element.type)
+            {
+                texCoords = reinterpret_cast<const float*>(base + element.offset);
+                texCoordStride = stride;
+                continue;
+            }
+            m_decodedTexCoords.resize(count * 2);
+            for (size_t i = 0; i < count; ++i)
+            {
+                float value[4];
+                DecodeVertexAttribute(element.type, base + stride * i + element.offset, value);
+                m_decodedTexCoords[i * 2] = value[0];
+                m_decodedTexCoords[i * 2 + 1] = value[1];
+            }
+            texCoords = m_decodedTexCoords.data();
+            texCoordStride = 2 * sizeof(float);
+        }
+    }
+
+    if (!positions)
+    {
+        m_vertices.clear();
+        m_clipCodes.clear();
+        m_clipPositions.clear();
+        m_processedCount = 0;
+        return;
+    }
+    Process(positions, positionStride, colors, sizeof(uint32_t), texCoords, texCoordStride, count);
+}
+
+size_t SoftwareVertexPipeline::CullTriangles(const uint16_t* indices, size_t indexCount, std::vector<uint16_t>& visible)
+{
+    return ClipTriangleList(indices, indexCount, visible);
+}
+
+size_t SoftwareVertexPipeline::CullTriangles(const uint32_t* indices, size_t indexCount, std::vector<uint32_t>& visible)
+{
+    return ClipTriangleList(indices, indexCount, visible);
+}
+
+template <typename Index>
+size_t SoftwareVertexPipeline::ClipTriangleList(const Index* indices, size_t indexCount, std::vector<Index>& visible)
+{
+    // Vertices clipped by the previous call are replaced
+    m_vertices.resize(m_processedCount);
+    m_clipPositions.resize(4 * m_processedCount);
+
+    visible.clear();
+    visible.reserve(indexCount);
+
+    size_t culled = 0;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const uint8_t a = m_clipCodes[indices[i]];
+        const uint8_t b = m_clipCodes[indices[i + 1]];
+        const uint8_t c = m_clipCodes[indices[i + 2]];
+
+        // Outside of one plane entirely
+        if (a & b & c)
+        {
+            ++culled;
+            continue;
+        }
+        if (!((a | b | c) & CLIP_NEAR))
+        {
+            visible.insert(visible.end(), indices + i, indices + i + 3);
+            continue;
+        }
+
+        // Sutherland-Hodgman against z = 0, the near plane of D3D clip space. Edges are always
+        // interpolated from the inside vertex, so triangles sharing an edge share the new vertex position
+        size_t polygon[4];
+        size_t polygonSize = 0;
+        for (unsigned e = 0; e < 3; ++e)
+        {
+            const size_t current = indices[i + e];
+            const size_t next = indices[i + (e + 1) % 3];
+            const bool currentInside = m_clipPositions[4 * current + 2] >= 0.0f;
+            const bool nextInside = m_clipPositions[4 * next + 2] >= 0.0f;
+            if (currentInside)
+            {
+                polygon[polygonSize++] = current;
+            }
+            if (currentInside != nextInside)
+            {
+                polygon[polygonSize++] = m_vertices.size();
+                AddNearPlaneVertex(currentInside ? current : next, currentInside ? next : current);
+            }
+        }
+
+        // Vertices behind the eye have no screen position, and 16-bit indices may run out
+        bool drawable = polygonSize >= 3;
+        for (size_t k = 0; k < polygonSize && drawable; ++k)
+        {
+            drawable = m_clipPositions[4 * polygon[k] + 3] > 0.0f && polygon[k] <= std::numeric_limits<Index>::max();
+        }
+        if (!drawable)
+        {
+            ++culled;
+            continue;
+        }
+
+        // Triangle fan of the clipped polygon, the winding is kept
+        for (size_t k = 1; k + 1 < polygonSize; ++k)
+        {
+            visible.push_back(static_cast<Index>(polygon[0]));
+            visible.push_back(static_cast<Index>(polygon[k]));
+            visible.push_back(static_cast<Index>(polygon[k + 1]));
+        }
+    }
+    return culled;
+}
+
+void SoftwareVertexPipeline::AddNearPlaneVertex(size_t inside, size_t outside)
+{
+    const float* a = &m_clipPositions[4 * inside];
+    const float* b = &m_clipPositions[4 * outside];
+    const float t = a[2] / (a[2] - b[2]);
+    float clip[4];
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        clip[c] = a[c] + (b[c] - a[c]) * t;
+    }
+    clip[2] = 0.0f;
+
+    const TransformedVertex& va = m_vertices[inside];
+    const TransformedVertex& vb = m_vertices[outside];
+    TransformedVertex vertex;
+    const float rhw = 1.0f / clip[3];
+    vertex.x = m_viewport.x + 0.5f * m_viewport.width + clip[0] * rhw * 0.5f * m_viewport.width;
+    vertex.y = m_viewport.y + 0.5f * m_viewport.height - clip[1] * rhw * 0.5f * m_viewport.height;
+    vertex.z = m_viewport.minZ;
+    vertex.rhw = rhw;
+    vertex.color = LerpColor(va.color, vb.color, t);
+    vertex.u = va.u + (vb.u - va.u) * t;
+    vertex.v = va.v + (vb.v - va.v) * t;
+
+    m_vertices.push_back(vertex);
+    m_clipPositions.insert(m_clipPositions.end(), clip, clip + 4);
+}
+
+void SoftwareVertexPipeline::TransformScalar(const float* positions, size_t positionStride, size_t first, size_t count)
+{
+    const float* m = m_matrix;
+    const float halfWidth = 0.5f * m_viewport.width;
+    const float halfHeight = 0.5f * m_viewport.height;
+    const float centerX = m_viewport.x + halfWidth;
+    const float centerY = m_viewport.y + halfHeight;
+    const float depthRange = m_viewport.maxZ - m_viewport.minZ;
+
+    for (size_t i = first; i < first + count; ++i)
+    {
+        const float* p = StridedFloats(positions, positionStride, i);
+        const float x = p[0] * m[0] + p[1] * m[4] + p[2] * m[8] + m[12];
+        const float y = p[0] * m[1] + p[1] * m[5] + p[2] * m[9] + m[13];
+        const float z = p[0] * m[2] + p[1] * m[6] + p[2] * m[10] + m[14];
+        const float w = p[0] * m[3] + p[1] * m[7] + p[2] * m[11] + m[15];
+
+        uint8_t code = 0;
+        code |= x < -w ? CLIP_LEFT : 0;
+        code |= x > w ? CLIP_RIGHT : 0;
+        code |= y < -w ? CLIP_BOTTOM : 0;
+        code |= y > w ? CLIP_TOP : 0;
+        code |= (z < 0.0f || w <= 0.0f) ? CLIP_NEAR : 0;
+        code |= z > w ? CLIP_FAR : 0;
+        m_clipCodes[i] = code;
+
+        float* clip = &m_clipPositions[4 * i];
+        clip[0] = x;
+        clip[1] = y;
+        clip[2] = z;
+        clip[3] = w;
+
+        TransformedVertex& vertex = m_vertices[i];
+        const float rhw = 1.0f / w;
+        vertex.x = centerX + x * rhw * halfWidth;
+        vertex.y = centerY - y * rhw * halfHeight;
+        vertex.z = m_viewport.minZ + z * rhw * depthRange;
+        vertex.rhw = rhw;
+    }
+}
+
+#ifdef SOFTWARE_VERTEX_SSE2
+
+void SoftwareVertexPipeline::TransformSimd(const float* positions, size_t positionStride, size_t count)
+{
+    __m128 m[16];
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        m[i] = _mm_set1_ps(m_matrix[i]);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 halfWidth = _mm_set1_ps(0.5f * m_viewport.width);
+    const __m128 halfHeight = _mm_set1_ps(0.5f * m_viewport.height);
+    const __m128 centerX = _mm_set1_ps(m_viewport.x + 0.5f * m_viewport.width);
+    const __m128 centerY = _mm_set1_ps(m_viewport.y + 0.5f * m_viewport.height);
+    const __m128 minZ = _mm_set1_ps(m_viewport.minZ);
+    const __m128 depthRange = _mm_set1_ps(m_viewport.maxZ - m_viewport.minZ);
+
+    // Four vertices are transposed into SoA registers, transformed and transposed back
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const float* p0 = StridedFloats(positions, positionStride, i);
+        const float* p1 = StridedFloats(positions, positionStride, i + 1);
+        const float* p2 = StridedFloats(positions, positionStride, i + 2);
+        const float* p3 = StridedFloats(positions, positionStride, i + 3);
+        const __m128 px = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+        const __m128 py = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+        const __m128 pz = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+
+        const __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m[0]), _mm_mul_ps(py, m[4])), _mm_mul_ps(pz, m[8])), m[12]);
+        const __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m[1]), _mm_mul_ps(py, m[5])), _mm_mul_ps(pz, m[9])), m[13]);
+        const __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m[2]), _mm_mul_ps(py, m[6])), _mm_mul_ps(pz, m[10])), m[14]);
+        const __m128 w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m[3]), _mm_mul_ps(py, m[7])), _mm_mul_ps(pz, m[11])), m[15]);
+
+        const __m128 negW = _mm_sub_ps(zero, w);
+        const int left = _mm_movemask_ps(_mm_cmplt_ps(x, negW));
+        const int right = _mm_movemask_ps(_mm_cmpgt_ps(x, w));
+        const int bottom = _mm_movemask_ps(_mm_cmplt_ps(y, negW));
+        const int top = _mm_movemask_ps(_mm_cmpgt_ps(y, w));
+        const int nearPlane = _mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(z, zero), _mm_cmple_ps(w, zero)));
+        const int farPlane = _mm_movemask_ps(_mm_cmpgt_ps(z, w));
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            m_clipCodes[i + k] = static_cast<uint8_t>(
+                (((left >> k) & 1) ? CLIP_LEFT : 0) | (((right >> k) & 1) ? CLIP_RIGHT : 0) |
+                (((bottom >> k) & 1) ? CLIP_BOTTOM : 0) | (((top >> k) & 1) ? CLIP_TOP : 0) |
+                (((nearPlane >> k) & 1) ? CLIP_NEAR : 0) | (((farPlane >> k) & 1) ? CLIP_FAR : 0));
+        }
+
+        __m128 clipX = x, clipY = y, clipZ = z, clipW = w;
+        _MM_TRANSPOSE4_PS(clipX, clipY, clipZ, clipW);
+        _mm_storeu_ps(&m_clipPositions[4 * i], clipX);
+        _mm_storeu_ps(&m_clipPositions[4 * i + 4], clipY);
+        _mm_storeu_ps(&m_clipPositions[4 * i + 8], clipZ);
+        _mm_storeu_ps(&m_clipPositions[4 * i + 12], clipW);
+
+        __m128 rhw = _mm_div_ps(one, w);
+        __m128 sx = _mm_add_ps(centerX, _mm_mul_ps(_mm_mul_ps(x, rhw), halfWidth));
+        __m128 sy = _mm_sub_ps(centerY, _mm_mul_ps(_mm_mul_ps(y, rhw), halfHeight));
+        __m128 sz = _mm_add_ps(minZ, _mm_mul_ps(_mm_mul_ps(z, rhw), depthRange));
+
+        _MM_TRANSPOSE4_PS(sx, sy, sz, rhw);
+        _mm_storeu_ps(&m_vertices[i].x, sx);
+        _mm_storeu_ps(&m_vertices[i + 1].x, sy);
+        _mm_storeu_ps(&m_vertices[i + 2].x, sz);
+        _mm_storeu_ps(&m_vertices[i + 3].x, rhw);
+    }
+
+    TransformScalar(positions, positionStride, i, count - i);
+}
+
+#else
+
+void SoftwareVertexPipeline::TransformSimd(const float* positions, size_t positionStride, size_t count)
+{
+    TransformScalar(positions, positionStride, 0, count);
+}
+
+#endif // SOFTWARE_VERTEX_SSE2
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "vertex_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Vertex processing modes, values match D3DCREATE_*_VERTEXPROCESSING
+enum VertexProcessingMode
+{
+    VERTEX_PROCESSING_SOFTWARE = 0x20,
+    VERTEX_PROCESSING_HARDWARE = 0x40,
+    VERTEX_PROCESSING_MIXED = 0x80
+};
+
+/// @brief D3DDEVCAPS_HWTRANSFORMANDLIGHT
+const unsigned DEVCAPS_HW_TRANSFORM_AND_LIGHT = 0x00010000;
+
+/// @brief Vertex processing modes to try when creating the device, best first
+/// Without hardware transform and lighting only software processing is possible.
+/// If the hardware vertex shader version (D3DCAPS9::VertexShaderVersion) is lower
+/// than required, mixed processing keeps fixed-function work on the GPU.
+/// Later modes are fallbacks for adapters which report more than they can create.
+/// Non-empty override ("hardware", "mixed" or "software") puts that mode first
+std::vector<VertexProcessingMode> VertexProcessingCandidates(unsigned devCaps, unsigned vertexShaderVersion,
+    unsigned requiredVertexShaderVersion, const char* override = NULL);
+
+const char* VertexProcessingName(VertexProcessingMode mode);
+
+/// @brief Pre-transformed vertex with color and one texture coordinate set
+struct TransformedVertex
+{
+    float x, y, z, rhw;
+
+    /// D3DCOLOR, A8R8G8B8
+    uint32_t color;
+
+    float u, v;
+};
+
+/// @brief D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1, layout of TransformedVertex
+const unsigned TRANSFORMED_VERTEX_FVF = 0x004 | 0x040 | 0x100;
+
+/// @brief Render target area, matches D3DVIEWPORT9
+struct ScreenViewport
+{
+    unsigned x, y, width, height;
+    float minZ, maxZ;
+};
+
+/// @brief Outcodes of the clip space position
+enum ClipCode
+{
+    CLIP_LEFT = 0x01,
+    CLIP_RIGHT = 0x02,
+    CLIP_BOTTOM = 0x04,
+    CLIP_TOP = 0x08,
+    CLIP_NEAR = 0x10,
+    CLIP_FAR = 0x20
+};
+
+/// @brief CPU replacement of the vertex stage for adapters without hardware transform
+/// Equivalent of the fixed-function transform and of the sample vertex shaders:
+/// clip = position * world * viewProjection with row vectors, as D3DX matrices.
+/// Vertices are projected to the screen and written as XYZRHW, color and texture
+/// coordinates are passed through. Four vertices at a time with SSE2 when available.
+/// Pre-transformed vertices are not clipped by the runtime, so triangles fully outside
+/// of the frustum are removed from the index list and triangles crossing the near plane
+/// are clipped against it into one or two triangles, as the hardware would
+class SoftwareVertexPipeline
+{
+public:
+
+    SoftwareVertexPipeline();
+
+    /// @brief Row-major 4x4 matrices
+    void SetTransform(const float world[16], const float viewProjection[16]);
+
+    void SetViewport(const ScreenViewport& viewport);
+
+    /// @brief Disable SSE2 path, for comparison with the scalar one
+    void SetSimd(bool enabled) { m_simd = enabled; }
+    bool Simd() const;
+
+    /// @brief Transform float3 positions, colors and texture coordinates are optional
+    /// Missing colors are white, missing texture coordinates are 0
+    void Process(const float* positions, size_t positionStride,
+        const uint32_t* colors, size_t colorStride,
+        const float* texCoords, size_t texCoordStride,
+        size_t count);
+
+    /// @brief Transform vertices of the layout, compact element types are decoded first
+    /// POSITION, COLOR and TEXCOORD 0 usages are taken, the others are ignored
+    void Process(const VertexLayout& layout, const void* vertices, size_t count);
+
+    /// @brief Indices of the visible triangles of the triangle list, referring to Vertices()
+    /// Vertices created by near plane clipping are appended to Vertices(), replacing the ones
+    /// of the previous call. Returns number of triangles removed
+    size_t CullTriangles(const uint16_t* indices, size_t indexCount, std::vector<uint16_t>& visible);
+    size_t CullTriangles(const uint32_t* indices, size_t indexCount, std::vector<uint32_t>& visible);
+
+    const std::vector<TransformedVertex>& Vertices() const { return m_vertices; }
+
+    /// @brief ClipCode bits of every processed vertex, clipping vertices have none
+    const std::vector<uint8_t>& ClipCodes() const { return m_clipCodes; }
+
+private:
+
+    void TransformScalar(const float* positions, size_t positionStride, size_t first, size_t count);
+    void TransformSimd(const float* positions, size_t positionStride, size_t count);
+
+    template <typename Index>
+    size_t ClipTriangleList(const Index* indices, size_t indexCount, std::vector<Index>& visible);
+
+    /// @brief Append the vertex where the edge crosses the near plane, interpolated in clip space
+    void AddNearPlaneVertex(size_t inside, size_t outside);
+
+    /// Combined world * viewProjection
+    float m_matrix[16];
+    ScreenViewport m_viewport;
+    bool m_simd;
+
+    std::vector<TransformedVertex> m_vertices;
+    std::vector<uint8_t> m_clipCodes;
+
+    /// Clip space x, y, z, w of every vertex, for near plane clipping
+    std::vector<float> m_clipPositions;
+
+    /// Vertices written by Process(), the ones after them come from clipping
+    size_t m_processedCount;
+
+    /// Decoded attributes of the layout
+    std::vector<float> m_decodedPositions;
+    std::vector<uint32_t> m_decodedColors;
+    std::vector<float> m_decodedTexCoords;
+};
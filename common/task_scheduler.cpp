@@ -0,0 +1,350 @@
+#include "task_scheduler.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+const TaskId TaskScheduler::INVALID_TASK;
+
+TaskScheduler::TaskScheduler(unsigned workerCount)
+    : m_rejected(false)
+    , m_wallTime(0.0)
+    , m_readyCount(0)
+    , m_stop(false)
+    , m_completedCount(0)
+    , m_failed(false)
+{
+    if (0 == workerCount)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < workerCount; ++i)
+    {
+        m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+    }
+    for (unsigned i = 0; i < workerCount; ++i)
+    {
+        m_workers.push_back(std::thread(&TaskScheduler::WorkerProc, this, static_cast<int>(i)));
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i].join();
+    }
+}
+
+TaskId TaskScheduler::Add(const std::string& name, const std::function<bool()>& work,
+    const std::vector<TaskId>& dependencies)
+{
+    return AddTask(name, work, dependencies, false);
+}
+
+TaskId TaskScheduler::AddOwnerTask(const std::string& name, const std::function<bool()>& work,
+    const std::vector<TaskId>& dependencies)
+{
+    return AddTask(name, work, dependencies, true);
+}
+
+TaskId TaskScheduler::AddTask(const std::string& name, const std::function<bool()>& work,
+    const std::vector<TaskId>& dependencies, bool ownerThread)
+{
+    TaskId id = static_cast<TaskId>(m_tasks.size());
+
+    // Only already added tasks can be dependencies, so the graph has no cycles. An unknown
+    // identifier is a mistake in the graph, ignoring it would leave the two tasks unordered
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        if (dependencies[i] >= id)
+        {
+            fprintf(stderr, "Task %s depends on unknown task %u\n", name.c_str(), dependencies[i]);
+            m_rejected = true;
+            return INVALID_TASK;
+        }
+    }
+
+    std::unique_ptr<Task> task(new Task);
+    task->name = name;
+    task->traceName = TRACE_INTERN(name);
+    task->work = work;
+    task->ownerThread = ownerThread;
+    task->pendingDependencies = 0;
+    task->dependencyFailed = false;
+
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        task->dependencies.push_back(dependencies[i]);
+        m_tasks[dependencies[i]]->dependents.push_back(id);
+    }
+
+    m_tasks.push_back(std::move(task));
+    return id;
+}
+
+bool TaskScheduler::Run()
+{
+    m_runStart = std::chrono::steady_clock::now();
+    m_completedCount = 0;
+    m_failed = false;
+    if (m_rejected)
+    {
+        m_rejected = false;
+        m_wallTime = 0.0;
+        m_timings.clear();
+        m_criticalPathDependencies.clear();
+        m_tasks.clear();
+        return false;
+    }
+
+    for (size_t i = 0; i < m_tasks.size(); ++i)
+    {
+        m_tasks[i]->pendingDependencies = static_cast<unsigned>(m_tasks[i]->dependencies.size());
+    }
+    for (size_t i = 0; i < m_tasks.size(); ++i)
+    {
+        if (m_tasks[i]->dependencies.empty())
+        {
+            Schedule(static_cast<TaskId>(i), -1);
+        }
+    }
+
+    // Execute owner tasks until everything is completed
+    {
+        std::unique_lock<std::mutex> lock(m_ownerLock);
+        while (m_completedCount < m_tasks.size())
+        {
+            if (m_ownerTasks.empty())
+            {
+                m_ownerWake.wait(lock);
+                continue;
+            }
+
+            TaskId id = m_ownerTasks.front();
+            m_ownerTasks.pop_front();
+            lock.unlock();
+            Execute(id, -1);
+            lock.lock();
+        }
+    }
+
+    m_wallTime = Elapsed();
+    m_timings.clear();
+    for (size_t i = 0; i < m_tasks.size(); ++i)
+    {
+        m_timings.push_back(m_tasks[i]->timing);
+    }
+
+    // Dependencies are kept for the critical path report
+    m_criticalPathDependencies.clear();
+    for (size_t i = 0; i < m_tasks.size(); ++i)
+    {
+        m_criticalPathDependencies.push_back(m_tasks[i]->dependencies);
+    }
+
+    m_tasks.clear();
+    return !m_failed;
+}
+
+void TaskScheduler::Schedule(TaskId id, int worker)
+{
+    if (m_tasks[id]->ownerThread)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_ownerLock);
+            m_ownerTasks.push_back(id);
+        }
+        m_ownerWake.notify_one();
+        return;
+    }
+
+    // Tasks released by the owner are spread over the workers
+    if (worker < 0)
+    {
+        worker = static_cast<int>(id % m_queues.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[worker]->lock);
+        m_queues[worker]->tasks.push_back(id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        ++m_readyCount;
+    }
+    m_wake.notify_one();
+}
+
+bool TaskScheduler::FindWork(int worker, TaskId& id)
+{
+    const size_t queueCount = m_queues.size();
+    for (size_t i = 0; i < queueCount; ++i)
+    {
+        WorkerQueue& queue = *m_queues[(worker + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+
+        // Own tasks are taken LIFO for cache locality, stolen ones FIFO
+        if (0 == i)
+        {
+            id = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            id = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        --m_readyCount;
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::Execute(TaskId id, int thread)
+{
+    Task& task = *m_tasks[id];
+    task.timing.name = task.name;
+    task.timing.thread = thread;
+    task.timing.skipped = task.dependencyFailed;
+    task.timing.start = Elapsed();
+
+    bool succeeded = false;
+    if (!task.timing.skipped)
+    {
+        TRACE_SCOPE(task.traceName);
+        try
+        {
+            succeeded = task.work();
+        }
+        catch (...)
+        {
+            succeeded = false;
+        }
+    }
+
+    task.timing.end = Elapsed();
+    task.timing.succeeded = succeeded;
+    if (!succeeded)
+    {
+        m_failed = true;
+    }
+
+    for (size_t i = 0; i < task.dependents.size(); ++i)
+    {
+        Task& dependent = *m_tasks[task.dependents[i]];
+        if (!succeeded)
+        {
+            dependent.dependencyFailed = true;
+        }
+        if (0 == --dependent.pendingDependencies)
+        {
+            Schedule(task.dependents[i], thread);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_ownerLock);
+        ++m_completedCount;
+    }
+    m_ownerWake.notify_one();
+}
+
+void TaskScheduler::WorkerProc(int worker)
+{
+    TRACE_THREAD_NAME("TaskScheduler worker");
+    for (;;)
+    {
+        TaskId id = 0;
+        if (FindWork(worker, id))
+        {
+            Execute(id, worker);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        m_wake.wait(lock, [this] { return m_stop || m_readyCount > 0; });
+        if (m_stop)
+        {
+            return;
+        }
+    }
+}
+
+double TaskScheduler::Elapsed() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_runStart).count();
+}
+
+std::string TaskScheduler::FormatCriticalPath() const
+{
+    if (m_timings.empty())
+    {
+        return std::string();
+    }
+
+    double taskTime = 0.0;
+    size_t last = 0;
+    for (size_t i = 0; i < m_timings.size(); ++i)
+    {
+        taskTime += m_timings[i].end - m_timings[i].start;
+        if (m_timings[i].end > m_timings[last].end)
+        {
+            last = i;
+        }
+    }
+
+    // Walk back from the last finished task through the dependencies which finished last
+    std::vector<size_t> path(1, last);
+    for (;;)
+    {
+        const std::vector<TaskId>& dependencies = m_criticalPathDependencies[path.back()];
+        if (dependencies.empty())
+        {
+            break;
+        }
+
+        size_t gate = dependencies[0];
+        for (size_t i = 1; i < dependencies.size(); ++i)
+        {
+            if (m_timings[dependencies[i]].end > m_timings[gate].end)
+            {
+                gate = dependencies[i];
+            }
+        }
+        path.push_back(gate);
+    }
+    std::reverse(path.begin(), path.end());
+
+    char line[256] = {};
+    snprintf(line, sizeof(line), "critical path %.2f ms with %u workers, task time %.2f ms, parallelism %.2fx\n",
+        m_wallTime, WorkerCount(), taskTime, m_wallTime > 0 ? taskTime / m_wallTime : 0.0);
+    std::string report(line);
+
+    double previousEnd = 0.0;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        const TaskTiming& timing = m_timings[path[i]];
+        char thread[24] = "owner";
+        if (timing.thread >= 0)
+        {
+            snprintf(thread, sizeof(thread), "worker %d", timing.thread);
+        }
+        snprintf(line, sizeof(line), "  %8.2f .. %8.2f ms  %8.2f ms  wait %6.2f ms  %-9s %s%s\n",
+            timing.start, timing.end, timing.end - timing.start, timing.start - previousEnd, thread,
+            timing.name.c_str(), timing.skipped ? " (skipped)" : (timing.succeeded ? "" : " (failed)"));
+        report += line;
+        previousEnd = timing.end;
+    }
+    return report;
+}
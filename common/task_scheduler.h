@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Task identifier inside of the scheduler
+typedef unsigned TaskId;
+
+/// @brief Execution record of a single task
+struct TaskTiming
+{
+    std::string name;
+
+    /// Milliseconds since the start of Run()
+    double start;
+    double end;
+
+    /// Worker index, -1 for the owner thread
+    int thread;
+
+    bool succeeded;
+
+    /// Not executed because a dependency failed
+    bool skipped;
+};
+
+/// @brief Work-stealing scheduler of a task graph with explicit dependencies
+/// Every worker owns a deque: it pops its own tasks LIFO and steals from the others FIFO.
+/// Owner tasks are executed only by the thread calling Run(), which is required
+/// for the calls tied to the thread owning a window or a device.
+/// Tasks are added before Run(), a failed task skips all its dependents
+class TaskScheduler
+{
+public:
+
+    /// @brief Returned instead of an identifier when a task is rejected
+    static const TaskId INVALID_TASK = ~0u;
+
+    /// @brief Start worker threads, 0 means one per hardware thread
+    explicit TaskScheduler(unsigned workerCount = 0);
+
+    /// @brief Stop and join worker threads
+    ~TaskScheduler();
+
+    /// @brief Add task executed by any worker thread
+    /// Dependencies must be identifiers of already added tasks. Otherwise the task is not added,
+    /// INVALID_TASK is returned and the next Run() fails without executing anything
+    TaskId Add(const std::string& name, const std::function<bool()>& work,
+        const std::vector<TaskId>& dependencies = std::vector<TaskId>());
+
+    /// @brief Add task executed by the thread calling Run()
+    TaskId AddOwnerTask(const std::string& name, const std::function<bool()>& work,
+        const std::vector<TaskId>& dependencies = std::vector<TaskId>());
+
+    /// @brief Execute all added tasks and wait for them
+    /// Returns false if any task failed or was rejected. Tasks are cleared afterwards, timings are kept
+    bool Run();
+
+    /// @brief Timings of the last Run(), indexed by task identifier
+    const std::vector<TaskTiming>& Timings() const { return m_timings; }
+
+    /// @brief Wall time of the last Run() in milliseconds
+    double WallTime() const { return m_wallTime; }
+
+    /// @brief Report of the last Run(): critical path with waits between its tasks,
+    /// total task time and achieved parallelism
+    std::string FormatCriticalPath() const;
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(m_workers.size()); }
+
+private:
+
+    struct Task
+    {
+        std::string name;
+
+        /// Name kept for the trace, NULL if tracing is compiled out
+        const char* traceName;
+
+        std::function<bool()> work;
+        bool ownerThread;
+        std::vector<TaskId> dependencies;
+        std::vector<TaskId> dependents;
+        std::atomic<unsigned> pendingDependencies;
+        std::atomic<bool> dependencyFailed;
+        TaskTiming timing;
+    };
+
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::deque<TaskId> tasks;
+    };
+
+    TaskScheduler(const TaskScheduler&);
+    TaskScheduler& operator=(const TaskScheduler&);
+
+    TaskId AddTask(const std::string& name, const std::function<bool()>& work,
+        const std::vector<TaskId>& dependencies, bool ownerThread);
+
+    /// @brief Push ready task into the queue of the worker or the owner
+    void Schedule(TaskId id, int worker);
+
+    /// @brief Pop task from own queue or steal from the others
+    bool FindWork(int worker, TaskId& id);
+
+    /// @brief Run task and release its dependents
+    void Execute(TaskId id, int thread);
+
+    void WorkerProc(int worker);
+
+    double Elapsed() const;
+
+    std::vector<std::unique_ptr<Task> > m_tasks;
+
+    /// A task was rejected since the last Run()
+    bool m_rejected;
+
+    std::vector<TaskTiming> m_timings;
+
+    /// Dependencies of the last Run() tasks, for the critical path report
+    std::vector<std::vector<TaskId> > m_criticalPathDependencies;
+    double m_wallTime;
+    std::chrono::steady_clock::time_point m_runStart;
+
+    std::vector<std::unique_ptr<WorkerQueue> > m_queues;
+    std::vector<std::thread> m_workers;
+
+    /// Idle workers wait for ready tasks
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+    std::atomic<unsigned> m_readyCount;
+    bool m_stop;
+
+    /// Owner thread waits for its tasks and for completion of the run
+    std::mutex m_ownerLock;
+    std::condition_variable m_ownerWake;
+    std::deque<TaskId> m_ownerTasks;
+    unsigned m_completedCount;
+    std::atomic<bool> m_failed;
+};
@@ -0,0 +1,221 @@
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+
+/// @brief Row of regions of the same maximal height
+struct Shelf
+{
+    unsigned page;
+    unsigned y;
+    unsigned height;
+    unsigned usedWidth;
+};
+
+AtlasUvRemap MakeUvRemap(const AtlasRegion& region, unsigned pageSize)
+{
+    AtlasUvRemap remap;
+    remap.scaleU = static_cast<float>(region.width) / pageSize;
+    remap.scaleV = static_cast<float>(region.height) / pageSize;
+    remap.offsetU = static_cast<float>(region.x) / pageSize;
+    remap.offsetV = static_cast<float>(region.y) / pageSize;
+    return remap;
+}
+
+} // namespace
+
+TextureAtlasPacker::TextureAtlasPacker(unsigned pageSize, unsigned mipLevels)
+    : m_pageSize(pageSize)
+    , m_mipLevels(std::max(1u, mipLevels))
+{
+}
+
+unsigned TextureAtlasPacker::PaddedSize(unsigned size) const
+{
+    unsigned alignment = Alignment();
+    return (size + alignment - 1) / alignment * alignment + 2 * alignment;
+}
+
+unsigned TextureAtlasPacker::Add(unsigned width, unsigned height)
+{
+    if (0 == width || 0 == height || PaddedSize(width) > m_pageSize || PaddedSize(height) > m_pageSize)
+    {
+        return ~0u;
+    }
+
+    Item item;
+    item.index = static_cast<unsigned>(m_items.size());
+    item.width = width;
+    item.height = height;
+    m_items.push_back(item);
+    return item.index;
+}
+
+AtlasLayout TextureAtlasPacker::Pack() const
+{
+    AtlasLayout layout;
+    layout.pageSize = m_pageSize;
+    layout.mipLevels = m_mipLevels;
+    layout.pageCount = 0;
+    layout.regions.resize(m_items.size());
+    layout.remaps.resize(m_items.size());
+
+    // Tallest first, so that shelves are filled with regions of similar height
+    std::vector<Item> items(m_items);
+    std::stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b)
+    {
+        return a.height != b.height ? a.height > b.height : a.width > b.width;
+    });
+
+    std::vector<Shelf> shelves;
+    std::vector<unsigned> pageHeights;
+    const unsigned alignment = Alignment();
+
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const unsigned paddedWidth = PaddedSize(items[i].width);
+        const unsigned paddedHeight = PaddedSize(items[i].height);
+
+        // First shelf with enough room
+        Shelf* shelf = NULL;
+        for (size_t s = 0; s < shelves.size() && !shelf; ++s)
+        {
+            if (shelves[s].height >= paddedHeight && shelves[s].usedWidth + paddedWidth <= m_pageSize)
+            {
+                shelf = &shelves[s];
+            }
+        }
+
+        // Open a new shelf on the first page with enough height left, or on a new page
+        if (!shelf)
+        {
+            unsigned page = 0;
+            while (page < pageHeights.size() && pageHeights[page] + paddedHeight > m_pageSize)
+            {
+                ++page;
+            }
+            if (page == pageHeights.size())
+            {
+                pageHeights.push_back(0);
+            }
+
+            Shelf newShelf;
+            newShelf.page = page;
+            newShelf.y = pageHeights[page];
+            newShelf.height = paddedHeight;
+            newShelf.usedWidth = 0;
+            pageHeights[page] += paddedHeight;
+            shelves.push_back(newShelf);
+            shelf = &shelves.back();
+        }
+
+        AtlasRegion& region = layout.regions[items[i].index];
+        region.atlas = shelf->page;
+        region.x = shelf->usedWidth + alignment;
+        region.y = shelf->y + alignment;
+        region.width = items[i].width;
+        region.height = items[i].height;
+        layout.remaps[items[i].index] = MakeUvRemap(region, m_pageSize);
+
+        shelf->usedWidth += paddedWidth;
+    }
+
+    layout.pageCount = static_cast<unsigned>(pageHeights.size());
+    return layout;
+}
+
+void ApplyUvRemap(const AtlasUvRemap& remap, float* uv, size_t count, size_t stride)
+{
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(uv);
+    for (size_t i = 0; i < count; ++i, bytes += stride)
+    {
+        float* pair = reinterpret_cast<float*>(bytes);
+        pair[0] = pair[0] * remap.scaleU + remap.offsetU;
+        pair[1] = pair[1] * remap.scaleV + remap.offsetV;
+    }
+}
+
+void ComposeAtlasRegion(const AtlasLayout& layout, unsigned index, const uint32_t* texels, uint32_t* page)
+{
+    const AtlasRegion& region = layout.regions[index];
+    const unsigned alignment = 1u << (layout.mipLevels - 1);
+    const unsigned paddedWidth = (region.width + alignment - 1) / alignment * alignment + 2 * alignment;
+    const unsigned paddedHeight = (region.height + alignment - 1) / alignment * alignment + 2 * alignment;
+    const unsigned left = region.x - alignment;
+    const unsigned top = region.y - alignment;
+
+    for (unsigned py = top; py < top + paddedHeight; ++py)
+    {
+        // Gutter texels replicate the nearest texture edge
+        int sy = std::min(std::max(static_cast<int>(py) - static_cast<int>(region.y), 0), static_cast<int>(region.height) - 1);
+        const uint32_t* srcRow = texels + sy * region.width;
+        uint32_t* dstRow = page + static_cast<size_t>(py) * layout.pageSize;
+        for (unsigned px = left; px < left + paddedWidth; ++px)
+        {
+            int sx = std::min(std::max(static_cast<int>(px) - static_cast<int>(region.x), 0), static_cast<int>(region.width) - 1);
+            dstRow[px] = srcRow[sx];
+        }
+    }
+}
+
+bool SaveAtlasLayout(const AtlasLayout& layout, const std::vector<std::string>& names, const std::string& filename)
+{
+    std::ofstream out(filename);
+    if (!out)
+    {
+        return false;
+    }
+
+    out << "atlas " << layout.pageSize << ' ' << layout.mipLevels << ' '
+        << layout.pageCount << ' ' << layout.regions.size() << '\n';
+    for (size_t i = 0; i < layout.regions.size(); ++i)
+    {
+        const AtlasRegion& region = layout.regions[i];
+        out << (i < names.size() ? names[i] : std::string("-")) << ' '
+            << region.atlas << ' ' << region.x << ' ' << region.y << ' '
+            << region.width << ' ' << region.height << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool LoadAtlasLayout(const std::string& filename, AtlasLayout& layout, std::vector<std::string>* names)
+{
+    std::ifstream in(filename);
+    std::string tag;
+    size_t count = 0;
+    if (!(in >> tag >> layout.pageSize >> layout.mipLevels >> layout.pageCount >> count) || tag != "atlas")
+    {
+        return false;
+    }
+
+    layout.regions.resize(count);
+    layout.remaps.resize(count);
+    if (names)
+    {
+        names->resize(count);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string name;
+        AtlasRegion& region = layout.regions[i];
+        if (!(in >> name >> region.atlas >> region.x >> region.y >> region.width >> region.height))
+        {
+            return false;
+        }
+        layout.remaps[i] = MakeUvRemap(region, layout.pageSize);
+        if (names)
+        {
+            (*names)[i] = name;
+        }
+    }
+    return true;
+}
+
+std::string AtlasPageFilename(const std::string& layoutFilename, unsigned page)
+{
+    return layoutFilename + '.' + std::to_string(page) + ".pam";
+}
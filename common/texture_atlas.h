@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Packed texture placement inside of an atlas
+struct AtlasRegion
+{
+    /// Atlas page index
+    unsigned atlas;
+
+    /// Texture rectangle in atlas texels, gutters are not included
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+};
+
+/// @brief Texture coordinates transformation into the atlas page
+/// Atlas UV = UV * scale + offset
+struct AtlasUvRemap
+{
+    float scaleU;
+    float scaleV;
+    float offsetU;
+    float offsetV;
+};
+
+/// @brief Result of atlas packing: pages and per-texture placement
+struct AtlasLayout
+{
+    /// Size of every atlas page in texels
+    unsigned pageSize;
+
+    /// Mip levels the gutters are sized for
+    unsigned mipLevels;
+
+    unsigned pageCount;
+
+    /// Regions and UV remap tables, indexed the same as the packed textures
+    std::vector<AtlasRegion> regions;
+    std::vector<AtlasUvRemap> remaps;
+};
+
+/// @brief Shelf packer which bins textures into square atlas pages
+/// Every region is aligned to the size of one texel of the smallest mip
+/// and surrounded by a gutter of the same size, so that box-filtered mips
+/// of neighbour textures never bleed into each other
+class TextureAtlasPacker
+{
+public:
+
+    /// @brief Pages are pageSize x pageSize texels, gutters cover mipLevels levels
+    TextureAtlasPacker(unsigned pageSize, unsigned mipLevels);
+
+    /// @brief Add texture of the given size, returns its index in the layout
+    /// Texture which does not fit into an empty page is not added, ~0u is returned
+    unsigned Add(unsigned width, unsigned height);
+
+    /// @brief Pack all added textures
+    AtlasLayout Pack() const;
+
+    /// @brief Texels of the smallest mip level in the top level
+    unsigned Alignment() const { return 1u << (m_mipLevels - 1); }
+
+private:
+
+    struct Item
+    {
+        unsigned index;
+        unsigned width;
+        unsigned height;
+    };
+
+    /// @brief Size with gutters rounded up to the alignment
+    unsigned PaddedSize(unsigned size) const;
+
+    unsigned m_pageSize;
+    unsigned m_mipLevels;
+    std::vector<Item> m_items;
+};
+
+/// @brief Transform UV pairs in place, stride is in bytes between consecutive pairs
+void ApplyUvRemap(const AtlasUvRemap& remap, float* uv, size_t count, size_t stride);
+
+/// @brief Copy 32-bit texels into the atlas page unchanged, gutters replicate texture edges
+/// Texels are region.width x region.height, page is layout.pageSize x layout.pageSize texels
+void ComposeAtlasRegion(const AtlasLayout& layout, unsigned index, const uint32_t* texels, uint32_t* page);
+
+/// @brief Save layout as a text table, consumed by LoadAtlasLayout()
+bool SaveAtlasLayout(const AtlasLayout& layout, const std::vector<std::string>& names, const std::string& filename);
+
+/// @brief Load layout saved by SaveAtlasLayout(), names are optional
+bool LoadAtlasLayout(const std::string& filename, AtlasLayout& layout, std::vector<std::string>* names);
+
+/// @brief Image file of an atlas page written next to the layout, "<layout>.<page>.pam"
+std::string AtlasPageFilename(const std::string& layoutFilename, unsigned page);
@@ -0,0 +1,266 @@
+#include "texture_residency.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+uint64_t EstimateMipBytes(const TextureDesc& desc, unsigned mip)
+{
+    uint64_t width = std::max(1u, desc.width >> mip);
+    uint64_t height = std::max(1u, desc.height >> mip);
+    if (desc.blockCompressed)
+    {
+        // 4x4 blocks, partial blocks are padded
+        uint64_t blocks = std::max<uint64_t>(1, (width + 3) / 4) * std::max<uint64_t>(1, (height + 3) / 4);
+        return blocks * 16 * desc.bitsPerPixel / 8;
+    }
+    return width * height * desc.bitsPerPixel / 8;
+}
+
+uint64_t EstimateTextureBytes(const TextureDesc& desc, unsigned firstMip)
+{
+    uint64_t bytes = 0;
+    for (unsigned mip = firstMip; mip < desc.mipLevels; ++mip)
+    {
+        bytes += EstimateMipBytes(desc, mip);
+    }
+    return bytes;
+}
+
+std::string FormatResidencyStats(const ResidencyFrameStats& stats)
+{
+    char line[256] = {};
+    snprintf(line, sizeof(line),
+        "frame %llu: resident %.2f/%.2f MB, evictions %u, mip drops %u, reloads %u/%u, stalls %u",
+        static_cast<unsigned long long>(stats.frame),
+        stats.residentBytes / (1024.0 * 1024.0),
+        stats.budgetBytes / (1024.0 * 1024.0),
+        stats.evictions,
+        stats.mipDrops,
+        stats.reloadsCompleted,
+        stats.reloadsRequested,
+        stats.reloadStalls);
+    return line;
+}
+
+const uint64_t TextureResidencyManager::NEVER_BOUND;
+
+TextureResidencyManager::TextureResidencyManager(ResidencyBackend* backend, uint64_t budgetBytes)
+    : m_backend(backend)
+    , m_budgetBytes(budgetBytes)
+    , m_residentBytes(0)
+    , m_frame(0)
+    , m_stats()
+    , m_stopLoader(false)
+{
+    m_loader = std::thread(&TextureResidencyManager::LoaderProc, this);
+}
+
+TextureResidencyManager::~TextureResidencyManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_stopLoader = true;
+        m_pending.clear();
+    }
+    m_queueSignal.notify_all();
+    m_loader.join();
+}
+
+TextureId TextureResidencyManager::Register(const TextureDesc& desc, bool resident)
+{
+    TextureId id = static_cast<TextureId>(m_textures.size());
+
+    TextureEntry entry;
+    entry.desc = desc;
+    entry.desc.mipLevels = std::max(1u, desc.mipLevels);
+    entry.state = resident ? Resident : Evicted;
+    entry.firstMip = resident ? 0 : entry.desc.mipLevels;
+    entry.lastBindFrame = NEVER_BOUND;
+    entry.loadPending = false;
+    entry.lru = m_lru.end();
+    m_textures.push_back(entry);
+
+    if (resident)
+    {
+        m_textures[id].lru = m_lru.insert(m_lru.end(), id);
+        m_residentBytes += EstimateTextureBytes(entry.desc, 0);
+    }
+    return id;
+}
+
+void TextureResidencyManager::SetBudget(uint64_t budgetBytes)
+{
+    m_budgetBytes = budgetBytes;
+}
+
+bool TextureResidencyManager::Bind(TextureId id)
+{
+    TextureEntry& entry = m_textures.at(id);
+    entry.lastBindFrame = m_frame;
+
+    if (Resident == entry.state)
+    {
+        m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+
+        // Restore dropped mips if the budget allows it now
+        if (entry.firstMip > 0 && !entry.loadPending)
+        {
+            unsigned firstMip = FitFirstMip(entry.desc, m_residentBytes - EstimateTextureBytes(entry.desc, entry.firstMip));
+            if (firstMip < entry.firstMip)
+            {
+                RequestLoad(id, firstMip);
+            }
+        }
+        return true;
+    }
+
+    ++m_stats.reloadStalls;
+    if (Evicted == entry.state)
+    {
+        entry.state = Loading;
+        if (!entry.loadPending)
+        {
+            RequestLoad(id, FitFirstMip(entry.desc, m_residentBytes));
+        }
+    }
+    return false;
+}
+
+ResidencyFrameStats TextureResidencyManager::EndFrame()
+{
+    UploadCompleted();
+    EnforceBudget();
+
+    ResidencyFrameStats stats = m_stats;
+    stats.frame = m_frame;
+    stats.budgetBytes = m_budgetBytes;
+    stats.residentBytes = m_residentBytes;
+
+    m_stats = ResidencyFrameStats();
+    ++m_frame;
+    return stats;
+}
+
+unsigned TextureResidencyManager::FitFirstMip(const TextureDesc& desc, uint64_t otherBytes) const
+{
+    // Most detailed mip chain which fits into the budget, the smallest mip otherwise
+    for (unsigned mip = 0; mip + 1 < desc.mipLevels; ++mip)
+    {
+        if (otherBytes + EstimateTextureBytes(desc, mip) <= m_budgetBytes)
+        {
+            return mip;
+        }
+    }
+    return desc.mipLevels - 1;
+}
+
+void TextureResidencyManager::RequestLoad(TextureId id, unsigned firstMip)
+{
+    m_textures[id].loadPending = true;
+    ++m_stats.reloadsRequested;
+
+    LoadRequest request;
+    request.id = id;
+    request.firstMip = firstMip;
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_pending.push_back(request);
+    }
+    m_queueSignal.notify_one();
+}
+
+void TextureResidencyManager::UploadCompleted()
+{
+    std::deque<LoadRequest> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        completed.swap(m_completed);
+    }
+
+    for (size_t i = 0; i < completed.size(); ++i)
+    {
+        const LoadRequest& request = completed[i];
+        TextureEntry& entry = m_textures[request.id];
+        entry.loadPending = false;
+
+        if (!request.data || !m_backend->Upload(request.id, request.firstMip, request.data))
+        {
+            // Keep the resident texture as is, next bind will retry evicted one
+            if (Loading == entry.state)
+            {
+                entry.state = Evicted;
+            }
+            continue;
+        }
+
+        if (Resident == entry.state)
+        {
+            m_residentBytes -= EstimateTextureBytes(entry.desc, entry.firstMip);
+        }
+        else
+        {
+            entry.lru = m_lru.insert(m_lru.begin(), request.id);
+            entry.state = Resident;
+        }
+        entry.firstMip = request.firstMip;
+        m_residentBytes += EstimateTextureBytes(entry.desc, entry.firstMip);
+        ++m_stats.reloadsCompleted;
+    }
+}
+
+void TextureResidencyManager::EnforceBudget()
+{
+    while (m_residentBytes > m_budgetBytes && !m_lru.empty())
+    {
+        TextureId id = m_lru.back();
+        TextureEntry& entry = m_textures[id];
+        if (entry.lastBindFrame == m_frame)
+        {
+            // Everything left is used by the current frame
+            break;
+        }
+
+        m_residentBytes -= EstimateMipBytes(entry.desc, entry.firstMip);
+        ++entry.firstMip;
+        if (entry.firstMip < entry.desc.mipLevels)
+        {
+            m_backend->SetFirstMip(id, entry.firstMip);
+            ++m_stats.mipDrops;
+        }
+        else
+        {
+            m_backend->Evict(id);
+            m_lru.erase(entry.lru);
+            entry.lru = m_lru.end();
+            entry.state = Evicted;
+            ++m_stats.evictions;
+        }
+    }
+}
+
+void TextureResidencyManager::LoaderProc()
+{
+    TRACE_THREAD_NAME("Texture loader");
+    std::unique_lock<std::mutex> lock(m_queueLock);
+    for (;;)
+    {
+        m_queueSignal.wait(lock, [this] { return m_stopLoader || !m_pending.empty(); });
+        if (m_stopLoader)
+        {
+            return;
+        }
+
+        LoadRequest request = m_pending.front();
+        m_pending.pop_front();
+
+        lock.unlock();
+        {
+            TRACE_SCOPE("LoadTexture");
+            request.data = m_backend->Load(request.id, request.firstMip);
+        }
+        lock.lock();
+
+        m_completed.push_back(request);
+    }
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Texture identifier inside of residency manager
+typedef unsigned TextureId;
+
+/// @brief Texture dimensions and format used for memory estimation
+struct TextureDesc
+{
+    unsigned width;
+    unsigned height;
+    unsigned mipLevels;
+
+    /// Bits per pixel, e.g. 32 for A8R8G8B8, 4 for DXT1, 8 for DXT3/DXT5
+    unsigned bitsPerPixel;
+
+    /// Block-compressed formats are stored in 4x4 pixel blocks
+    bool blockCompressed;
+};
+
+/// @brief Estimated size of the single mip level in bytes
+uint64_t EstimateMipBytes(const TextureDesc& desc, unsigned mip);
+
+/// @brief Estimated size of the mip chain starting from firstMip in bytes
+uint64_t EstimateTextureBytes(const TextureDesc& desc, unsigned firstMip);
+
+/// @brief Residency counters collected during one frame
+struct ResidencyFrameStats
+{
+    uint64_t frame;
+    uint64_t budgetBytes;
+    uint64_t residentBytes;
+
+    /// Textures released completely
+    unsigned evictions;
+
+    /// Top mip levels dropped from resident textures
+    unsigned mipDrops;
+
+    /// Reloads queued to the loader thread
+    unsigned reloadsRequested;
+
+    /// Reloads uploaded to the device
+    unsigned reloadsCompleted;
+
+    /// Binds of textures which were not resident at the moment
+    unsigned reloadStalls;
+};
+
+/// @brief Format residency counters as a single log line
+std::string FormatResidencyStats(const ResidencyFrameStats& stats);
+
+/// @brief Device-specific part of texture residency
+/// Load() is called on the loader thread and must not touch the device,
+/// all other methods are called on the thread which owns the device
+class ResidencyBackend
+{
+public:
+
+    virtual ~ResidencyBackend() {}
+
+    /// @brief Read and decode texture data starting from firstMip
+    /// Returns empty pointer on failure
+    virtual std::shared_ptr<void> Load(TextureId id, unsigned firstMip) = 0;
+
+    /// @brief Create device texture from the data returned by Load()
+    virtual bool Upload(TextureId id, unsigned firstMip, const std::shared_ptr<void>& data) = 0;
+
+    /// @brief Drop mip levels above firstMip of the resident texture
+    virtual void SetFirstMip(TextureId id, unsigned firstMip) = 0;
+
+    /// @brief Release device texture completely
+    virtual void Evict(TextureId id) = 0;
+};
+
+/// @brief Keeps estimated texture memory under the budget
+/// Textures are ordered by the last bind, least recently bound are trimmed first
+/// by dropping their top mips one by one, then evicted completely.
+/// Evicted textures bound again are reloaded asynchronously with the most
+/// detailed mip chain which fits into the budget
+class TextureResidencyManager
+{
+public:
+
+    /// @brief Backend is not owned and must outlive the manager
+    TextureResidencyManager(ResidencyBackend* backend, uint64_t budgetBytes);
+
+    /// @brief Stops the loader thread, pending reloads are dropped
+    ~TextureResidencyManager();
+
+    /// @brief Register texture, resident one is expected to be loaded with all mips
+    TextureId Register(const TextureDesc& desc, bool resident);
+
+    /// @brief Change memory budget, applied at the end of the frame
+    void SetBudget(uint64_t budgetBytes);
+
+    /// @brief Memory budget
+    uint64_t Budget() const { return m_budgetBytes; }
+
+    /// @brief Current estimated memory of resident textures
+    uint64_t ResidentBytes() const { return m_residentBytes; }
+
+    /// @brief Mark texture as used in this frame
+    /// Returns false if texture is not resident and should not be bound,
+    /// reload is queued in that case
+    bool Bind(TextureId id);
+
+    /// @brief Finish the frame: upload finished reloads, enforce the budget
+    /// and return the counters collected since the previous call
+    ResidencyFrameStats EndFrame();
+
+private:
+
+    /// @brief Last bind frame of a texture which was never bound, equal to no frame
+    static const uint64_t NEVER_BOUND = ~0ull;
+
+    enum TextureState
+    {
+        Resident,
+        Loading,
+        Evicted
+    };
+
+    struct TextureEntry
+    {
+        TextureDesc desc;
+        TextureState state;
+
+        /// Most detailed resident mip level
+        unsigned firstMip;
+
+        /// Frame of the last bind, NEVER_BOUND before the first one
+        uint64_t lastBindFrame;
+
+        /// Load request is queued or in progress
+        bool loadPending;
+
+        /// Position in LRU list, valid for resident textures
+        std::list<TextureId>::iterator lru;
+    };
+
+    struct LoadRequest
+    {
+        TextureId id;
+        unsigned firstMip;
+        std::shared_ptr<void> data;
+    };
+
+    TextureResidencyManager(const TextureResidencyManager&);
+    TextureResidencyManager& operator=(const TextureResidencyManager&);
+
+    /// @brief First mip of the most detailed chain fitting into the budget next to otherBytes
+    unsigned FitFirstMip(const TextureDesc& desc, uint64_t otherBytes) const;
+
+    /// @brief Queue asynchronous load of the texture
+    void RequestLoad(TextureId id, unsigned firstMip);
+
+    /// @brief Upload loads completed by the loader thread
+    void UploadCompleted();
+
+    /// @brief Trim and evict least recently bound textures until the budget is met
+    void EnforceBudget();
+
+    /// @brief Loader thread procedure
+    void LoaderProc();
+
+    ResidencyBackend* m_backend;
+    uint64_t m_budgetBytes;
+    uint64_t m_residentBytes;
+    uint64_t m_frame;
+
+    std::vector<TextureEntry> m_textures;
+
+    /// Resident textures, most recently bound at the front
+    std::list<TextureId> m_lru;
+
+    ResidencyFrameStats m_stats;
+
+    /// Loader thread queues
+    std::mutex m_queueLock;
+    std::condition_variable m_queueSignal;
+    std::deque<LoadRequest> m_pending;
+    std::deque<LoadRequest> m_completed;
+    bool m_stopLoader;
+    std::thread m_loader;
+};
@@ -0,0 +1,506 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const std::chrono::steady_clock::time_point TRACE_EPOCH = std::chrono::steady_clock::now();
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    bool instant;
+};
+
+/// @brief Fixed block of events, filled by the owner thread
+/// Count is published with release, so the flushing thread sees complete events
+struct TraceChunk
+{
+    static const size_t CAPACITY = 4096;
+
+    TraceChunk() : count(0), next(NULL) {}
+
+    TraceEvent events[CAPACITY];
+    std::atomic<size_t> count;
+    std::atomic<TraceChunk*> next;
+};
+
+/// Events beyond this are dropped, 64 MB per thread
+const size_t MAX_CHUNKS_PER_THREAD = 512;
+
+/// @brief Event buffer of one thread, kept after the thread exits
+struct TraceThread
+{
+    explicit TraceThread(unsigned id) : tid(id), name(NULL), tail(&head), chunks(1), dropped(0) {}
+
+    ~TraceThread()
+    {
+        TraceChunk* chunk = head.next.load();
+        while (chunk)
+        {
+            TraceChunk* next = chunk->next.load();
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    unsigned tid;
+    std::atomic<const char*> name;
+    TraceChunk head;
+
+    /// Owner thread only
+    TraceChunk* tail;
+    size_t chunks;
+
+    std::atomic<uint64_t> dropped;
+};
+
+/// @brief Threads, settings and interned names, lock is not taken by recording
+struct TraceRegistry
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<TraceThread> > threads;
+    std::set<std::string> names;
+    std::string path;
+    std::string processName;
+};
+
+TraceRegistry& Registry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+thread_local TraceThread* t_thread = NULL;
+
+TraceThread& CurrentThread()
+{
+    if (!t_thread)
+    {
+        TraceRegistry& registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.lock);
+        registry.threads.push_back(std::unique_ptr<TraceThread>(new TraceThread(static_cast<unsigned>(registry.threads.size() + 1))));
+        t_thread = registry.threads.back().get();
+    }
+    return *t_thread;
+}
+
+void Append(const TraceEvent& event)
+{
+    TraceThread& thread = CurrentThread();
+    TraceChunk* chunk = thread.tail;
+    size_t count = chunk->count.load(std::memory_order_relaxed);
+    if (TraceChunk::CAPACITY == count)
+    {
+        if (thread.chunks == MAX_CHUNKS_PER_THREAD)
+        {
+            thread.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        TraceChunk* next = new TraceChunk;
+        chunk->next.store(next, std::memory_order_release);
+        thread.tail = chunk = next;
+        ++thread.chunks;
+        count = 0;
+    }
+    chunk->events[count] = event;
+    chunk->count.store(count + 1, std::memory_order_release);
+}
+
+unsigned ProcessId()
+{
+#ifdef _WIN32
+    return static_cast<unsigned>(GetCurrentProcessId());
+#else
+    return static_cast<unsigned>(getpid());
+#endif
+}
+
+std::string HostName()
+{
+    char name[256] = {};
+#ifdef _WIN32
+    DWORD size = sizeof(name);
+    GetComputerNameA(name, &size);
+#else
+    gethostname(name, sizeof(name) - 1);
+#endif
+    return name;
+}
+
+/// @brief Event of a thread, as copied for writing
+struct ThreadEvent
+{
+    unsigned tid;
+    TraceEvent event;
+};
+
+/// @brief Snapshot of the recorded events, called with the registry lock held
+void CollectEvents(TraceRegistry& registry, std::vector<ThreadEvent>& events,
+    std::vector<std::pair<unsigned, std::string> >& threadNames)
+{
+    for (size_t i = 0; i < registry.threads.size(); ++i)
+    {
+        const TraceThread& thread = *registry.threads[i];
+        const char* name = thread.name.load(std::memory_order_acquire);
+        threadNames.push_back(std::make_pair(thread.tid, name ? std::string(name) : std::string()));
+
+        const TraceChunk* chunk = &thread.head;
+        while (chunk)
+        {
+            const size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t e = 0; e < count; ++e)
+            {
+                ThreadEvent event = { thread.tid, chunk->events[e] };
+                events.push_back(event);
+            }
+            chunk = chunk->next.load(std::memory_order_acquire);
+        }
+    }
+}
+
+std::string JsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if ('"' == c || '\\' == c)
+        {
+            escaped += '\\';
+            escaped += static_cast<char>(c);
+        }
+        else if (c < 0x20)
+        {
+            char code[8] = {};
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+        {
+            escaped += static_cast<char>(c);
+        }
+    }
+    return escaped;
+}
+
+/// @brief Chrome JSON object format, one event per line, timestamps in microseconds
+bool WriteChromeJson(FILE* file, unsigned pid, const std::string& processName,
+    const std::vector<ThreadEvent>& events, const std::vector<std::pair<unsigned, std::string> >& threadNames)
+{
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+        pid, JsonEscape(processName).c_str());
+    for (size_t i = 0; i < threadNames.size(); ++i)
+    {
+        if (!threadNames[i].second.empty())
+        {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                pid, threadNames[i].first, JsonEscape(threadNames[i].second).c_str());
+        }
+    }
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const TraceEvent& event = events[i].event;
+        const std::string name = JsonEscape(event.name ? event.name : "");
+        if (event.instant)
+        {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+                name.c_str(), event.start / 1000.0, pid, events[i].tid);
+        }
+        else
+        {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+                name.c_str(), event.start / 1000.0, (event.end - event.start) / 1000.0, pid, events[i].tid);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return 0 == ferror(file);
+}
+
+// Perfetto TracePacket fields, see perfetto/protos/perfetto/trace/trace_packet.proto
+enum PerfettoField
+{
+    TRACE_PACKET = 1,
+    PACKET_TIMESTAMP = 8,
+    PACKET_SEQUENCE_ID = 10,
+    PACKET_TRACK_EVENT = 11,
+    PACKET_SEQUENCE_FLAGS = 13,
+    PACKET_TRACK_DESCRIPTOR = 60,
+
+    TRACK_DESCRIPTOR_UUID = 1,
+    TRACK_DESCRIPTOR_PROCESS = 3,
+    TRACK_DESCRIPTOR_THREAD = 4,
+
+    PROCESS_PID = 1,
+    PROCESS_NAME = 6,
+
+    THREAD_PID = 1,
+    THREAD_TID = 2,
+    THREAD_NAME = 5,
+
+    TRACK_EVENT_TYPE = 9,
+    TRACK_EVENT_TRACK_UUID = 11,
+    TRACK_EVENT_NAME = 23
+};
+
+enum PerfettoEventType
+{
+    SLICE_BEGIN = 1,
+    SLICE_END = 2,
+    INSTANT = 3
+};
+
+const uint32_t SEQUENCE_ID = 1;
+const uint32_t SEQ_INCREMENTAL_STATE_CLEARED = 1;
+
+void AppendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void AppendUint(std::string& out, unsigned field, uint64_t value)
+{
+    AppendVarint(out, field << 3);
+    AppendVarint(out, value);
+}
+
+void AppendBytes(std::string& out, unsigned field, const std::string& bytes)
+{
+    AppendVarint(out, (field << 3) | 2);
+    AppendVarint(out, bytes.size());
+    out += bytes;
+}
+
+/// @brief Track descriptors of the process and threads, then begin and end of every slice
+bool WritePerfetto(FILE* file, unsigned pid, const std::string& processName,
+    const std::vector<ThreadEvent>& events, const std::vector<std::pair<unsigned, std::string> >& threadNames)
+{
+    std::string trace;
+    std::string packet, descriptor, body;
+
+    const uint64_t processUuid = static_cast<uint64_t>(pid) << 32;
+    AppendUint(body, PROCESS_PID, pid);
+    AppendBytes(body, PROCESS_NAME, processName);
+    AppendUint(descriptor, TRACK_DESCRIPTOR_UUID, processUuid);
+    AppendBytes(descriptor, TRACK_DESCRIPTOR_PROCESS, body);
+    AppendUint(packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    AppendUint(packet, PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+    AppendBytes(packet, PACKET_TRACK_DESCRIPTOR, descriptor);
+    AppendBytes(trace, TRACE_PACKET, packet);
+
+    for (size_t i = 0; i < threadNames.size(); ++i)
+    {
+        packet.clear();
+        descriptor.clear();
+        body.clear();
+        AppendUint(body, THREAD_PID, pid);
+        AppendUint(body, THREAD_TID, threadNames[i].first);
+        if (!threadNames[i].second.empty())
+        {
+            AppendBytes(body, THREAD_NAME, threadNames[i].second);
+        }
+        AppendUint(descriptor, TRACK_DESCRIPTOR_UUID, processUuid | threadNames[i].first);
+        AppendBytes(descriptor, TRACK_DESCRIPTOR_THREAD, body);
+        AppendUint(packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+        AppendBytes(packet, PACKET_TRACK_DESCRIPTOR, descriptor);
+        AppendBytes(trace, TRACE_PACKET, packet);
+    }
+
+    // Slices of a thread must nest: at equal timestamps ends go first, the inner one first,
+    // then begins, the outer one first. Zero-length slices go last, each begin directly
+    // followed by its end, inside the slices beginning at the same time
+    struct Marker
+    {
+        uint64_t timestamp;
+        unsigned order;
+        uint64_t duration;
+        unsigned tid;
+        PerfettoEventType type;
+        const char* name;
+    };
+    std::vector<Marker> markers;
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const TraceEvent& event = events[i].event;
+        const uint64_t duration = event.end - event.start;
+        if (event.instant)
+        {
+            Marker instant = { event.start, 1, 0, events[i].tid, INSTANT, event.name };
+            markers.push_back(instant);
+            continue;
+        }
+        if (0 == duration)
+        {
+            // Equal keys, the stable sort keeps the end right after the begin
+            Marker begin = { event.start, 3, 0, events[i].tid, SLICE_BEGIN, event.name };
+            Marker end = { event.end, 3, 0, events[i].tid, SLICE_END, event.name };
+            markers.push_back(begin);
+            markers.push_back(end);
+            continue;
+        }
+        Marker begin = { event.start, 2, ~duration, events[i].tid, SLICE_BEGIN, event.name };
+        Marker end = { event.end, 0, duration, events[i].tid, SLICE_END, event.name };
+        markers.push_back(begin);
+        markers.push_back(end);
+    }
+    std::stable_sort(markers.begin(), markers.end(), [](const Marker& a, const Marker& b)
+    {
+        if (a.timestamp != b.timestamp)
+        {
+            return a.timestamp < b.timestamp;
+        }
+        return a.order != b.order ? a.order < b.order : a.duration < b.duration;
+    });
+
+    for (size_t i = 0; i < markers.size(); ++i)
+    {
+        packet.clear();
+        body.clear();
+        AppendUint(body, TRACK_EVENT_TYPE, markers[i].type);
+        AppendUint(body, TRACK_EVENT_TRACK_UUID, processUuid | markers[i].tid);
+        if (SLICE_END != markers[i].type)
+        {
+            AppendBytes(body, TRACK_EVENT_NAME, markers[i].name ? markers[i].name : "");
+        }
+        AppendUint(packet, PACKET_TIMESTAMP, markers[i].timestamp);
+        AppendUint(packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+        AppendBytes(packet, PACKET_TRACK_EVENT, body);
+        AppendBytes(trace, TRACE_PACKET, packet);
+    }
+
+    return trace.size() == fwrite(trace.data(), 1, trace.size(), file);
+}
+
+bool EndsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && 0 == text.compare(text.size() - suffix.size(), suffix.size(), suffix);
+}
+
+void FlushAtExit()
+{
+    TraceFlush();
+}
+
+} // namespace
+
+uint64_t TraceNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - TRACE_EPOCH).count();
+}
+
+void TraceStart(const std::string& path, const std::string& processName)
+{
+    TraceRegistry& registry = Registry();
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(registry.lock);
+        first = registry.path.empty();
+        const char* overridePath = getenv("D3D_TRACE_FILE");
+        registry.path = overridePath && *overridePath ? overridePath : path;
+        registry.processName = processName + " @ " + HostName();
+    }
+
+    // Registry is constructed before the handler is registered, so it is destroyed after it runs
+    if (first)
+    {
+        atexit(FlushAtExit);
+    }
+}
+
+bool TraceFlush()
+{
+    std::string path;
+    {
+        TraceRegistry& registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.lock);
+        path = registry.path;
+    }
+    return !path.empty() && TraceWrite(path);
+}
+
+bool TraceWrite(const std::string& path)
+{
+    TraceRegistry& registry = Registry();
+    std::vector<ThreadEvent> events;
+    std::vector<std::pair<unsigned, std::string> > threadNames;
+    std::string processName;
+    {
+        std::lock_guard<std::mutex> lock(registry.lock);
+        CollectEvents(registry, events, threadNames);
+        processName = registry.processName.empty() ? HostName() : registry.processName;
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = EndsWith(path, ".json") ?
+        WriteChromeJson(file, ProcessId(), processName, events, threadNames) :
+        WritePerfetto(file, ProcessId(), processName, events, threadNames);
+    return 0 == fclose(file) && written;
+}
+
+void TraceEventCounts(uint64_t& recorded, uint64_t& dropped)
+{
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    recorded = dropped = 0;
+    for (size_t i = 0; i < registry.threads.size(); ++i)
+    {
+        const TraceThread& thread = *registry.threads[i];
+        for (const TraceChunk* chunk = &thread.head; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+        {
+            recorded += chunk->count.load(std::memory_order_acquire);
+        }
+        dropped += thread.dropped.load(std::memory_order_relaxed);
+    }
+}
+
+void TraceSetThreadName(const char* name)
+{
+    CurrentThread().name.store(name, std::memory_order_release);
+}
+
+const char* TraceInternName(const std::string& name)
+{
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    return registry.names.insert(name).first->c_str();
+}
+
+void TraceRecord(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    TraceEvent event = { name, startNs, endNs, false };
+    Append(event);
+}
+
+void TraceInstant(const char* name)
+{
+    const uint64_t now = TraceNow();
+    TraceEvent event = { name, now, now, true };
+    Append(event);
+}
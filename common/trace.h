@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Trace scopes are compiled in only with D3D_TRACE_ENABLED, defined by the D3D_TRACE
+// CMake option. Otherwise the macros expand to nothing and their arguments are not evaluated
+#ifdef D3D_TRACE_ENABLED
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+/// @brief Trace into the file written at exit, see TraceStart()
+#define TRACE_START(path, processName) TraceStart((path), (processName))
+
+/// @brief Duration of the enclosing block, name must outlive the trace (literal or TRACE_INTERN)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#define TRACE_INSTANT(name) TraceInstant(name)
+#define TRACE_THREAD_NAME(name) TraceSetThreadName(name)
+#define TRACE_INTERN(name) TraceInternName(name)
+#define TRACE_FLUSH() TraceFlush()
+
+#else
+
+#define TRACE_START(path, processName) static_cast<void>(0)
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_INSTANT(name) static_cast<void>(0)
+#define TRACE_THREAD_NAME(name) static_cast<void>(0)
+#define TRACE_INTERN(name) static_cast<const char*>(NULL)
+#define TRACE_FLUSH() static_cast<void>(0)
+
+#endif
+
+/// @brief Nanoseconds since the trace epoch, taken when the process loads the library
+uint64_t TraceNow();
+
+/// @brief Set the file written by TraceFlush() and at exit, D3D_TRACE_FILE environment variable overrides it
+/// Chrome JSON for .json files, Perfetto protobuf otherwise (.pftrace).
+/// Process is named processName @ host name, so that traces of several machines can be told apart
+void TraceStart(const std::string& path, const std::string& processName);
+
+/// @brief Write all events recorded so far to the file set by TraceStart()
+bool TraceFlush();
+
+/// @brief Write all events recorded so far, format from the extension
+bool TraceWrite(const std::string& path);
+
+/// @brief Events recorded and dropped because the thread buffer was full
+void TraceEventCounts(uint64_t& recorded, uint64_t& dropped);
+
+/// @brief Name of the calling thread in the trace
+void TraceSetThreadName(const char* name);
+
+/// @brief Copy of the name which lives until the process exits, for names built at run time
+const char* TraceInternName(const std::string& name);
+
+/// @brief Record a complete event on the calling thread
+/// Appends to the buffer of the thread without locking
+void TraceRecord(const char* name, uint64_t startNs, uint64_t endNs);
+
+void TraceInstant(const char* name);
+
+/// @brief Records the duration of its lifetime
+class TraceScope
+{
+public:
+
+    explicit TraceScope(const char* name) : m_name(name), m_start(TraceNow()) {}
+    ~TraceScope() { TraceRecord(m_name, m_start, TraceNow()); }
+
+private:
+
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+    const char* m_name;
+    uint64_t m_start;
+};
@@ -0,0 +1,316 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_HIERARCHY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const float IDENTITY[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+/// @brief result = a * b, row-major, result must not alias the inputs
+void MultiplyScalar(const float* a, const float* b, float* result)
+{
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        for (unsigned column = 0; column < 4; ++column)
+        {
+            result[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] +
+                a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+        }
+    }
+}
+
+#ifdef TRANSFORM_HIERARCHY_SSE2
+/// @brief Whole row per multiply, summed in the order of the scalar path so that results are equal
+void MultiplySimd(const float* a, const float* b, float* result)
+{
+    const __m128 row0 = _mm_loadu_ps(b);
+    const __m128 row1 = _mm_loadu_ps(b + 4);
+    const __m128 row2 = _mm_loadu_ps(b + 8);
+    const __m128 row3 = _mm_loadu_ps(b + 12);
+    for (unsigned row = 0; row < 4; ++row)
+    {
+        const float* left = a + 4 * row;
+        __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(left[0]), row0), _mm_mul_ps(_mm_set1_ps(left[1]), row1));
+        sum = _mm_add_ps(_mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(left[2]), row2)), _mm_mul_ps(_mm_set1_ps(left[3]), row3));
+        _mm_storeu_ps(result + 4 * row, sum);
+    }
+}
+#endif
+
+} // namespace
+
+const uint32_t TransformHierarchy::NO_PARENT;
+const uint32_t TransformHierarchy::INVALID_NODE;
+
+TransformHierarchy::TransformHierarchy()
+    : m_simd(true)
+    , m_restructure(false)
+{
+    m_stats.nodesUpdated = 0;
+    m_stats.subtreesUpdated = 0;
+    m_stats.restructured = false;
+}
+
+bool TransformHierarchy::Simd() const
+{
+#ifdef TRANSFORM_HIERARCHY_SSE2
+    return m_simd;
+#else
+    return false;
+#endif
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const float local[16])
+{
+    // A new node has no children, so only a missing parent can break the hierarchy
+    if (NO_PARENT != parent && parent >= m_position.size())
+    {
+        return INVALID_NODE;
+    }
+
+    const uint32_t node = static_cast<uint32_t>(m_position.size());
+    const uint32_t position = static_cast<uint32_t>(m_node.size());
+    m_position.push_back(position);
+    m_parentNode.push_back(parent);
+
+    // A root appended after all subtrees keeps them contiguous, a child has to be moved next to its parent
+    m_node.push_back(node);
+    m_parent.push_back(NO_PARENT == parent ? NO_PARENT : m_position[parent]);
+    m_subtreeSize.push_back(1);
+    m_local.insert(m_local.end(), local, local + 16);
+    m_world.insert(m_world.end(), IDENTITY, IDENTITY + 16);
+    m_dirty.push_back(0);
+    m_restructure = m_restructure || NO_PARENT != parent;
+    MarkDirty(position);
+    return node;
+}
+
+bool TransformHierarchy::SetParent(uint32_t node, uint32_t parent)
+{
+    if (node >= m_position.size() || (NO_PARENT != parent && parent >= m_position.size()))
+    {
+        return false;
+    }
+    for (uint32_t ancestor = parent; NO_PARENT != ancestor; ancestor = m_parentNode[ancestor])
+    {
+        if (ancestor == node)
+        {
+            return false;
+        }
+    }
+    if (m_parentNode[node] != parent)
+    {
+        m_parentNode[node] = parent;
+        m_restructure = true;
+        MarkDirty(m_position[node]);
+    }
+    return true;
+}
+
+uint32_t TransformHierarchy::Parent(uint32_t node) const
+{
+    return m_parentNode[node];
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const float local[16])
+{
+    const size_t position = m_position[node];
+    memcpy(&m_local[16 * position], local, 16 * sizeof(float));
+    MarkDirty(position);
+}
+
+void TransformHierarchy::MarkDirty(size_t position)
+{
+    if (!m_dirty[position])
+    {
+        m_dirty[position] = 1;
+        m_dirtyPositions.push_back(static_cast<uint32_t>(position));
+    }
+}
+
+void TransformHierarchy::Update()
+{
+    m_stats.nodesUpdated = 0;
+    m_stats.subtreesUpdated = 0;
+    m_stats.restructured = m_restructure;
+    if (m_restructure)
+    {
+        Restructure();
+    }
+
+    // Many changes are ordered faster by a pass over the flags than by sorting
+    if (m_dirtyPositions.size() > m_node.size() / 32)
+    {
+        m_dirtyPositions.clear();
+        for (size_t i = 0; i < m_dirty.size(); ++i)
+        {
+            if (m_dirty[i])
+            {
+                m_dirtyPositions.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+    else
+    {
+        std::sort(m_dirtyPositions.begin(), m_dirtyPositions.end());
+    }
+
+    // Subtrees are nested or disjoint, a dirty node inside the previous range is updated with it
+    size_t end = 0;
+    for (size_t i = 0; i < m_dirtyPositions.size(); ++i)
+    {
+        const size_t position = m_dirtyPositions[i];
+        if (position >= end)
+        {
+            end = position + m_subtreeSize[position];
+            UpdateRange(position, end);
+            m_stats.nodesUpdated += end - position;
+            ++m_stats.subtreesUpdated;
+        }
+        m_dirty[position] = 0;
+    }
+    m_dirtyPositions.clear();
+}
+
+void TransformHierarchy::UpdateAll()
+{
+    m_stats.restructured = m_restructure;
+    if (m_restructure)
+    {
+        Restructure();
+    }
+    for (size_t i = 0; i < m_dirtyPositions.size(); ++i)
+    {
+        m_dirty[m_dirtyPositions[i]] = 0;
+    }
+    m_dirtyPositions.clear();
+
+    UpdateRange(0, m_node.size());
+    m_stats.nodesUpdated = m_node.size();
+    m_stats.subtreesUpdated = 0;
+    for (size_t i = 0; i < m_parent.size(); ++i)
+    {
+        m_stats.subtreesUpdated += NO_PARENT == m_parent[i];
+    }
+}
+
+void TransformHierarchy::UpdateRange(size_t first, size_t end)
+{
+    for (size_t i = first; i < end; ++i)
+    {
+        const float* local = &m_local[16 * i];
+        float* world = &m_world[16 * i];
+        if (NO_PARENT == m_parent[i])
+        {
+            memcpy(world, local, 16 * sizeof(float));
+            continue;
+        }
+        const float* parentWorld = &m_world[16 * static_cast<size_t>(m_parent[i])];
+#ifdef TRANSFORM_HIERARCHY_SSE2
+        if (m_simd)
+        {
+            MultiplySimd(local, parentWorld, world);
+            continue;
+        }
+#endif
+        MultiplyScalar(local, parentWorld, world);
+    }
+}
+
+void TransformHierarchy::Restructure()
+{
+    const size_t count = m_node.size();
+
+    // Children of every node in storage order, so that siblings keep their relative order
+    std::vector<uint32_t> firstChild(count + 1, 0), children(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t parent = m_parentNode[m_node[i]];
+        if (NO_PARENT != parent)
+        {
+            ++firstChild[parent + 1];
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        firstChild[i + 1] += firstChild[i];
+    }
+    std::vector<uint32_t> filled(firstChild.begin(), firstChild.end() - 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t parent = m_parentNode[m_node[i]];
+        if (NO_PARENT != parent)
+        {
+            children[filled[parent]++] = m_node[i];
+        }
+    }
+
+    // Depth-first order of the ids, roots in storage order
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    std::vector<uint32_t> stack;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (NO_PARENT != m_parentNode[m_node[i]])
+        {
+            continue;
+        }
+        stack.push_back(m_node[i]);
+        while (!stack.empty())
+        {
+            const uint32_t node = stack.back();
+            stack.pop_back();
+            order.push_back(node);
+            for (uint32_t c = firstChild[node + 1]; c > firstChild[node]; --c)
+            {
+                stack.push_back(children[c - 1]);
+            }
+        }
+    }
+
+    std::vector<float> local(m_local.size()), world(m_world.size());
+    std::vector<uint8_t> dirty(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t previous = m_position[order[i]];
+        memcpy(&local[16 * i], &m_local[16 * previous], 16 * sizeof(float));
+        memcpy(&world[16 * i], &m_world[16 * previous], 16 * sizeof(float));
+        dirty[i] = m_dirty[previous];
+    }
+    m_dirtyPositions.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_node[i] = order[i];
+        m_position[order[i]] = static_cast<uint32_t>(i);
+        if (dirty[i])
+        {
+            m_dirtyPositions.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    m_local.swap(local);
+    m_world.swap(world);
+    m_dirty.swap(dirty);
+
+    // Children follow their parents, subtree sizes are summed from the back
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t parent = m_parentNode[m_node[i]];
+        m_parent[i] = NO_PARENT == parent ? NO_PARENT : m_position[parent];
+        m_subtreeSize[i] = 1;
+    }
+    for (size_t i = count; i-- > 0;)
+    {
+        if (NO_PARENT != m_parent[i])
+        {
+            m_subtreeSize[m_parent[i]] += m_subtreeSize[i];
+        }
+    }
+    m_restructure = false;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Nodes and matrices recomputed by the last TransformHierarchy::Update()
+struct TransformUpdateStats
+{
+    /// Nodes whose world matrix was recomputed
+    size_t nodesUpdated;
+
+    /// Contiguous subtrees recomputed, one per dirty node not below another dirty node
+    size_t subtreesUpdated;
+
+    /// Whether nodes were added or reparented, which sorts all nodes again
+    bool restructured;
+};
+
+/// @brief Parent/child transforms with world matrices updated incrementally
+/// Matrices are row-major with row vectors, as D3DX ones: world = local * parent world.
+/// Every attribute lives in its own array indexed by the storage position of the node:
+/// parents, subtree sizes, local and world matrices and dirty flags. Nodes are stored in
+/// depth-first order, so parents precede their children and every subtree is one range.
+/// Changing a local matrix marks its node dirty; Update() recomputes the range of every
+/// dirty node which is not inside another dirty range, so the cost follows the number of
+/// nodes below changes and not the size of the hierarchy. Products are computed a row at
+/// a time with SSE2 where available. Adding and reparenting nodes sorts the arrays again
+/// in the next update, which costs a pass over all nodes
+class TransformHierarchy
+{
+public:
+
+    /// @brief Parent of root nodes
+    static const uint32_t NO_PARENT = 0xffffffff;
+
+    /// @brief Id returned when a node can't be added
+    static const uint32_t INVALID_NODE = 0xffffffff;
+
+    TransformHierarchy();
+
+    /// @brief Add a node below the parent, NO_PARENT for a root, returns the id of the node
+    /// Ids stay valid when the nodes are sorted again. A parent which is not a node is
+    /// rejected, nothing is added and INVALID_NODE is returned
+    uint32_t AddNode(uint32_t parent, const float local[16]);
+
+    /// @brief Move the node with its subtree below another parent, NO_PARENT makes it a root
+    /// False if either id is not a node, or the parent is the node itself or one of its descendants
+    bool SetParent(uint32_t node, uint32_t parent);
+    uint32_t Parent(uint32_t node) const;
+
+    void SetLocal(uint32_t node, const float local[16]);
+    const float* Local(uint32_t node) const { return &m_local[16 * m_position[node]]; }
+
+    /// @brief World matrix as of the last Update()
+    const float* World(uint32_t node) const { return &m_world[16 * m_position[node]]; }
+
+    /// @brief Recompute the world matrices of the dirty subtrees
+    void Update();
+
+    /// @brief Recompute all world matrices, for comparison with the incremental update
+    void UpdateAll();
+
+    size_t NodeCount() const { return m_parent.size(); }
+
+    /// @brief Disable SSE2 path, for comparison with the scalar one
+    void SetSimd(bool enabled) { m_simd = enabled; }
+    bool Simd() const;
+
+    const TransformUpdateStats& LastUpdate() const { return m_stats; }
+
+    /// @brief Storage order, for iterating the matrices in bulk
+    /// World matrices of all nodes as 16 consecutive floats each, in the order of NodeAt()
+    const float* WorldMatrices() const { return m_world.empty() ? NULL : &m_world[0]; }
+    uint32_t NodeAt(size_t position) const { return m_node[position]; }
+    size_t Position(uint32_t node) const { return m_position[node]; }
+
+private:
+
+    /// @brief Sort the nodes depth-first from the parents of the ids and rebuild the arrays
+    void Restructure();
+
+    /// @brief World matrices of the positions in [first, end), the parent of first is up to date
+    void UpdateRange(size_t first, size_t end);
+
+    void MarkDirty(size_t position);
+
+    bool m_simd;
+    bool m_restructure;
+    TransformUpdateStats m_stats;
+
+    /// Indexed by id
+    std::vector<uint32_t> m_position;
+    std::vector<uint32_t> m_parentNode;
+
+    /// Indexed by storage position
+    std::vector<uint32_t> m_node;
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_subtreeSize;
+    std::vector<float> m_local;
+    std::vector<float> m_world;
+    std::vector<uint8_t> m_dirty;
+
+    /// Positions marked dirty since the last update, each once
+    std::vector<uint32_t> m_dirtyPositions;
+};
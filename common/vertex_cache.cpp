@@ -0,0 +1,248 @@
+#include "vertex_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const int FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+/// @brief Vertex score: recently used vertices and vertices with few remaining triangles are preferred
+float ForsythVertexScore(int cachePosition, unsigned activeTriangles)
+{
+    if (0 == activeTriangles)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // Vertices of the last triangle get a fixed score so that strips are not favoured too much
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+
+    score += FORSYTH_VALENCE_BOOST_SCALE * powf(static_cast<float>(activeTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+} // namespace
+
+VertexCacheStats SimulateVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+    VertexCacheModel model, unsigned cacheSize)
+{
+    VertexCacheStats stats = {};
+    stats.triangles = indices.size() / 3;
+    stats.vertices = vertexCount;
+
+    std::vector<uint32_t> cache;
+    cache.reserve(cacheSize + 1);
+
+    for (size_t i = 0; i < stats.triangles * 3; ++i)
+    {
+        uint32_t index = indices[i];
+        std::vector<uint32_t>::iterator it = std::find(cache.begin(), cache.end(), index);
+        if (it != cache.end())
+        {
+            if (VERTEX_CACHE_LRU == model)
+            {
+                cache.erase(it);
+                cache.insert(cache.begin(), index);
+            }
+            continue;
+        }
+
+        ++stats.transforms;
+        cache.insert(cache.begin(), index);
+        if (cache.size() > cacheSize)
+        {
+            cache.pop_back();
+        }
+    }
+
+    stats.acmr = stats.triangles ? static_cast<double>(stats.transforms) / stats.triangles : 0.0;
+    stats.atvr = stats.vertices ? static_cast<double>(stats.transforms) / stats.vertices : 0.0;
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (0 == triangleCount)
+    {
+        return;
+    }
+
+    // Vertex to triangle adjacency
+    std::vector<unsigned> activeTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        ++activeTriangles[indices[i]];
+    }
+
+    std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + activeTriangles[v];
+    }
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<size_t> adjacencyFill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[t * 3 + k];
+            adjacency[adjacencyFill[v]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScore[v] = ForsythVertexScore(-1, activeTriangles[v]);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    // Cache holds up to 3 extra entries while the new triangle is pushed
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    size_t scanCursor = 0;
+    size_t bestTriangle = triangleCount;
+    float bestScore = -1.0f;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        // No candidate around the cache, take the best remaining triangle
+        if (bestTriangle == triangleCount)
+        {
+            bestScore = -1.0f;
+            for (size_t t = scanCursor; t < triangleCount; ++t)
+            {
+                if (!emitted[t] && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+            while (scanCursor < triangleCount && emitted[scanCursor])
+            {
+                ++scanCursor;
+            }
+        }
+
+        const uint32_t* triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+
+        // Emit triangle and detach it from its vertices
+        nextCache.clear();
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = triangle[k];
+            output.push_back(v);
+            nextCache.push_back(v);
+
+            uint32_t* begin = &adjacency[adjacencyOffset[v]];
+            uint32_t* end = begin + activeTriangles[v];
+            uint32_t* it = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+            std::swap(*it, *(end - 1));
+            --activeTriangles[v];
+        }
+
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+            {
+                nextCache.push_back(v);
+            }
+        }
+        cache.swap(nextCache);
+
+        // Vertices pushed out of the cache lose their position score
+        for (size_t i = FORSYTH_CACHE_SIZE; i < cache.size(); ++i)
+        {
+            cachePosition[cache[i]] = -1;
+            vertexScore[cache[i]] = ForsythVertexScore(-1, activeTriangles[cache[i]]);
+        }
+        for (size_t i = 0; i < cache.size() && i < static_cast<size_t>(FORSYTH_CACHE_SIZE); ++i)
+        {
+            cachePosition[cache[i]] = static_cast<int>(i);
+            vertexScore[cache[i]] = ForsythVertexScore(static_cast<int>(i), activeTriangles[cache[i]]);
+        }
+
+        // Rescore triangles around the cache and the evicted vertices, pick the best of them
+        bestTriangle = triangleCount;
+        bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            uint32_t v = cache[i];
+            for (size_t a = 0; a < activeTriangles[v]; ++a)
+            {
+                uint32_t t = adjacency[adjacencyOffset[v] + a];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                triangleScore[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (cache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE))
+        {
+            cache.resize(FORSYTH_CACHE_SIZE);
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void OptimizeVertexFetch(Mesh& mesh)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (size_t i = 0; i < mesh.indices.size(); ++i)
+    {
+        uint32_t& target = remap[mesh.indices[i]];
+        if (unused == target)
+        {
+            target = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[mesh.indices[i]]);
+        }
+        mesh.indices[i] = target;
+    }
+
+    // Vertices not referenced by any triangle are dropped
+    mesh.vertices.swap(vertices);
+}
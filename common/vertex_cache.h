@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+/// @brief Post-transform vertex cache replacement policy
+enum VertexCacheModel
+{
+    /// Hits do not refresh the entry, as in most fixed-size hardware caches
+    VERTEX_CACHE_FIFO,
+
+    /// Hits move the entry to the front
+    VERTEX_CACHE_LRU
+};
+
+/// @brief Result of the post-transform cache simulation
+struct VertexCacheStats
+{
+    /// Vertex shader invocations
+    size_t transforms;
+    size_t triangles;
+    size_t vertices;
+
+    /// Average cache miss ratio: transforms per triangle, 0.5 is ideal for regular grids, 3 is the worst
+    double acmr;
+
+    /// Average transform to vertex ratio: transforms per vertex, 1 is ideal
+    double atvr;
+};
+
+/// @brief Simulate the post-transform cache of the given size over a triangle list
+VertexCacheStats SimulateVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+    VertexCacheModel model, unsigned cacheSize);
+
+/// @brief Reorder triangles for post-transform cache locality
+/// Linear-speed vertex cache optimization by Tom Forsyth, tuned for 32 entries
+/// which performs well on smaller FIFO caches as well
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+/// @brief Reorder vertices in the order of the first use for pre-transform fetch locality
+/// Should be done after OptimizeVertexCache(), indices are remapped accordingly
+void OptimizeVertexFetch(Mesh& mesh);
@@ -0,0 +1,594 @@
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_FORMAT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const float SHORT_NORM_SCALE = 32767.0f;
+const float UBYTE_NORM_SCALE = 255.0f;
+const float DEC3_NORM_SCALE = 511.0f;
+
+/// @brief Number of float components of the element
+unsigned ElementComponents(VertexElementType type)
+{
+    switch (type)
+    {
+    case VET_FLOAT1:
+        return 1;
+    case VET_FLOAT2:
+    case VET_SHORT2N:
+    case VET_FLOAT16_2:
+        return 2;
+    case VET_FLOAT3:
+    case VET_DEC3N:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+uint32_t PackDec3N(int x, int y, int z)
+{
+    return (static_cast<uint32_t>(x) & 0x3FF) | ((static_cast<uint32_t>(y) & 0x3FF) << 10) | ((static_cast<uint32_t>(z) & 0x3FF) << 20);
+}
+
+#ifdef VERTEX_FORMAT_SSE2
+
+/// @brief Load components into 4 lanes, missing components are 0 and w is 1
+inline __m128 LoadComponents(const float* src, unsigned components)
+{
+    switch (components)
+    {
+    case 1:
+        return _mm_setr_ps(src[0], 0.0f, 0.0f, 1.0f);
+    case 2:
+        return _mm_setr_ps(src[0], src[1], 0.0f, 1.0f);
+    case 3:
+        return _mm_setr_ps(src[0], src[1], src[2], 1.0f);
+    default:
+        return _mm_loadu_ps(src);
+    }
+}
+
+/// @brief Float16 conversion of 4 lanes with round to nearest even, results are in low 16 bits of each lane
+/// Fabian Giesen's branchless float_to_half_rtne
+inline __m128i FloatToHalf4(__m128 value)
+{
+    const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i nanBit = _mm_set1_epi32(0x200);
+    const __m128i infinity = _mm_set1_epi32(0x7C00);
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32(0xFFF - ((127 - 15) << 23));
+
+    __m128 sign = _mm_and_ps(_mm_castsi128_ps(_mm_set1_epi32(0x80000000)), value);
+    __m128 absolute = _mm_xor_ps(value, sign);
+    __m128i absoluteBits = _mm_castps_si128(absolute);
+
+    __m128 isNan = _mm_cmpunord_ps(absolute, absolute);
+    __m128i isRegular = _mm_cmpgt_epi32(f16max, absoluteBits);
+    __m128i special = _mm_or_si128(_mm_and_si128(_mm_castps_si128(isNan), nanBit), infinity);
+    __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absoluteBits);
+
+    // Subnormal result: let the FPU round the mantissa
+    __m128 subnormalSum = _mm_add_ps(absolute, _mm_castsi128_ps(subnormalMagic));
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(subnormalSum), subnormalMagic);
+
+    // Normal result: rebias exponent and round the mantissa, ties go to even
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absoluteBits, 31 - 13), 31);
+    __m128i rounded = _mm_sub_epi32(_mm_add_epi32(absoluteBits, normalBias), mantissaOdd);
+    __m128i normal = _mm_srli_epi32(rounded, 13);
+
+    __m128i regular = _mm_or_si128(_mm_and_si128(subnormal, isSubnormal), _mm_andnot_si128(isSubnormal, normal));
+    __m128i joined = _mm_or_si128(_mm_and_si128(regular, isRegular), _mm_andnot_si128(isRegular, special));
+    return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+struct EncodeFloat16
+{
+    unsigned components;
+    void operator()(__m128 value, unsigned char* dst) const
+    {
+        // Sign-extended halves fit into signed saturation
+        __m128i halves = _mm_packs_epi32(FloatToHalf4(value), _mm_setzero_si128());
+        if (2 == components)
+        {
+            int packed = _mm_cvtsi128_si32(halves);
+            memcpy(dst, &packed, 4);
+        }
+        else
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), halves);
+        }
+    }
+};
+
+struct EncodeShortN
+{
+    unsigned components;
+    void operator()(__m128 value, unsigned char* dst) const
+    {
+        __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+        __m128i shorts = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(SHORT_NORM_SCALE))), _mm_setzero_si128());
+        if (2 == components)
+        {
+            int packed = _mm_cvtsi128_si32(shorts);
+            memcpy(dst, &packed, 4);
+        }
+        else
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), shorts);
+        }
+    }
+};
+
+struct EncodeUbyteN
+{
+    void operator()(__m128 value, unsigned char* dst) const
+    {
+        __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128i ints = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(UBYTE_NORM_SCALE)));
+        __m128i shorts = _mm_packs_epi32(ints, ints);
+        int packed = _mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts));
+        memcpy(dst, &packed, 4);
+    }
+};
+
+struct EncodeDec3N
+{
+    void operator()(__m128 value, unsigned char* dst) const
+    {
+        __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+        __m128i ints = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(DEC3_NORM_SCALE)));
+
+        // SSE2 has no per-lane variable shifts
+        int lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), ints);
+        uint32_t packed = PackDec3N(lanes[0], lanes[1], lanes[2]);
+        memcpy(dst, &packed, 4);
+    }
+};
+
+template <typename Encoder>
+void EncodeStream(Encoder encoder, const float* src, size_t srcStride, unsigned components,
+    void* dst, size_t dstStride, size_t count)
+{
+    const unsigned char* srcBytes = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* dstBytes = static_cast<unsigned char*>(dst);
+    for (size_t i = 0; i < count; ++i, srcBytes += srcStride, dstBytes += dstStride)
+    {
+        encoder(LoadComponents(reinterpret_cast<const float*>(srcBytes), components), dstBytes);
+    }
+}
+
+#else
+
+float ClampFloat(float value, float low, float high)
+{
+    return std::min(std::max(value, low), high);
+}
+
+/// @brief Load components into 4 values, missing components are 0 and w is 1
+inline void LoadComponents(const float* src, unsigned components, float value[4])
+{
+    value[0] = value[1] = value[2] = 0.0f;
+    value[3] = 1.0f;
+    memcpy(value, src, std::min(components, 4u) * sizeof(float));
+}
+
+struct EncodeFloat16
+{
+    unsigned components;
+    void operator()(const float* value, unsigned char* dst) const
+    {
+        uint16_t halves[4];
+        for (unsigned c = 0; c < components; ++c)
+        {
+            halves[c] = FloatToHalf(value[c]);
+        }
+        memcpy(dst, halves, components * sizeof(uint16_t));
+    }
+};
+
+struct EncodeShortN
+{
+    unsigned components;
+    void operator()(const float* value, unsigned char* dst) const
+    {
+        int16_t shorts[4];
+        for (unsigned c = 0; c < components; ++c)
+        {
+            shorts[c] = static_cast<int16_t>(lrintf(ClampFloat(value[c], -1.0f, 1.0f) * SHORT_NORM_SCALE));
+        }
+        memcpy(dst, shorts, components * sizeof(int16_t));
+    }
+};
+
+struct EncodeUbyteN
+{
+    void operator()(const float* value, unsigned char* dst) const
+    {
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            dst[c] = static_cast<unsigned char>(lrintf(ClampFloat(value[c], 0.0f, 1.0f) * UBYTE_NORM_SCALE));
+        }
+    }
+};
+
+struct EncodeDec3N
+{
+    void operator()(const float* value, unsigned char* dst) const
+    {
+        uint32_t packed = PackDec3N(
+            static_cast<int>(lrintf(ClampFloat(value[0], -1.0f, 1.0f) * DEC3_NORM_SCALE)),
+            static_cast<int>(lrintf(ClampFloat(value[1], -1.0f, 1.0f) * DEC3_NORM_SCALE)),
+            static_cast<int>(lrintf(ClampFloat(value[2], -1.0f, 1.0f) * DEC3_NORM_SCALE)));
+        memcpy(dst, &packed, 4);
+    }
+};
+
+template <typename Encoder>
+void EncodeStream(Encoder encoder, const float* src, size_t srcStride, unsigned components,
+    void* dst, size_t dstStride, size_t count)
+{
+    const unsigned char* srcBytes = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* dstBytes = static_cast<unsigned char*>(dst);
+    float value[4];
+    for (size_t i = 0; i < count; ++i, srcBytes += srcStride, dstBytes += dstStride)
+    {
+        LoadComponents(reinterpret_cast<const float*>(srcBytes), components, value);
+        encoder(value, dstBytes);
+    }
+}
+
+#endif // VERTEX_FORMAT_SSE2
+
+/// @brief Copy of float components, missing ones are 0 and w is 1
+void EncodeFloats(const float* src, size_t srcStride, unsigned components, unsigned dstComponents,
+    void* dst, size_t dstStride, size_t count)
+{
+    const unsigned char* srcBytes = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* dstBytes = static_cast<unsigned char*>(dst);
+    for (size_t i = 0; i < count; ++i, srcBytes += srcStride, dstBytes += dstStride)
+    {
+        float value[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        memcpy(value, srcBytes, std::min(components, 4u) * sizeof(float));
+        memcpy(dstBytes, value, dstComponents * sizeof(float));
+    }
+}
+
+} // namespace
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    bits &= 0x7FFFFFFF;
+
+    uint16_t half = 0;
+    if (bits >= static_cast<uint32_t>((127 + 16) << 23))
+    {
+        // Infinity or NaN
+        half = (bits > 0x7F800000) ? 0x7E00 : 0x7C00;
+    }
+    else if (bits < static_cast<uint32_t>((127 - 14) << 23))
+    {
+        // Subnormal: let the FPU round the mantissa
+        const uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic = 0.0f;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        float absolute = 0.0f;
+        memcpy(&absolute, &bits, sizeof(absolute));
+        float sum = absolute + magic;
+        uint32_t sumBits = 0;
+        memcpy(&sumBits, &sum, sizeof(sumBits));
+        half = static_cast<uint16_t>(sumBits - magicBits);
+    }
+    else
+    {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF + mantissaOdd;
+        half = static_cast<uint16_t>(bits >> 13);
+    }
+    return half | sign;
+}
+
+float HalfToFloat(uint16_t value)
+{
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    float result = 0.0f;
+    if (0 == exponent)
+    {
+        result = ldexpf(static_cast<float>(mantissa), -24);
+    }
+    else if (31 == exponent)
+    {
+        result = mantissa ? NAN : INFINITY;
+    }
+    else
+    {
+        result = ldexpf(static_cast<float>(mantissa | 0x400), static_cast<int>(exponent) - 25);
+    }
+    return sign ? -result : result;
+}
+
+unsigned VertexElementSize(VertexElementType type)
+{
+    switch (type)
+    {
+    case VET_FLOAT1:
+    case VET_UBYTE4N:
+    case VET_SHORT2N:
+    case VET_DEC3N:
+    case VET_FLOAT16_2:
+        return 4;
+    case VET_FLOAT2:
+    case VET_SHORT4N:
+    case VET_FLOAT16_4:
+        return 8;
+    case VET_FLOAT3:
+        return 12;
+    case VET_FLOAT4:
+        return 16;
+    }
+    return 0;
+}
+
+unsigned VertexElementCapsBit(VertexElementType type)
+{
+    // D3DDTCAPS_*
+    switch (type)
+    {
+    case VET_UBYTE4N:
+        return 0x002;
+    case VET_SHORT2N:
+        return 0x004;
+    case VET_SHORT4N:
+        return 0x008;
+    case VET_DEC3N:
+        return 0x080;
+    case VET_FLOAT16_2:
+        return 0x100;
+    case VET_FLOAT16_4:
+        return 0x200;
+    default:
+        return 0;
+    }
+}
+
+VertexElementType SupportedVertexElementType(VertexElementType type, unsigned declTypeCaps)
+{
+    unsigned capsBit = VertexElementCapsBit(type);
+    if (0 == capsBit || (declTypeCaps & capsBit))
+    {
+        return type;
+    }
+
+    static const VertexElementType FLOAT_TYPES[] = { VET_FLOAT1, VET_FLOAT2, VET_FLOAT3, VET_FLOAT4 };
+    return FLOAT_TYPES[ElementComponents(type) - 1];
+}
+
+VertexLayout& VertexLayout::Add(VertexElementType type, VertexElementUsage usage, unsigned usageIndex)
+{
+    VertexElement element;
+    element.offset = m_stride;
+    element.type = type;
+    element.usage = usage;
+    element.usageIndex = usageIndex;
+    m_elements.push_back(element);
+    m_stride += VertexElementSize(type);
+    return *this;
+}
+
+void EncodeVertexAttribute(VertexElementType type, const float* src, size_t srcStride, unsigned components,
+    void* dst, size_t dstStride, size_t count)
+{
+    switch (type)
+    {
+    case VET_FLOAT1:
+    case VET_FLOAT2:
+    case VET_FLOAT3:
+    case VET_FLOAT4:
+        EncodeFloats(src, srcStride, components, ElementComponents(type), dst, dstStride, count);
+        break;
+    case VET_FLOAT16_2:
+    case VET_FLOAT16_4:
+        {
+            EncodeFloat16 encoder = { ElementComponents(type) };
+            EncodeStream(encoder, src, srcStride, components, dst, dstStride, count);
+            break;
+        }
+    case VET_SHORT2N:
+    case VET_SHORT4N:
+        {
+            EncodeShortN encoder = { ElementComponents(type) };
+            EncodeStream(encoder, src, srcStride, components, dst, dstStride, count);
+            break;
+        }
+    case VET_UBYTE4N:
+        EncodeStream(EncodeUbyteN(), src, srcStride, components, dst, dstStride, count);
+        break;
+    case VET_DEC3N:
+        EncodeStream(EncodeDec3N(), src, srcStride, components, dst, dstStride, count);
+        break;
+    }
+}
+
+void DecodeVertexAttribute(VertexElementType type, const void* src, float out[4])
+{
+    out[0] = out[1] = out[2] = 0.0f;
+    out[3] = 1.0f;
+
+    const unsigned components = ElementComponents(type);
+    switch (type)
+    {
+    case VET_FLOAT1:
+    case VET_FLOAT2:
+    case VET_FLOAT3:
+    case VET_FLOAT4:
+        memcpy(out, src, components * sizeof(float));
+        break;
+    case VET_FLOAT16_2:
+    case VET_FLOAT16_4:
+        {
+            uint16_t halves[4];
+            memcpy(halves, src, components * sizeof(uint16_t));
+            for (unsigned c = 0; c < components; ++c)
+            {
+                out[c] = HalfToFloat(halves[c]);
+            }
+            break;
+        }
+    case VET_SHORT2N:
+    case VET_SHORT4N:
+        {
+            int16_t shorts[4];
+            memcpy(shorts, src, components * sizeof(int16_t));
+            for (unsigned c = 0; c < components; ++c)
+            {
+                out[c] = std::max(shorts[c] / SHORT_NORM_SCALE, -1.0f);
+            }
+            break;
+        }
+    case VET_UBYTE4N:
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(src);
+            for (unsigned c = 0; c < 4; ++c)
+            {
+                out[c] = bytes[c] / UBYTE_NORM_SCALE;
+            }
+            break;
+        }
+    case VET_DEC3N:
+        {
+            uint32_t packed = 0;
+            memcpy(&packed, src, sizeof(packed));
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                // Sign-extend 10-bit field
+                int field = static_cast<int>((packed >> (10 * c)) & 0x3FF);
+                field = (field ^ 0x200) - 0x200;
+                out[c] = std::max(field / DEC3_NORM_SCALE, -1.0f);
+            }
+            break;
+        }
+    }
+}
+
+QuantizationError MeasureQuantizationError(VertexElementType type, const float* src, size_t srcStride, unsigned components,
+    const void* dst, size_t dstStride, size_t count)
+{
+    QuantizationError error = { 0.0f, 0.0f };
+    const unsigned checked = std::min(components, ElementComponents(type));
+    const unsigned char* srcBytes = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* dstBytes = static_cast<const unsigned char*>(dst);
+
+    float maxMagnitude = 0.0f;
+    for (size_t i = 0; i < count; ++i, srcBytes += srcStride, dstBytes += dstStride)
+    {
+        const float* value = reinterpret_cast<const float*>(srcBytes);
+        float decoded[4];
+        DecodeVertexAttribute(type, dstBytes, decoded);
+        for (unsigned c = 0; c < checked; ++c)
+        {
+            error.maxError = std::max(error.maxError, fabsf(decoded[c] - value[c]));
+            maxMagnitude = std::max(maxMagnitude, fabsf(value[c]));
+        }
+    }
+
+    switch (type)
+    {
+    case VET_FLOAT16_2:
+    case VET_FLOAT16_4:
+        // Half of the 10-bit mantissa step at the largest magnitude
+        error.boundError = maxMagnitude / 2048.0f;
+        break;
+    case VET_SHORT2N:
+    case VET_SHORT4N:
+        error.boundError = 0.5f / SHORT_NORM_SCALE;
+        break;
+    case VET_UBYTE4N:
+        error.boundError = 0.5f / UBYTE_NORM_SCALE;
+        break;
+    case VET_DEC3N:
+        error.boundError = 0.5f / DEC3_NORM_SCALE;
+        break;
+    default:
+        break;
+    }
+    return error;
+}
+
+void EncodeMeshVertices(const Mesh& mesh, const VertexLayout& layout, std::vector<uint8_t>& vertices,
+    std::vector<QuantizationError>* errors)
+{
+    const size_t count = mesh.vertices.size();
+    const unsigned stride = layout.Stride();
+    vertices.resize(count * stride);
+    if (errors)
+    {
+        errors->clear();
+    }
+    if (0 == count)
+    {
+        return;
+    }
+
+    std::vector<float> colors;
+    const std::vector<VertexElement>& elements = layout.Elements();
+    for (size_t e = 0; e < elements.size(); ++e)
+    {
+        const VertexElement& element = elements[e];
+        const float* src = NULL;
+        size_t srcStride = sizeof(MeshVertex);
+        unsigned components = 0;
+
+        switch (element.usage)
+        {
+        case VEU_POSITION:
+            src = mesh.vertices[0].position;
+            components = 3;
+            break;
+        case VEU_NORMAL:
+            src = mesh.vertices[0].normal;
+            components = 3;
+            break;
+        case VEU_TEXCOORD:
+            src = mesh.vertices[0].texCoord;
+            components = 2;
+            break;
+        case VEU_COLOR:
+            colors.resize(count * 4);
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (size_t c = 0; c < 3; ++c)
+                {
+                    colors[i * 4 + c] = 0.5f + 0.5f * mesh.vertices[i].normal[c];
+                }
+                colors[i * 4 + 3] = 1.0f;
+            }
+            src = colors.data();
+            srcStride = 4 * sizeof(float);
+            components = 4;
+            break;
+        }
+
+        EncodeVertexAttribute(element.type, src, srcStride, components, &vertices[element.offset], stride, count);
+        if (errors)
+        {
+            errors->push_back(MeasureQuantizationError(element.type, src, srcStride, components, &vertices[element.offset], stride, count));
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Vertex element types, values match D3DDECLTYPE
+enum VertexElementType
+{
+    VET_FLOAT1 = 0,
+    VET_FLOAT2 = 1,
+    VET_FLOAT3 = 2,
+    VET_FLOAT4 = 3,
+    VET_UBYTE4N = 8,
+    VET_SHORT2N = 9,
+    VET_SHORT4N = 10,
+    VET_DEC3N = 14,
+    VET_FLOAT16_2 = 15,
+    VET_FLOAT16_4 = 16
+};
+
+/// @brief Vertex element usages, values match D3DDECLUSAGE
+enum VertexElementUsage
+{
+    VEU_POSITION = 0,
+    VEU_NORMAL = 3,
+    VEU_TEXCOORD = 5,
+    VEU_COLOR = 10
+};
+
+/// @brief Single element of the vertex layout, maps to D3DVERTEXELEMENT9 of stream 0
+struct VertexElement
+{
+    unsigned offset;
+    VertexElementType type;
+    VertexElementUsage usage;
+    unsigned usageIndex;
+};
+
+/// @brief Size of the element in bytes
+unsigned VertexElementSize(VertexElementType type);
+
+/// @brief D3DDTCAPS bit required for the element type, 0 if always supported
+unsigned VertexElementCapsBit(VertexElementType type);
+
+/// @brief Type itself if declTypeCaps (D3DCAPS9::DeclTypes) support it,
+/// float type with the same number of components otherwise
+VertexElementType SupportedVertexElementType(VertexElementType type, unsigned declTypeCaps);
+
+/// @brief Interleaved vertex layout of a single stream
+class VertexLayout
+{
+public:
+
+    VertexLayout() : m_stride(0) {}
+
+    /// @brief Append element right after the previous one
+    VertexLayout& Add(VertexElementType type, VertexElementUsage usage, unsigned usageIndex = 0);
+
+    const std::vector<VertexElement>& Elements() const { return m_elements; }
+
+    /// @brief Vertex size in bytes
+    unsigned Stride() const { return m_stride; }
+
+private:
+
+    std::vector<VertexElement> m_elements;
+    unsigned m_stride;
+};
+
+/// @brief Quantization error of one attribute stream
+struct QuantizationError
+{
+    /// Largest absolute difference between source and decoded components
+    float maxError;
+
+    /// Worst case error of the format for values in its range, e.g. half of the quantization step
+    float boundError;
+};
+
+/// @brief Quantize float attribute stream into the element type
+/// Source has `components` floats per vertex and srcStride bytes between vertices,
+/// missing components are filled with 0, and w with 1. Normalized types clamp the input
+/// to [-1, 1] or [0, 1] for UBYTE4N. Uses SSE2 when available
+void EncodeVertexAttribute(VertexElementType type, const float* src, size_t srcStride, unsigned components,
+    void* dst, size_t dstStride, size_t count);
+
+/// @brief Decode single element into 4 floats
+void DecodeVertexAttribute(VertexElementType type, const void* src, float out[4]);
+
+/// @brief Compare encoded stream with the source
+QuantizationError MeasureQuantizationError(VertexElementType type, const float* src, size_t srcStride, unsigned components,
+    const void* dst, size_t dstStride, size_t count);
+
+/// @brief Convert mesh into the interleaved vertex stream of the layout
+/// POSITION, NORMAL and TEXCOORD usages are taken from the mesh, COLOR is derived from the normal.
+/// Errors are reported per layout element if requested
+void EncodeMeshVertices(const Mesh& mesh, const VertexLayout& layout, std::vector<uint8_t>& vertices,
+    std::vector<QuantizationError>* errors);
+
+/// @brief Float16 conversion with round to nearest even
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
@@ -0,0 +1,99 @@
+#include "counting_device.h"
+
+CountingDevice::CountingDevice()
+    : m_device(NULL)
+    , m_counters()
+{
+}
+
+HRESULT CountingDevice::SetTexture(DWORD stage, IDirect3DBaseTexture9* texture)
+{
+    ++m_counters.textureBinds;
+    return m_device->SetTexture(stage, texture);
+}
+
+HRESULT CountingDevice::SetRenderState(D3DRENDERSTATETYPE state, DWORD value)
+{
+    ++m_counters.renderStateChanges;
+    return m_device->SetRenderState(state, value);
+}
+
+HRESULT CountingDevice::SetTextureStageState(DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value)
+{
+    ++m_counters.renderStateChanges;
+    return m_device->SetTextureStageState(stage, type, value);
+}
+
+HRESULT CountingDevice::SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+{
+    ++m_counters.samplerStateChanges;
+    return m_device->SetSamplerState(sampler, type, value);
+}
+
+HRESULT CountingDevice::SetFVF(DWORD fvf)
+{
+    ++m_counters.renderStateChanges;
+    return m_device->SetFVF(fvf);
+}
+
+HRESULT CountingDevice::SetVertexDeclaration(LPDIRECT3DVERTEXDECLARATION9 declaration)
+{
+    ++m_counters.renderStateChanges;
+    return m_device->SetVertexDeclaration(declaration);
+}
+
+HRESULT CountingDevice::SetVertexShader(LPDIRECT3DVERTEXSHADER9 shader)
+{
+    ++m_counters.shaderBinds;
+    return m_device->SetVertexShader(shader);
+}
+
+HRESULT CountingDevice::SetPixelShader(LPDIRECT3DPIXELSHADER9 shader)
+{
+    ++m_counters.shaderBinds;
+    return m_device->SetPixelShader(shader);
+}
+
+HRESULT CountingDevice::SetRenderTarget(DWORD index, LPDIRECT3DSURFACE9 target)
+{
+    ++m_counters.renderTargetChanges;
+    return m_device->SetRenderTarget(index, target);
+}
+
+HRESULT CountingDevice::SetMatrix(LPD3DXCONSTANTTABLE table, D3DXHANDLE constant, const D3DXMATRIX* matrix)
+{
+    ++m_counters.constantUploads;
+    return table->SetMatrix(m_device, constant, matrix);
+}
+
+HRESULT CountingDevice::DrawPrimitive(D3DPRIMITIVETYPE primitiveType, UINT startVertex, UINT primitiveCount)
+{
+    CountDraw(primitiveType, primitiveCount);
+    return m_device->DrawPrimitive(primitiveType, startVertex, primitiveCount);
+}
+
+HRESULT CountingDevice::DrawPrimitiveUP(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount, const void* vertices, UINT stride)
+{
+    CountDraw(primitiveType, primitiveCount);
+    return m_device->DrawPrimitiveUP(primitiveType, primitiveCount, vertices, stride);
+}
+
+HRESULT CountingDevice::DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE primitiveType, UINT minVertexIndex, UINT numVertices,
+    UINT primitiveCount, const void* indices, D3DFORMAT indexFormat, const void* vertices, UINT stride)
+{
+    CountDraw(primitiveType, primitiveCount);
+    return m_device->DrawIndexedPrimitiveUP(primitiveType, minVertexIndex, numVertices, primitiveCount, 
+        indices, indexFormat, vertices, stride);
+}
+
+void CountingDevice::ResetCounters()
+{
+    m_counters = DeviceCounters();
+}
+
+void CountingDevice::CountDraw(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount)
+{
+    ++m_counters.draws;
+    m_counters.primitives += primitiveCount;
+    m_counters.vertices += PrimitiveVertexCount(primitiveType, primitiveCount);
+}
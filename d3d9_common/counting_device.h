@@ -0,0 +1,54 @@
+#pragma once
+
+#include "null_device.h"
+
+#include <d3d9.h>
+#include <d3dx9.h>
+
+/// @brief Direct3D 9 device which counts the calls the way the null device counts them
+/// Wraps the state, shader, constant and draw calls the samples make while rendering a frame,
+/// the other calls are made on Device(). Texture stage states count as render states, as
+/// the null device has none. Calls made on the device directly, e.g. by the HUD, are not counted
+class CountingDevice
+{
+public:
+
+    CountingDevice();
+
+    void Attach(LPDIRECT3DDEVICE9 device) { m_device = device; }
+    LPDIRECT3DDEVICE9 Device() const { return m_device; }
+
+    HRESULT SetTexture(DWORD stage, IDirect3DBaseTexture9* texture);
+    HRESULT SetRenderState(D3DRENDERSTATETYPE state, DWORD value);
+    HRESULT SetTextureStageState(DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value);
+    HRESULT SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+    HRESULT SetFVF(DWORD fvf);
+
+    /// @brief Replaces the FVF, so it counts as a render state as SetFVF() does
+    HRESULT SetVertexDeclaration(LPDIRECT3DVERTEXDECLARATION9 declaration);
+    HRESULT SetVertexShader(LPDIRECT3DVERTEXSHADER9 shader);
+    HRESULT SetPixelShader(LPDIRECT3DPIXELSHADER9 shader);
+    HRESULT SetRenderTarget(DWORD index, LPDIRECT3DSURFACE9 target);
+
+    /// @brief Matrix constant set through the constant table of the bound shader
+    HRESULT SetMatrix(LPD3DXCONSTANTTABLE table, D3DXHANDLE constant, const D3DXMATRIX* matrix);
+
+    HRESULT DrawPrimitive(D3DPRIMITIVETYPE primitiveType, UINT startVertex, UINT primitiveCount);
+    HRESULT DrawPrimitiveUP(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount, const void* vertices, UINT stride);
+    HRESULT DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE primitiveType, UINT minVertexIndex, UINT numVertices,
+        UINT primitiveCount, const void* indices, D3DFORMAT indexFormat, const void* vertices, UINT stride);
+
+    /// @brief Calls since the last reset
+    const DeviceCounters& Counters() const { return m_counters; }
+    void ResetCounters();
+
+private:
+
+    CountingDevice(const CountingDevice&);
+    CountingDevice& operator=(const CountingDevice&);
+
+    void CountDraw(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount);
+
+    LPDIRECT3DDEVICE9 m_device;
+    DeviceCounters m_counters;
+};
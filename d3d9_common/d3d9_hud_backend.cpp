@@ -0,0 +1,123 @@
+#include "d3d9_hud_backend.h"
+
+#include <cstring>
+
+D3D9HudBackend::D3D9HudBackend(LPDIRECT3DDEVICE9 device)
+    : m_device(device)
+    , m_atlas(NULL)
+    , m_vertexBuffer(NULL)
+    , m_capacity(0)
+    , m_sceneState(NULL)
+{
+}
+
+D3D9HudBackend::~D3D9HudBackend()
+{
+    if (m_sceneState)
+    {
+        m_sceneState->Release();
+    }
+    if (m_vertexBuffer)
+    {
+        m_vertexBuffer->Release();
+    }
+    if (m_atlas)
+    {
+        m_atlas->Release();
+    }
+}
+
+void D3D9HudBackend::SetHudState()
+{
+    m_device->SetVertexShader(NULL);
+    m_device->SetPixelShader(NULL);
+    m_device->SetFVF(HUD_VERTEX_FVF);
+    m_device->SetStreamSource(0, m_vertexBuffer, 0, sizeof(HudVertex));
+    m_device->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+    m_device->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+    m_device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+    m_device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+    m_device->SetTexture(0, m_atlas);
+    m_device->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_MODULATE);
+    m_device->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    m_device->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_DIFFUSE);
+    m_device->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_MODULATE);
+    m_device->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+    m_device->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+    m_device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+    m_device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+    m_device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+}
+
+HRESULT D3D9HudBackend::Init()
+{
+    // Recorded block holds exactly the states the HUD sets, it captures them from the scene
+    HRESULT hr = m_device->BeginStateBlock();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    SetHudState();
+    hr = m_device->EndStateBlock(&m_sceneState);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const HudFontAtlas font = BuildHudFontAtlas();
+    hr = m_device->CreateTexture(font.width, font.height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &m_atlas, NULL);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    D3DLOCKED_RECT locked;
+    hr = m_atlas->LockRect(0, &locked, NULL, 0);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    for (unsigned y = 0; y < font.height; ++y)
+    {
+        DWORD* row = reinterpret_cast<DWORD*>(static_cast<BYTE*>(locked.pBits) + y * locked.Pitch);
+        for (unsigned x = 0; x < font.width; ++x)
+        {
+            row[x] = D3DCOLOR_ARGB(font.alpha[y * font.width + x], 255, 255, 255);
+        }
+    }
+    return m_atlas->UnlockRect(0);
+}
+
+bool D3D9HudBackend::Upload(const HudVertex* vertices, unsigned vertexCount)
+{
+    if (vertexCount > m_capacity)
+    {
+        if (m_vertexBuffer)
+        {
+            m_vertexBuffer->Release();
+            m_vertexBuffer = NULL;
+        }
+        m_capacity = 0;
+        const UINT capacity = vertexCount + vertexCount / 2;
+        if (FAILED(m_device->CreateVertexBuffer(capacity * sizeof(HudVertex), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+            HUD_VERTEX_FVF, D3DPOOL_DEFAULT, &m_vertexBuffer, NULL)))
+        {
+            return false;
+        }
+        m_capacity = capacity;
+    }
+    void* data = NULL;
+    if (FAILED(m_vertexBuffer->Lock(0, vertexCount * sizeof(HudVertex), &data, D3DLOCK_DISCARD)))
+    {
+        return false;
+    }
+    memcpy(data, vertices, vertexCount * sizeof(HudVertex));
+    return SUCCEEDED(m_vertexBuffer->Unlock());
+}
+
+void D3D9HudBackend::Draw(unsigned vertexCount)
+{
+    m_sceneState->Capture();
+    SetHudState();
+    m_device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, vertexCount / 3);
+    m_sceneState->Apply();
+}
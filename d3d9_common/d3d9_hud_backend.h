@@ -0,0 +1,43 @@
+#pragma once
+
+#include "hud.h"
+
+#include <d3d9.h>
+
+/// @brief Performance HUD on the Direct3D 9 device
+/// Font atlas in a managed texture, vertices in one dynamic vertex buffer written with
+/// D3DLOCK_DISCARD, the whole HUD is one alpha blended draw over the frame.
+/// The HUD calls the device directly, so they are not counted with the calls of the scene.
+/// Every state the HUD sets is captured before its draw and restored after it
+class D3D9HudBackend : public HudBackend
+{
+public:
+
+    explicit D3D9HudBackend(LPDIRECT3DDEVICE9 device);
+    ~D3D9HudBackend();
+
+    /// @brief Record the state block and create the white texture with the alpha of the font atlas
+    HRESULT Init();
+
+    /// @brief Buffer grows by half when the text outgrows it
+    virtual bool Upload(const HudVertex* vertices, unsigned vertexCount);
+
+    /// @brief Fixed function, point sampled, the texture alpha modulates the vertex color
+    virtual void Draw(unsigned vertexCount);
+
+private:
+
+    D3D9HudBackend(const D3D9HudBackend&);
+    D3D9HudBackend& operator=(const D3D9HudBackend&);
+
+    /// @brief Shaders, vertex stream, blending, depth test, texture stage and sampler 0 of the HUD
+    void SetHudState();
+
+    LPDIRECT3DDEVICE9 m_device;
+    LPDIRECT3DTEXTURE9 m_atlas;
+    LPDIRECT3DVERTEXBUFFER9 m_vertexBuffer;
+    UINT m_capacity;
+
+    /// States of the scene overwritten by the HUD
+    LPDIRECT3DSTATEBLOCK9 m_sceneState;
+};
@@ -0,0 +1,89 @@
+#include "d3d9_shader_compile.h"
+#include "shader_daemon.h"
+#include "trace.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+
+/// @brief Shape of shader bytecode for the profile: whole DWORDs, the version token of the
+/// profile first and the end token last. Anything else is not passed to D3DX or the device
+bool IsShaderBytecode(const std::string& bytecode, LPCSTR profile)
+{
+    if (bytecode.size() < 2 * sizeof(DWORD) || 0 != bytecode.size() % sizeof(DWORD) || strlen(profile) < 6)
+    {
+        return false;
+    }
+
+    DWORD version = 0;
+    DWORD end = 0;
+    memcpy(&version, bytecode.data(), sizeof(version));
+    memcpy(&end, bytecode.data() + bytecode.size() - sizeof(end), sizeof(end));
+
+    const DWORD typeToken = 0 == strncmp(profile, "vs_", 3) ? 0xFFFE0000 : 0 == strncmp(profile, "ps_", 3) ? 0xFFFF0000 : 0;
+    if (0 == typeToken || (version & 0xFFFF0000) != typeToken || D3DSIO_END != end ||
+        static_cast<DWORD>(profile[3] - '0') != D3DSHADER_VERSION_MAJOR(version))
+    {
+        return false;
+    }
+
+    // ps_2_a, ps_2_b and vs_2_a only fix the major version
+    return !isdigit(static_cast<unsigned char>(profile[5])) || static_cast<DWORD>(profile[5] - '0') == D3DSHADER_VERSION_MINOR(version);
+}
+
+} // namespace
+
+HRESULT CompileShader(const std::string& source, LPCSTR entryPoint, LPCSTR profile, DWORD flags, 
+    LPD3DXBUFFER* shaderBuffer, LPD3DXCONSTANTTABLE* constantTable)
+{
+    TRACE_SCOPE("CompileShader");
+
+    ShaderCompileRequest request;
+    request.source = source;
+    request.entryPoint = entryPoint;
+    request.profile = profile;
+    request.flags = flags;
+
+    ShaderDaemonClient daemon(DefaultShaderDaemonAddress());
+    ShaderCompileResult result;
+    const bool compiledByDaemon = daemon.Compile(request, result);
+    if (compiledByDaemon && result.succeeded && !IsShaderBytecode(result.bytecode, profile))
+    {
+        OutputDebugStringA("Shader daemon returned no shader bytecode, compiling in-process\n");
+    }
+    else if (compiledByDaemon && result.succeeded)
+    {
+        HRESULT hr = D3DXCreateBuffer(static_cast<DWORD>(result.bytecode.size()), shaderBuffer);
+        if (SUCCEEDED(hr))
+        {
+            memcpy((*shaderBuffer)->GetBufferPointer(), result.bytecode.data(), result.bytecode.size());
+            hr = D3DXGetShaderConstantTable(reinterpret_cast<const DWORD*>((*shaderBuffer)->GetBufferPointer()), constantTable);
+            if (SUCCEEDED(hr))
+            {
+                return hr;
+            }
+            (*shaderBuffer)->Release();
+            *shaderBuffer = NULL;
+        }
+    }
+    else if (compiledByDaemon)
+    {
+        OutputDebugStringA("Shader daemon failed to compile, compiling in-process:\n");
+        OutputDebugStringA(result.errors.c_str());
+    }
+
+    LPD3DXBUFFER errorBuffer = NULL;
+    HRESULT hr = D3DXCompileShader(source.c_str(), 
+        static_cast<UINT>(source.size()), 
+        NULL, NULL, 
+        entryPoint, profile, 
+        flags, shaderBuffer, &errorBuffer, constantTable);
+    if (errorBuffer)
+    {
+        OutputDebugStringA(static_cast<LPCSTR>(errorBuffer->GetBufferPointer()));
+        errorBuffer->Release();
+    }
+    return hr;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <d3dx9.h>
+
+/// @brief Compile with the shader daemon if it is running, in-process otherwise
+/// Bytecode the daemon returns has to start with the version token of the profile and end
+/// with the end token before D3DX parses it, so a daemon with the stub compiler is ignored.
+/// A daemon which does not answer within the client timeout is ignored too. A failure
+/// reported by the daemon is compiled again in-process, which recovers from a stale
+/// cached failure or a daemon with a different compiler.
+/// Compiler messages are written to the debugger output
+HRESULT CompileShader(const std::string& source, LPCSTR entryPoint, LPCSTR profile, DWORD flags, 
+    LPD3DXBUFFER* shaderBuffer, LPD3DXCONSTANTTABLE* constantTable);
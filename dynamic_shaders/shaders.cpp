@@ -1,5 +1,20 @@
 #include "resource.h"
-
+#include "counting_device.h"
+#include "d3d9_hud_backend.h"
+#include "d3d9_shader_compile.h"
+#include "dynamic_resolution.h"
+#include "gpu_profiler.h"
+#include "hud.h"
+#include "mesh.h"
+#include "render_graph.h"
+#include "software_vertex.h"
+#include "trace.h"
+#include "vertex_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -12,96 +27,6 @@
 
 static const int MAX_LOADSTRING = 256;
 
-/// @brief Shaders application window class
-class ApplicationWindow
-{
-public:
-
-    /// Access from WinMain
-    friend int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow);
-
-    // @brief Registers the window class
-    // This function and its usage are only necessary if you want this code
-    // to be compatible with Win32 systems prior to the 'RegisterClassEx'
-    // function that was added to Windows 95. It is important to call this function
-    // so that the application will get 'well formed' small icons associated
-    // with it
-    static ATOM MyRegisterClass(HINSTANCE hInstance);
-
-    /// @brief Saves instance handle and creates main window
-    /// In this function, we save the instance handle in a class member and
-    /// create and display the main program window.
-    static BOOL InitInstance(HINSTANCE, int);
-
-    /// @brief Initialize Direct3D subsystem
-    static BOOL InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight, LPCSTR vertexSrcFile, LPCSTR pixelSrcFile);
-
-    /// @brief Run window messages processing
-    /// WM_COMMAND	- process the application menu
-    /// WM_PAINT	- Paint the main window
-    /// WM_DESTROY	- post a quit message and return
-    static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
-
-    /// @brief Window title
-    static LPSTR WindowTitle() { return m_wndTitle; }
-
-    /// @brief Window class
-    static LPSTR WindowClass() { return m_wndClass; }
-
-    /// @brief Window handle
-    static HWND WindowHandle() { return m_hMainWnd; }
-
-    /// @brief Direct3D device
-    static LPDIRECT3DDEVICE9 Direct3DDevice() { return m_d3dDevice; }
-
-    /// @brief Setter of window handle
-    static void SetWindowHandle(HWND handle) { m_hMainWnd = handle; }
-
-    /// @brief Setter of application handle
-    static void SetInstanceHandle(HINSTANCE handle) { m_hInst = handle; }
-
-private:
-
-    /// Direct3D 
-    static LPDIRECT3D9 m_D3D;
-
-    /// Direct3D device
-    static LPDIRECT3DDEVICE9 m_d3dDevice;
-
-    /// Application handle
-    static HINSTANCE m_hInst;
-
-    /// Window handle
-    static HWND m_hMainWnd;
-
-    /// Window display title
-    static CHAR m_wndTitle[MAX_LOADSTRING];
-
-    /// Window class
-    static CHAR m_wndClass[MAX_LOADSTRING];
-
-    /// Shaders
-    static LPDIRECT3DPIXELSHADER9 m_pixelShader;
-    static LPDIRECT3DVERTEXSHADER9 m_vertexShader;
-
-    /// Shader tables
-    static LPD3DXCONSTANTTABLE m_vertexShaderTable;
-    static LPD3DXCONSTANTTABLE m_pixelShaderTable;
-};
-
-/// Init static class members
-LPDIRECT3D9 ApplicationWindow::m_D3D = NULL;
-LPDIRECT3DDEVICE9 ApplicationWindow::m_d3dDevice = NULL;
-HINSTANCE ApplicationWindow::m_hInst = NULL;
-HWND ApplicationWindow::m_hMainWnd = NULL;
-CHAR ApplicationWindow::m_wndTitle[MAX_LOADSTRING] = {};
-CHAR ApplicationWindow::m_wndClass[MAX_LOADSTRING] = {};
-LPDIRECT3DPIXELSHADER9 ApplicationWindow::m_pixelShader = NULL;
-LPDIRECT3DVERTEXSHADER9 ApplicationWindow::m_vertexShader = NULL;
-LPD3DXCONSTANTTABLE ApplicationWindow::m_vertexShaderTable = NULL;
-LPD3DXCONSTANTTABLE ApplicationWindow::m_pixelShaderTable = NULL;
-
-
 /// @brief Minimalistic command-line parser class
 class CommandLineParams
 {
@@ -162,40 +87,393 @@ std::string GetFileContent(const std::string& filename)
     return buffer.str();
 }
 
+struct VertPosDiffuse 
+{
+    D3DXVECTOR3 m_pos;
+    D3DCOLOR m_color;
+    VertPosDiffuse(D3DXVECTOR3 pos, D3DCOLOR color)
+        : m_pos(pos), m_color(color)
+    {}
+};
+
+/// @brief Scene geometry loaded from OBJ or binary mesh file
+struct SceneMesh
+{
+    std::vector<VertPosDiffuse> vertices;
+
+    /// 16-bit indices are used whenever possible, 32-bit ones otherwise
+    std::vector<WORD> indices16;
+    std::vector<DWORD> indices32;
+
+    UINT TriangleCount() const 
+    { 
+        return static_cast<UINT>((indices16.empty() ? indices32.size() : indices16.size()) / 3); 
+    }
+};
+
+/// @brief Load mesh and reorder it for vertex cache and fetch locality
+/// Expected vertex shader invocations for typical post-transform caches are written to the debugger output
+BOOL LoadSceneMesh(const std::string& filename, SceneMesh& sceneMesh)
+{
+    Mesh mesh;
+    if (!LoadMesh(filename, mesh))
+    {
+        return FALSE;
+    }
+
+    OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+    OptimizeVertexFetch(mesh);
+
+    static const unsigned CACHE_SIZES[] = { 8, 16, 24, 32 };
+    for (size_t i = 0; i < sizeof(CACHE_SIZES) / sizeof(CACHE_SIZES[0]); ++i)
+    {
+        VertexCacheStats stats = SimulateVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_FIFO, CACHE_SIZES[i]);
+        char line[256] = {};
+        _snprintf_s(line, sizeof(line), _TRUNCATE, "%s: FIFO %u, ACMR %.3f, ATVR %.3f, %u vertex shader invocations per draw\n",
+            filename.c_str(), CACHE_SIZES[i], stats.acmr, stats.atvr, static_cast<unsigned>(stats.transforms));
+        OutputDebugStringA(line);
+    }
+
+    // Color from normal, shaders of this sample have no other vertex attributes
+    sceneMesh.vertices.clear();
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        const MeshVertex& v = mesh.vertices[i];
+        sceneMesh.vertices.push_back(VertPosDiffuse(D3DXVECTOR3(v.position), 
+            D3DCOLOR_COLORVALUE(0.5f + 0.5f * v.normal[0], 0.5f + 0.5f * v.normal[1], 0.5f + 0.5f * v.normal[2], 1.0f)));
+    }
+
+    sceneMesh.indices16.clear();
+    sceneMesh.indices32.clear();
+    if (mesh.vertices.size() <= 0xFFFF)
+    {
+        sceneMesh.indices16.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+    else
+    {
+        sceneMesh.indices32.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+    return TRUE;
+}
+
+/// @brief Full-screen quad of the upscale pass, pre-transformed
+struct UpscaleVertex
+{
+    float x, y, z, rhw;
+    float u, v;
+};
+
+const DWORD UPSCALE_VERTEX_FVF = D3DFVF_XYZRHW | D3DFVF_TEX1;
+
+/// @brief Timestamp queries of the Direct3D 9 device
+class D3D9GpuQueries : public GpuQueryBackend
+{
+public:
+
+    explicit D3D9GpuQueries(LPDIRECT3DDEVICE9 device) : m_device(device) {}
+
+    virtual void* CreateQuery(GpuQueryType type)
+    {
+        LPDIRECT3DQUERY9 query = NULL;
+        return SUCCEEDED(m_device->CreateQuery(static_cast<D3DQUERYTYPE>(type), &query)) ? query : NULL;
+    }
+
+    virtual void ReleaseQuery(void* query)
+    {
+        static_cast<LPDIRECT3DQUERY9>(query)->Release();
+    }
+
+    virtual void IssueBegin(void* query)
+    {
+        static_cast<LPDIRECT3DQUERY9>(query)->Issue(D3DISSUE_BEGIN);
+    }
+
+    virtual void IssueEnd(void* query)
+    {
+        static_cast<LPDIRECT3DQUERY9>(query)->Issue(D3DISSUE_END);
+    }
+
+    /// @brief No D3DGETDATA_FLUSH, Present submits the queries
+    virtual GpuQueryStatus GetData(void* query, uint64_t& value)
+    {
+        LPDIRECT3DQUERY9 d3dQuery = static_cast<LPDIRECT3DQUERY9>(query);
+        HRESULT hr = E_FAIL;
+        if (D3DQUERYTYPE_TIMESTAMPDISJOINT == d3dQuery->GetType())
+        {
+            BOOL disjoint = FALSE;
+            hr = d3dQuery->GetData(&disjoint, sizeof(disjoint), 0);
+            value = disjoint ? 1 : 0;
+        }
+        else
+        {
+            UINT64 ticks = 0;
+            hr = d3dQuery->GetData(&ticks, sizeof(ticks), 0);
+            value = ticks;
+        }
+        return S_OK == hr ? GPU_QUERY_READY : (S_FALSE == hr ? GPU_QUERY_PENDING : GPU_QUERY_FAILED);
+    }
+
+private:
+
+    LPDIRECT3DDEVICE9 m_device;
+};
+
+/// @brief Render target textures of the Direct3D 9 device
+/// Targets are handed to the passes as LPDIRECT3DTEXTURE9, imported targets as LPDIRECT3DSURFACE9
+class D3D9TargetBackend : public RenderTargetBackend
+{
+public:
+
+    explicit D3D9TargetBackend(LPDIRECT3DDEVICE9 device) : m_device(device) {}
+
+    virtual void* CreateTarget(const RenderTargetDesc& desc)
+    {
+        LPDIRECT3DTEXTURE9 texture = NULL;
+        return SUCCEEDED(m_device->CreateTexture(desc.width, desc.height, 1, D3DUSAGE_RENDERTARGET, 
+            static_cast<D3DFORMAT>(desc.format), D3DPOOL_DEFAULT, &texture, NULL)) ? texture : NULL;
+    }
+
+    virtual void ReleaseTarget(void* target)
+    {
+        static_cast<LPDIRECT3DTEXTURE9>(target)->Release();
+    }
+
+private:
+
+    LPDIRECT3DDEVICE9 m_device;
+};
+
+/// @brief Shaders application window class
+/// Every instance owns its window, device, shaders and scene
+class ApplicationWindow
+{
+public:
+
+    /// @brief Scene mesh is copied, empty mesh means the hard-coded triangle
+    ApplicationWindow(HINSTANCE hInstance, const SceneMesh& sceneMesh);
+
+    /// @brief Release Direct3D objects and destroy the window
+    ~ApplicationWindow();
+
+    // @brief Registers the window class
+    // This function and its usage are only necessary if you want this code
+    // to be compatible with Win32 systems prior to the 'RegisterClassEx'
+    // function that was added to Windows 95. It is important to call this function
+    // so that the application will get 'well formed' small icons associated
+    // with it
+    static ATOM MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass);
+
+    /// @brief Creates main window of the instance
+    /// In this function, we create and display the main program window.
+    BOOL InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow);
+
+    /// @brief Initialize Direct3D subsystem
+    BOOL InitD3D(int iWindowWidth, int iWindowHeight, LPCSTR vertexSrcFile, LPCSTR pixelSrcFile);
+
+    /// @brief Process messages of the calling thread and render until the window is closed
+    int Run();
+
+    /// @brief Run window messages processing
+    /// Routes messages to the instance stored in the window user data
+    static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
+
+    /// @brief Window handle
+    HWND WindowHandle() const { return m_hMainWnd; }
+
+    /// @brief Direct3D device
+    LPDIRECT3DDEVICE9 Direct3DDevice() const { return m_d3dDevice; }
+
+private:
+
+    ApplicationWindow(const ApplicationWindow&);
+    ApplicationWindow& operator=(const ApplicationWindow&);
+
+    /// @brief Messages of the instance window
+    /// WM_PAINT	- Paint the main window
+    /// WM_KEYDOWN	- H shows or hides the performance HUD
+    /// WM_DESTROY	- post a quit message and return
+    LRESULT HandleMessage(HWND, UINT, WPARAM, LPARAM);
+
+    void RenderFrame();
+
+    /// @brief Clear and scene passes into the current render target
+    void DrawScene();
+
+    /// @brief Frame graph of the scene and upscale passes and the controller of the scene resolution
+    /// Enabled only by the D3D_FRAME_BUDGET_MS environment variable, the frame budget in milliseconds.
+    /// Without it, or with 0, the scene is rendered to the back buffer at full resolution
+    void InitDynamicResolution(UINT width, UINT height);
+
+    /// @brief Draw the rendered part of the intermediate target over the whole render target
+    void UpscaleScene(LPDIRECT3DTEXTURE9 sceneTexture, LPDIRECT3DSURFACE9 target);
+
+    /// Direct3D 
+    LPDIRECT3D9 m_D3D;
+
+    /// Direct3D device
+    LPDIRECT3DDEVICE9 m_d3dDevice;
+
+    /// Application handle
+    HINSTANCE m_hInst;
+
+    /// Window handle
+    HWND m_hMainWnd;
+
+    /// Shaders
+    LPDIRECT3DPIXELSHADER9 m_pixelShader;
+    LPDIRECT3DVERTEXSHADER9 m_vertexShader;
+
+    /// Shader tables
+    LPD3DXCONSTANTTABLE m_vertexShaderTable;
+    LPD3DXCONSTANTTABLE m_pixelShaderTable;
+
+    /// Vertex processing the device was created with
+    VertexProcessingMode m_vertexProcessing;
+
+    /// CPU vertex pipeline replacing the vertex shader, NULL if the shader is used
+    SoftwareVertexPipeline* m_softwareVertices;
+
+    /// Scene and its rotation
+    SceneMesh m_sceneMesh;
+    float m_angle;
+
+    /// GPU time of the clear, scene and upscale passes
+    D3D9GpuQueries* m_gpuQueries;
+    GpuProfiler* m_gpuProfiler;
+    unsigned m_frame;
+
+    /// Scene resolution, NULL if the scene is rendered to the back buffer
+    /// Otherwise the frame graph renders the scene into a transient target and upscales it to the back buffer
+    DynamicResolutionController* m_resolution;
+    RenderGraph m_frameGraph;
+    D3D9TargetBackend* m_targetBackend;
+    LPDIRECT3DSURFACE9 m_backBuffer;
+    UINT m_sceneTextureWidth;
+    UINT m_sceneTextureHeight;
+
+    /// Performance HUD, the calls of the scene are made through the counting device
+    PerformanceHud m_hud;
+    D3D9HudBackend* m_hudBackend;
+    CountingDevice m_countingDevice;
+    std::chrono::steady_clock::time_point m_frameStart;
+
+    /// Indices left after culling of the CPU transformed vertices
+    std::vector<WORD> m_visibleIndices16;
+    std::vector<uint32_t> m_visibleIndices32;
+};
+
 int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
 
+    // Startup and frames are traced when built with D3D_TRACE, the trace is written at exit
+    TRACE_START("dynamic_shaders_trace.json", "dynamic_shaders");
+    TRACE_INSTANT("WinMain");
+    TRACE_THREAD_NAME("Window");
+
     std::string vertexSrcHlsl("shaders/rotating_triangle_vertex.hlsl");
     std::string pixelSrcHlsl("shaders/rotating_triangle_pixel.hlsl");
+    std::string meshFile;
     CommandLineParams cmdLineParams(lpCmdLine);
-    if(2 == cmdLineParams.size())
+    if(cmdLineParams.size() >= 2)
     {
         vertexSrcHlsl = cmdLineParams.param(0);
         pixelSrcHlsl = cmdLineParams.param(1);
     }
+    if(3 == cmdLineParams.size())
+    {
+        meshFile = cmdLineParams.param(2);
+    }
+
+    // Optional mesh replaces the hard-coded triangle
+    SceneMesh sceneMesh;
+    if (!meshFile.empty() && !LoadSceneMesh(meshFile, sceneMesh))
+    {
+        return FALSE;
+    }
 
     // Initialize global strings
-    LoadString(hInstance, IDS_APP_TITLE, ApplicationWindow::m_wndTitle, MAX_LOADSTRING);
-    LoadString(hInstance, IDC_SHADERS, ApplicationWindow::m_wndClass, MAX_LOADSTRING);
-    ApplicationWindow::MyRegisterClass(hInstance);
+    CHAR windowTitle[MAX_LOADSTRING] = {};
+    CHAR windowClass[MAX_LOADSTRING] = {};
+    LoadString(hInstance, IDS_APP_TITLE, windowTitle, MAX_LOADSTRING);
+    LoadString(hInstance, IDC_SHADERS, windowClass, MAX_LOADSTRING);
+    ApplicationWindow::MyRegisterClass(hInstance, windowClass);
 
     // Perform application initialization:
-    if (!ApplicationWindow::InitInstance(hInstance, nCmdShow))
+    ApplicationWindow window(hInstance, sceneMesh);
+    if (!window.InitInstance(windowClass, windowTitle, nCmdShow))
         return FALSE;
 
     RECT rc;
-    GetClientRect(ApplicationWindow::m_hMainWnd, &rc);
-    BOOL ret = ApplicationWindow::InitD3D(ApplicationWindow::m_hMainWnd, 
-        rc.right - rc.left, rc.bottom - rc.top, 
+    GetClientRect(window.WindowHandle(), &rc);
+    BOOL ret = window.InitD3D(rc.right - rc.left, rc.bottom - rc.top, 
         vertexSrcHlsl.c_str(), pixelSrcHlsl.c_str());
 
     if (!ret) {
         return FALSE;
     }
 
-    // Main message loop
-    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_SHADERS));
+    return window.Run();
+}
+
+ApplicationWindow::ApplicationWindow(HINSTANCE hInstance, const SceneMesh& sceneMesh)
+    : m_D3D(NULL)
+    , m_d3dDevice(NULL)
+    , m_hInst(hInstance)
+    , m_hMainWnd(NULL)
+    , m_pixelShader(NULL)
+    , m_vertexShader(NULL)
+    , m_vertexShaderTable(NULL)
+    , m_pixelShaderTable(NULL)
+    , m_vertexProcessing(VERTEX_PROCESSING_HARDWARE)
+    , m_softwareVertices(NULL)
+    , m_sceneMesh(sceneMesh)
+    , m_angle(0.0f)
+    , m_gpuQueries(NULL)
+    , m_gpuProfiler(NULL)
+    , m_frame(0)
+    , m_resolution(NULL)
+    , m_targetBackend(NULL)
+    , m_backBuffer(NULL)
+    , m_sceneTextureWidth(0)
+    , m_sceneTextureHeight(0)
+    , m_hudBackend(NULL)
+{
+}
+
+ApplicationWindow::~ApplicationWindow()
+{
+    delete m_softwareVertices;
+    delete m_resolution;
+    delete m_hudBackend;
+
+    // Graph targets are released through the backend, before the device
+    m_frameGraph.ReleaseSurfaces();
+    delete m_targetBackend;
+
+    // Queries are released before the device
+    delete m_gpuProfiler;
+    delete m_gpuQueries;
+
+    IUnknown* objects[] = { m_backBuffer, 
+        m_pixelShaderTable, m_vertexShaderTable, m_pixelShader, m_vertexShader, m_d3dDevice, m_D3D };
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); ++i)
+    {
+        if (objects[i])
+        {
+            objects[i]->Release();
+        }
+    }
+    if (m_hMainWnd && IsWindow(m_hMainWnd))
+    {
+        DestroyWindow(m_hMainWnd);
+    }
+}
+
+int ApplicationWindow::Run()
+{
+    // Main message loop, only messages of this thread's windows are retrieved
+    HACCEL hAccelTable = LoadAccelerators(m_hInst, MAKEINTRESOURCE(IDC_SHADERS));
     MSG msg;
     ZeroMemory(&msg, sizeof(MSG));
     while( msg.message!=WM_QUIT )
@@ -207,54 +485,212 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         }
         else
         {
-            struct VertPosDiffuse 
-            {
-                D3DXVECTOR3 m_pos;
-                D3DCOLOR m_color;
-                VertPosDiffuse(D3DXVECTOR3 pos, D3DCOLOR color)
-                    : m_pos(pos), m_color(color)
-                {}
-            };
-
-            VertPosDiffuse v[] = 
-            {
-                VertPosDiffuse(D3DXVECTOR3(-1, -1, 0), D3DCOLOR_XRGB(255, 0, 0)),
-                VertPosDiffuse(D3DXVECTOR3(1,  -1, 0), D3DCOLOR_XRGB(0, 0, 255)),
-                VertPosDiffuse(D3DXVECTOR3(1,   1, 0), D3DCOLOR_XRGB(0, 255, 0))
-            };
-            ApplicationWindow::m_d3dDevice->BeginScene();
-            ApplicationWindow::m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL|D3DCLEAR_ZBUFFER, 0xff808080, 1, 0);
-            ApplicationWindow::m_d3dDevice->SetFVF(D3DFVF_XYZ|D3DFVF_DIFFUSE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_LIGHTING, FALSE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZENABLE, D3DZB_TRUE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZFUNC, D3DCMP_LESS);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZWRITEENABLE, TRUE);
-
-            D3DXMATRIX mat, matViewProj, matProj, matView;
-            static float angle=0.0f;
-            angle+=.1f;
-            D3DXMatrixRotationY(&mat, angle);
-            D3DXMatrixPerspectiveFovLH(&matProj, D3DX_PI/3, 800.f/600, .01f, 20);
-            D3DXMatrixLookAtLH(&matView, &D3DXVECTOR3(0, 2, 2), &D3DXVECTOR3(0,0,0), &D3DXVECTOR3(0, 1, 0));
-
-            D3DXMatrixMultiply(&matViewProj, &matView, &matProj);
-            ApplicationWindow::m_d3dDevice->SetPixelShader(ApplicationWindow::m_pixelShader);
-            ApplicationWindow::m_d3dDevice->SetVertexShader(ApplicationWindow::m_vertexShader);
-            ApplicationWindow::m_vertexShaderTable->SetMatrix(ApplicationWindow::m_d3dDevice, "mWorld", &mat);
-            ApplicationWindow::m_vertexShaderTable->SetMatrix(ApplicationWindow::m_d3dDevice, "mViewProjection", &matViewProj);
-            ApplicationWindow::m_d3dDevice->DrawPrimitiveUP(D3DPT_TRIANGLELIST, 1, v, sizeof(VertPosDiffuse));
-            ApplicationWindow::m_d3dDevice->EndScene();
-            ApplicationWindow::m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+            RenderFrame();
         }
     }
     
     return static_cast<int>(msg.wParam);
 }
 
-ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
+void ApplicationWindow::RenderFrame()
+{
+    TRACE_SCOPE("Frame");
+
+    // HUD shows the interval between frames and the calls of the previous frame
+    const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    m_hud.AddFrame(std::chrono::duration<double, std::milli>(frameStart - m_frameStart).count(), m_countingDevice.Counters());
+    m_frameStart = frameStart;
+    m_countingDevice.ResetCounters();
+
+    // Scale is chosen from the timings of earlier frames, every change is logged
+    if (m_resolution && m_resolution->Update(m_frame))
+    {
+        std::vector<DynamicResolutionChange> change(1, m_resolution->Log().back());
+        OutputDebugStringA(FormatDynamicResolutionLog(change).c_str());
+    }
+
+    m_gpuProfiler->BeginFrame();
+    m_d3dDevice->BeginScene();
+    if (m_resolution && !m_frameGraph.Execute(*m_targetBackend))
+    {
+        // Target is created by the first execution, nothing was drawn if that failed
+        OutputDebugStringA("Unable to create the scene render target, dynamic resolution is disabled\n");
+        m_frameGraph.ReleaseSurfaces();
+        delete m_resolution;
+        m_resolution = NULL;
+    }
+    if (!m_resolution)
+    {
+        DrawScene();
+    }
+    if (m_hudBackend && m_hud.Enabled())
+    {
+        m_gpuProfiler->BeginPass("hud");
+        m_hud.Draw(*m_hudBackend);
+        m_gpuProfiler->EndPass();
+    }
+    m_d3dDevice->EndScene();
+    m_gpuProfiler->EndFrame();
+    ++m_frame;
+    {
+        TRACE_SCOPE("Present");
+        m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+    }
+
+    // Timings of a frame arrive a few frames later, every 60th one is written to the debugger output
+    GpuFrameTiming timing;
+    while (m_gpuProfiler->PopFrame(timing))
+    {
+        if (0 == timing.frame % 60)
+        {
+            OutputDebugStringA((FormatGpuFrameTiming(timing) + "\n").c_str());
+        }
+        if (m_resolution)
+        {
+            m_resolution->AddFrameTime(timing.frame, m_gpuProfiler->Supported() ? timing.gpuMilliseconds : timing.cpuMilliseconds);
+        }
+        if (m_gpuProfiler->Supported())
+        {
+            m_hud.SetGpuMilliseconds(timing.gpuMilliseconds);
+        }
+    }
+}
+
+void ApplicationWindow::DrawScene()
+{
+    VertPosDiffuse v[] = 
+    {
+        VertPosDiffuse(D3DXVECTOR3(-1, -1, 0), D3DCOLOR_XRGB(255, 0, 0)),
+        VertPosDiffuse(D3DXVECTOR3(1,  -1, 0), D3DCOLOR_XRGB(0, 0, 255)),
+        VertPosDiffuse(D3DXVECTOR3(1,   1, 0), D3DCOLOR_XRGB(0, 255, 0))
+    };
+
+    m_gpuProfiler->BeginPass("clear");
+    m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL|D3DCLEAR_ZBUFFER, 0xff808080, 1, 0);
+    m_gpuProfiler->EndPass();
+    m_gpuProfiler->BeginPass("scene");
+    m_countingDevice.SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    m_countingDevice.SetRenderState(D3DRS_LIGHTING, FALSE);
+    m_countingDevice.SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+    m_countingDevice.SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
+    m_countingDevice.SetRenderState(D3DRS_ZENABLE, D3DZB_TRUE);
+    m_countingDevice.SetRenderState(D3DRS_ZFUNC, D3DCMP_LESS);
+    m_countingDevice.SetRenderState(D3DRS_ZWRITEENABLE, TRUE);
+
+    D3DXMATRIX mat, matViewProj, matProj, matView;
+    m_angle+=.1f;
+    D3DXMatrixRotationY(&mat, m_angle);
+    D3DXMatrixPerspectiveFovLH(&matProj, D3DX_PI/3, 800.f/600, .01f, 20);
+    D3DXMatrixLookAtLH(&matView, &D3DXVECTOR3(0, 2, 2), &D3DXVECTOR3(0,0,0), &D3DXVECTOR3(0, 1, 0));
+
+    D3DXMatrixMultiply(&matViewProj, &matView, &matProj);
+    m_countingDevice.SetPixelShader(m_pixelShader);
+    if (m_softwareVertices)
+    {
+        // Transformed on the CPU, the device gets screen space vertices
+        SoftwareVertexPipeline& pipeline = *m_softwareVertices;
+        pipeline.SetTransform(mat, matViewProj);
+        if (m_sceneMesh.vertices.empty())
+        {
+            static const WORD triangle[] = { 0, 1, 2 };
+            pipeline.Process(&v[0].m_pos.x, sizeof(VertPosDiffuse), 
+                reinterpret_cast<const uint32_t*>(&v[0].m_color), sizeof(VertPosDiffuse), NULL, 0, 3);
+            pipeline.CullTriangles(triangle, 3, m_visibleIndices16);
+        }
+        else
+        {
+            pipeline.Process(&m_sceneMesh.vertices[0].m_pos.x, sizeof(VertPosDiffuse), 
+                reinterpret_cast<const uint32_t*>(&m_sceneMesh.vertices[0].m_color), sizeof(VertPosDiffuse), 
+                NULL, 0, m_sceneMesh.vertices.size());
+            if (!m_sceneMesh.indices16.empty())
+            {
+                pipeline.CullTriangles(&m_sceneMesh.indices16[0], m_sceneMesh.indices16.size(), m_visibleIndices16);
+            }
+            else
+            {
+                pipeline.CullTriangles(reinterpret_cast<const uint32_t*>(&m_sceneMesh.indices32[0]), 
+                    m_sceneMesh.indices32.size(), m_visibleIndices32);
+            }
+        }
+
+        m_countingDevice.SetVertexShader(NULL);
+        m_countingDevice.SetFVF(TRANSFORMED_VERTEX_FVF);
+        const UINT vertexCount = static_cast<UINT>(pipeline.Vertices().size());
+        if (m_sceneMesh.indices32.empty() && !m_visibleIndices16.empty())
+        {
+            m_countingDevice.DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, 
+                vertexCount, static_cast<UINT>(m_visibleIndices16.size() / 3), 
+                &m_visibleIndices16[0], D3DFMT_INDEX16, &pipeline.Vertices()[0], sizeof(TransformedVertex));
+        }
+        else if (!m_sceneMesh.indices32.empty() && !m_visibleIndices32.empty())
+        {
+            m_countingDevice.DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, 
+                vertexCount, static_cast<UINT>(m_visibleIndices32.size() / 3), 
+                &m_visibleIndices32[0], D3DFMT_INDEX32, &pipeline.Vertices()[0], sizeof(TransformedVertex));
+        }
+    }
+    else
+    {
+        m_countingDevice.SetFVF(D3DFVF_XYZ|D3DFVF_DIFFUSE);
+        m_countingDevice.SetVertexShader(m_vertexShader);
+        m_countingDevice.SetMatrix(m_vertexShaderTable, "mWorld", &mat);
+        m_countingDevice.SetMatrix(m_vertexShaderTable, "mViewProjection", &matViewProj);
+        if (m_sceneMesh.vertices.empty())
+        {
+            m_countingDevice.DrawPrimitiveUP(D3DPT_TRIANGLELIST, 1, v, sizeof(VertPosDiffuse));
+        }
+        else if (!m_sceneMesh.indices16.empty())
+        {
+            m_countingDevice.DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, 
+                static_cast<UINT>(m_sceneMesh.vertices.size()), m_sceneMesh.TriangleCount(), 
+                &m_sceneMesh.indices16[0], D3DFMT_INDEX16, &m_sceneMesh.vertices[0], sizeof(VertPosDiffuse));
+        }
+        else
+        {
+            m_countingDevice.DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, 
+                static_cast<UINT>(m_sceneMesh.vertices.size()), m_sceneMesh.TriangleCount(), 
+                &m_sceneMesh.indices32[0], D3DFMT_INDEX32, &m_sceneMesh.vertices[0], sizeof(VertPosDiffuse));
+        }
+    }
+    m_gpuProfiler->EndPass();
+}
+
+void ApplicationWindow::UpscaleScene(LPDIRECT3DTEXTURE9 sceneTexture, LPDIRECT3DSURFACE9 target)
+{
+    // Setting the render target resets the viewport to the whole target
+    m_countingDevice.SetRenderTarget(0, target);
+
+    // Pixel centers at texel centers, see "Directly Mapping Texels to Pixels"
+    const float width = static_cast<float>(m_sceneTextureWidth);
+    const float height = static_cast<float>(m_sceneTextureHeight);
+    const float right = static_cast<float>(m_resolution->RenderWidth()) / m_sceneTextureWidth;
+    const float bottom = static_cast<float>(m_resolution->RenderHeight()) / m_sceneTextureHeight;
+    const UpscaleVertex quad[4] =
+    {
+        { -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f },
+        { width - 0.5f, -0.5f, 0.0f, 1.0f, right, 0.0f },
+        { -0.5f, height - 0.5f, 0.0f, 1.0f, 0.0f, bottom },
+        { width - 0.5f, height - 0.5f, 0.0f, 1.0f, right, bottom }
+    };
+
+    m_countingDevice.SetVertexShader(NULL);
+    m_countingDevice.SetPixelShader(NULL);
+    m_countingDevice.SetFVF(UPSCALE_VERTEX_FVF);
+    m_countingDevice.SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+    m_countingDevice.SetTexture(0, sceneTexture);
+    m_countingDevice.SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+    m_countingDevice.SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+    m_countingDevice.DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, quad, sizeof(UpscaleVertex));
+
+    // Scene texture is the render target of the next frame
+    m_countingDevice.SetTexture(0, NULL);
+}
+
+ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass)
 {
     WNDCLASSEX wcex;
 
@@ -268,36 +704,51 @@ ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
     wcex.hCursor		= LoadCursor(NULL, IDC_ARROW);
     wcex.hbrBackground	= NULL;
     wcex.lpszMenuName	= NULL;
-    wcex.lpszClassName	= m_wndClass;
+    wcex.lpszClassName	= windowClass;
     wcex.hIconSm		= LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
 
     return RegisterClassEx(&wcex);
 }
 
-BOOL ApplicationWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
+BOOL ApplicationWindow::InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow)
 {
-    ApplicationWindow::SetInstanceHandle(hInstance);
-
-    HWND handle = CreateWindow(ApplicationWindow::WindowClass(), 
-        ApplicationWindow::WindowTitle(), 
+    // Instance pointer reaches WndProc with WM_NCCREATE
+    HWND handle = CreateWindow(windowClass, 
+        windowTitle, 
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT, 
         800, 600, 
-        NULL, NULL, hInstance, NULL);
+        NULL, NULL, m_hInst, this);
 
     if (!handle) {
         return FALSE;
     }
 
-    ApplicationWindow::SetWindowHandle(handle);
+    m_hMainWnd = handle;
 
-    ShowWindow(ApplicationWindow::WindowHandle(), nCmdShow);
-    UpdateWindow(ApplicationWindow::WindowHandle());
+    ShowWindow(m_hMainWnd, nCmdShow);
+    UpdateWindow(m_hMainWnd);
 
     return TRUE;
 }
 
 LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (WM_NCCREATE == message)
+    {
+        CREATESTRUCT* createStruct = reinterpret_cast<CREATESTRUCT*>(lParam);
+        SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(createStruct->lpCreateParams));
+    }
+
+    ApplicationWindow* window = reinterpret_cast<ApplicationWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+    if (!window)
+    {
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return window->HandleMessage(hWnd, message, wParam, lParam);
+}
+
+LRESULT ApplicationWindow::HandleMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message)
     {
@@ -311,7 +762,14 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
             EndPaint(hWnd, &ps);
             break;
         }
+    case WM_KEYDOWN:
+        if ('H' == wParam)
+        {
+            m_hud.Toggle();
+        }
+        break;
     case WM_DESTROY:
+        m_hMainWnd = NULL;
         PostQuitMessage(0);
         break;
     default:
@@ -320,8 +778,10 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
     return 0;
 }
 
-BOOL ApplicationWindow::InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight, LPCSTR vertexSrcFile, LPCSTR pixelSrcFile)
+BOOL ApplicationWindow::InitD3D(int iWindowWidth, int iWindowHeight, LPCSTR vertexSrcFile, LPCSTR pixelSrcFile)
 {
+    TRACE_SCOPE("InitD3D");
+
     m_D3D = Direct3DCreate9(D3D_SDK_VERSION);
     if (m_D3D==NULL)
         return FALSE;
@@ -338,38 +798,183 @@ BOOL ApplicationWindow::InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight,
     d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
     d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
 
-    HRESULT hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hWnd, D3DCREATE_HARDWARE_VERTEXPROCESSING, &d3dpp, &m_d3dDevice);
+    // Vertex processing is chosen from the caps, D3D_VERTEX_PROCESSING environment variable overrides it
+    D3DCAPS9 caps;
+    HRESULT hr = m_D3D->GetDeviceCaps(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &caps);
+    EXIT_ON_FAILURE(hr);
+
+    CHAR vertexProcessingOverride[32] = {};
+    GetEnvironmentVariableA("D3D_VERTEX_PROCESSING", vertexProcessingOverride, sizeof(vertexProcessingOverride));
+    std::vector<VertexProcessingMode> candidates = VertexProcessingCandidates(caps.DevCaps, caps.VertexShaderVersion, 
+        D3DVS_VERSION(3, 0), vertexProcessingOverride);
+    hr = D3DERR_NOTAVAILABLE;
+    for (size_t i = 0; i < candidates.size() && FAILED(hr); ++i)
+    {
+        m_vertexProcessing = candidates[i];
+        TRACE_SCOPE("CreateDevice");
+        hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, m_hMainWnd, m_vertexProcessing, &d3dpp, &m_d3dDevice);
+    }
     EXIT_ON_FAILURE(hr);
 
-    LPD3DXBUFFER dxErrorBuffer = NULL;
     LPD3DXBUFFER dxShaderBuffer = NULL;
 
+    // Shader daemon shares compiled shaders between processes, see tools/shader_daemon.cpp
     std::string vertexShaderSrc = GetFileContent(vertexSrcFile);
-    hr = D3DXCompileShader(vertexShaderSrc.c_str(), 
-        vertexShaderSrc.size(), 
-        NULL, NULL, 
-        "main", "vs_3_0", 
-        D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &dxErrorBuffer, &m_vertexShaderTable);
+    hr = CompileShader(vertexShaderSrc, "main", "vs_3_0", D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &m_vertexShaderTable);
     EXIT_ON_FAILURE(hr);
 
-    hr = m_d3dDevice->CreateVertexShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_vertexShader);
+    {
+        TRACE_SCOPE("CreateVertexShader");
+        hr = m_d3dDevice->CreateVertexShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_vertexShader);
+    }
     EXIT_ON_FAILURE(hr);
 
     dxShaderBuffer->Release();
 
+    // Without hardware vertex shaders, shaders which only transform by mWorld and mViewProjection
+    // are replaced by the CPU pipeline. Pre-transformed vertices can't feed ps_3_0, so ps_2_0 is used
     std::string pixelShaderSrc = GetFileContent(pixelSrcFile);
-    hr = D3DXCompileShader(pixelShaderSrc.c_str(), 
-        pixelShaderSrc.size(), 
-        NULL, NULL, 
-        "main", "ps_3_0", 
-        D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &dxErrorBuffer, &m_pixelShaderTable);
-    EXIT_ON_FAILURE(hr);
+    hr = E_FAIL;
+    if (VERTEX_PROCESSING_HARDWARE != m_vertexProcessing && 
+        m_vertexShaderTable->GetConstantByName(NULL, "mWorld") && 
+        m_vertexShaderTable->GetConstantByName(NULL, "mViewProjection"))
+    {
+        hr = CompileShader(pixelShaderSrc, "main", "ps_2_0", D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &m_pixelShaderTable);
+    }
+    if (SUCCEEDED(hr))
+    {
+        D3DVIEWPORT9 viewport;
+        hr = m_d3dDevice->GetViewport(&viewport);
+        EXIT_ON_FAILURE(hr);
+
+        ScreenViewport screenViewport = { viewport.X, viewport.Y, viewport.Width, viewport.Height, viewport.MinZ, viewport.MaxZ };
+        m_softwareVertices = new SoftwareVertexPipeline;
+        m_softwareVertices->SetViewport(screenViewport);
+    }
+    else
+    {
+        // Shaders of a mixed device run on the CPU in the runtime
+        if (VERTEX_PROCESSING_MIXED == m_vertexProcessing)
+        {
+            m_d3dDevice->SetSoftwareVertexProcessing(TRUE);
+        }
+        hr = CompileShader(pixelShaderSrc, "main", "ps_3_0", D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &m_pixelShaderTable);
+        EXIT_ON_FAILURE(hr);
+    }
+
+    char line[256] = {};
+    _snprintf_s(line, sizeof(line), _TRUNCATE, "%s vertex processing, vertex shader %s\n", 
+        VertexProcessingName(m_vertexProcessing), m_softwareVertices ? "replaced by the CPU pipeline" : "used");
+    OutputDebugStringA(line);
 
-    hr = m_d3dDevice->CreatePixelShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_pixelShader);
+    {
+        TRACE_SCOPE("CreatePixelShader");
+        hr = m_d3dDevice->CreatePixelShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_pixelShader);
+    }
     EXIT_ON_FAILURE(hr);
 
     dxShaderBuffer->Release();
 
+    m_gpuQueries = new D3D9GpuQueries(m_d3dDevice);
+    m_gpuProfiler = new GpuProfiler(*m_gpuQueries);
+    if (!m_gpuProfiler->Supported())
+    {
+        OutputDebugStringA("Timestamp queries are not supported, only CPU pass times are reported\n");
+    }
+
+    InitDynamicResolution(d3dpp.BackBufferWidth, d3dpp.BackBufferHeight);
+
+    m_countingDevice.Attach(m_d3dDevice);
+
+    // Frames are drawn without the HUD if its texture can't be created
+    m_hudBackend = new D3D9HudBackend(m_d3dDevice);
+    if (FAILED(m_hudBackend->Init()))
+    {
+        OutputDebugStringA("Unable to create the HUD state block or font texture, the HUD is disabled\n");
+        delete m_hudBackend;
+        m_hudBackend = NULL;
+    }
+    std::vector<std::string> shaderNames;
+    shaderNames.push_back(std::string("vs: ") + (m_softwareVertices ? "CPU pipeline" : vertexSrcFile));
+    shaderNames.push_back(std::string("ps: ") + pixelSrcFile);
+    m_hud.SetShaderNames(shaderNames);
+    m_frameStart = std::chrono::steady_clock::now();
+
     return TRUE;
 }
 
+void ApplicationWindow::InitDynamicResolution(UINT width, UINT height)
+{
+    CHAR budgetText[32] = {};
+    GetEnvironmentVariableA("D3D_FRAME_BUDGET_MS", budgetText, sizeof(budgetText));
+    const double budget = strtod(budgetText, NULL);
+    if (budget <= 0.0)
+    {
+        return;
+    }
+
+    D3DSURFACE_DESC desc;
+    HRESULT hr = m_d3dDevice->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &m_backBuffer);
+    if (SUCCEEDED(hr))
+    {
+        hr = m_backBuffer->GetDesc(&desc);
+    }
+    if (FAILED(hr))
+    {
+        OutputDebugStringA("Unable to get the back buffer, dynamic resolution is disabled\n");
+        return;
+    }
+
+    // Scene target has the size and format of the back buffer, the back buffer formats are 32 bit.
+    // Scale never goes above 1, so the automatic depth buffer is large enough for the scene target
+    const RenderTargetDesc targetDesc = { width, height, static_cast<uint32_t>(desc.Format), 32 };
+    const RenderResourceId sceneTarget = m_frameGraph.CreateTarget("scene", targetDesc);
+    const RenderResourceId backBufferTarget = m_frameGraph.ImportTarget("back buffer", targetDesc);
+    m_frameGraph.SetImportedTarget(backBufferTarget, m_backBuffer);
+    m_frameGraph.AddPass("scene", std::vector<RenderResourceId>(), std::vector<RenderResourceId>(1, sceneTarget),
+        [this, sceneTarget](const RenderPassContext& context)
+        {
+            LPDIRECT3DSURFACE9 surface = NULL;
+            if (FAILED(static_cast<LPDIRECT3DTEXTURE9>(context.Target(sceneTarget))->GetSurfaceLevel(0, &surface)))
+            {
+                return;
+            }
+            D3DVIEWPORT9 viewport = { 0, 0, m_resolution->RenderWidth(), m_resolution->RenderHeight(), 0.0f, 1.0f };
+            m_countingDevice.SetRenderTarget(0, surface);
+            m_d3dDevice->SetViewport(&viewport);
+            surface->Release();
+            if (m_softwareVertices)
+            {
+                ScreenViewport screenViewport = { viewport.X, viewport.Y, viewport.Width, viewport.Height, viewport.MinZ, viewport.MaxZ };
+                m_softwareVertices->SetViewport(screenViewport);
+            }
+            DrawScene();
+        });
+    m_frameGraph.AddPass("upscale", std::vector<RenderResourceId>(1, sceneTarget), std::vector<RenderResourceId>(1, backBufferTarget),
+        [this, sceneTarget, backBufferTarget](const RenderPassContext& context)
+        {
+            m_gpuProfiler->BeginPass("upscale");
+            UpscaleScene(static_cast<LPDIRECT3DTEXTURE9>(context.Target(sceneTarget)), 
+                static_cast<LPDIRECT3DSURFACE9>(context.Target(backBufferTarget)));
+            m_gpuProfiler->EndPass();
+        });
+    if (!m_frameGraph.Compile())
+    {
+        OutputDebugStringA(("Unable to compile the frame graph, " + m_frameGraph.Error() + "\n").c_str());
+        return;
+    }
+    OutputDebugStringA((FormatRenderGraphReport(m_frameGraph.Report()) + "\n").c_str());
+
+    m_targetBackend = new D3D9TargetBackend(m_d3dDevice);
+    m_sceneTextureWidth = width;
+    m_sceneTextureHeight = height;
+    DynamicResolutionSettings settings = DefaultDynamicResolutionSettings(budget);
+    settings.maxScale = 1.0f;
+    m_resolution = new DynamicResolutionController(settings, width, height);
+
+    char line[128] = {};
+    _snprintf_s(line, sizeof(line), _TRUNCATE, "Dynamic resolution, frame budget %.1f ms, scale %.2f to %.2f\n",
+        budget, settings.minScale, settings.maxScale);
+    OutputDebugStringA(line);
+}
+
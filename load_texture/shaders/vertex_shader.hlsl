@@ -9,12 +9,12 @@ struct VS_OUTPUT
 	float2 tc: TEXCOORD0;
 };
 
-VS_OUTPUT main(float3 Pos  : POSITION0, float4 Color: COLOR0)
+VS_OUTPUT main(float3 Pos  : POSITION0, float2 tc: TEXCOORD0)
 {
 	VS_OUTPUT Out;
 	// tranform vertex
 	float4 pos = mul(float4(Pos, 1), mWorld);
 	Out.Pos = mul(pos, mViewProjection);
-	Out.tc = Color.rg;
+	Out.tc = tc;
 	return Out;
 }
\ No newline at end of file
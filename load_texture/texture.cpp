@@ -1,8 +1,25 @@
 #include "resource.h"
-
+#include "counting_device.h"
+#include "d3d9_hud_backend.h"
+#include "d3d9_shader_compile.h"
+#include "hud.h"
+#include "image_compare.h"
+#include "software_vertex.h"
+#include "task_scheduler.h"
+#include "trace.h"
+#include "texture_atlas.h"
+#include "texture_residency.h"
+#include "vertex_format.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <d3d9.h>
 #include <d3dx9.h>
 
@@ -11,13 +28,18 @@
 
 static const int MAX_LOADSTRING = 256;
 
+class DdsResidencyBackend;
+
 /// @brief Textures application window class
+/// Every instance owns its window, device, shaders and textures
 class ApplicationWindow
 {
 public:
 
-    /// Access from WinMain
-    friend int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow);
+    explicit ApplicationWindow(HINSTANCE hInstance);
+
+    /// @brief Release Direct3D objects and destroy the window
+    ~ApplicationWindow();
 
     // @brief Registers the window class
     // This function and its usage are only necessary if you want this code
@@ -25,85 +47,93 @@ public:
     // function that was added to Windows 95. It is important to call this function
     // so that the application will get 'well formed' small icons associated
     // with it
-    static ATOM MyRegisterClass(HINSTANCE hInstance);
+    static ATOM MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass);
 
-    /// @brief Saves instance handle and creates main window
-    /// In this function, we save the instance handle in a class member and
-    /// create and display the main program window.
-    static BOOL InitInstance(HINSTANCE, int);
+    /// @brief Creates main window of the instance
+    /// In this function, we create and display the main program window.
+    BOOL InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow);
 
     /// @brief Initialize Direct3D subsystem
-    static BOOL InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight);
+    /// Zero texture budget means all available texture memory
+    BOOL InitD3D(int iWindowWidth, int iWindowHeight, UINT textureBudgetMb);
+
+    /// @brief Process messages of the calling thread and render until the window is closed
+    int Run();
 
     /// @brief Run window messages processing
-    /// WM_COMMAND	- process the application menu
-    /// WM_PAINT	- Paint the main window
-    /// WM_DESTROY	- post a quit message and return
+    /// Routes messages to the instance stored in the window user data
     static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
-    /// @brief Window title
-    static LPSTR WindowTitle() { return m_wndTitle; }
-
-    /// @brief Window class
-    static LPSTR WindowClass() { return m_wndClass; }
-
     /// @brief Window handle
-    static HWND WindowHandle() { return m_hMainWnd; }
+    HWND WindowHandle() const { return m_hMainWnd; }
 
     /// @brief Direct3D device
-    static LPDIRECT3DDEVICE9 Direct3DDevice() { return m_d3dDevice; }
+    LPDIRECT3DDEVICE9 Direct3DDevice() const { return m_d3dDevice; }
 
-    /// @brief Setter of window handle
-    static void SetWindowHandle(HWND handle) { m_hMainWnd = handle; }
+private:
 
-    /// @brief Setter of application handle
-    static void SetInstanceHandle(HINSTANCE handle) { m_hInst = handle; }
+    ApplicationWindow(const ApplicationWindow&);
+    ApplicationWindow& operator=(const ApplicationWindow&);
 
-private:
+    /// @brief Messages of the instance window
+    /// WM_PAINT	- Paint the main window
+    /// WM_KEYDOWN	- H shows or hides the performance HUD
+    /// WM_DESTROY	- post a quit message and return
+    LRESULT HandleMessage(HWND, UINT, WPARAM, LPARAM);
+
+    void RenderFrame();
 
     /// Direct3D 
-    static LPDIRECT3D9 m_D3D;
+    LPDIRECT3D9 m_D3D;
 
     /// Direct3D device
-    static LPDIRECT3DDEVICE9 m_d3dDevice;
+    LPDIRECT3DDEVICE9 m_d3dDevice;
 
     /// Application handle
-    static HINSTANCE m_hInst;
+    HINSTANCE m_hInst;
 
     /// Window handle
-    static HWND m_hMainWnd;
-
-    /// Window display title
-    static CHAR m_wndTitle[MAX_LOADSTRING];
-
-    /// Window class
-    static CHAR m_wndClass[MAX_LOADSTRING];
+    HWND m_hMainWnd;
 
     /// Shaders
-    static LPDIRECT3DPIXELSHADER9 m_pixelShader;
-    static LPDIRECT3DVERTEXSHADER9 m_vertexShader;
+    LPDIRECT3DPIXELSHADER9 m_pixelShader;
+    LPDIRECT3DVERTEXSHADER9 m_vertexShader;
 
     /// Shader tables
-    static LPD3DXCONSTANTTABLE m_vertexShaderTable;
-    static LPD3DXCONSTANTTABLE m_pixelShaderTable;
+    LPD3DXCONSTANTTABLE m_vertexShaderTable;
+    LPD3DXCONSTANTTABLE m_pixelShaderTable;
 
-    /// Texture to load from file
-    static LPDIRECT3DTEXTURE9 m_3dTexture;
-};
+    /// Textured quad in the compact vertex format
+    LPDIRECT3DVERTEXDECLARATION9 m_vertexDeclaration;
+    VertexLayout m_quadLayout;
+    std::vector<uint8_t> m_quadVertices;
+
+    /// Textures loaded from file and their residency
+    DdsResidencyBackend* m_textureBackend;
+    TextureResidencyManager* m_textureResidency;
+    TextureId m_textureId;
+
+    /// Atlas page holding the quad texture, NULL unless D3D_TEXTURE_ATLAS names a layout
+    LPDIRECT3DTEXTURE9 m_atlasTexture;
+
+    /// Vertex processing the device was created with
+    VertexProcessingMode m_vertexProcessing;
+
+    /// CPU vertex pipeline replacing the vertex shader, NULL if the shader is used
+    SoftwareVertexPipeline* m_softwareVertices;
+
+    /// Indices left after culling of the CPU transformed quad
+    std::vector<WORD> m_visibleIndices;
 
-/// Init static class members
-LPDIRECT3D9 ApplicationWindow::m_D3D = NULL;
-LPDIRECT3DDEVICE9 ApplicationWindow::m_d3dDevice = NULL;
-HINSTANCE ApplicationWindow::m_hInst = NULL;
-HWND ApplicationWindow::m_hMainWnd = NULL;
-CHAR ApplicationWindow::m_wndTitle[MAX_LOADSTRING] = {};
-CHAR ApplicationWindow::m_wndClass[MAX_LOADSTRING] = {};
-LPDIRECT3DPIXELSHADER9 ApplicationWindow::m_pixelShader = NULL;
-LPDIRECT3DVERTEXSHADER9 ApplicationWindow::m_vertexShader = NULL;
-LPD3DXCONSTANTTABLE ApplicationWindow::m_vertexShaderTable = NULL;
-LPD3DXCONSTANTTABLE ApplicationWindow::m_pixelShaderTable = NULL;
-LPDIRECT3DTEXTURE9 ApplicationWindow::m_3dTexture = NULL;
+    /// Quad rotation
+    float m_angle;
 
+    /// Performance HUD, the calls of the scene are made through the counting device
+    PerformanceHud m_hud;
+    D3D9HudBackend* m_hudBackend;
+    CountingDevice m_countingDevice;
+    std::chrono::steady_clock::time_point m_frameStart;
+};
 
 std::string GetFileContent(const std::string& filename)
 {
@@ -113,28 +143,268 @@ std::string GetFileContent(const std::string& filename)
     return buffer.str();
 }
 
+std::string GetBinaryFileContent(const std::string& filename)
+{
+    std::ifstream t(filename, std::ios::binary);
+    std::stringstream buffer;
+    buffer << t.rdbuf();
+    return buffer.str();
+}
+
+/// @brief Direct3D declaration of the single-stream vertex layout
+std::vector<D3DVERTEXELEMENT9> MakeVertexDeclaration(const VertexLayout& layout)
+{
+    std::vector<D3DVERTEXELEMENT9> declaration;
+    const std::vector<VertexElement>& elements = layout.Elements();
+    for (size_t i = 0; i < elements.size(); ++i)
+    {
+        D3DVERTEXELEMENT9 element = 
+        {
+            0, 
+            static_cast<WORD>(elements[i].offset), 
+            static_cast<BYTE>(elements[i].type), 
+            D3DDECLMETHOD_DEFAULT, 
+            static_cast<BYTE>(elements[i].usage), 
+            static_cast<BYTE>(elements[i].usageIndex)
+        };
+        declaration.push_back(element);
+    }
+    D3DVERTEXELEMENT9 end = D3DDECL_END();
+    declaration.push_back(end);
+    return declaration;
+}
+
+/// @brief Bits per pixel of the texture format, used for residency estimation
+UINT FormatBitsPerPixel(D3DFORMAT format)
+{
+    switch (format)
+    {
+    case D3DFMT_DXT1:
+        return 4;
+    case D3DFMT_DXT2:
+    case D3DFMT_DXT3:
+    case D3DFMT_DXT4:
+    case D3DFMT_DXT5:
+    case D3DFMT_L8:
+    case D3DFMT_A8:
+    case D3DFMT_P8:
+        return 8;
+    case D3DFMT_R5G6B5:
+    case D3DFMT_X1R5G5B5:
+    case D3DFMT_A1R5G5B5:
+    case D3DFMT_A4R4G4B4:
+    case D3DFMT_A8L8:
+    case D3DFMT_L16:
+        return 16;
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_A16B16G16R16F:
+        return 64;
+    case D3DFMT_A32B32G32R32F:
+        return 128;
+    default:
+        return 32;
+    }
+}
+
+/// @brief Residency backend which streams DDS files into the managed pool
+/// Dropped mips are handled with SetLOD(), reloads skip top DDS mip levels
+class DdsResidencyBackend : public ResidencyBackend
+{
+public:
+
+    explicit DdsResidencyBackend(LPDIRECT3DDEVICE9 device) : m_device(device) {}
+
+    ~DdsResidencyBackend()
+    {
+        for (size_t i = 0; i < m_textures.size(); ++i)
+        {
+            if (m_textures[i])
+            {
+                m_textures[i]->Release();
+            }
+        }
+    }
+
+    /// @brief Load texture with all mips and register it as resident
+    /// File content is read beforehand, filename is kept for reloads
+    HRESULT AddTexture(TextureResidencyManager& residency, const std::string& filename, const std::string& content, TextureId* id)
+    {
+        LPDIRECT3DTEXTURE9 texture = NULL;
+        HRESULT hr = D3DXCreateTextureFromFileInMemoryEx(m_device, content.data(), static_cast<UINT>(content.size()), 
+            D3DX_DEFAULT, D3DX_DEFAULT, D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 
+            D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &texture);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        D3DSURFACE_DESC surfaceDesc;
+        texture->GetLevelDesc(0, &surfaceDesc);
+
+        TextureDesc desc;
+        desc.width = surfaceDesc.Width;
+        desc.height = surfaceDesc.Height;
+        desc.mipLevels = texture->GetLevelCount();
+        desc.bitsPerPixel = FormatBitsPerPixel(surfaceDesc.Format);
+        desc.blockCompressed = (surfaceDesc.Format >= D3DFMT_DXT1 && surfaceDesc.Format <= D3DFMT_DXT5);
+
+        std::lock_guard<std::mutex> lock(m_filesLock);
+        *id = residency.Register(desc, true);
+        m_files.push_back(filename);
+        m_textures.push_back(texture);
+        m_loadedFirstMip.push_back(0);
+        return S_OK;
+    }
+
+    /// @brief Device texture, NULL if evicted
+    LPDIRECT3DTEXTURE9 Texture(TextureId id) const { return m_textures[id]; }
+
+    virtual std::shared_ptr<void> Load(TextureId id, unsigned firstMip)
+    {
+        UNREFERENCED_PARAMETER(firstMip);
+
+        std::string filename;
+        {
+            std::lock_guard<std::mutex> lock(m_filesLock);
+            filename = m_files[id];
+        }
+
+        std::shared_ptr<std::string> content = std::make_shared<std::string>(GetBinaryFileContent(filename));
+        if (content->empty())
+        {
+            return std::shared_ptr<void>();
+        }
+        return content;
+    }
+
+    virtual bool Upload(TextureId id, unsigned firstMip, const std::shared_ptr<void>& data)
+    {
+        const std::string* content = static_cast<const std::string*>(data.get());
+
+        LPDIRECT3DTEXTURE9 texture = NULL;
+        HRESULT hr = D3DXCreateTextureFromFileInMemoryEx(m_device, content->data(), static_cast<UINT>(content->size()), 
+            D3DX_DEFAULT, D3DX_DEFAULT, D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 
+            D3DX_DEFAULT, D3DX_SKIP_DDS_MIP_LEVELS(firstMip, D3DX_DEFAULT), 0, NULL, NULL, &texture);
+        if (FAILED(hr))
+        {
+            return false;
+        }
+
+        Evict(id);
+        m_textures[id] = texture;
+        m_loadedFirstMip[id] = firstMip;
+        return true;
+    }
+
+    virtual void SetFirstMip(TextureId id, unsigned firstMip)
+    {
+        m_textures[id]->SetLOD(firstMip - m_loadedFirstMip[id]);
+    }
+
+    virtual void Evict(TextureId id)
+    {
+        if (m_textures[id])
+        {
+            m_textures[id]->Release();
+            m_textures[id] = NULL;
+        }
+    }
+
+private:
+
+    LPDIRECT3DDEVICE9 m_device;
+
+    /// Source files are read by the loader thread
+    std::mutex m_filesLock;
+    std::vector<std::string> m_files;
+
+    std::vector<LPDIRECT3DTEXTURE9> m_textures;
+
+    /// Top mip of the loaded file, SetLOD() is relative to it
+    std::vector<unsigned> m_loadedFirstMip;
+};
+
 int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // Startup and frames are traced when built with D3D_TRACE, the trace is written at exit
+    TRACE_START("load_texture_trace.json", "load_texture");
+    TRACE_INSTANT("WinMain");
+    TRACE_THREAD_NAME("Window");
+
+    // Optional texture memory budget in megabytes
+    UINT textureBudgetMb = static_cast<UINT>(strtoul(lpCmdLine, NULL, 10));
 
     // Initialize global strings
-    LoadString(hInstance, IDS_APP_TITLE, ApplicationWindow::m_wndTitle, MAX_LOADSTRING);
-    LoadString(hInstance, IDC_TEXTURE, ApplicationWindow::m_wndClass, MAX_LOADSTRING);
-    ApplicationWindow::MyRegisterClass(hInstance);
+    CHAR windowTitle[MAX_LOADSTRING] = {};
+    CHAR windowClass[MAX_LOADSTRING] = {};
+    LoadString(hInstance, IDS_APP_TITLE, windowTitle, MAX_LOADSTRING);
+    LoadString(hInstance, IDC_TEXTURE, windowClass, MAX_LOADSTRING);
+    ApplicationWindow::MyRegisterClass(hInstance, windowClass);
 
     // Perform application initialization:
-    if (!ApplicationWindow::InitInstance(hInstance, nCmdShow))
+    ApplicationWindow window(hInstance);
+    if (!window.InitInstance(windowClass, windowTitle, nCmdShow))
         return FALSE;
 
     RECT rc;
-    GetClientRect(ApplicationWindow::m_hMainWnd, &rc);
-    if (!ApplicationWindow::InitD3D(ApplicationWindow::m_hMainWnd, rc.right - rc.left, rc.bottom - rc.top)) {
+    GetClientRect(window.WindowHandle(), &rc);
+    if (!window.InitD3D(rc.right - rc.left, rc.bottom - rc.top, textureBudgetMb)) {
         return FALSE;
     }
 
-    // Main message loop
-    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_TEXTURE));
+    return window.Run();
+}
+
+ApplicationWindow::ApplicationWindow(HINSTANCE hInstance)
+    : m_D3D(NULL)
+    , m_d3dDevice(NULL)
+    , m_hInst(hInstance)
+    , m_hMainWnd(NULL)
+    , m_pixelShader(NULL)
+    , m_vertexShader(NULL)
+    , m_vertexShaderTable(NULL)
+    , m_pixelShaderTable(NULL)
+    , m_vertexDeclaration(NULL)
+    , m_textureBackend(NULL)
+    , m_textureResidency(NULL)
+    , m_textureId(0)
+    , m_atlasTexture(NULL)
+    , m_vertexProcessing(VERTEX_PROCESSING_HARDWARE)
+    , m_softwareVertices(NULL)
+    , m_angle(0.0f)
+    , m_hudBackend(NULL)
+{
+}
+
+ApplicationWindow::~ApplicationWindow()
+{
+    // Residency manager stops its loader thread before the backend goes away
+    delete m_textureResidency;
+    delete m_textureBackend;
+    delete m_softwareVertices;
+    delete m_hudBackend;
+
+    IUnknown* objects[] = { m_vertexDeclaration, m_atlasTexture, m_pixelShaderTable, m_vertexShaderTable, 
+        m_pixelShader, m_vertexShader, m_d3dDevice, m_D3D };
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); ++i)
+    {
+        if (objects[i])
+        {
+            objects[i]->Release();
+        }
+    }
+    if (m_hMainWnd && IsWindow(m_hMainWnd))
+    {
+        DestroyWindow(m_hMainWnd);
+    }
+}
+
+int ApplicationWindow::Run()
+{
+    // Main message loop, only messages of this thread's windows are retrieved
+    HACCEL hAccelTable = LoadAccelerators(m_hInst, MAKEINTRESOURCE(IDC_TEXTURE));
     MSG msg;
     ZeroMemory(&msg, sizeof(MSG));
     while( msg.message!=WM_QUIT )
@@ -146,62 +416,103 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         }
         else
         {
-            struct VertPosDiffuse 
-            {
-                D3DXVECTOR3 m_pos;
-                D3DCOLOR m_color;
-                VertPosDiffuse(D3DXVECTOR3 pos, D3DCOLOR color)
-                    : m_pos(pos), m_color(color)
-                {}
-            };
-
-            VertPosDiffuse v[] = 
-            {
-                VertPosDiffuse(D3DXVECTOR3(-1, -1, 0), D3DCOLOR_XRGB(0, 0, 0)),
-                VertPosDiffuse(D3DXVECTOR3( 1, -1, 0), D3DCOLOR_XRGB(255, 0, 0)),
-                VertPosDiffuse(D3DXVECTOR3(-1,  1, 0), D3DCOLOR_XRGB(0, 255, 0)),
-                VertPosDiffuse(D3DXVECTOR3( 1,  1, 0), D3DCOLOR_XRGB(255, 255, 0))
-            };
-            ApplicationWindow::m_d3dDevice->BeginScene();
-            ApplicationWindow::m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL|D3DCLEAR_ZBUFFER, 0xff808080, 1, 0);
-
-            ApplicationWindow::m_d3dDevice->SetFVF(D3DFVF_XYZ|D3DFVF_DIFFUSE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_LIGHTING, FALSE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZENABLE, D3DZB_TRUE);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZFUNC, D3DCMP_LESS);
-            ApplicationWindow::m_d3dDevice->SetRenderState(D3DRS_ZWRITEENABLE, TRUE);
-
-            D3DXMATRIX mat, matViewProj, matProj, matView;
-            static float angle=0.0f;
-            angle+=.03f;
-            D3DXMatrixRotationY(&mat, angle);
-            D3DXMatrixPerspectiveFovLH(&matProj, D3DX_PI/3, 800.f/600, .01f, 20);
-            D3DXMatrixLookAtLH(&matView, &D3DXVECTOR3(2, 2, 2), &D3DXVECTOR3(0,0,0), &D3DXVECTOR3(0, 1, 0));
-
-            D3DXMatrixMultiply(&matViewProj, &matView, &matProj);
-
-            ApplicationWindow::m_d3dDevice->SetPixelShader(ApplicationWindow::m_pixelShader);
-            ApplicationWindow::m_d3dDevice->SetVertexShader(ApplicationWindow::m_vertexShader);
-
-            ApplicationWindow::m_vertexShaderTable->SetMatrix(ApplicationWindow::m_d3dDevice, "mWorld", &mat);
-            ApplicationWindow::m_vertexShaderTable->SetMatrix(ApplicationWindow::m_d3dDevice, "mViewProjection", &matViewProj);
-            ApplicationWindow::m_d3dDevice->SetTexture(0, ApplicationWindow::m_3dTexture);
-            ApplicationWindow::m_d3dDevice->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
-            ApplicationWindow::m_d3dDevice->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
-            ApplicationWindow::m_d3dDevice->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
-            ApplicationWindow::m_d3dDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, v, sizeof(VertPosDiffuse));
-            ApplicationWindow::m_d3dDevice->EndScene();
-            ApplicationWindow::m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+            RenderFrame();
         }
     }
     
     return static_cast<int>(msg.wParam);
 }
 
-ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
+void ApplicationWindow::RenderFrame()
+{
+    TRACE_SCOPE("Frame");
+
+    // HUD shows the interval between frames and the calls of the previous frame
+    const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    m_hud.AddFrame(std::chrono::duration<double, std::milli>(frameStart - m_frameStart).count(), m_countingDevice.Counters());
+    m_frameStart = frameStart;
+    m_countingDevice.ResetCounters();
+
+    m_d3dDevice->BeginScene();
+    m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL|D3DCLEAR_ZBUFFER, 0xff808080, 1, 0);
+
+    m_countingDevice.SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    m_countingDevice.SetRenderState(D3DRS_LIGHTING, FALSE);
+    m_countingDevice.SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+    m_countingDevice.SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
+    m_countingDevice.SetRenderState(D3DRS_ZENABLE, D3DZB_TRUE);
+    m_countingDevice.SetRenderState(D3DRS_ZFUNC, D3DCMP_LESS);
+    m_countingDevice.SetRenderState(D3DRS_ZWRITEENABLE, TRUE);
+
+    D3DXMATRIX mat, matViewProj, matProj, matView;
+    m_angle+=.03f;
+    D3DXMatrixRotationY(&mat, m_angle);
+    D3DXMatrixPerspectiveFovLH(&matProj, D3DX_PI/3, 800.f/600, .01f, 20);
+    D3DXMatrixLookAtLH(&matView, &D3DXVECTOR3(2, 2, 2), &D3DXVECTOR3(0,0,0), &D3DXVECTOR3(0, 1, 0));
+
+    D3DXMatrixMultiply(&matViewProj, &matView, &matProj);
+
+    m_countingDevice.SetPixelShader(m_pixelShader);
+    if (!m_softwareVertices)
+    {
+        m_countingDevice.SetVertexDeclaration(m_vertexDeclaration);
+        m_countingDevice.SetVertexShader(m_vertexShader);
+        m_countingDevice.SetMatrix(m_vertexShaderTable, "mWorld", &mat);
+        m_countingDevice.SetMatrix(m_vertexShaderTable, "mViewProjection", &matViewProj);
+    }
+    // Non-resident texture is being reloaded, draw without it meanwhile
+    LPDIRECT3DTEXTURE9 texture = m_atlasTexture;
+    if (!texture && m_textureResidency->Bind(m_textureId))
+    {
+        texture = m_textureBackend->Texture(m_textureId);
+    }
+    m_countingDevice.SetTexture(0, texture);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    m_countingDevice.SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
+    if (m_softwareVertices)
+    {
+        // Quad strip as a list, the CPU pipeline culls and clips triangles of a list
+        static const WORD quad[] = { 0, 1, 2, 2, 1, 3 };
+        SoftwareVertexPipeline& pipeline = *m_softwareVertices;
+        pipeline.SetTransform(mat, matViewProj);
+        pipeline.Process(m_quadLayout, &m_quadVertices[0], 4);
+        pipeline.CullTriangles(quad, 6, m_visibleIndices);
+
+        m_countingDevice.SetVertexShader(NULL);
+        m_countingDevice.SetFVF(TRANSFORMED_VERTEX_FVF);
+        if (!m_visibleIndices.empty())
+        {
+            m_countingDevice.DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, static_cast<UINT>(pipeline.Vertices().size()), 
+                static_cast<UINT>(m_visibleIndices.size() / 3), &m_visibleIndices[0], D3DFMT_INDEX16, 
+                &pipeline.Vertices()[0], sizeof(TransformedVertex));
+        }
+    }
+    else
+    {
+        m_countingDevice.DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, 
+            &m_quadVertices[0], m_quadLayout.Stride());
+    }
+    if (m_hudBackend)
+    {
+        m_hud.Draw(*m_hudBackend);
+    }
+    m_d3dDevice->EndScene();
+    {
+        TRACE_SCOPE("Present");
+        m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+    }
+
+    // Only frames which changed the residency are logged, the steady state stays quiet
+    ResidencyFrameStats residencyStats = m_textureResidency->EndFrame();
+    if (residencyStats.evictions || residencyStats.mipDrops || residencyStats.reloadsRequested || 
+        residencyStats.reloadsCompleted || residencyStats.reloadStalls)
+    {
+        OutputDebugStringA((FormatResidencyStats(residencyStats) + "\n").c_str());
+    }
+}
+
+ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass)
 {
     WNDCLASSEX wcex;
 
@@ -215,36 +526,51 @@ ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
     wcex.hCursor		= LoadCursor(NULL, IDC_ARROW);
     wcex.hbrBackground	= NULL;
     wcex.lpszMenuName	= NULL;
-    wcex.lpszClassName	= m_wndClass;
+    wcex.lpszClassName	= windowClass;
     wcex.hIconSm		= LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
 
     return RegisterClassEx(&wcex);
 }
 
-BOOL ApplicationWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
+BOOL ApplicationWindow::InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow)
 {
-    ApplicationWindow::SetInstanceHandle(hInstance);
-
-    HWND handle = CreateWindow(ApplicationWindow::WindowClass(), 
-        ApplicationWindow::WindowTitle(), 
+    // Instance pointer reaches WndProc with WM_NCCREATE
+    HWND handle = CreateWindow(windowClass, 
+        windowTitle, 
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT, 
         800, 600, 
-        NULL, NULL, hInstance, NULL);
+        NULL, NULL, m_hInst, this);
 
     if (!handle) {
         return FALSE;
     }
 
-    ApplicationWindow::SetWindowHandle(handle);
+    m_hMainWnd = handle;
 
-    ShowWindow(ApplicationWindow::WindowHandle(), nCmdShow);
-    UpdateWindow(ApplicationWindow::WindowHandle());
+    ShowWindow(m_hMainWnd, nCmdShow);
+    UpdateWindow(m_hMainWnd);
 
     return TRUE;
 }
 
 LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (WM_NCCREATE == message)
+    {
+        CREATESTRUCT* createStruct = reinterpret_cast<CREATESTRUCT*>(lParam);
+        SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(createStruct->lpCreateParams));
+    }
+
+    ApplicationWindow* window = reinterpret_cast<ApplicationWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+    if (!window)
+    {
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return window->HandleMessage(hWnd, message, wParam, lParam);
+}
+
+LRESULT ApplicationWindow::HandleMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message)
     {
@@ -258,7 +584,14 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
             EndPaint(hWnd, &ps);
             break;
         }
+    case WM_KEYDOWN:
+        if ('H' == wParam)
+        {
+            m_hud.Toggle();
+        }
+        break;
     case WM_DESTROY:
+        m_hMainWnd = NULL;
         PostQuitMessage(0);
         break;
     default:
@@ -267,59 +600,280 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
     return 0;
 }
 
-BOOL ApplicationWindow::InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight)
+BOOL ApplicationWindow::InitD3D(int iWindowWidth, int iWindowHeight, UINT textureBudgetMb)
 {
+    TRACE_SCOPE("InitD3D");
+
+    // File reads, HLSL compilation and DDS parsing overlap with device creation,
+    // everything touching the device runs on this thread
+    TaskScheduler scheduler;
+
+    // Vertex processing is chosen from the caps, D3D_VERTEX_PROCESSING environment variable overrides it.
+    // The caps are read before the device is created, so the shader profiles are known up front
     m_D3D = Direct3DCreate9(D3D_SDK_VERSION);
     if (m_D3D==NULL)
         return FALSE;
 
-    D3DPRESENT_PARAMETERS d3dpp;
-    ZeroMemory(&d3dpp, sizeof(D3DPRESENT_PARAMETERS));
-    d3dpp.BackBufferWidth = iWindowWidth;
-    d3dpp.BackBufferHeight = iWindowHeight;
-    d3dpp.BackBufferCount = 1;
-    d3dpp.Windowed = TRUE;
-    d3dpp.BackBufferFormat = D3DFMT_UNKNOWN;
-    d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
-    d3dpp.EnableAutoDepthStencil = TRUE;
-    d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
-    d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
-
-    HRESULT hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hWnd, D3DCREATE_HARDWARE_VERTEXPROCESSING, &d3dpp, &m_d3dDevice);
-    EXIT_ON_FAILURE(hr);
-
-    LPD3DXBUFFER dxErrorBuffer = NULL;
-    LPD3DXBUFFER dxShaderBuffer = NULL;
-
-    std::string vertexShaderSrc = GetFileContent("shaders/vertex_shader.hlsl");
-    hr = D3DXCompileShader(vertexShaderSrc.c_str(), 
-        vertexShaderSrc.size(), 
-        NULL, NULL, 
-        "main", "vs_3_0", 
-        D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &dxErrorBuffer, &m_vertexShaderTable);
-    EXIT_ON_FAILURE(hr);
-
-    hr = m_d3dDevice->CreateVertexShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_vertexShader);
-    EXIT_ON_FAILURE(hr);
-
-    dxShaderBuffer->Release();
-
-    std::string pixelShaderSrc = GetFileContent("shaders/pixel_shader.hlsl");
-    hr = D3DXCompileShader(pixelShaderSrc.c_str(), 
-        pixelShaderSrc.size(), 
-        NULL, NULL, 
-        "pixel_shader_main", "ps_3_0", 
-        D3DXSHADER_OPTIMIZATION_LEVEL3, &dxShaderBuffer, &dxErrorBuffer, &m_pixelShaderTable);
-    EXIT_ON_FAILURE(hr);
-
-    hr = m_d3dDevice->CreatePixelShader(reinterpret_cast<DWORD*>(dxShaderBuffer->GetBufferPointer()), &m_pixelShader);
-    EXIT_ON_FAILURE(hr);
-
-    dxShaderBuffer->Release();
-
-    hr = D3DXCreateTextureFromFile(m_d3dDevice, "textures/stone-ground-diff.dds", &m_3dTexture);
-    EXIT_ON_FAILURE(hr);
-
-    return TRUE;    
-}
+    D3DCAPS9 adapterCaps;
+    HRESULT adapterHr = m_D3D->GetDeviceCaps(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &adapterCaps);
+    EXIT_ON_FAILURE(adapterHr);
+
+    CHAR vertexProcessingOverride[32] = {};
+    GetEnvironmentVariableA("D3D_VERTEX_PROCESSING", vertexProcessingOverride, sizeof(vertexProcessingOverride));
+    const std::vector<VertexProcessingMode> candidates = VertexProcessingCandidates(adapterCaps.DevCaps, 
+        adapterCaps.VertexShaderVersion, D3DVS_VERSION(3, 0), vertexProcessingOverride);
+
+    // D3D_TEXTURE_ATLAS names a layout written by atlas_packer, the quad is textured with the first
+    // packed texture sampled from its atlas page through the UV remap instead of the DDS texture
+    CHAR atlasFile[MAX_PATH] = {};
+    GetEnvironmentVariableA("D3D_TEXTURE_ATLAS", atlasFile, sizeof(atlasFile));
+    AtlasLayout atlasLayout;
+    Image atlasPage;
+    TaskId readAtlas = scheduler.Add("ReadAtlas", [&]() -> bool
+    {
+        if (!atlasFile[0])
+        {
+            return true;
+        }
+        return LoadAtlasLayout(atlasFile, atlasLayout, NULL) && !atlasLayout.regions.empty() &&
+            LoadNetpbmImage(AtlasPageFilename(atlasFile, atlasLayout.regions[0].atlas), atlasPage);
+    });
 
+    TaskId createDevice = scheduler.AddOwnerTask("CreateDevice", [&]() -> bool
+    {
+        D3DPRESENT_PARAMETERS d3dpp;
+        ZeroMemory(&d3dpp, sizeof(D3DPRESENT_PARAMETERS));
+        d3dpp.BackBufferWidth = iWindowWidth;
+        d3dpp.BackBufferHeight = iWindowHeight;
+        d3dpp.BackBufferCount = 1;
+        d3dpp.Windowed = TRUE;
+        d3dpp.BackBufferFormat = D3DFMT_UNKNOWN;
+        d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+        d3dpp.EnableAutoDepthStencil = TRUE;
+        d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
+        d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
+
+        HRESULT hr = D3DERR_NOTAVAILABLE;
+        for (size_t i = 0; i < candidates.size() && FAILED(hr); ++i)
+        {
+            m_vertexProcessing = candidates[i];
+            hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, m_hMainWnd, m_vertexProcessing, &d3dpp, &m_d3dDevice);
+        }
+        EXIT_ON_FAILURE(hr);
+
+        // Without hardware vertex shaders the quad is transformed by the CPU pipeline
+        if (VERTEX_PROCESSING_HARDWARE != m_vertexProcessing)
+        {
+            D3DVIEWPORT9 viewport;
+            hr = m_d3dDevice->GetViewport(&viewport);
+            EXIT_ON_FAILURE(hr);
+
+            ScreenViewport screenViewport = { viewport.X, viewport.Y, viewport.Width, viewport.Height, viewport.MinZ, viewport.MaxZ };
+            m_softwareVertices = new SoftwareVertexPipeline;
+            m_softwareVertices->SetViewport(screenViewport);
+        }
+
+        char line[256] = {};
+        _snprintf_s(line, sizeof(line), _TRUNCATE, "%s vertex processing, vertex shader %s\n", 
+            VertexProcessingName(m_vertexProcessing), m_softwareVertices ? "replaced by the CPU pipeline" : "used");
+        OutputDebugStringA(line);
+        return TRUE;
+    });
+
+    scheduler.AddOwnerTask("CreateVertexDeclaration", [&]() -> bool
+    {
+        // Quad with 16-bit normalized texture coordinates, if the adapter supports them
+        D3DCAPS9 caps;
+        HRESULT hr = m_d3dDevice->GetDeviceCaps(&caps);
+        EXIT_ON_FAILURE(hr);
+
+        m_quadLayout.Add(VET_FLOAT3, VEU_POSITION);
+        m_quadLayout.Add(SupportedVertexElementType(VET_SHORT2N, caps.DeclTypes), VEU_TEXCOORD);
+
+        Mesh quad;
+        const float quadCorners[4][2] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+        for (int i = 0; i < 4; ++i)
+        {
+            MeshVertex vertex = {};
+            vertex.position[0] = quadCorners[i][0];
+            vertex.position[1] = quadCorners[i][1];
+            vertex.texCoord[0] = 0.5f + 0.5f * quadCorners[i][0];
+            vertex.texCoord[1] = 0.5f + 0.5f * quadCorners[i][1];
+            if (!atlasLayout.remaps.empty())
+            {
+                ApplyUvRemap(atlasLayout.remaps[0], vertex.texCoord, 1, sizeof(vertex.texCoord));
+            }
+            quad.vertices.push_back(vertex);
+        }
+
+        std::vector<QuantizationError> quantizationErrors;
+        EncodeMeshVertices(quad, m_quadLayout, m_quadVertices, &quantizationErrors);
+        for (size_t i = 0; i < quantizationErrors.size(); ++i)
+        {
+            char line[256] = {};
+            _snprintf_s(line, sizeof(line), _TRUNCATE, "vertex element %u type %u: max error %g, bound %g, stride %u bytes\n",
+                static_cast<unsigned>(i), static_cast<unsigned>(m_quadLayout.Elements()[i].type), 
+                quantizationErrors[i].maxError, quantizationErrors[i].boundError, m_quadLayout.Stride());
+            OutputDebugStringA(line);
+        }
+
+        std::vector<D3DVERTEXELEMENT9> declaration = MakeVertexDeclaration(m_quadLayout);
+        hr = m_d3dDevice->CreateVertexDeclaration(&declaration[0], &m_vertexDeclaration);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { createDevice, readAtlas });
+
+    // Shader compilation does not need the device, it is asked from the shader daemon first
+    std::string vertexShaderSrc;
+    LPD3DXBUFFER vertexShaderBuffer = NULL;
+    TaskId readVertexShader = scheduler.Add("ReadVertexShader", [&]() -> bool
+    {
+        vertexShaderSrc = GetFileContent("shaders/vertex_shader.hlsl");
+        return !vertexShaderSrc.empty();
+    });
+
+    TaskId compileVertexShader = scheduler.Add("CompileVertexShader", [&]() -> bool
+    {
+        HRESULT hr = CompileShader(vertexShaderSrc, "main", "vs_3_0", D3DXSHADER_OPTIMIZATION_LEVEL3, 
+            &vertexShaderBuffer, &m_vertexShaderTable);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { readVertexShader });
+
+    scheduler.AddOwnerTask("CreateVertexShader", [&]() -> bool
+    {
+        HRESULT hr = m_d3dDevice->CreateVertexShader(reinterpret_cast<DWORD*>(vertexShaderBuffer->GetBufferPointer()), &m_vertexShader);
+        vertexShaderBuffer->Release();
+        vertexShaderBuffer = NULL;
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { createDevice, compileVertexShader });
+
+    std::string pixelShaderSrc;
+    LPD3DXBUFFER pixelShaderBuffer = NULL;
+    TaskId readPixelShader = scheduler.Add("ReadPixelShader", [&]() -> bool
+    {
+        pixelShaderSrc = GetFileContent("shaders/pixel_shader.hlsl");
+        return !pixelShaderSrc.empty();
+    });
+
+    // Pre-transformed vertices of the CPU pipeline can't feed ps_3_0. The profile is the one of the
+    // first vertex processing candidate, the shader is compiled again if device creation fell back
+    const bool predictedSoftwareVertices = VERTEX_PROCESSING_HARDWARE != candidates.front();
+    TaskId compilePixelShader = scheduler.Add("CompilePixelShader", [&]() -> bool
+    {
+        HRESULT hr = CompileShader(pixelShaderSrc, "pixel_shader_main", predictedSoftwareVertices ? "ps_2_0" : "ps_3_0", 
+            D3DXSHADER_OPTIMIZATION_LEVEL3, &pixelShaderBuffer, &m_pixelShaderTable);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { readPixelShader });
+
+    scheduler.AddOwnerTask("CreatePixelShader", [&]() -> bool
+    {
+        if ((NULL != m_softwareVertices) != predictedSoftwareVertices)
+        {
+            OutputDebugStringA("Vertex processing fell back, compiling the pixel shader for it\n");
+            pixelShaderBuffer->Release();
+            pixelShaderBuffer = NULL;
+            if (m_pixelShaderTable)
+            {
+                m_pixelShaderTable->Release();
+                m_pixelShaderTable = NULL;
+            }
+            HRESULT hr = CompileShader(pixelShaderSrc, "pixel_shader_main", m_softwareVertices ? "ps_2_0" : "ps_3_0", 
+                D3DXSHADER_OPTIMIZATION_LEVEL3, &pixelShaderBuffer, &m_pixelShaderTable);
+            EXIT_ON_FAILURE(hr);
+        }
+
+        HRESULT hr = m_d3dDevice->CreatePixelShader(reinterpret_cast<DWORD*>(pixelShaderBuffer->GetBufferPointer()), &m_pixelShader);
+        pixelShaderBuffer->Release();
+        pixelShaderBuffer = NULL;
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { createDevice, compilePixelShader });
+
+    // DDS header is parsed without the device, texture is created from memory
+    const std::string textureFile("textures/stone-ground-diff.dds");
+    std::string textureContent;
+    TaskId readTexture = scheduler.Add("ReadTexture", [&]() -> bool
+    {
+        textureContent = GetBinaryFileContent(textureFile);
+        D3DXIMAGE_INFO imageInfo;
+        HRESULT hr = D3DXGetImageInfoFromFileInMemory(textureContent.data(), static_cast<UINT>(textureContent.size()), &imageInfo);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    });
+
+    scheduler.AddOwnerTask("CreateTexture", [&]() -> bool
+    {
+        UINT64 textureBudget = textureBudgetMb ? UINT64(textureBudgetMb) * 1024 * 1024 : m_d3dDevice->GetAvailableTextureMem();
+        m_textureBackend = new DdsResidencyBackend(m_d3dDevice);
+        m_textureResidency = new TextureResidencyManager(m_textureBackend, textureBudget);
+
+        HRESULT hr = m_textureBackend->AddTexture(*m_textureResidency, textureFile, textureContent, &m_textureId);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { createDevice, readTexture });
+
+    scheduler.AddOwnerTask("CreateAtlasTexture", [&]() -> bool
+    {
+        if (atlasPage.pixels.empty())
+        {
+            return TRUE;
+        }
+
+        // Page texels are BGRA bytes, the memory layout of A8R8G8B8
+        HRESULT hr = D3DXCreateTexture(m_d3dDevice, atlasPage.width, atlasPage.height, atlasLayout.mipLevels, 
+            0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &m_atlasTexture);
+        EXIT_ON_FAILURE(hr);
+
+        D3DLOCKED_RECT locked;
+        hr = m_atlasTexture->LockRect(0, &locked, NULL, 0);
+        EXIT_ON_FAILURE(hr);
+        for (unsigned y = 0; y < atlasPage.height; ++y)
+        {
+            memcpy(static_cast<uint8_t*>(locked.pBits) + static_cast<size_t>(y) * locked.Pitch, 
+                &atlasPage.pixels[static_cast<size_t>(y) * atlasPage.width * 4], atlasPage.width * 4);
+        }
+        m_atlasTexture->UnlockRect(0);
+
+        // Box filtered mips, the gutters are sized so that neighbour regions don't bleed into them
+        hr = D3DXFilterTexture(m_atlasTexture, NULL, 0, D3DX_FILTER_BOX);
+        EXIT_ON_FAILURE(hr);
+        return TRUE;
+    }, { createDevice, readAtlas });
+
+    BOOL succeeded = scheduler.Run();
+    OutputDebugStringA(("InitD3D " + scheduler.FormatCriticalPath()).c_str());
+
+    // Shaders compiled while the device creation failed are never created
+    if (vertexShaderBuffer)
+    {
+        vertexShaderBuffer->Release();
+    }
+    if (pixelShaderBuffer)
+    {
+        pixelShaderBuffer->Release();
+    }
+    if (!succeeded)
+    {
+        return FALSE;
+    }
+
+    m_countingDevice.Attach(m_d3dDevice);
+
+    // Frames are drawn without the HUD if its texture can't be created
+    m_hudBackend = new D3D9HudBackend(m_d3dDevice);
+    if (FAILED(m_hudBackend->Init()))
+    {
+        OutputDebugStringA("Unable to create the HUD state block or font texture, the HUD is disabled\n");
+        delete m_hudBackend;
+        m_hudBackend = NULL;
+    }
+    std::vector<std::string> shaderNames;
+    shaderNames.push_back(m_softwareVertices ? "vs: CPU pipeline" : "vs: shaders/vertex_shader.hlsl");
+    shaderNames.push_back("ps: shaders/pixel_shader.hlsl");
+    m_hud.SetShaderNames(shaderNames);
+    m_frameStart = std::chrono::steady_clock::now();
+    return TRUE;
+}
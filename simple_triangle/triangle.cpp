@@ -1,16 +1,32 @@
 #include "resource.h"
+#include "counting_device.h"
+#include "d3d9_hud_backend.h"
+#include "hud.h"
+#include "software_vertex.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
 #include <d3d9.h>
 #include <d3dx9.h>
 
 static const int MAX_LOADSTRING = 256;
 
 /// @brief Triangles application window class
+/// Every instance owns its window, device and frame timing, so several
+/// instances may run concurrently, each on its own thread
 class ApplicationWindow
 {
 public:
 
-    /// Access from WinMain
-    friend int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow);
+    ApplicationWindow(HINSTANCE hInstance, UINT index);
+
+    /// @brief Release device and destroy the window
+    ~ApplicationWindow();
 
     // @brief Registers the window class
     // This function and its usage are only necessary if you want this code
@@ -18,97 +34,175 @@ public:
     // function that was added to Windows 95. It is important to call this function
     // so that the application will get 'well formed' small icons associated
     // with it
-    static ATOM MyRegisterClass(HINSTANCE hInstance);
+    static ATOM MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass);
 
-    /// @brief Saves instance handle and creates main window
-    /// In this function, we save the instance handle in a class member and
-    /// create and display the main program window.
-    static BOOL InitInstance(HINSTANCE, int);
+    /// @brief Creates main window of the instance
+    /// In this function, we create and display the main program window.
+    BOOL InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow);
 
     /// @brief Initialize Direct3D subsystem
-    static BOOL InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight);
+    BOOL InitD3D(int iWindowWidth, int iWindowHeight);
+
+    /// @brief Process messages of the calling thread and render until the window is closed
+    int Run();
 
     /// @brief Run window messages processing
-    /// WM_COMMAND	- process the application menu
-    /// WM_PAINT	- Paint the main window
-    /// WM_DESTROY	- post a quit message and return
+    /// Routes messages to the instance stored in the window user data
     static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
-    /// @brief Window title
-    static LPSTR WindowTitle() { return m_wndTitle; }
-
-    /// @brief Window class
-    static LPSTR WindowClass() { return m_wndClass; }
-
     /// @brief Window handle
-    static HWND WindowHandle() { return m_hMainWnd; }
+    HWND WindowHandle() const { return m_hMainWnd; }
 
     /// @brief Direct3D device
-    static LPDIRECT3DDEVICE9 Direct3DDevice() { return m_d3dDevice; }
+    LPDIRECT3DDEVICE9 Direct3DDevice() const { return m_d3dDevice; }
 
-    /// @brief Setter of window handle
-    static void SetWindowHandle(HWND handle) { m_hMainWnd = handle; }
+    /// @brief Frames presented by Run()
+    UINT Frames() const { return m_frames; }
 
-    /// @brief Setter of application handle
-    static void SetInstanceHandle(HINSTANCE handle) { m_hInst = handle; }
+    /// @brief Duration of Run() in milliseconds
+    double Milliseconds() const { return m_milliseconds; }
 
 private:
 
-    /// Direct3D 
-    static LPDIRECT3D9 m_D3D;
+    ApplicationWindow(const ApplicationWindow&);
+    ApplicationWindow& operator=(const ApplicationWindow&);
+
+    /// @brief Messages of the instance window
+    /// WM_PAINT	- Paint the main window
+    /// WM_KEYDOWN	- H shows or hides the performance HUD
+    /// WM_DESTROY	- post a quit message and return
+    LRESULT HandleMessage(HWND, UINT, WPARAM, LPARAM);
+
+    void RenderFrame();
+
+    /// Instance index
+    UINT m_index;
+
+    /// Direct3D
+    LPDIRECT3D9 m_D3D;
 
     /// Direct3D device
-    static LPDIRECT3DDEVICE9 m_d3dDevice;
+    LPDIRECT3DDEVICE9 m_d3dDevice;
 
     /// Application handle
-    static HINSTANCE m_hInst;
+    HINSTANCE m_hInst;
 
     /// Window handle
-    static HWND m_hMainWnd;
+    HWND m_hMainWnd;
 
-    /// Window display title
-    static CHAR m_wndTitle[MAX_LOADSTRING];
+    /// Frame statistics
+    UINT m_frames;
+    double m_milliseconds;
 
-    /// Window class
-    static CHAR m_wndClass[MAX_LOADSTRING];
+    /// Performance HUD, the calls of the scene are made through the counting device
+    PerformanceHud m_hud;
+    D3D9HudBackend* m_hudBackend;
+    CountingDevice m_countingDevice;
+    std::chrono::steady_clock::time_point m_frameStart;
 };
 
-/// Init static class members
-LPDIRECT3D9 ApplicationWindow::m_D3D = NULL;
-LPDIRECT3DDEVICE9 ApplicationWindow::m_d3dDevice = NULL;
-HINSTANCE ApplicationWindow::m_hInst = NULL;
-HWND ApplicationWindow::m_hMainWnd = NULL;
-CHAR ApplicationWindow::m_wndTitle[MAX_LOADSTRING] = {};
-CHAR ApplicationWindow::m_wndClass[MAX_LOADSTRING] = {};
+/// @brief Create, run and destroy one instance on the calling thread
+/// Result line is written to the debugger output
+int RunInstance(HINSTANCE hInstance, UINT index, LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow)
+{
+    TRACE_THREAD_NAME(TRACE_INTERN("Window " + std::to_string(index)));
+    ApplicationWindow window(hInstance, index);
+    if (!window.InitInstance(windowClass, windowTitle, nCmdShow))
+    {
+        return FALSE;
+    }
 
+    RECT rc;
+    GetClientRect(window.WindowHandle(), &rc);
+    if (!window.InitD3D(rc.right - rc.left, rc.bottom - rc.top))
+    {
+        return FALSE;
+    }
+
+    int ret = window.Run();
+
+    char line[256] = {};
+    _snprintf_s(line, sizeof(line), _TRUNCATE, "instance %u: %u frames in %.1f ms, %.1f fps\n", index,
+        window.Frames(), window.Milliseconds(), window.Milliseconds() > 0 ? window.Frames() * 1000.0 / window.Milliseconds() : 0.0);
+    OutputDebugStringA(line);
+    return ret;
+}
 
 int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // Startup and frames are traced when built with D3D_TRACE, the trace is written at exit
+    TRACE_START("simple_triangle_trace.json", "simple_triangle");
+    TRACE_INSTANT("WinMain");
+
+    // Optional number of windows, each one with its own device and thread
+    UINT instanceCount = static_cast<UINT>(strtoul(lpCmdLine, NULL, 10));
+    if (0 == instanceCount)
+    {
+        instanceCount = 1;
+    }
 
     // Initialize global strings
-    LoadString(hInstance, IDS_APP_TITLE, ApplicationWindow::m_wndTitle, MAX_LOADSTRING);
-    LoadString(hInstance, IDC_TRIANGLE, ApplicationWindow::m_wndClass, MAX_LOADSTRING);
-    ApplicationWindow::MyRegisterClass(hInstance);
+    CHAR windowTitle[MAX_LOADSTRING] = {};
+    CHAR windowClass[MAX_LOADSTRING] = {};
+    LoadString(hInstance, IDS_APP_TITLE, windowTitle, MAX_LOADSTRING);
+    LoadString(hInstance, IDC_TRIANGLE, windowClass, MAX_LOADSTRING);
+    ApplicationWindow::MyRegisterClass(hInstance, windowClass);
 
-    // Perform application initialization:
-    if (!ApplicationWindow::InitInstance(hInstance, nCmdShow))
+    if (1 == instanceCount)
     {
-        return FALSE;
+        return RunInstance(hInstance, 0, windowClass, windowTitle, nCmdShow);
     }
 
-    RECT rc;
-    GetClientRect(ApplicationWindow::WindowHandle(), &rc);
-    if (!ApplicationWindow::InitD3D(ApplicationWindow::WindowHandle(), rc.right - rc.left, rc.bottom - rc.top))
+    std::vector<std::thread> threads;
+    for (UINT i = 0; i < instanceCount; ++i)
     {
-        return FALSE;
+        threads.push_back(std::thread(RunInstance, hInstance, i, windowClass, windowTitle, nCmdShow));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
     }
+    return 0;
+}
+
+ApplicationWindow::ApplicationWindow(HINSTANCE hInstance, UINT index)
+    : m_index(index)
+    , m_D3D(NULL)
+    , m_d3dDevice(NULL)
+    , m_hInst(hInstance)
+    , m_hMainWnd(NULL)
+    , m_frames(0)
+    , m_milliseconds(0.0)
+    , m_hudBackend(NULL)
+{
+}
+
+ApplicationWindow::~ApplicationWindow()
+{
+    delete m_hudBackend;
+    if (m_d3dDevice)
+    {
+        m_d3dDevice->Release();
+    }
+    if (m_D3D)
+    {
+        m_D3D->Release();
+    }
+    if (m_hMainWnd && IsWindow(m_hMainWnd))
+    {
+        DestroyWindow(m_hMainWnd);
+    }
+}
 
-    // Main message loop
-    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_TRIANGLE));
+int ApplicationWindow::Run()
+{
+    // Main message loop, only messages of this thread's windows are retrieved
+    HACCEL hAccelTable = LoadAccelerators(m_hInst, MAKEINTRESOURCE(IDC_TRIANGLE));
     MSG msg;
     ZeroMemory(&msg, sizeof(MSG));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     while(msg.message != WM_QUIT)
     {
         if( PeekMessage( &msg, NULL, 0U, 0U, PM_REMOVE ) )
@@ -118,34 +212,54 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         }
         else
         {
-            struct VertexCoordinates 
-            {
-                VertexCoordinates(D3DXVECTOR4 pos, D3DCOLOR color) : m_pos(pos), m_color(color) {}
-                D3DXVECTOR4 m_pos;
-                D3DCOLOR m_color;
-            };
-
-            VertexCoordinates triangleVertexSet[] = 
-            {
-                VertexCoordinates(D3DXVECTOR4(  0,   0, 0, 1), D3DCOLOR_XRGB(255, 0, 0)),
-                VertexCoordinates(D3DXVECTOR4(400,   0, 0, 1), D3DCOLOR_XRGB(0, 0, 255)),
-                VertexCoordinates(D3DXVECTOR4(400, 400, 0, 1), D3DCOLOR_XRGB(0, 255, 0))
-            };
-
-            ApplicationWindow::m_d3dDevice->BeginScene();
-            ApplicationWindow::m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL| D3DCLEAR_ZBUFFER, 0x808080, 0, 0);
-
-            ApplicationWindow::m_d3dDevice->SetFVF(D3DFVF_XYZRHW|D3DFVF_DIFFUSE);
-            ApplicationWindow::m_d3dDevice->DrawPrimitiveUP(D3DPT_TRIANGLELIST, 1, triangleVertexSet, sizeof(VertexCoordinates));
-            ApplicationWindow::m_d3dDevice->EndScene();
-            ApplicationWindow::m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+            RenderFrame();
         }
     }
-    
+    m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
     return static_cast<int>(msg.wParam);
 }
 
-ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
+void ApplicationWindow::RenderFrame()
+{
+    struct VertexCoordinates
+    {
+        VertexCoordinates(D3DXVECTOR4 pos, D3DCOLOR color) : m_pos(pos), m_color(color) {}
+        D3DXVECTOR4 m_pos;
+        D3DCOLOR m_color;
+    };
+
+    VertexCoordinates triangleVertexSet[] =
+    {
+        VertexCoordinates(D3DXVECTOR4(  0,   0, 0, 1), D3DCOLOR_XRGB(255, 0, 0)),
+        VertexCoordinates(D3DXVECTOR4(400,   0, 0, 1), D3DCOLOR_XRGB(0, 0, 255)),
+        VertexCoordinates(D3DXVECTOR4(400, 400, 0, 1), D3DCOLOR_XRGB(0, 255, 0))
+    };
+
+    TRACE_SCOPE("Frame");
+
+    // HUD shows the interval between frames and the calls of the previous frame
+    const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    m_hud.AddFrame(std::chrono::duration<double, std::milli>(frameStart - m_frameStart).count(), m_countingDevice.Counters());
+    m_frameStart = frameStart;
+    m_countingDevice.ResetCounters();
+
+    m_d3dDevice->BeginScene();
+    m_d3dDevice->Clear(0, NULL, D3DCLEAR_TARGET|D3DCLEAR_STENCIL| D3DCLEAR_ZBUFFER, 0x808080, 0, 0);
+
+    m_countingDevice.SetFVF(D3DFVF_XYZRHW|D3DFVF_DIFFUSE);
+    m_countingDevice.DrawPrimitiveUP(D3DPT_TRIANGLELIST, 1, triangleVertexSet, sizeof(VertexCoordinates));
+
+    if (m_hudBackend)
+    {
+        m_hud.Draw(*m_hudBackend);
+    }
+    m_d3dDevice->EndScene();
+    m_d3dDevice->Present(NULL, NULL, NULL, NULL);
+    ++m_frames;
+}
+
+ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance, LPCSTR windowClass)
 {
     WNDCLASSEX wcex;
 
@@ -159,37 +273,55 @@ ATOM ApplicationWindow::MyRegisterClass(HINSTANCE hInstance)
     wcex.hCursor		= LoadCursor(NULL, IDC_ARROW);
     wcex.hbrBackground	= NULL;
     wcex.lpszMenuName	= NULL;
-    wcex.lpszClassName	= ApplicationWindow::WindowClass();
+    wcex.lpszClassName	= windowClass;
     wcex.hIconSm		= LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
 
     return RegisterClassEx(&wcex);
 }
 
-BOOL ApplicationWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
+BOOL ApplicationWindow::InitInstance(LPCSTR windowClass, LPCSTR windowTitle, int nCmdShow)
 {
-    ApplicationWindow::SetInstanceHandle(hInstance);
+    CHAR title[MAX_LOADSTRING + 16] = {};
+    _snprintf_s(title, sizeof(title), _TRUNCATE, 0 == m_index ? "%s" : "%s #%u", windowTitle, m_index);
 
-    HWND handle = CreateWindow(ApplicationWindow::WindowClass(), 
-        ApplicationWindow::WindowTitle(), 
+    // Instance pointer reaches WndProc with WM_NCCREATE
+    HWND handle = CreateWindow(windowClass,
+        title,
         WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, 
-        800, 600, 
-        NULL, NULL, hInstance, NULL);
+        CW_USEDEFAULT, CW_USEDEFAULT,
+        800, 600,
+        NULL, NULL, m_hInst, this);
 
-    if (!handle) 
+    if (!handle)
     {
         return FALSE;
     }
 
-    ApplicationWindow::SetWindowHandle(handle);
+    m_hMainWnd = handle;
 
-    ShowWindow(ApplicationWindow::WindowHandle(), nCmdShow);
-    UpdateWindow(ApplicationWindow::WindowHandle());
+    ShowWindow(m_hMainWnd, nCmdShow);
+    UpdateWindow(m_hMainWnd);
 
     return TRUE;
 }
 
 LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (WM_NCCREATE == message)
+    {
+        CREATESTRUCT* createStruct = reinterpret_cast<CREATESTRUCT*>(lParam);
+        SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(createStruct->lpCreateParams));
+    }
+
+    ApplicationWindow* window = reinterpret_cast<ApplicationWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+    if (!window)
+    {
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return window->HandleMessage(hWnd, message, wParam, lParam);
+}
+
+LRESULT ApplicationWindow::HandleMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message)
     {
@@ -203,7 +335,14 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
             EndPaint(hWnd, &ps);
             break;
         }
+    case WM_KEYDOWN:
+        if ('H' == wParam)
+        {
+            m_hud.Toggle();
+        }
+        break;
     case WM_DESTROY:
+        m_hMainWnd = NULL;
         PostQuitMessage(0);
         break;
     default:
@@ -212,8 +351,10 @@ LRESULT CALLBACK ApplicationWindow::WndProc(HWND hWnd, UINT message, WPARAM wPar
     return 0;
 }
 
-BOOL ApplicationWindow::InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight)
+BOOL ApplicationWindow::InitD3D(int iWindowWidth, int iWindowHeight)
 {
+    TRACE_SCOPE("InitD3D");
+
     m_D3D = Direct3DCreate9(D3D_SDK_VERSION);
     if (NULL == m_D3D)
     {
@@ -232,7 +373,48 @@ BOOL ApplicationWindow::InitD3D(HWND hWnd, int iWindowWidth, int iWindowHeight)
     d3dpp.EnableAutoDepthStencil = TRUE;
     d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
 
-    HRESULT hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hWnd, D3DCREATE_HARDWARE_VERTEXPROCESSING, &d3dpp, &m_d3dDevice);
-    return !FAILED(hr);
-}
+    // Vertex processing is chosen from the caps, D3D_VERTEX_PROCESSING environment variable overrides it.
+    // Vertices of this sample are pre-transformed, so no vertex shader version is required
+    D3DCAPS9 caps;
+    HRESULT hr = m_D3D->GetDeviceCaps(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &caps);
+    if (FAILED(hr))
+    {
+        return FALSE;
+    }
+
+    CHAR vertexProcessingOverride[32] = {};
+    GetEnvironmentVariableA("D3D_VERTEX_PROCESSING", vertexProcessingOverride, sizeof(vertexProcessingOverride));
+    std::vector<VertexProcessingMode> candidates = VertexProcessingCandidates(caps.DevCaps, caps.VertexShaderVersion,
+        0, vertexProcessingOverride);
+    hr = D3DERR_NOTAVAILABLE;
+    for (size_t i = 0; i < candidates.size() && FAILED(hr); ++i)
+    {
+        TRACE_SCOPE("CreateDevice");
+        hr = m_D3D->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, m_hMainWnd, candidates[i], &d3dpp, &m_d3dDevice);
+        if (SUCCEEDED(hr))
+        {
+            char line[64] = {};
+            _snprintf_s(line, sizeof(line), _TRUNCATE, "%s vertex processing\n", VertexProcessingName(candidates[i]));
+            OutputDebugStringA(line);
+            m_hud.SetShaderNames(std::vector<std::string>(1, std::string("fixed function, ") + 
+                VertexProcessingName(candidates[i]) + " vertex processing"));
+        }
+    }
+    if (FAILED(hr))
+    {
+        return FALSE;
+    }
 
+    m_countingDevice.Attach(m_d3dDevice);
+
+    // Frames are drawn without the HUD if its texture can't be created
+    m_hudBackend = new D3D9HudBackend(m_d3dDevice);
+    if (FAILED(m_hudBackend->Init()))
+    {
+        OutputDebugStringA("Unable to create the HUD state block or font texture, the HUD is disabled\n");
+        delete m_hudBackend;
+        m_hudBackend = NULL;
+    }
+    m_frameStart = std::chrono::steady_clock::now();
+    return TRUE;
+}
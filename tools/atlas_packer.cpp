@@ -0,0 +1,95 @@
+// Offline texture atlas packer
+// Reads a list of Netpbm images, one file name per line, and writes the atlas layout table
+// and every composed page as "<layout>.<page>.pam", loaded at runtime with LoadAtlasLayout()
+// and AtlasPageFilename()
+
+#include "image_compare.h"
+#include "texture_atlas.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: atlas_packer <image list> <layout output> [page size = 2048] [mip levels = 4]\n");
+        return 1;
+    }
+
+    unsigned pageSize = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 2048;
+    unsigned mipLevels = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], NULL, 10)) : 4;
+
+    std::ifstream list(argv[1]);
+    if (!list)
+    {
+        printf("Unable to open %s\n", argv[1]);
+        return 1;
+    }
+
+    TextureAtlasPacker packer(pageSize, mipLevels);
+    std::vector<std::string> names;
+    std::vector<Image> images;
+    std::string name;
+    unsigned long long texels = 0;
+    while (list >> name)
+    {
+        Image image;
+        if (!LoadNetpbmImage(name, image))
+        {
+            printf("Unable to load %s\n", name.c_str());
+            return 1;
+        }
+        if (~0u == packer.Add(image.width, image.height))
+        {
+            printf("Skip %s: %ux%u does not fit into %u page\n", name.c_str(), image.width, image.height, pageSize);
+            continue;
+        }
+        names.push_back(name);
+        texels += static_cast<unsigned long long>(image.width) * image.height;
+        images.push_back(image);
+    }
+
+    AtlasLayout layout = packer.Pack();
+    if (!SaveAtlasLayout(layout, names, argv[2]))
+    {
+        printf("Unable to write %s\n", argv[2]);
+        return 1;
+    }
+
+    // Texels are BGRA bytes, composed as 32-bit values and written back unchanged
+    std::vector<std::vector<uint32_t> > pages(layout.pageCount, std::vector<uint32_t>(static_cast<size_t>(pageSize) * pageSize, 0));
+    std::vector<uint32_t> texture;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        texture.resize(static_cast<size_t>(images[i].width) * images[i].height);
+        memcpy(texture.data(), images[i].pixels.data(), texture.size() * sizeof(uint32_t));
+        ComposeAtlasRegion(layout, static_cast<unsigned>(i), texture.data(), pages[layout.regions[i].atlas].data());
+    }
+
+    for (unsigned page = 0; page < layout.pageCount; ++page)
+    {
+        Image pageImage;
+        pageImage.width = pageSize;
+        pageImage.height = pageSize;
+        pageImage.pixels.resize(pages[page].size() * sizeof(uint32_t));
+        memcpy(pageImage.pixels.data(), pages[page].data(), pageImage.pixels.size());
+
+        const std::string pageFile = AtlasPageFilename(argv[2], page);
+        if (!SaveNetpbmImage(pageFile, pageImage, true))
+        {
+            printf("Unable to write %s\n", pageFile.c_str());
+            return 1;
+        }
+    }
+
+    double pageTexels = static_cast<double>(pageSize) * pageSize * layout.pageCount;
+    printf("%u textures packed into %u pages of %ux%u, occupancy %.1f%%\n",
+        static_cast<unsigned>(names.size()), layout.pageCount, pageSize, pageSize,
+        pageTexels > 0 ? 100.0 * texels / pageTexels : 0.0);
+    return 0;
+}
@@ -0,0 +1,290 @@
+// Runs many independent rendering instances concurrently in one process
+// Every instance owns a null device and its own scene, transformed either by the
+// software vertex pipeline or submitted pre-transformed. One instance is run first
+// as the baseline, then all instances on their own threads, and the throughput
+// scaling is reported. GPU time of the passes of every instance is measured with timestamp
+// queries emulated by its device. Per-instance results are optionally written to separate files
+
+#include "deterministic_random.h"
+#include "gpu_profiler.h"
+#include "instance_runner.h"
+#include "mesh.h"
+#include "null_device.h"
+#include "software_vertex.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+
+enum Backend
+{
+    BACKEND_SOFTWARE,
+    BACKEND_NULL
+};
+
+/// @brief Rotating cloud of random triangles, different for every instance
+class SceneInstance : public RenderInstance
+{
+public:
+
+    SceneInstance(unsigned instance, Backend backend, unsigned triangleCount)
+        : m_instance(instance)
+        , m_backend(backend)
+        , m_triangleCount(triangleCount)
+        , m_queries(m_device)
+        , m_profiler(m_queries)
+        , m_visibleTriangles(0)
+        , m_gpuMilliseconds(0.0)
+        , m_gpuFrames(0)
+    {
+    }
+
+    virtual bool Init()
+    {
+        unsigned seed = 12345 + m_instance * 7919;
+        m_mesh.vertices.resize(m_triangleCount * 3);
+        m_mesh.indices.resize(m_triangleCount * 3);
+        for (size_t i = 0; i < m_mesh.vertices.size(); ++i)
+        {
+            MeshVertex& vertex = m_mesh.vertices[i];
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                vertex.position[c] = (NextRandom(seed) % 4000) / 1000.0f - 2.0f;
+                vertex.normal[c] = 0.0f;
+            }
+            vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
+            m_mesh.indices[i] = static_cast<uint32_t>(i);
+        }
+
+        // Null backend instances submit the first frame transformed once
+        float world[16];
+        MakeRotationY(0.0f, world);
+        float viewProjection[16];
+        MakeViewProjection(viewProjection);
+        m_pipeline.SetTransform(world, viewProjection);
+        m_pipeline.SetViewport(VIEWPORT);
+        m_pipeline.Process(m_mesh.vertices[0].position, sizeof(MeshVertex), NULL, 0, NULL, 0, m_mesh.vertices.size());
+        m_pipeline.CullTriangles(m_mesh.indices.data(), m_mesh.indices.size(), m_visible);
+        return true;
+    }
+
+    virtual bool RenderFrame(unsigned frame)
+    {
+        if (BACKEND_SOFTWARE == m_backend)
+        {
+            float world[16];
+            MakeRotationY(0.01f * frame * (1 + m_instance % 3), world);
+            float viewProjection[16];
+            MakeViewProjection(viewProjection);
+            m_pipeline.SetTransform(world, viewProjection);
+            m_pipeline.Process(m_mesh.vertices[0].position, sizeof(MeshVertex), NULL, 0, NULL, 0, m_mesh.vertices.size());
+            m_pipeline.CullTriangles(m_mesh.indices.data(), m_mesh.indices.size(), m_visible);
+        }
+
+        m_profiler.BeginFrame();
+        m_device.BeginScene();
+        m_profiler.BeginPass("clear");
+        m_device.Clear(0xff808080, 1.0f, 0);
+        m_profiler.EndPass();
+        m_profiler.BeginPass("scene");
+        m_device.SetFVF(TRANSFORMED_VERTEX_FVF);
+
+        // 16-bit indices, so the visible triangles are gathered in chunks
+        const std::vector<TransformedVertex>& vertices = m_pipeline.Vertices();
+        for (size_t first = 0; first < m_visible.size(); first += CHUNK_INDICES)
+        {
+            const size_t last = std::min(m_visible.size(), first + CHUNK_INDICES);
+            m_chunk.clear();
+            m_chunkVertices.clear();
+            for (size_t i = first; i < last; ++i)
+            {
+                m_chunk.push_back(static_cast<uint16_t>(m_chunkVertices.size()));
+                m_chunkVertices.push_back(vertices[m_visible[i]]);
+            }
+            m_device.DrawIndexedPrimitiveUP(NULL_PT_TRIANGLELIST, 0, static_cast<unsigned>(m_chunkVertices.size()),
+                static_cast<unsigned>(m_chunk.size() / 3), m_chunk.data(), m_chunkVertices.data(), sizeof(TransformedVertex));
+        }
+
+        m_profiler.EndPass();
+        m_device.EndScene();
+        m_profiler.EndFrame();
+        m_device.Present();
+
+        // Emulated GPU time depends only on the scene, so it is part of the compared output
+        GpuFrameTiming timing;
+        while (m_profiler.PopFrame(timing))
+        {
+            m_gpuMilliseconds += timing.gpuMilliseconds;
+            ++m_gpuFrames;
+        }
+
+        m_visibleTriangles = static_cast<unsigned>(m_visible.size() / 3);
+        return true;
+    }
+
+    virtual DeviceCounters Counters() const
+    {
+        return m_device.Counters();
+    }
+
+    virtual std::string Output() const
+    {
+        char line[192] = {};
+        snprintf(line, sizeof(line), "%u visible triangles, last frame checksum %08x, gpu %.3f ms per frame in %u frames",
+            m_visibleTriangles, Checksum(m_pipeline.Vertices()), m_gpuFrames ? m_gpuMilliseconds / m_gpuFrames : 0.0, m_gpuFrames);
+        return line;
+    }
+
+private:
+
+    static const size_t CHUNK_INDICES = 3 * 20000;
+    static const ScreenViewport VIEWPORT;
+
+    /// @brief FNV-1a of the screen positions, equal for equal scenes regardless of threading
+    static uint32_t Checksum(const std::vector<TransformedVertex>& vertices)
+    {
+        uint32_t hash = 2166136261u;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(vertices.data());
+        for (size_t i = 0; i < vertices.size() * sizeof(TransformedVertex); ++i)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static void MakeRotationY(float angle, float matrix[16])
+    {
+        const float c = cosf(angle), s = sinf(angle);
+        const float rotation[16] = { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1 };
+        std::copy(rotation, rotation + 16, matrix);
+    }
+
+    /// @brief Perspective projection with the eye at (0, 0, -3) looking at the origin
+    static void MakeViewProjection(float matrix[16])
+    {
+        const float zn = 0.01f, zf = 20.0f;
+        const float yScale = 1.0f / tanf(3.14159265f / 6);
+        const float q = zf / (zf - zn);
+        const float viewProjection[16] =
+        {
+            yScale * 600 / 800, 0, 0, 0,
+            0, yScale, 0, 0,
+            0, 0, q, 1,
+            0, 0, 3 * q - zn * q, 3
+        };
+        std::copy(viewProjection, viewProjection + 16, matrix);
+    }
+
+    unsigned m_instance;
+    Backend m_backend;
+    unsigned m_triangleCount;
+
+    NullDevice m_device;
+    NullGpuQueries m_queries;
+    GpuProfiler m_profiler;
+    SoftwareVertexPipeline m_pipeline;
+    Mesh m_mesh;
+
+    std::vector<uint32_t> m_visible;
+    std::vector<uint16_t> m_chunk;
+    std::vector<TransformedVertex> m_chunkVertices;
+
+    unsigned m_visibleTriangles;
+    double m_gpuMilliseconds;
+    unsigned m_gpuFrames;
+};
+
+const ScreenViewport SceneInstance::VIEWPORT = { 0, 0, 800, 600, 0.0f, 1.0f };
+
+/// @brief Instances per second of wall time, the slowest instance defines the wall time
+double Throughput(const std::vector<InstanceResult>& results)
+{
+    double wall = 0.0;
+    unsigned frames = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        wall = std::max(wall, results[i].milliseconds);
+        frames += results[i].frames;
+    }
+    return wall > 0 ? frames * 1000.0 / wall : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned instanceCount = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : std::thread::hardware_concurrency();
+    unsigned frames = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 200;
+    const char* backendName = argc > 3 ? argv[3] : "software";
+    const char* outputPrefix = argc > 4 ? argv[4] : NULL;
+    const unsigned triangleCount = 20000;
+
+    // Frames of every instance are traced when built with D3D_TRACE
+    TRACE_START("device_farm_trace.json", "device_farm");
+
+    Backend backend = BACKEND_SOFTWARE;
+    if (0 == strcmp(backendName, "null"))
+    {
+        backend = BACKEND_NULL;
+    }
+    else if (0 != strcmp(backendName, "software"))
+    {
+        instanceCount = 0;
+    }
+    if (0 == instanceCount || 0 == frames)
+    {
+        printf("Usage: device_farm [instances = hardware threads] [frames = 200] [software|null] [result file prefix]\n");
+        return 1;
+    }
+
+    RenderInstanceFactory factory = [backend, triangleCount](unsigned instance)
+    {
+        return std::unique_ptr<RenderInstance>(new SceneInstance(instance, backend, triangleCount));
+    };
+
+    std::vector<InstanceResult> baseline = RunInstances(factory, 1, frames);
+    std::vector<InstanceResult> results = RunInstances(factory, instanceCount, frames);
+
+    bool succeeded = baseline[0].succeeded;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const std::string line = FormatInstanceResult(results[i]);
+        printf("%s\n", line.c_str());
+        succeeded = succeeded && results[i].succeeded;
+
+        if (outputPrefix)
+        {
+            char filename[1024] = {};
+            snprintf(filename, sizeof(filename), "%s%u.txt", outputPrefix, results[i].instance);
+            FILE* file = fopen(filename, "w");
+            if (!file)
+            {
+                printf("Unable to write %s\n", filename);
+                return 1;
+            }
+            fprintf(file, "%s\n", line.c_str());
+            fclose(file);
+        }
+    }
+
+    // Instance 0 renders the same scene alone and together with the others
+    if (baseline[0].output != results[0].output)
+    {
+        printf("instance 0 output differs from the single instance run\n");
+        succeeded = false;
+    }
+
+    const double single = Throughput(baseline);
+    const double all = Throughput(results);
+    printf("%s backend, %u triangles per scene, %u hardware threads\n", backendName, triangleCount, std::thread::hardware_concurrency());
+    printf("1 instance: %.1f frames/s, %u instances: %.1f frames/s, scaling %.2fx\n",
+        single, instanceCount, all, single > 0 ? all / single : 0.0);
+    return succeeded ? 0 : 1;
+}
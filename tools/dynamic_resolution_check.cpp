@@ -0,0 +1,192 @@
+// Runs a scene of changing load on the null backend with dynamic resolution scaling
+// The scene renders into an intermediate target at the resolution chosen by the controller,
+// then a single pass upscales it to the back buffer. The emulated GPU charges every pixel
+// shaded, so GPU time follows the resolution. The load changes in phases with per-frame noise:
+// within a phase the scale must not go down after it went up and must settle by the last quarter,
+// where the frame must fit the budget unless the scale is at its minimum and the resolution
+// must not be lower than the budget allows. Prints the log of the scale over time.
+// Exits with 1 on failure
+
+#include "deterministic_random.h"
+#include "dynamic_resolution.h"
+#include "gpu_profiler.h"
+#include "null_device.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+/// D3DFORMAT value
+const uint32_t FORMAT_A8R8G8B8 = 21;
+
+const unsigned BACK_BUFFER_WIDTH = 1280;
+const unsigned BACK_BUFFER_HEIGHT = 720;
+
+/// Full-screen draws of the scene in every phase, the scene costs about 0.9 ms per draw at full resolution
+const unsigned PHASE_DRAWS[] = { 8, 30, 8, 80, 20, 8 };
+
+struct PhaseResult
+{
+    unsigned draws;
+    float scale;
+    double gpuMilliseconds;
+
+    /// Changes in the last quarter of the phase
+    unsigned lateChanges;
+
+    unsigned decreases;
+    unsigned increases;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned phaseFrames = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 300;
+    const double budget = argc > 2 ? strtod(argv[2], NULL) : 16.7;
+    const unsigned pixelPs = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 1000;
+    if (phaseFrames < 200 || budget <= 0.0 || 0 == pixelPs)
+    {
+        printf("Usage: dynamic_resolution_check [frames per phase = 300, at least 200] [budget ms = 16.7] [pixel cost ps = 1000]\n");
+        return 1;
+    }
+
+    NullDevice device;
+    device.SetBackBufferSize(BACK_BUFFER_WIDTH, BACK_BUFFER_HEIGHT);
+    device.SetGpuPixelCost(pixelPs);
+    NullGpuQueries queries(device);
+    GpuProfiler profiler(queries);
+
+    const DynamicResolutionSettings settings = DefaultDynamicResolutionSettings(budget);
+    DynamicResolutionController controller(settings, BACK_BUFFER_WIDTH, BACK_BUFFER_HEIGHT);
+
+    // Intermediate target at the largest scale, smaller resolutions use part of it
+    const void* intermediate = device.CreateRenderTarget(static_cast<unsigned>(BACK_BUFFER_WIDTH * settings.maxScale + 0.5f),
+        static_cast<unsigned>(BACK_BUFFER_HEIGHT * settings.maxScale + 0.5f), FORMAT_A8R8G8B8, 32);
+
+    static const float quad[] = { -1, -1, 0.5f, 1,  -1, 1, 0.5f, 1,  1, -1, 0.5f, 1,  1, 1, 0.5f, 1 };
+    const unsigned phaseCount = sizeof(PHASE_DRAWS) / sizeof(PHASE_DRAWS[0]);
+    const unsigned frames = phaseCount * phaseFrames;
+
+    // GPU time and scale of every frame, by frame number
+    std::vector<double> gpuMilliseconds(frames, -1.0);
+    std::vector<float> scales(frames, 0.0f);
+
+    unsigned seed = 12345;
+    for (unsigned frame = 0; frame < frames; ++frame)
+    {
+        controller.Update(frame);
+        scales[frame] = controller.Scale();
+
+        // Noise of up to 10% of the load, around the phase average
+        const unsigned phaseDraws = PHASE_DRAWS[frame / phaseFrames];
+        const unsigned noise = phaseDraws / 10;
+        const unsigned draws = phaseDraws - noise + NextRandom(seed) % (2 * noise + 1);
+
+        profiler.BeginFrame();
+        device.BeginScene();
+
+        profiler.BeginPass("scene");
+        device.SetRenderTarget(0, intermediate);
+        device.SetViewport(0, 0, controller.RenderWidth(), controller.RenderHeight());
+        device.Clear(0xff808080, 1.0f, 0);
+        for (unsigned i = 0; i < draws; ++i)
+        {
+            device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, quad, 4 * sizeof(float));
+        }
+        profiler.EndPass();
+
+        profiler.BeginPass("upscale");
+        device.SetRenderTarget(0, device.BackBuffer());
+        device.SetTexture(0, intermediate);
+        device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, quad, 4 * sizeof(float));
+        device.SetTexture(0, NULL);
+        profiler.EndPass();
+
+        device.EndScene();
+        profiler.EndFrame();
+        device.Present();
+
+        GpuFrameTiming timing;
+        while (profiler.PopFrame(timing))
+        {
+            gpuMilliseconds[timing.frame] = timing.gpuMilliseconds;
+            controller.AddFrameTime(timing.frame, timing.gpuMilliseconds);
+        }
+    }
+    device.ReleaseRenderTarget(intermediate);
+
+    const std::vector<DynamicResolutionChange>& log = controller.Log();
+    printf("%ux%u back buffer, budget %.1f ms, scale %.2f to %.2f, %u frames per phase\n",
+        BACK_BUFFER_WIDTH, BACK_BUFFER_HEIGHT, budget, settings.minScale, settings.maxScale, phaseFrames);
+    printf("%s", FormatDynamicResolutionLog(log).c_str());
+
+    // Last quarter of every phase: settled scale, within the budget and without headroom left
+    bool succeeded = true;
+    for (unsigned p = 0; p < phaseCount; ++p)
+    {
+        const unsigned first = p * phaseFrames + phaseFrames * 3 / 4, last = (p + 1) * phaseFrames;
+        PhaseResult result = { PHASE_DRAWS[p], scales[last - 1], 0.0, 0, 0, 0 };
+        unsigned measured = 0;
+        for (unsigned frame = first; frame < last; ++frame)
+        {
+            if (gpuMilliseconds[frame] >= 0.0)
+            {
+                result.gpuMilliseconds += gpuMilliseconds[frame];
+                ++measured;
+            }
+            if (frame > first && scales[frame] != scales[frame - 1])
+            {
+                ++result.lateChanges;
+            }
+        }
+        result.gpuMilliseconds = measured ? result.gpuMilliseconds / measured : 0.0;
+
+        // Hysteresis: once the scale went up under a load it must not have to go down again
+        bool oscillates = false;
+        for (size_t i = 1; i < log.size(); ++i)
+        {
+            if (log[i].frame / phaseFrames == p)
+            {
+                const bool decrease = log[i].scale < log[i - 1].scale;
+                oscillates = oscillates || (decrease && result.increases);
+                ++(decrease ? result.decreases : result.increases);
+            }
+        }
+        printf("phase %u: %u draws, scale %.2f, gpu %.3f ms, %u decreases, %u increases\n",
+            p, result.draws, result.scale, result.gpuMilliseconds, result.decreases, result.increases);
+
+        if (result.lateChanges)
+        {
+            printf("phase %u: scale did not settle\n", p);
+            succeeded = false;
+        }
+        if (oscillates)
+        {
+            printf("phase %u: scale oscillates\n", p);
+            succeeded = false;
+        }
+        if (result.scale > settings.minScale && result.gpuMilliseconds > budget * settings.decreaseThreshold)
+        {
+            printf("phase %u: frame time over the budget above the minimum scale\n", p);
+            succeeded = false;
+        }
+
+        // Below the maximum the next step must be predicted to leave the middle of the band
+        const float next = std::min(result.scale + settings.scaleStep, settings.maxScale);
+        const double nextMilliseconds = result.gpuMilliseconds * (next / result.scale) * (next / result.scale);
+        if (result.scale < settings.maxScale && result.gpuMilliseconds < budget * settings.increaseThreshold &&
+            nextMilliseconds < budget * (settings.increaseThreshold + settings.decreaseThreshold) / 2)
+        {
+            printf("phase %u: resolution kept lower than the budget allows\n", p);
+            succeeded = false;
+        }
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// Runs frames with profiled passes on the null device and validates the GPU timings
+// The emulated GPU advances its clock by a known cost of every command, so pass times
+// must match the cost of their draws. Frames must be read back asynchronously after the
+// emulated GPU latency, frames whose results are late must be dropped instead of waited
+// for, and frames with a disjoint clock must be discarded. Exits with 1 on failure
+
+#include "gpu_profiler.h"
+#include "null_device.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+const unsigned DRAW_NS = 3000;
+const unsigned VERTEX_NS = 5;
+const unsigned CLEAR_NS = 40000;
+
+/// @brief Device without timestamp queries
+class UnsupportedQueries : public GpuQueryBackend
+{
+public:
+
+    virtual void* CreateQuery(GpuQueryType) { return NULL; }
+    virtual void ReleaseQuery(void*) {}
+    virtual void IssueBegin(void*) {}
+    virtual void IssueEnd(void*) {}
+    virtual GpuQueryStatus GetData(void*, uint64_t&) { return GPU_QUERY_FAILED; }
+};
+
+struct RunResult
+{
+    std::vector<GpuFrameTiming> frames;
+    GpuProfilerStats stats;
+};
+
+/// @brief Clear pass, then scene pass with a nested shadow pass; frame 0 draws once, every next frame one more time
+RunResult Run(NullDevice& device, GpuQueryBackend& queries, unsigned profilerLatency, unsigned frames, unsigned disjointFrame)
+{
+    static const float triangle[] = { -1, -1, 0.5f, 1,  0, 1, 0.5f, 1,  1, -1, 0.5f, 1 };
+
+    RunResult result;
+    GpuProfiler profiler(queries, profilerLatency);
+    for (unsigned frame = 0; frame < frames; ++frame)
+    {
+        profiler.BeginFrame();
+        device.BeginScene();
+
+        profiler.BeginPass("clear");
+        device.Clear(0xff000000, 1.0f, 0);
+        profiler.EndPass();
+
+        profiler.BeginPass("scene");
+        profiler.BeginPass("shadow");
+        device.DrawPrimitiveUP(NULL_PT_TRIANGLELIST, 1, triangle, 4 * sizeof(float));
+        profiler.EndPass();
+        if (frame == disjointFrame)
+        {
+            device.SimulateGpuDisjoint();
+        }
+        for (unsigned i = 0; i <= frame % 8; ++i)
+        {
+            device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, triangle, 4 * sizeof(float));
+        }
+        profiler.EndPass();
+
+        device.EndScene();
+        profiler.EndFrame();
+        device.Present();
+
+        GpuFrameTiming timing;
+        while (profiler.PopFrame(timing))
+        {
+            result.frames.push_back(timing);
+        }
+    }
+    result.stats = profiler.Stats();
+    return result;
+}
+
+bool Near(double milliseconds, uint64_t expectedNs)
+{
+    // Timestamps are truncated to whole ticks
+    const double tick = 1000.0 / NullDevice::GPU_FREQUENCY;
+    return fabs(milliseconds - expectedNs / 1000000.0) <= 2 * tick;
+}
+
+/// @brief Timings must match the cost model, every frame once, in order
+bool ValidateTimings(const RunResult& result, unsigned expectedLatency, unsigned skippedFrame)
+{
+    bool succeeded = true;
+    unsigned previous = 0;
+    for (size_t i = 0; i < result.frames.size(); ++i)
+    {
+        const GpuFrameTiming& timing = result.frames[i];
+        if ((i > 0 && timing.frame <= previous) || timing.frame == skippedFrame)
+        {
+            printf("frame %u reported out of order or despite a disjoint clock\n", timing.frame);
+            succeeded = false;
+        }
+        previous = timing.frame;
+
+        const uint64_t shadowNs = DRAW_NS + 3 * VERTEX_NS;
+        const uint64_t sceneNs = shadowNs + (timing.frame % 8 + 1) * (DRAW_NS + 4 * VERTEX_NS);
+        if (3 != timing.passes.size() || timing.readbackLatency != expectedLatency ||
+            !Near(timing.passes[0].gpuMilliseconds, CLEAR_NS) || !Near(timing.passes[1].gpuMilliseconds, sceneNs) ||
+            !Near(timing.passes[2].gpuMilliseconds, shadowNs) || 1 != timing.passes[2].depth ||
+            !Near(timing.gpuMilliseconds, CLEAR_NS + sceneNs))
+        {
+            printf("unexpected timing, %s\n", FormatGpuFrameTiming(timing).c_str());
+            succeeded = false;
+        }
+    }
+    return succeeded;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned frames = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 64;
+    const unsigned gpuLatency = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 3;
+    if (frames < 16 || 0 == gpuLatency)
+    {
+        printf("Usage: gpu_profiler_check [frames = 64, at least 16] [emulated GPU latency = 3]\n");
+        return 1;
+    }
+
+    bool succeeded = true;
+
+    // Ring deep enough for the GPU latency: every frame is read back once the GPU is done with it
+    {
+        NullDevice device;
+        NullGpuQueries queries(device);
+        device.SetGpuCost(DRAW_NS, VERTEX_NS, CLEAR_NS);
+        device.SetGpuLatency(gpuLatency);
+        const unsigned disjointFrame = frames / 2;
+        RunResult result = Run(device, queries, gpuLatency + 1, frames, disjointFrame);
+
+        for (size_t i = 0; i < result.frames.size() && i < 4; ++i)
+        {
+            printf("%s\n", FormatGpuFrameTiming(result.frames[i]).c_str());
+        }
+        printf("%u frames issued, %u resolved, %u disjoint, %u dropped, %u queries, %u query issues\n",
+            result.stats.framesIssued, result.stats.framesResolved, result.stats.framesDisjoint,
+            result.stats.framesDropped, result.stats.queriesCreated, device.Counters().queryIssues);
+
+        // Frames of the last gpuLatency - 1 presents are still in flight
+        succeeded = ValidateTimings(result, gpuLatency - 1, disjointFrame) && succeeded;
+        if (result.stats.framesResolved != frames - gpuLatency || 1 != result.stats.framesDisjoint ||
+            0 != result.stats.framesDropped || result.frames.size() != result.stats.framesResolved)
+        {
+            printf("expected %u resolved frames, 1 disjoint and none dropped\n", frames - gpuLatency);
+            succeeded = false;
+        }
+    }
+
+    // Ring too short for the GPU latency: late frames are dropped, the profiler never waits
+    {
+        NullDevice device;
+        NullGpuQueries queries(device);
+        device.SetGpuLatency(gpuLatency + 2);
+        RunResult result = Run(device, queries, gpuLatency, frames, frames);
+        printf("ring of %u frames, GPU %u frames behind: %u resolved, %u dropped\n",
+            gpuLatency, gpuLatency + 2, result.stats.framesResolved, result.stats.framesDropped);
+        if (0 != result.stats.framesResolved || frames - gpuLatency != result.stats.framesDropped)
+        {
+            printf("expected every frame whose slot was reused to be dropped\n");
+            succeeded = false;
+        }
+    }
+
+    // Without timestamp queries frames are still reported with their CPU time
+    {
+        NullDevice device;
+        UnsupportedQueries queries;
+        RunResult result = Run(device, queries, 2, frames, frames);
+        if (result.frames.size() != frames || result.frames.back().gpuMilliseconds != 0.0)
+        {
+            printf("expected CPU timings of all frames without timestamp queries\n");
+            succeeded = false;
+        }
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
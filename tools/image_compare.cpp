@@ -0,0 +1,131 @@
+// Compares rendered images, e.g. dumps of the same shader taken on different hosts
+// A pair is given on the command line, or a list file holds one "reference test" pair per line.
+// Images are binary Netpbm files (P6 or P7 RGB_ALPHA). The tolerance is one value for every
+// channel or four comma separated values for B, G, R and A. Tolerance 255 accepts any difference
+// of a channel, which still counts in the different pixels, MSE and PSNR; --ignore-alpha leaves
+// alpha out of every statistic, for dumps of X8R8G8B8 targets whose alpha is undefined.
+// Prints the differences of every pair that is not identical, PSNR and SSIM included, and
+// optionally writes the heatmap of a single pair. Exits with 1 if a pair is over the tolerance
+
+#include "image_compare.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// @brief "2" or "2,2,2,255"
+bool ParseTolerance(const char* text, uint8_t tolerance[4])
+{
+    unsigned values[4] = {};
+    const int count = sscanf(text, "%u,%u,%u,%u", &values[0], &values[1], &values[2], &values[3]);
+    if (1 != count && 4 != count)
+    {
+        return false;
+    }
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        const unsigned value = values[1 == count ? 0 : c];
+        if (value > 255)
+        {
+            return false;
+        }
+        tolerance[c] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // --ignore-alpha is accepted anywhere, the other arguments are positional
+    ImageCompareSettings settings = DefaultImageCompareSettings();
+    std::vector<char*> arguments;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (i > 0 && std::string("--ignore-alpha") == argv[i])
+        {
+            settings.compareAlpha = false;
+            continue;
+        }
+        arguments.push_back(argv[i]);
+    }
+    argc = static_cast<int>(arguments.size());
+    argv = arguments.data();
+
+    const bool list = argc > 2 && std::string("--list") == argv[1];
+    if (argc < 3 || (argc > 3 && !ParseTolerance(argv[3], settings.tolerance)))
+    {
+        printf("Usage: image_compare [--ignore-alpha] <reference> <test> [tolerance = 0] [heatmap output]\n"
+               "       image_compare [--ignore-alpha] --list <pairs file> [tolerance = 0] [threads = 0]\n");
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string> > pairs;
+    if (list)
+    {
+        std::ifstream file(argv[2]);
+        if (!file)
+        {
+            printf("Unable to open %s\n", argv[2]);
+            return 1;
+        }
+        std::string reference, test;
+        while (file >> reference >> test)
+        {
+            pairs.push_back(std::make_pair(reference, test));
+        }
+    }
+    else
+    {
+        pairs.push_back(std::make_pair(std::string(argv[1]), std::string(argv[2])));
+    }
+    const unsigned threads = list && argc > 4 ? static_cast<unsigned>(strtoul(argv[4], NULL, 10)) : 0;
+    const char* heatmapFile = !list && argc > 4 ? argv[4] : NULL;
+
+    ImageComparer comparer(threads);
+    Image reference, test, heatmap;
+    unsigned failed = 0, different = 0;
+    double loadMilliseconds = 0.0, compareMilliseconds = 0.0;
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool loaded = LoadNetpbmImage(pairs[i].first, reference) && LoadNetpbmImage(pairs[i].second, test);
+        std::chrono::steady_clock::time_point loadEnd = std::chrono::steady_clock::now();
+        loadMilliseconds += std::chrono::duration<double, std::milli>(loadEnd - start).count();
+        if (!loaded)
+        {
+            printf("%s %s: unable to load\n", pairs[i].first.c_str(), pairs[i].second.c_str());
+            ++failed;
+            continue;
+        }
+
+        const ImageCompareResult result = comparer.Compare(MakeImageView(reference), MakeImageView(test), settings,
+            heatmapFile ? &heatmap : NULL);
+        compareMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadEnd).count();
+        different += !result.identical;
+        failed += !result.sizeMatches || result.failedPixels;
+        if (!result.identical || !list)
+        {
+            printf("%s %s: %s\n", pairs[i].first.c_str(), pairs[i].second.c_str(), FormatImageCompareResult(result).c_str());
+        }
+    }
+
+    if (heatmapFile && !heatmap.pixels.empty() && !SaveNetpbmImage(heatmapFile, heatmap))
+    {
+        printf("Unable to write %s\n", heatmapFile);
+        return 1;
+    }
+    if (list)
+    {
+        printf("%u pairs, %u different, %u over tolerance, load %.1f ms, compare %.1f ms\n",
+            static_cast<unsigned>(pairs.size()), different, failed, loadMilliseconds, compareMilliseconds);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+// Mesh converter and post-transform vertex cache report
+// Loads OBJ or binary mesh, optimizes it for vertex cache and fetch locality,
+// reports ACMR/ATVR before and after, memory and quantization error
+// of the compact vertex format, and optionally saves the binary mesh
+
+#include "mesh.h"
+#include "vertex_cache.h"
+#include "vertex_format.h"
+
+#include <cstdio>
+
+namespace
+{
+
+void PrintCacheReport(const char* title, const Mesh& mesh)
+{
+    static const unsigned CACHE_SIZES[] = { 8, 16, 24, 32 };
+
+    printf("%s: %u vertices, %u triangles\n", title,
+        static_cast<unsigned>(mesh.vertices.size()), static_cast<unsigned>(mesh.TriangleCount()));
+    printf("  %-6s %6s %8s %8s %12s\n", "cache", "size", "ACMR", "ATVR", "transforms");
+    for (size_t model = VERTEX_CACHE_FIFO; model <= VERTEX_CACHE_LRU; ++model)
+    {
+        for (size_t i = 0; i < sizeof(CACHE_SIZES) / sizeof(CACHE_SIZES[0]); ++i)
+        {
+            VertexCacheStats stats = SimulateVertexCache(mesh.indices, mesh.vertices.size(),
+                static_cast<VertexCacheModel>(model), CACHE_SIZES[i]);
+            printf("  %-6s %6u %8.3f %8.3f %12u\n", VERTEX_CACHE_FIFO == model ? "FIFO" : "LRU",
+                CACHE_SIZES[i], stats.acmr, stats.atvr, static_cast<unsigned>(stats.transforms));
+        }
+    }
+}
+
+void PrintCompactFormatReport(const Mesh& mesh)
+{
+    static const char* ELEMENT_NAMES[] = { "POSITION FLOAT16_4", "NORMAL DEC3N", "TEXCOORD SHORT2N" };
+
+    VertexLayout layout;
+    layout.Add(VET_FLOAT16_4, VEU_POSITION);
+    layout.Add(VET_DEC3N, VEU_NORMAL);
+    layout.Add(VET_SHORT2N, VEU_TEXCOORD);
+
+    std::vector<uint8_t> vertices;
+    std::vector<QuantizationError> errors;
+    EncodeMeshVertices(mesh, layout, vertices, &errors);
+
+    const size_t floatBytes = mesh.vertices.size() * sizeof(MeshVertex);
+    printf("compact vertices: %u bytes per vertex instead of %u, %u bytes instead of %u, %.2fx smaller\n",
+        layout.Stride(), static_cast<unsigned>(sizeof(MeshVertex)),
+        static_cast<unsigned>(vertices.size()), static_cast<unsigned>(floatBytes),
+        vertices.empty() ? 0.0 : static_cast<double>(floatBytes) / vertices.size());
+    for (size_t i = 0; i < errors.size(); ++i)
+    {
+        printf("  %-20s max error %.6g, bound %.6g\n", ELEMENT_NAMES[i], errors[i].maxError, errors[i].boundError);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: mesh_tool <input .obj or .mesh> [optimized .mesh output]\n");
+        return 1;
+    }
+
+    Mesh mesh;
+    if (!LoadMesh(argv[1], mesh))
+    {
+        printf("Unable to load %s\n", argv[1]);
+        return 1;
+    }
+
+    PrintCacheReport("source", mesh);
+
+    OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+    OptimizeVertexFetch(mesh);
+
+    PrintCacheReport("optimized", mesh);
+    PrintCompactFormatReport(mesh);
+
+    if (argc > 2 && !SaveBinaryMesh(argv[2], mesh))
+    {
+        printf("Unable to write %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
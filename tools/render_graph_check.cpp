@@ -0,0 +1,287 @@
+// Builds the post-processing frame as a render graph and runs it on the null backend
+// Prints the culled passes, the surface of every transient target and the target memory
+// with and without aliasing. Execution is validated: every read must find on its surface
+// the content the target was last written with, and no pass may write the surface it reads,
+// so aliased targets whose lifetimes overlap are detected. Exits with 1 on validation failure
+
+#include "null_device.h"
+#include "render_graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// D3DFORMAT values
+const uint32_t FORMAT_A8R8G8B8 = 21;
+const uint32_t FORMAT_D24S8 = 75;
+const uint32_t FORMAT_A16B16G16R16F = 113;
+const uint32_t FORMAT_R32F = 114;
+
+RenderTargetDesc MakeDesc(unsigned width, unsigned height, uint32_t format, unsigned bitsPerPixel)
+{
+    RenderTargetDesc desc = { width, height, format, bitsPerPixel };
+    return desc;
+}
+
+/// @brief Render targets of the null device
+class NullTargetBackend : public RenderTargetBackend
+{
+public:
+
+    explicit NullTargetBackend(NullDevice& device) : m_device(device) {}
+
+    virtual void* CreateTarget(const RenderTargetDesc& desc)
+    {
+        return const_cast<void*>(m_device.CreateRenderTarget(desc.width, desc.height, desc.format, desc.bitsPerPixel));
+    }
+
+    virtual void ReleaseTarget(void* target)
+    {
+        m_device.ReleaseRenderTarget(target);
+    }
+
+private:
+
+    NullDevice& m_device;
+};
+
+/// @brief Tracks which target the content of every surface belongs to
+class ContentValidator
+{
+public:
+
+    ContentValidator(const RenderGraph& graph) : m_graph(graph), m_failures(0) {}
+
+    void Read(const RenderPassContext& context, RenderResourceId resource)
+    {
+        std::map<void*, RenderResourceId>::const_iterator owner = m_owners.find(context.Target(resource));
+        if (owner == m_owners.end() || owner->second != resource)
+        {
+            printf("pass %s reads %s, but its surface holds %s\n", m_graph.PassName(context.Pass()).c_str(),
+                m_graph.TargetName(resource).c_str(), owner == m_owners.end() ? "nothing" : m_graph.TargetName(owner->second).c_str());
+            ++m_failures;
+        }
+    }
+
+    /// @brief Surface written by the pass must not be read by it as another target
+    void Write(const RenderPassContext& context, RenderResourceId resource, const std::vector<RenderResourceId>& reads)
+    {
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            if (reads[i] != resource && context.Target(reads[i]) == context.Target(resource))
+            {
+                printf("pass %s writes %s to the surface of %s it reads\n", m_graph.PassName(context.Pass()).c_str(),
+                    m_graph.TargetName(resource).c_str(), m_graph.TargetName(reads[i]).c_str());
+                ++m_failures;
+            }
+        }
+        m_owners[context.Target(resource)] = resource;
+    }
+
+    void Executed(RenderPassId pass) { m_executed.push_back(pass); }
+
+    const std::vector<RenderPassId>& ExecutedPasses() const { return m_executed; }
+    unsigned Failures() const { return m_failures; }
+
+    void NextFrame() { m_executed.clear(); }
+
+private:
+
+    const RenderGraph& m_graph;
+    std::map<void*, RenderResourceId> m_owners;
+    std::vector<RenderPassId> m_executed;
+    unsigned m_failures;
+};
+
+/// @brief Full screen pass: binds the read targets as textures and draws a quad into the write targets
+RenderPassExecute MakePass(NullDevice& device, ContentValidator& validator,
+    std::vector<RenderResourceId> reads, std::vector<RenderResourceId> writes)
+{
+    return [&device, &validator, reads, writes](const RenderPassContext& context)
+    {
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            validator.Read(context, reads[i]);
+            device.SetTexture(static_cast<unsigned>(i), context.Target(reads[i]));
+        }
+        for (size_t i = 0; i < writes.size(); ++i)
+        {
+            device.SetRenderTarget(static_cast<unsigned>(i), context.Target(writes[i]));
+        }
+
+        static const float quad[] = { -1, -1, 0, 1,  -1, 1, 0, 1,  1, -1, 0, 1,  1, 1, 0, 1 };
+        device.DrawPrimitiveUP(NULL_PT_TRIANGLESTRIP, 2, quad, 4 * sizeof(float));
+
+        for (size_t i = 0; i < writes.size(); ++i)
+        {
+            validator.Write(context, writes[i], reads);
+        }
+        validator.Executed(context.Pass());
+    };
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const unsigned width = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], NULL, 10)) : 1280;
+    const unsigned height = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 720;
+    const unsigned frames = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 3;
+    if (width < 8 || height < 8 || 0 == frames)
+    {
+        printf("Usage: render_graph_check [width = 1280] [height = 720] [frames = 3]\n");
+        return 1;
+    }
+
+    // Graph reading a target before any pass writes it must be rejected
+    {
+        RenderGraph invalid;
+        RenderResourceId output = invalid.ImportTarget("output", MakeDesc(width, height, FORMAT_A8R8G8B8, 32));
+        RenderResourceId unwritten = invalid.CreateTarget("unwritten", MakeDesc(width, height, FORMAT_A8R8G8B8, 32));
+        invalid.AddPass("copy", { unwritten }, { output }, RenderPassExecute());
+        if (invalid.Compile())
+        {
+            printf("graph reading an unwritten target was accepted\n");
+            return 1;
+        }
+    }
+
+    NullDevice device;
+    NullTargetBackend backend(device);
+    bool succeeded = true;
+    {
+        RenderGraph graph;
+        ContentValidator validator(graph);
+
+        const RenderTargetDesc full = MakeDesc(width, height, FORMAT_A8R8G8B8, 32);
+        const RenderTargetDesc half = MakeDesc(width / 2, height / 2, FORMAT_A8R8G8B8, 32);
+        const RenderTargetDesc quarter = MakeDesc(width / 4, height / 4, FORMAT_A8R8G8B8, 32);
+
+        RenderResourceId backBuffer = graph.ImportTarget("back buffer", full);
+        RenderResourceId fingerprint = graph.ImportTarget("fingerprint", MakeDesc(16, 16, FORMAT_R32F, 32));
+        RenderResourceId sceneColor = graph.CreateTarget("scene color", MakeDesc(width, height, FORMAT_A16B16G16R16F, 64));
+        RenderResourceId sceneDepth = graph.CreateTarget("scene depth", MakeDesc(width, height, FORMAT_D24S8, 32));
+        RenderResourceId bright = graph.CreateTarget("bright", half);
+        RenderResourceId blurH = graph.CreateTarget("blur horizontal", half);
+        RenderResourceId blurV = graph.CreateTarget("blur vertical", half);
+        RenderResourceId quarterDown = graph.CreateTarget("quarter", quarter);
+        RenderResourceId quarterH = graph.CreateTarget("quarter horizontal", quarter);
+        RenderResourceId quarterV = graph.CreateTarget("quarter vertical", quarter);
+        RenderResourceId tonemapped = graph.CreateTarget("tonemapped", full);
+        RenderResourceId depthView = graph.CreateTarget("depth view", full);
+
+        struct PassDecl
+        {
+            const char* name;
+            std::vector<RenderResourceId> reads;
+            std::vector<RenderResourceId> writes;
+        };
+        const PassDecl passes[] =
+        {
+            { "scene", {}, { sceneColor, sceneDepth } },
+            { "bright pass", { sceneColor }, { bright } },
+            { "blur horizontal", { bright }, { blurH } },
+            { "blur vertical", { blurH }, { blurV } },
+            { "downsample", { blurV }, { quarterDown } },
+            { "quarter horizontal", { quarterDown }, { quarterH } },
+            { "quarter vertical", { quarterH }, { quarterV } },
+            { "tonemap", { sceneColor, blurV, quarterV }, { tonemapped } },
+            { "depth debug view", { sceneDepth }, { depthView } },
+            { "antialias", { tonemapped }, { backBuffer } },
+            { "fingerprint", { tonemapped }, { fingerprint } }
+        };
+        const size_t passCount = sizeof(passes) / sizeof(passes[0]);
+        for (size_t i = 0; i < passCount; ++i)
+        {
+            graph.AddPass(passes[i].name, passes[i].reads, passes[i].writes,
+                MakePass(device, validator, passes[i].reads, passes[i].writes));
+        }
+
+        if (!graph.Compile())
+        {
+            printf("compilation failed: %s\n", graph.Error().c_str());
+            return 1;
+        }
+
+        int fingerprintSurface = 0;
+        graph.SetImportedTarget(backBuffer, const_cast<void*>(device.BackBuffer()));
+        graph.SetImportedTarget(fingerprint, &fingerprintSurface);
+
+        for (RenderPassId pass = 0; pass < passCount; ++pass)
+        {
+            if (graph.PassCulled(pass))
+            {
+                printf("culled pass: %s\n", graph.PassName(pass).c_str());
+            }
+        }
+        for (RenderResourceId resource = 0; resource <= depthView; ++resource)
+        {
+            if (graph.TargetSurface(resource) >= 0)
+            {
+                printf("%-20s surface %d\n", graph.TargetName(resource).c_str(), graph.TargetSurface(resource));
+            }
+        }
+
+        for (unsigned frame = 0; frame < frames; ++frame)
+        {
+            validator.NextFrame();
+            device.BeginScene();
+            if (!graph.Execute(backend))
+            {
+                printf("execution failed: %s\n", graph.Error().c_str());
+                return 1;
+            }
+            device.EndScene();
+            device.Present();
+
+            const size_t expected = passCount - graph.Report().culledPasses;
+            if (validator.ExecutedPasses().size() != expected)
+            {
+                printf("frame %u: %u passes executed, %u expected\n", frame,
+                    static_cast<unsigned>(validator.ExecutedPasses().size()), static_cast<unsigned>(expected));
+                succeeded = false;
+            }
+        }
+
+        const RenderGraphReport& report = graph.Report();
+        printf("%s\n", FormatRenderGraphReport(report).c_str());
+        printf("null device: %.2f MB of render targets, %u target changes, %u draws in %u frames\n",
+            device.PeakRenderTargetBytes() / (1024.0 * 1024.0), device.Counters().renderTargetChanges,
+            device.Counters().draws, device.Counters().frames);
+
+        if (validator.Failures())
+        {
+            succeeded = false;
+        }
+        if (!graph.PassCulled(8) || 1 != report.culledPasses)
+        {
+            printf("only the depth debug view should be culled\n");
+            succeeded = false;
+        }
+        if (device.PeakRenderTargetBytes() != report.aliasedBytes)
+        {
+            printf("device allocated %llu bytes, the graph reported %llu\n",
+                static_cast<unsigned long long>(device.PeakRenderTargetBytes()), static_cast<unsigned long long>(report.aliasedBytes));
+            succeeded = false;
+        }
+        if (report.aliasedBytes < report.peakLiveBytes || report.aliasedBytes >= report.unaliasedBytes)
+        {
+            printf("aliased memory must be between the live peak and the unaliased memory\n");
+            succeeded = false;
+        }
+    }
+
+    if (device.RenderTargetBytes())
+    {
+        printf("graph did not release its render targets\n");
+        succeeded = false;
+    }
+
+    printf("%s\n", succeeded ? "ok" : "FAILED");
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Shader compile daemon shared by the samples and test processes on one machine
+// Identical requests of all clients are compiled once, results are kept in memory and
+// in the cache directory. Compiles with D3DX where available, with the stub compiler
+// otherwise or when asked to, so that the protocol can be exercised on any platform
+
+#include "shader_compile.h"
+#include "shader_daemon.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef SHADER_DAEMON_D3DX
+#include <d3dx9.h>
+#endif
+
+namespace
+{
+
+std::atomic<bool> g_stop(false);
+
+void OnSignal(int)
+{
+    g_stop = true;
+}
+
+#ifdef SHADER_DAEMON_D3DX
+
+ShaderCompileResult D3DXShaderCompile(const ShaderCompileRequest& request)
+{
+    LPD3DXBUFFER shaderBuffer = NULL;
+    LPD3DXBUFFER errorBuffer = NULL;
+    HRESULT hr = D3DXCompileShader(request.source.c_str(), static_cast<UINT>(request.source.size()), NULL, NULL,
+        request.entryPoint.c_str(), request.profile.c_str(), request.flags, &shaderBuffer, &errorBuffer, NULL);
+
+    ShaderCompileResult result;
+    result.succeeded = SUCCEEDED(hr);
+    result.origin = SHADER_RESULT_COMPILED;
+    if (shaderBuffer)
+    {
+        result.bytecode.assign(static_cast<const char*>(shaderBuffer->GetBufferPointer()), shaderBuffer->GetBufferSize());
+        shaderBuffer->Release();
+    }
+    if (errorBuffer)
+    {
+        result.errors.assign(static_cast<const char*>(errorBuffer->GetBufferPointer()));
+        errorBuffer->Release();
+    }
+    return result;
+}
+
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const std::string address = argc > 1 && strcmp(argv[1], "-") ? argv[1] : DefaultShaderDaemonAddress();
+    const std::string cacheDirectory = argc > 2 ? argv[2] : "shader_cache";
+    const unsigned workerCount = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], NULL, 10)) : 0;
+    bool stub = argc > 4 && 0 == strcmp(argv[4], "stub");
+
+    if (argc > 4 && !stub)
+    {
+        printf("Usage: shader_daemon [address|- = default] [cache directory = shader_cache] [workers = hardware threads] [stub]\n");
+        return 1;
+    }
+
+    ShaderCompiler compiler = [](const ShaderCompileRequest& request) { return StubShaderCompile(request, 0); };
+#ifdef SHADER_DAEMON_D3DX
+    if (!stub)
+    {
+        compiler = D3DXShaderCompile;
+    }
+#else
+    stub = true;
+#endif
+
+    ShaderCompileService service(compiler, cacheDirectory, workerCount);
+    ShaderDaemonServer server(service);
+    if (!server.Start(address))
+    {
+        printf("Unable to listen on %s, another daemon may be running\n", address.c_str());
+        return 1;
+    }
+    printf("Serving %s with the %s compiler, cache in %s\n", address.c_str(), stub ? "stub" : "D3DX", cacheDirectory.c_str());
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    while (!g_stop)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    server.Stop();
+
+    const ShaderServiceStats stats = service.Stats();
+    printf("%u connections, %u requests: %u compiled (%u failed), %u joined in flight, %u from memory, %u from disk\n",
+        server.Connections(), stats.requests, stats.compiles, stats.failures, stats.joined, stats.memoryHits, stats.diskHits);
+    return 0;
+}